@@ -0,0 +1,61 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * host runner of the per-packet microbenchmarks in main/wgk_bench.c, the same kernels
+ * the firmware runs when built with BENCHMARK
+ *
+ * ./wgk_bench                          table, TSC ticks on x86 (ns elsewhere) per call
+ * ./wgk_bench -c -l $(git rev-parse --short HEAD) >> bench.csv     track regressions
+ * perf record -g ./wgk_bench -L 100                               profile, 100 runs
+ */
+
+#include <unistd.h>
+#include "wgk_host.h"
+#include "wgk_bench.h"
+
+
+int main(int argc, char **argv) {
+    static wgk_bench_result_t res[WGK_BENCH_MAX];
+    const char *label = NULL;
+    uint32_t reps = WGK_BENCH_REPS, iters = WGK_BENCH_ITERS, loops = 1, i;
+    int opt, csv = 0, n = 0;
+
+    while ((opt = getopt(argc, argv, "r:n:l:L:ch")) != -1) {
+        switch (opt) {
+            case 'r': reps = atoi(optarg); break;
+            case 'n': iters = atoi(optarg); break;
+            case 'l': label = optarg; break;
+            case 'L': loops = atoi(optarg); break;
+            case 'c': csv = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-r repetitions] [-n calls per repetition] [-L runs] [-c] [-l label]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (reps > WGK_BENCH_REPS_MAX) reps = WGK_BENCH_REPS_MAX;
+
+    if (!ring_buf_init()) return 1;
+    for (i = 0; i < loops; i++) {
+        n = wgk_bench_run(res, reps, iters);
+        if (n == 0) return 1;
+    }
+    wgk_bench_print(res, n, label, !csv, csv);
+    return 0;
+}
@@ -0,0 +1,154 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * runs the channel scorer of main/chan_score.c on recorded scans and checks the result
+ *
+ * a scan file has one AP per line as the receiver logs them after "scan:", see
+ * find_free_channel(): "primary center bw rssi [ssid]". Other lines:
+ *   busy <channel> <permille>      an airtime probe
+ *   cached <channel>               the best channel of the last boot, see chan_pick()
+ *   dfs                            DFS channels are allowed
+ *   expect <channel>               the channel that has to win
+ * '#' starts a comment.
+ *
+ * cd host/scans && ../../build-host/wgk_chanscore *.scan     PASS or FAIL per file, exit code 1 on any FAIL
+ * build-host/wgk_chanscore -v host/scans/club.scan           the whole ranking
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chan_score.h"
+
+#define MAX_APS                 256
+#define RANK_SHOWN              5
+
+typedef struct {
+    scan_ap_t ap[MAX_APS];
+    int n_ap;
+    chan_busy_t busy[CHAN_RANK_MAX];
+    int n_busy;
+    int cached;
+    int expect;
+    bool dfs;
+} scan_file_t;
+
+
+static int load(const char *name, scan_file_t *sf) {
+    FILE *f = fopen(name, "r");
+    char line[256], *p;
+    int primary, center, bw, rssi, channel, permille, lineno = 0;
+
+    if (f == NULL) {
+        perror(name);
+        return -1;
+    }
+    memset(sf, 0, sizeof(*sf));
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        if ((p = strchr(line, '#')) != NULL) *p = '\0';
+        for (p = line; *p == ' ' || *p == '\t'; p++);
+        if (*p == '\n' || *p == '\0') continue;
+
+        if (sscanf(p, "busy %d %d", &channel, &permille) == 2 && sf->n_busy < CHAN_RANK_MAX) {
+            sf->busy[sf->n_busy].channel = channel;
+            sf->busy[sf->n_busy++].permille = permille;
+        } else if (sscanf(p, "cached %d", &channel) == 1) {
+            sf->cached = channel;
+        } else if (sscanf(p, "expect %d", &channel) == 1) {
+            sf->expect = channel;
+        } else if (strncmp(p, "dfs", 3) == 0) {
+            sf->dfs = true;
+        } else if (sscanf(p, "%d %d %d %d", &primary, &center, &bw, &rssi) == 4 && sf->n_ap < MAX_APS) {
+            sf->ap[sf->n_ap].primary = primary;
+            sf->ap[sf->n_ap].center = center;
+            sf->ap[sf->n_ap].bw = bw;
+            sf->ap[sf->n_ap++].rssi = rssi;
+        } else {
+            fprintf(stderr, "%s:%d: cannot parse %s", name, lineno, p);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+
+static bool check(const char *name, bool dfs, int verbose) {
+    static scan_file_t sf;
+    chan_rank_t rank[CHAN_RANK_MAX];
+    chan_rank_cache_t cache;
+    int i, n;
+    uint8_t pick;
+    bool ok;
+
+    if (load(name, &sf) < 0) return false;
+    n = chan_rank(sf.ap, sf.n_ap, sf.busy, sf.n_busy, sf.dfs || dfs, rank);
+    memset(&cache, 0, sizeof(cache));
+    if (sf.cached) {
+        cache.n = 1;
+        cache.rank[0].channel = sf.cached;
+    }
+    pick = chan_pick(rank, n, sf.cached ? &cache : NULL);
+    ok = sf.expect == 0 || pick == sf.expect;
+
+    printf("%-4s %s: %d APs, %d probes, picked %d", ok ? "PASS" : "FAIL", name, sf.n_ap, sf.n_busy, pick);
+    if (sf.expect) printf(", expected %d", sf.expect);
+    if (sf.cached) printf(", cached %d", sf.cached);
+    printf("\n");
+    for (i = 0; i < n && (verbose || i < RANK_SHOWN); i++) {
+        printf("    %2d. channel %3d score %4d, %2d APs%s\n", i + 1, rank[i].channel, rank[i].score, rank[i].aps,
+               chan_is_dfs(rank[i].channel) ? ", DFS" : "");
+    }
+    return ok;
+}
+
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-d] [-v] scan...\n"
+                    "-d allows DFS channels in every file, -v shows the whole ranking\n", name);
+}
+
+
+int main(int argc, char **argv) {
+    int opt, verbose = 0, failed = 0;
+    bool dfs = false;
+
+    while ((opt = getopt(argc, argv, "dvh")) != -1) {
+        switch (opt) {
+            case 'd': dfs = true; break;
+            case 'v': verbose = 1; break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 2;
+    }
+    for (; optind < argc; optind++) {
+        if (!check(argv[optind], dfs, verbose)) failed++;
+    }
+    if (failed) printf("%d of the scans failed\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,366 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * channel migration in virtual time: the state machine of main/chan_mon.c against
+ * simulated channels, with the real ring buffer and concealment logic behind it
+ *
+ * every candidate channel has its own impairment (impair.c). The sender sends a packet
+ * every PACKET_TIME_US on the channel it is on, arrivals go through ring_buf_put(), the
+ * receiver's I2S clock plays out through playout.c, and every CHAN_MON_INTERVAL ms the
+ * monitor rates the interval like chan_mon_task() does. An interferer moves onto the
+ * current channel. What a move costs is modelled as well: the AP is away for the scan
+ * dwell on each candidate, the switch itself is an outage, and a sender that missed both
+ * our announcement and the AP's CSA beacon has to reconnect.
+ *
+ * ./wgk_chansim                                the interferer after 10 s, without and with migration
+ * ./wgk_chansim -i 5 -t 120 -v                 print the rating of every interval
+ * ./wgk_chansim -m 0.5 -R 3000                 the sender misses half of the announcements and
+ *                                              takes 3 s to reconnect
+ */
+
+#include <unistd.h>
+#include "wgk_host.h"
+#include "impair.h"
+#include "playout.h"
+
+#define CLOCK_PHASE             0.37                    // same as impair_sim.c
+#define START_CHANNEL           36
+#define LINK_RSSI               (-55)                   // dBm, sender and receiver are on the same stage
+
+typedef struct {
+    uint8_t channel;
+    impair_cfg_t cfg;
+    impair_t im;
+} sim_chan_t;
+
+// the venue: a few neighbours, and one channel that is clean until the interferer arrives,
+// an 80 MHz AP with its primary on our channel
+static sim_chan_t chans[CHAN_NUM_CANDIDATES];
+static const scan_ap_t neighbours[] = {
+    { 40, 38, 40, -62 }, { 40, 40, 20, -75 }, { 44, 44, 20, -78 }, { 48, 46, 40, -58 },
+    { 149, 155, 80, -71 }, { 157, 155, 80, -66 }, { 165, 165, 20, -84 },
+};
+#define NUM_NEIGHBOURS (sizeof(neighbours) / sizeof(scan_ap_t))
+static const scan_ap_t interferer = { START_CHANNEL, START_CHANNEL + 6, 80, -48 };
+static scan_ap_t venue[NUM_NEIGHBOURS + 1];
+static uint32_t venue_n;
+
+static const impair_cfg_t quiet = { .loss_good = 0.0005, .base_us = 300, .jitter_dist = JITTER_NORMAL, .jitter_us = 300 };
+static const impair_cfg_t busy = { .ge_p = 0.01, .ge_r = 0.2, .loss_good = 0.01, .loss_bad = 0.5, .base_us = 800,
+                                   .jitter_dist = JITTER_PARETO, .jitter_us = 2000 };
+
+typedef struct {
+    uint8_t ap, sta;            // the channel each side is on
+    double down_until;          // the sender is switching or reconnecting
+    double away_from, away_until;   // the AP is scanning another channel
+    bool told;                  // the sender got an announcement of the current move
+    uint16_t epoch;             // the sender's, see chan_follow()
+} link_t;
+
+/*
+ * pending arrivals, a binary min heap on the arrival time like in impair_sim.c
+ */
+typedef struct {
+    double t;
+    uint32_t seq;
+    uint8_t channel;            // the one it was sent on
+} arrival_t;
+
+static arrival_t *heap;
+static uint32_t heap_n, heap_size;
+
+static void heap_push(double t, uint32_t seq, uint8_t channel) {
+    uint32_t i;
+
+    if (heap_n == heap_size) {
+        heap_size = heap_size ? 2 * heap_size : 1024;
+        heap = realloc(heap, heap_size * sizeof(arrival_t));
+    }
+    for (i = heap_n++; i > 0 && heap[(i - 1) / 2].t > t; i = (i - 1) / 2) {
+        heap[i] = heap[(i - 1) / 2];
+    }
+    heap[i].t = t;
+    heap[i].seq = seq;
+    heap[i].channel = channel;
+}
+
+static arrival_t heap_pop(void) {
+    arrival_t top = heap[0], last = heap[--heap_n];
+    uint32_t i = 0, c;
+
+    while ((c = 2 * i + 1) < heap_n) {
+        if (c + 1 < heap_n && heap[c + 1].t < heap[c].t) c++;
+        if (heap[c].t >= last.t) break;
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = last;
+    return top;
+}
+
+
+// for the misses on top of the channel's loss, independent of the impairment PRNGs
+static uint64_t rng;
+
+static double uniform(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (rng >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+static sim_chan_t *chan_by_number(uint8_t channel) {
+    int i;
+
+    for (i = 0; i < CHAN_NUM_CANDIDATES; i++) {
+        if (chans[i].channel == channel) return &chans[i];
+    }
+    return NULL;
+}
+
+
+static void setup(uint64_t seed) {
+    size_t i;
+
+    memset(chans, 0, sizeof(chans));
+    for (i = 0; i < CHAN_NUM_CANDIDATES; i++) {
+        chans[i].channel = chan_candidates[i];
+        chans[i].cfg = quiet;
+    }
+    memcpy(venue, neighbours, sizeof(neighbours));
+    venue_n = NUM_NEIGHBOURS;
+    for (i = 0; i < CHAN_NUM_CANDIDATES; i++) impair_init(&chans[i].im, &chans[i].cfg, seed + chans[i].channel);
+    rng = seed * 0x9e3779b97f4a7c15ULL + 1;
+}
+
+
+// what chan_scan_candidate() sees: only the APs with their primary on the channel
+static int32_t scan(uint8_t channel) {
+    scan_ap_t seen[NUM_NEIGHBOURS + 1];
+    uint32_t i, n = 0;
+
+    for (i = 0; i < venue_n; i++) {
+        if (venue[i].primary == channel) seen[n++] = venue[i];
+    }
+    return chan_scan_rating(channel, seen, n);
+}
+
+
+// a control message over the AP's channel, lost like audio and, with -m, on top of that
+static bool deliver(const link_t *link, double now, double miss) {
+    double arrival[2];
+
+    if (now < link->down_until || link->ap != link->sta) return false;
+    if (impair_packet(&chan_by_number(link->ap)->im, now, sizeof(chan_msg_t), arrival) == 0) return false;
+    return uniform() >= miss;
+}
+
+
+static void run(bool migrate, double seconds, double interferer_s, double miss, double switch_ms,
+                double reconnect_ms, uint64_t seed, int verbose) {
+    static uint8_t dmabuf[I2S_BUF_SIZE];
+    static udp_buf_t buf;
+    chan_mon_t cm;
+    chan_state_t prev_state = CHAN_MONITOR;
+    chan_msg_t msg, ack;
+    link_sample_t s;
+    link_t link = { START_CHANNEL, START_CHANNEL, 0.0, 0.0, 0.0, false, 0 };
+    playout_t pl;
+    playout_state_t state = PLAYOUT_IDLE;
+    uint32_t n = (uint32_t)(seconds * 1e6 / PACKET_TIME_US), k = 1, seq;
+    uint32_t sent = 0, received = 0, failed = 0, scan_idx = CHAN_NUM_CANDIDATES;
+    double next_send = PACKET_TIME_US, next_tick = CLOCK_PHASE * PACKET_TIME_US;
+    double next_mon = CHAN_MON_INTERVAL * 1000.0, now, arrival[2];
+    int32_t rating, best_rating = 0;
+    uint8_t best = 0;
+    bool hit = false;
+    int copies, i;
+
+    setup(seed);
+    chan_mon_init(&cm, START_CHANNEL);
+    playout_reset(&pl, 1);
+    lat_hist_reset(&jitter_hist);
+    printf("%s:\n", migrate ? "migrating" : "static");
+
+    while (state != PLAYOUT_END) {
+        // next event: a send, an arrival, an I2S tick or a monitor interval
+        now = next_tick;
+        if (k <= n && next_send < now) now = next_send;
+        if (heap_n > 0 && heap[0].t < now) now = heap[0].t;
+        if (next_mon < now) now = next_mon;
+        wgk_host_set_time((uint32_t)(uint64_t)now);
+
+        if (!hit && now >= interferer_s * 1e6) {
+            sim_chan_t *c = chan_by_number(link.ap);
+            venue[venue_n++] = interferer;
+            c->cfg = busy;
+            impair_init(&c->im, &c->cfg, seed + c->channel + 1000);
+            hit = true;
+            printf("  %8.3f s  interferer on channel %d\n", now / 1e6, c->channel);
+        }
+
+        if (k <= n && now == next_send) {
+            sent++;
+            if (now < link.down_until || link.sta != link.ap) {
+                failed++;               // not associated, sendto() fails
+            } else {
+                copies = impair_packet(&chan_by_number(link.sta)->im, now, sizeof(udp_buf_t), arrival);
+                for (i = 0; i < copies; i++) heap_push(arrival[i], k, link.sta);
+            }
+            k++;
+            next_send += PACKET_TIME_US;
+        } else if (heap_n > 0 && now == heap[0].t) {
+            arrival_t a = heap_pop();
+            // nobody listens on the old channel, or while the AP scans elsewhere
+            if (a.channel == link.ap && !(now >= link.away_from && now < link.away_until)) {
+                wgk_fill_dma_buf(dmabuf, a.seq);
+                udp_pack(&buf, dmabuf);
+                buf.sequence_number = a.seq;
+                telem_inc(TC_RX_PACKETS);
+                ring_buf_put(&buf);
+                received++;
+            }
+        } else if (now == next_mon) {
+            // the sample chan_mon_task() takes
+            s.expected = sent;
+            s.received = received;
+            s.tx_failed = failed;
+            s.rssi = LINK_RSSI;
+            s.jitter_p99_us = lat_hist_percentile(&jitter_hist, 990);
+            lat_hist_reset(&jitter_hist);
+            sent = received = failed = 0;
+            next_mon += CHAN_MON_INTERVAL * 1000.0;
+
+            if (!migrate) {
+                // rate it all the same, for the -v comparison
+                cm.rating += chan_rate(&s, RINGBUF_OFFSET * PACKET_TIME_US) - (cm.rating >> CHAN_EWMA_SHIFT);
+            } else {
+                switch (chan_mon_tick(&cm, &s, RINGBUF_OFFSET * PACKET_TIME_US)) {
+                    case CHAN_ACT_SCAN:
+                        scan_idx = 0;
+                        best = 0;
+                        best_rating = 0;
+                        break;
+                    case CHAN_ACT_ANNOUNCE:
+                        chan_mon_announce(&cm, &msg);
+                        if (deliver(&link, now, miss) && chan_follow(&link.epoch, &msg, &ack)) {
+                            link.told = true;
+                            if (deliver(&link, now, miss)) chan_mon_ack(&cm, &ack);
+                        }
+                        break;
+                    case CHAN_ACT_SWITCH:
+                        // the sender follows our announcement or the CSA beacon, else it loses the AP
+                        link.ap = cm.channel;
+                        if (link.told || uniform() >= miss) {
+                            link.down_until = now + switch_ms * 1000.0;
+                        } else {
+                            link.down_until = now + reconnect_ms * 1000.0;
+                            printf("  %8.3f s  the sender missed the move, reconnecting\n", now / 1e6);
+                        }
+                        link.sta = cm.channel;
+                        link.told = false;
+                        break;
+                    default:
+                        break;
+                }
+                // one candidate per interval, like chan_mon_task()
+                if (cm.state == CHAN_SCAN && scan_idx < CHAN_NUM_CANDIDATES) {
+                    sim_chan_t *c = &chans[scan_idx];
+                    if (c->channel != cm.channel) {
+                        link.away_from = now;
+                        link.away_until = now + CHAN_SCAN_DWELL * 1000.0;
+                        rating = scan(c->channel);
+                        if (rating > best_rating) {
+                            best = c->channel;
+                            best_rating = rating;
+                        }
+                    }
+                    if (++scan_idx == CHAN_NUM_CANDIDATES) chan_mon_scan_done(&cm, best, best_rating);
+                }
+            }
+            if (cm.state != prev_state) {
+                printf("  %8.3f s  %-8s -> %-8s channel %3d", now / 1e6, chan_state_name(prev_state),
+                       chan_state_name(cm.state), cm.channel);
+                if (cm.state == CHAN_ANNOUNCE) printf(", moving to %d", cm.target);
+                if (prev_state == CHAN_SCAN) printf(", best candidate %d rated %d", best, best_rating);
+                printf(", rating %d\n", chan_mon_rating(&cm));
+                prev_state = cm.state;
+            } else if (verbose) {
+                printf("  %8.3f s  %-8s channel %3d, rated %3d, loss %2u/%u, jitter p99 %5u µs\n", now / 1e6,
+                       chan_state_name(cm.state), cm.channel, chan_mon_rating(&cm),
+                       s.expected - (s.received < s.expected ? s.received : s.expected), s.expected, s.jitter_p99_us);
+            }
+        } else {
+            state = playout_tick(&pl, n, &seq);
+            next_tick += PACKET_TIME_US;
+            if (state == PLAYOUT_PLAYED) {
+                lat_hist_add(&pl.latency, (int32_t)(now + (NUM_TX_DMA_BUFS - 1) * PACKET_TIME_US
+                                                    - (seq - 1.0) * PACKET_TIME_US));
+            }
+        }
+    }
+    playout_finish(&pl);
+    heap_n = 0;
+
+    printf("  channel %d, %u moves, %u aborted, %u outage intervals, rating %d ",
+           cm.channel, cm.moves, cm.aborted, cm.outage_ticks, chan_mon_rating(&cm));
+    playout_print(&pl);
+}
+
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-t seconds] [-r seed] [-i interferer_s] [-m miss] [-o switch_ms] [-R reconnect_ms]\n"
+                    "       [-n] [-v]\n"
+                    "miss is the probability that the sender misses an announcement or the CSA beacon\n"
+                    "-n runs without migration only\n", name);
+}
+
+
+int main(int argc, char **argv) {
+    double seconds = 60.0, interferer_s = 10.0, miss = 0.0, switch_ms = 20.0, reconnect_ms = 1500.0;
+    uint64_t seed = 1;
+    int opt, verbose = 0, only_static = 0;
+
+    while ((opt = getopt(argc, argv, "t:r:i:m:o:R:nvh")) != -1) {
+        switch (opt) {
+            case 't': seconds = atof(optarg); break;
+            case 'r': seed = strtoull(optarg, NULL, 0); break;
+            case 'i': interferer_s = atof(optarg); break;
+            case 'm': miss = atof(optarg); break;
+            case 'o': switch_ms = atof(optarg); break;
+            case 'R': reconnect_ms = atof(optarg); break;
+            case 'n': only_static = 1; break;
+            case 'v': verbose = 1; break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+
+    wgk_host_virtual_time(true);
+    if (!ring_buf_init()) return 1;
+    printf("%.0f s, interferer at %.1f s, RINGBUF_OFFSET %d, monitor every %d ms, switch %.0f ms, "
+           "reconnect %.0f ms, miss %.2f, seed %llu\n", seconds, interferer_s, RINGBUF_OFFSET, CHAN_MON_INTERVAL,
+           switch_ms, reconnect_ms, miss, (unsigned long long)seed);
+    run(false, seconds, interferer_s, miss, switch_ms, reconnect_ms, seed, verbose);
+    if (!only_static) run(true, seconds, interferer_s, miss, switch_ms, reconnect_ms, seed, verbose);
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * checks of the CPU frequency governor, see main/cpu_gov.h
+ *
+ * the margin against the deadlines, done again in floating point for every load on a grid,
+ * the level cpu_gov_lowest() picks for it, and load profiles through cpu_gov_decide()
+ * window by window: a light load steps down one level per CPU_GOV_DOWN windows, a jump in
+ * load goes up in the window it shows, a load at the hysteresis edge does not flap, and
+ * the I2S callback's own deadline counts, also at the idle level.
+ *
+ * ./wgk_cpugov                 PASS or FAIL, exit code 1 on FAIL
+ * ./wgk_cpugov -v              the windows of every profile
+ */
+
+#include <unistd.h>
+#include "wgk_host.h"
+#include "cpu_gov.h"
+
+#define MAX_WINDOWS             64
+#define PACKETS                 (CPU_GOV_INTERVAL * 1000 / PACKET_TIME_US)
+
+// a load profile: cycles per packet in the task and the callback, changing at the given
+// windows, or taking turns window by window when alternate is set
+typedef struct {
+    const char *name;
+    int start_level;
+    int windows;
+    int steps;
+    bool alternate;
+    struct { int at; uint32_t task, isr; } load[2];
+    int want_level;             // at the end
+    int max_changes;            // level changes at most
+} profile_t;
+
+// cycles at which the lower level just keeps CPU_GOV_MARGIN + CPU_GOV_HYST, give or take
+#define EDGE(mhz, d)            ((uint32_t)((mhz) * PACKET_TIME_US * (1000 - CPU_GOV_MARGIN - CPU_GOV_HYST) / 1000) + (d))
+
+static const profile_t profiles[] = {
+    { "idle to lowest",  2, 3 * CPU_GOV_DOWN, 1, false, { { 0, 20000, 2000 } }, 0, 2 },
+    { "step up",         0, 4, 2, false, { { 0, 20000, 2000 }, { 2, 100000, 2000 } }, 1, 1 },
+    { "too heavy",       0, 4, 1, false, { { 0, 250000, 2000 } }, CPU_GOV_LEVELS - 1, 1 },
+    { "hysteresis edge", 1, 10 * CPU_GOV_DOWN, 2, true, { { 0, EDGE(80, 500), 0 }, { 0, EDGE(80, -500), 0 } }, 1, 0 },
+    { "callback bound",  2, 3 * CPU_GOV_DOWN, 1, false, { { 0, 2000, 6000 } }, 1, 1 },
+    { "no packets",      1, 10, 1, false, { { 0, 0, 0 } }, 1, 0 },
+};
+#define NUM_PROFILES (sizeof(profiles)/sizeof(profile_t))
+
+static int verbose, failures;
+
+
+static double margin_ref(uint32_t task, uint32_t isr, uint32_t mhz) {
+    double t = 1.0 - (task + isr) / (double)mhz / PACKET_TIME_US, i = 1.0 - isr / (double)mhz / CPU_GOV_ISR_US;
+
+    return 1000.0 * (t < i ? t : i);
+}
+
+
+static void check_margin(void) {
+    uint32_t task, isr;
+    int l, lowest, n = 0;
+    double m;
+
+    for (task = 0; task <= 600000; task += 997) {
+        for (isr = 0; isr <= 30000; isr += 1009) {
+            for (l = 0; l < CPU_GOV_LEVELS; l++) {
+                m = margin_ref(task, isr, cpu_gov_mhz[l]);
+                // integer division rounds the used share down, the margin up by less than 1
+                if (cpu_gov_margin(task, isr, cpu_gov_mhz[l]) < m - 1e-9 || cpu_gov_margin(task, isr, cpu_gov_mhz[l]) > m + 1.0) {
+                    if (failures++ < 10 || verbose) {
+                        printf("margin(%u, %u, %u) = %ld, not %.2f\n", task, isr, cpu_gov_mhz[l],
+                               (long)cpu_gov_margin(task, isr, cpu_gov_mhz[l]), m);
+                    }
+                }
+            }
+            lowest = cpu_gov_lowest(task, isr, CPU_GOV_MARGIN);
+            if ((lowest < CPU_GOV_LEVELS - 1 && cpu_gov_margin(task, isr, cpu_gov_mhz[lowest]) < CPU_GOV_MARGIN) ||
+                (lowest > 0 && cpu_gov_margin(task, isr, cpu_gov_mhz[lowest - 1]) >= CPU_GOV_MARGIN)) {
+                if (failures++ < 10 || verbose) printf("lowest(%u, %u) = %d\n", task, isr, lowest);
+            }
+            n++;
+        }
+    }
+    printf("margin: %d loads\n", n);
+}
+
+
+static void run_profile(const profile_t *p) {
+    cpu_gov_t g;
+    uint32_t task = 0, isr = 0;
+    int w, i, k, prev, changes = 0, fail = 0;
+
+    cpu_gov_init(&g, p->start_level);
+    for (w = 0; w < p->windows; w++) {
+        for (k = 0; k < p->steps; k++) {
+            if (p->alternate ? (w % p->steps) == k : p->load[k].at == w) {
+                task = p->load[k].task;
+                isr = p->load[k].isr;
+            }
+        }
+        for (i = 0; i < PACKETS && (task | isr) != 0; i++) {
+            cpu_gov_sample_isr(&g, isr);
+            cpu_gov_sample_task(&g, task - (i & 7));            // the worst packet sets it
+        }
+        prev = g.level;
+        cpu_gov_decide(&g);
+        changes += (g.level != prev);
+        // a window short of the margin leaves it at a level that keeps it, if there is one
+        if ((task | isr) != 0 && g.level < CPU_GOV_LEVELS - 1 && cpu_gov_margin(task, isr, cpu_gov_mhz[g.level]) < CPU_GOV_MARGIN) {
+            printf("%s: window %d at %u MHz keeps %ld permille\n", p->name, w, cpu_gov_mhz[g.level],
+                   (long)cpu_gov_margin(task, isr, cpu_gov_mhz[g.level]));
+            fail = 1;
+        }
+        if ((task | isr) != 0 && (g.idle_level > g.level ||
+            (g.idle_level < g.level && cpu_gov_margin(0, isr, cpu_gov_mhz[g.idle_level]) < CPU_GOV_MARGIN))) {
+            printf("%s: window %d idles at %u MHz, the callback keeps %ld permille\n", p->name, w,
+                   cpu_gov_mhz[g.idle_level], (long)cpu_gov_margin(0, isr, cpu_gov_mhz[g.idle_level]));
+            fail = 1;
+        }
+        if (verbose) {
+            printf("  %-16s %2d  task %6u isr %5u  -> %3u MHz, idle %3u MHz, margin %4ld, down run %d\n", p->name, w,
+                   task, isr, cpu_gov_mhz[g.level], cpu_gov_mhz[g.idle_level], (long)g.margin, g.down_run);
+        }
+    }
+    if (g.level != p->want_level || changes > p->max_changes) {
+        printf("%s: ends at %u MHz after %d changes, not %u MHz and at most %d\n", p->name, cpu_gov_mhz[g.level],
+               changes, cpu_gov_mhz[p->want_level], p->max_changes);
+        fail = 1;
+    }
+    failures += fail;
+}
+
+
+int main(int argc, char **argv) {
+    int opt;
+    size_t i;
+
+    while ((opt = getopt(argc, argv, "vh")) != -1) {
+        switch (opt) {
+            case 'v': verbose = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    check_margin();
+    for (i = 0; i < NUM_PROFILES; i++) run_profile(&profiles[i]);
+    printf("profiles: %u\n", (unsigned)NUM_PROFILES);
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
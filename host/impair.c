@@ -0,0 +1,168 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// network impairment stage, see impair.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "impair.h"
+
+#define PARETO_SHAPE            1.5
+#define MAX_JITTER_US           1000000.0
+
+
+// xorshift64, same as tools/latency_sim.c
+static double uniform(impair_t *im) {
+    im->rng ^= im->rng << 13;
+    im->rng ^= im->rng >> 7;
+    im->rng ^= im->rng << 17;
+    return (double)(im->rng >> 11) / (double)(1ULL << 53);
+}
+
+
+static double normal(impair_t *im) {
+    double u1 = uniform(im), u2 = uniform(im);
+
+    return sqrt(-2.0 * log(1.0 - u1)) * cos(2.0 * M_PI * u2);
+}
+
+
+static double jitter(impair_t *im) {
+    double j = im->cfg.jitter_us, d;
+
+    switch (im->cfg.jitter_dist) {
+        case JITTER_UNIFORM:
+            return 2.0 * j * uniform(im);
+        case JITTER_NORMAL:
+            d = j + 0.5 * j * normal(im);
+            return d > 0.0 ? d : 0.0;
+        case JITTER_EXPONENTIAL:
+            return -j * log(1.0 - uniform(im));
+        case JITTER_PARETO:
+            // scale chosen so that the mean is j
+            d = j * (PARETO_SHAPE - 1.0) / PARETO_SHAPE / pow(1.0 - uniform(im), 1.0 / PARETO_SHAPE);
+            return d < MAX_JITTER_US ? d : MAX_JITTER_US;
+        default:
+            return 0.0;
+    }
+}
+
+
+void impair_init(impair_t *im, const impair_cfg_t *cfg, uint64_t seed) {
+    memset(im, 0, sizeof(impair_t));
+    im->cfg = *cfg;
+    // splitmix64 of the seed: every seed its own sequence, and never the all zero state
+    seed += 0x9e3779b97f4a7c15ULL;
+    seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebULL;
+    im->rng = (seed ^ (seed >> 31)) | 1;
+}
+
+
+int impair_packet(impair_t *im, double send_us, uint32_t size, double arrival[2]) {
+    const impair_cfg_t *c = &im->cfg;
+    double t = send_us, extra;
+    int copies = 1;
+    uint32_t n = im->n++;
+
+    // loss, from the trace or the Gilbert-Elliott model
+    if (c->trace != NULL) {
+        extra = c->trace[n % c->trace_len];
+        if (extra < 0) {
+            im->lost++;
+            return 0;
+        }
+    } else {
+        im->bad = im->bad ? (uniform(im) >= c->ge_r) : (uniform(im) < c->ge_p);
+        if (uniform(im) < (im->bad ? c->loss_bad : c->loss_good)) {
+            im->lost++;
+            return 0;
+        }
+        extra = jitter(im);
+    }
+
+    // rate limited FIFO
+    if (c->rate_kbps > 0.0) {
+        double start = im->link_free_us > t ? im->link_free_us : t;
+        if (c->max_queue_us > 0.0 && start - t > c->max_queue_us) {
+            im->queue_drops++;
+            return 0;
+        }
+        im->link_free_us = start + size * 8.0 * 1000.0 / c->rate_kbps;
+        t = im->link_free_us;
+    }
+
+    t += c->base_us + extra;
+    if (c->reorder_p > 0.0 && uniform(im) < c->reorder_p) {
+        t += c->reorder_us;
+        im->reordered++;
+    }
+    arrival[0] = t;
+    if (c->dup_p > 0.0 && uniform(im) < c->dup_p) {
+        arrival[1] = t + c->dup_us;
+        im->duplicated++;
+        copies = 2;
+    }
+    return copies;
+}
+
+
+int impair_load_trace(const char *name, int32_t **trace) {
+    FILE *f = fopen(name, "r");
+    char line[256], *s;
+    int n = 0, size = 1024;
+    int32_t *t;
+
+    if (f == NULL) {
+        perror(name);
+        return -1;
+    }
+    t = malloc(size * sizeof(int32_t));
+    while (t != NULL && fgets(line, sizeof(line), f)) {
+        s = line + strspn(line, " \t");
+        if (*s == '#' || *s == '\n' || *s == 0) continue;
+        if (n == size) {
+            size *= 2;
+            t = realloc(t, size * sizeof(int32_t));
+            if (t == NULL) break;
+        }
+        t[n++] = (*s == '-') ? -1 : atoi(s);
+    }
+    fclose(f);
+    if (t == NULL || n == 0) {
+        fprintf(stderr, "%s: no packets\n", name);
+        free(t);
+        return -1;
+    }
+    *trace = t;
+    return n;
+}
+
+
+jitter_dist_t impair_dist_by_name(const char *name) {
+    static const char *names[] = { "none", "uniform", "normal", "exponential", "pareto" };
+    int i;
+
+    for (i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) return (jitter_dist_t)i;
+    }
+    return JITTER_NONE;
+}
@@ -0,0 +1,82 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// network impairment stage for the host harnesses. Given the send time of a packet it
+// decides whether and when the packet (and possibly a duplicate) arrives. Everything is
+// driven by a seeded PRNG, so a scenario with the same seed gives the same result.
+
+#ifndef _IMPAIR_H
+#define _IMPAIR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    JITTER_NONE = 0,
+    JITTER_UNIFORM,             // 0 .. 2 * jitter_us
+    JITTER_NORMAL,              // mean jitter_us, sd jitter_us / 2, clipped at 0
+    JITTER_EXPONENTIAL,         // mean jitter_us
+    JITTER_PARETO,              // shape 1.5, mean jitter_us, heavy tail capped at 1 s
+} jitter_dist_t;
+
+typedef struct {
+    // Gilbert-Elliott loss: a two state Markov chain evaluated once per packet
+    double ge_p;                // P(good -> bad)
+    double ge_r;                // P(bad -> good)
+    double loss_good;           // loss probability in the good state
+    double loss_bad;            // loss probability in the bad state
+    // delay
+    double base_us;             // constant one-way delay
+    jitter_dist_t jitter_dist;
+    double jitter_us;
+    // reordering: a packet is held back so that the following ones overtake it
+    double reorder_p;
+    double reorder_us;
+    // duplication: a second copy arrives dup_us after the first one
+    double dup_p;
+    double dup_us;
+    // rate limit: a FIFO drained at rate_kbps, tail drop beyond max_queue_us. 0 = unlimited
+    double rate_kbps;
+    double max_queue_us;
+    // field trace, see impair_load_trace(). Replaces the loss and jitter models when set.
+    const int32_t *trace;       // extra delay in µs per packet, < 0 means lost
+    uint32_t trace_len;
+} impair_cfg_t;
+
+typedef struct {
+    impair_cfg_t cfg;
+    uint64_t rng;
+    bool bad;                   // Gilbert-Elliott state
+    double link_free_us;        // when the rate limited link has sent everything queued
+    uint32_t n;                 // packets offered so far
+    uint32_t lost, queue_drops, reordered, duplicated;
+} impair_t;
+
+void impair_init(impair_t *im, const impair_cfg_t *cfg, uint64_t seed);
+
+// returns how many copies arrive (0, 1 or 2) and their arrival times in arrival[]
+int impair_packet(impair_t *im, double send_us, uint32_t size, double arrival[2]);
+
+// reads a field trace: one packet per line, the extra one-way delay in µs or '-' for a
+// lost packet; '#' starts a comment. Returns the number of packets, or -1.
+int impair_load_trace(const char *name, int32_t **trace);
+
+jitter_dist_t impair_dist_by_name(const char *name);
+
+#endif /* _IMPAIR_H */
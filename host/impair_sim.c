@@ -0,0 +1,320 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * impairment scenarios against the real ring buffer and concealment logic
+ *
+ * a discrete event simulation in virtual time: the sender captures a packet every
+ * PACKET_TIME_US, packs it with udp_pack(), the impairment stage (impair.c) decides if
+ * and when it arrives, arrivals go through ring_buf_put(), and the receiver's I2S clock
+ * (optionally drifting) calls ring_buf_read() every PACKET_TIME_US. The clock the core
+ * sees through get_time_us_in_isr() is the virtual one, so a minute of audio takes
+ * well under a second and the same seed always gives the same result.
+ *
+ * ./wgk_impair                                 all built-in scenarios
+ * ./wgk_impair -s burst                        the scenarios whose name contains "burst"
+ * ./wgk_impair -g 0.01:0.3:0.8 -j pareto:2000  a custom scenario, see usage()
+ * ./wgk_impair -f gig.trace                    replay a field trace of extra delays
+ * ./wgk_impair -s crowded -w crowded.wgkc      also save the arrivals as a packet capture for wgk_replay
+ * ./wgk_impair -R 10                           the sender restarts every 10 s, with a new session
+ * ./wgk_impair -S 65000                        the sender counts from 65000, its 16 bit sequence numbers wrap 1 s in.
+ *                                              Nothing may change but the capture
+ * ./wgk_impair -B 4                            the sender sends 4 packets per wake of the radio, see main/tx_ps.h
+ * ./wgk_impair -P -s normal                    every power save schedule of tx_ps.h, modelled mA against latency
+ */
+
+#include <math.h>
+#include <unistd.h>
+#include "wgk_host.h"
+#include "impair.h"
+#include "playout.h"
+#include "tx_ps.h"
+
+#define CLOCK_PHASE             0.37                    // receiver I2S ticks are this many packets after the sender's
+#define RESTART_DOWN_US         1500000                 // a restarting sender sends nothing for this long
+
+typedef struct {
+    const char *name;
+    impair_cfg_t cfg;
+    double drift_ppm;           // receiver I2S clock error
+    double restart_s;           // the sender restarts this often, 0 = never
+} scenario_t;
+
+static scenario_t scenarios[] = {
+    { "clean",          { .loss_good = 0.0,  .base_us = 300 }, 0.0 },
+    { "random loss 1%", { .loss_good = 0.01, .base_us = 300 }, 0.0 },
+    { "burst loss",     { .ge_p = 0.005, .ge_r = 0.2, .loss_bad = 0.7, .base_us = 300 }, 0.0 },
+    { "jitter normal",  { .base_us = 300, .jitter_dist = JITTER_NORMAL, .jitter_us = 1000 }, 0.0 },
+    { "jitter exp",     { .base_us = 300, .jitter_dist = JITTER_EXPONENTIAL, .jitter_us = 1000 }, 0.0 },
+    { "jitter pareto",  { .base_us = 300, .jitter_dist = JITTER_PARETO, .jitter_us = 1000 }, 0.0 },
+    { "reorder",        { .base_us = 300, .jitter_dist = JITTER_UNIFORM, .jitter_us = 200,
+                          .reorder_p = 0.02, .reorder_us = 3000 }, 0.0 },
+    { "duplicate",      { .base_us = 300, .jitter_dist = JITTER_UNIFORM, .jitter_us = 200,
+                          .dup_p = 0.05, .dup_us = 500 }, 0.0 },
+    { "rate limit",     { .base_us = 300, .jitter_dist = JITTER_EXPONENTIAL, .jitter_us = 300,
+                          .rate_kbps = 6500, .max_queue_us = 20000 }, 0.0 },
+    { "crowded venue",  { .ge_p = 0.002, .ge_r = 0.3, .loss_good = 0.001, .loss_bad = 0.5, .base_us = 500,
+                          .jitter_dist = JITTER_PARETO, .jitter_us = 1500, .reorder_p = 0.01, .reorder_us = 2000 }, 0.0 },
+    { "drift 100 ppm",  { .base_us = 300, .jitter_dist = JITTER_NORMAL, .jitter_us = 500 }, 100.0 },
+    { "sender restart", { .base_us = 300, .jitter_dist = JITTER_NORMAL, .jitter_us = 500 }, 0.0, 10.0 },
+};
+#define NUM_SCENARIOS (sizeof(scenarios)/sizeof(scenario_t))
+
+static wire_seq_t first_seq = 1;                        // what the sender counts from, after every restart
+static int burst = 1;                                   // packets the sender holds back for one wake, see tx_ps.h
+
+/*
+ * pending arrivals, a binary min heap on the arrival time
+ */
+typedef struct {
+    double t;
+    udp_buf_t *buf;
+} arrival_t;
+
+static arrival_t *heap;
+static uint32_t heap_n, heap_size;
+
+static void heap_push(double t, udp_buf_t *buf) {
+    uint32_t i;
+
+    if (heap_n == heap_size) {
+        heap_size = heap_size ? 2 * heap_size : 1024;
+        heap = realloc(heap, heap_size * sizeof(arrival_t));
+    }
+    for (i = heap_n++; i > 0 && heap[(i - 1) / 2].t > t; i = (i - 1) / 2) {
+        heap[i] = heap[(i - 1) / 2];
+    }
+    heap[i].t = t;
+    heap[i].buf = buf;
+}
+
+static arrival_t heap_pop(void) {
+    arrival_t top = heap[0], last = heap[--heap_n];
+    uint32_t i = 0, c;
+
+    while ((c = 2 * i + 1) < heap_n) {
+        if (c + 1 < heap_n && heap[c + 1].t < heap[c].t) c++;
+        if (heap[c].t >= last.t) break;
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = last;
+    return top;
+}
+
+
+// the same file tools/capture_fetch.c writes, from the same ring the receiver uses
+static int save_capture(const char *name) {
+    static capture_chunk_t chunk;
+    capture_info_t info;
+    uint32_t first;
+    FILE *f = fopen(name, "wb");
+
+    if (f == NULL) {
+        perror(name);
+        return -1;
+    }
+    pkt_capture_freeze();
+    pkt_capture_info(&info, 0);
+    fwrite(&info, sizeof(info), 1, f);
+    for (first = 0; pkt_capture_read(&chunk, first, CAPTURE_CHUNK_RECS) > 0; first += chunk.n) {
+        fwrite(chunk.rec, sizeof(capture_rec_t), chunk.n, f);
+    }
+    fclose(f);
+    pkt_capture_resume();
+    return 0;
+}
+
+
+static void run(const scenario_t *sc, double seconds, uint64_t seed, int verbose, const char *capture) {
+    impair_t im;
+    playout_t pl;
+    static uint8_t dmabuf[I2S_BUF_SIZE];
+    uint32_t n = (uint32_t)(seconds * 1e6 / PACKET_TIME_US), k = 1, seq;
+    double t_rx = PACKET_TIME_US * (1.0 + sc->drift_ppm * 1e-6);
+    double next_send = PACKET_TIME_US, next_tick = CLOCK_PHASE * t_rx, now, arrival[2];
+    playout_state_t state = PLAYOUT_IDLE;
+    int copies, i, pos;
+    double burst_arrival = 0.0;
+    // a restarted sender counts from first_seq again. The test signal keeps k, so that the play out
+    // is scored against the time the audio was captured, like without restarts.
+    double restart = sc->restart_s > 0.0 ? sc->restart_s * 1e6 : INFINITY;
+    uint32_t session = 1, first_k = 1;
+
+    impair_init(&im, &sc->cfg, seed);
+    playout_reset(&pl, 1);
+    if (capture != NULL) pkt_capture_resume();
+
+    while (state != PLAYOUT_END) {
+        // next event: a capture on the sender, an arrival, or an I2S tick on the receiver
+        now = next_tick;
+        if (k <= n && next_send < now) now = next_send;
+        if (heap_n > 0 && heap[0].t < now) now = heap[0].t;
+        wgk_host_set_time((uint32_t)(uint64_t)now);
+
+        if (k <= n && now == next_send && now >= restart + RESTART_DOWN_US) {
+            restart += sc->restart_s * 1e6;                     // up again
+            session++;
+            first_k = k;
+        }
+        if (k <= n && now == next_send && now >= restart) {
+            k++;                                                // down, the audio of this time is lost
+            next_send += PACKET_TIME_US;
+        } else if (k <= n && now == next_send) {
+            udp_buf_t *buf = malloc(sizeof(udp_buf_t));
+            memset(buf, 0, sizeof(udp_buf_t));
+            wgk_fill_dma_buf(dmabuf, k);
+            udp_pack(buf, dmabuf);
+            buf->sequence_number = first_seq + (k - first_k);
+            buf->session = session;
+            // a burst goes on air back to back when its last packet is captured
+            pos = (k - first_k) % burst;
+            copies = impair_packet(&im, now + tx_ps_hold_us(burst, pos) + pos * TX_PS_AIRTIME_US, sizeof(udp_buf_t), arrival);
+            // and leaves the sender's queue in order, the jitter of one packet delays the rest
+            if (copies > 0 && pos > 0 && arrival[0] < burst_arrival + TX_PS_AIRTIME_US) {
+                arrival[0] = burst_arrival + TX_PS_AIRTIME_US;
+            }
+            if (copies > 0) burst_arrival = arrival[0];
+            for (i = 0; i < copies; i++) {
+                udp_buf_t *copy = buf;
+                if (i > 0) {
+                    copy = malloc(sizeof(udp_buf_t));
+                    memcpy(copy, buf, sizeof(udp_buf_t));
+                }
+                heap_push(arrival[i], copy);
+            }
+            if (copies == 0) free(buf);
+            k++;
+            next_send += PACKET_TIME_US;
+        } else if (heap_n > 0 && now == heap[0].t) {
+            arrival_t a = heap_pop();
+            telem_inc(TC_RX_PACKETS);
+            if (capture != NULL) pkt_capture_add((uint32_t)(uint64_t)now, a.buf->sequence_number, sizeof(udp_buf_t));
+            ring_buf_put(a.buf);
+            free(a.buf);
+        } else {
+            state = playout_tick(&pl, n, &seq);
+            next_tick += t_rx;
+            if (state == PLAYOUT_PLAYED) {
+                // capture of packet seq ends at seq * PACKET_TIME_US, and the DMA buffer we fill
+                // now starts playing after the other NUM_TX_DMA_BUFS - 1 buffers, like in ringbuf.c
+                lat_hist_add(&pl.latency, (int32_t)(now + (NUM_TX_DMA_BUFS - 1) * PACKET_TIME_US
+                                                    - (seq - 1.0) * PACKET_TIME_US));
+            }
+        }
+    }
+    playout_finish(&pl);
+    while (heap_n > 0) free(heap_pop().buf);
+    if (capture != NULL) save_capture(capture);
+
+    printf("%-16s lost %5u+%-4u reord %4u dup %4u ", sc->name, im.lost, im.queue_drops, im.reordered, im.duplicated);
+    playout_print(&pl);
+    if (verbose) {
+        printf("  %u packets sent, %u received, %u ticks, %u played, %u silent, %u underruns, %u resyncs, %u fades\n",
+               n, telem_counter[TC_RX_PACKETS], pl.ticks, pl.played, pl.silent, telem_counter[TC_RX_UNDERRUNS],
+               telem_counter[TC_RX_RESYNCS], telem_counter[TC_RX_FADE_OUTS] + telem_counter[TC_RX_FADE_INS]);
+    }
+}
+
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-t seconds] [-r seed] [-s name] [-v]\n"
+                    "       [-l loss] [-g p:r:loss_bad] [-b base_us] [-j dist:us] [-o reorder_p:us]\n"
+                    "       [-u dup_p:us] [-k rate_kbps:max_queue_us] [-d drift_ppm] [-f trace] [-R restart_s]\n"
+                    "       [-w capture.wgkc]    save the arrivals of the last scenario run\n"
+                    "       [-S first_seq]       the sender's first sequence number, 1 .. 65535\n"
+                    "       [-B burst]           packets per wake of the sender's radio, 1 .. %d\n"
+                    "       [-P]                 run the scenarios once per power save schedule of main/tx_ps.h\n"
+                    "dist is none, uniform, normal, exponential or pareto\n", name, TX_PS_BURST_MAX);
+}
+
+
+int main(int argc, char **argv) {
+    scenario_t custom = { "custom", { .base_us = 300 }, 0.0, 0.0 };
+    double seconds = 60.0;
+    uint64_t seed = 1;
+    const char *filter = NULL, *capture = NULL;
+    char dist[32];
+    int opt, use_custom = 0, verbose = 0, schedules = 0, len, j;
+    int32_t *trace;
+    size_t i;
+
+    while ((opt = getopt(argc, argv, "t:r:s:vl:g:b:j:o:u:k:d:f:w:R:S:B:Ph")) != -1) {
+        use_custom |= (strchr("lgbjoukdfR", opt) != NULL);
+        switch (opt) {
+            case 't': seconds = atof(optarg); break;
+            case 'r': seed = strtoull(optarg, NULL, 0); break;
+            case 's': filter = optarg; break;
+            case 'v': verbose = 1; break;
+            case 'w': capture = optarg; break;
+            case 'S': first_seq = (wire_seq_t)atoi(optarg); break;
+            case 'B': burst = atoi(optarg); break;
+            case 'P': schedules = 1; break;
+            case 'l': custom.cfg.loss_good = atof(optarg); break;
+            case 'g': sscanf(optarg, "%lf:%lf:%lf", &custom.cfg.ge_p, &custom.cfg.ge_r, &custom.cfg.loss_bad); break;
+            case 'b': custom.cfg.base_us = atof(optarg); break;
+            case 'j':
+                if (sscanf(optarg, "%31[a-z]:%lf", dist, &custom.cfg.jitter_us) == 2) {
+                    custom.cfg.jitter_dist = impair_dist_by_name(dist);
+                }
+                break;
+            case 'o': sscanf(optarg, "%lf:%lf", &custom.cfg.reorder_p, &custom.cfg.reorder_us); break;
+            case 'u': sscanf(optarg, "%lf:%lf", &custom.cfg.dup_p, &custom.cfg.dup_us); break;
+            case 'k': sscanf(optarg, "%lf:%lf", &custom.cfg.rate_kbps, &custom.cfg.max_queue_us); break;
+            case 'd': custom.drift_ppm = atof(optarg); break;
+            case 'R': custom.restart_s = atof(optarg); break;
+            case 'f':
+                if ((len = impair_load_trace(optarg, &trace)) < 0) return 1;
+                custom.name = "trace";
+                custom.cfg.trace = trace;
+                custom.cfg.trace_len = len;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+
+    if (burst < 1 || burst > TX_PS_BURST_MAX) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    wgk_host_virtual_time(true);
+    if (!ring_buf_init()) return 1;
+    if (capture != NULL && !pkt_capture_init()) return 1;
+    printf("%.0f s per scenario, RINGBUF_OFFSET %d, packet time %d µs, seed %llu\n",
+           seconds, RINGBUF_OFFSET, PACKET_TIME_US, (unsigned long long)seed);
+    for (j = 0; j < (schedules ? tx_ps_num_sched : 1); j++) {
+        if (schedules) {
+            // the latency is what the burst adds on top of the ring, the current only the model
+            burst = tx_ps_sched[j].burst;
+            printf("%-9s burst %d, %3u mA modelled, holds up to %.2f ms\n", tx_ps_sched[j].name, burst,
+                   tx_ps_current_ma(&tx_ps_sched[j]), tx_ps_hold_us(burst, 0) / 1000.0);
+        }
+        if (use_custom) {
+            run(&custom, seconds, seed, verbose, capture);
+        } else {
+            for (i = 0; i < NUM_SCENARIOS; i++) {
+                if (filter == NULL || strstr(scenarios[i].name, filter)) run(&scenarios[i], seconds, seed, verbose, capture);
+            }
+        }
+    }
+    return 0;
+}
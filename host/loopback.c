@@ -0,0 +1,279 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * loopback harness: a sender and a receiver running the real pipeline core over
+ * localhost UDP, with simulated I2S clocks.
+ *
+ * sender thread      every PACKET_TIME_US: test signal -> udp_pack() -> sendto()
+ * receiver thread    recvfrom() -> ring_buf_put()
+ * i2s thread         every PACKET_TIME_US * (1 + drift): ring_buf_read() -> check the samples
+ *
+ * On the target ring_buf_read() runs in the I2S ISR and may preempt ring_buf_put() but never
+ * runs in parallel with it. Here both run on different threads, so a mutex serializes them.
+ *
+ * ./wgk_loopback [-t seconds] [-d drift_ppm] [-x speedup] [-P port]
+ *
+ * The hot paths alone are benchmarked by wgk_bench, see main/wgk_bench.c.
+ *
+ * The functional run fails (exit 1) when a sample arrives corrupted, or a packet is played
+ * out of order without an underrun or concealment explaining it. Underruns themselves are
+ * only reported: threads on a loaded host are sometimes late by more than the ring offset.
+ * Running as root gives the clock threads SCHED_FIFO, which makes that much rarer.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "wgk_host.h"
+
+#define SEND_TIME_SLOTS         4096                    // power of 2
+
+static struct {
+    double seconds;
+    double drift_ppm;                                   // receiver I2S clock error relative to the sender
+    double speedup;
+    int port;
+} cfg = { 5.0, 0.0, 1.0, HOST_PORT };
+
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile bool sender_done = false;
+static uint32_t packets_sent;
+static uint64_t send_time[SEND_TIME_SLOTS];            // ns, indexed by sequence number
+
+typedef struct {
+    uint64_t n, sum, max;
+} timing_t;
+
+static timing_t t_pack, t_put, t_get;
+
+
+static void timing_add(timing_t *t, uint64_t ns) {
+    t->n++;
+    t->sum += ns;
+    if (ns > t->max) t->max = ns;
+}
+
+
+static void timing_print(const char *name, const timing_t *t) {
+    printf("  %-16s %10llu calls  avg %7.0f ns  max %8llu ns\n", name, (unsigned long long)t->n,
+           t->n ? (double)t->sum / t->n : 0.0, (unsigned long long)t->max);
+}
+
+
+static void sleep_until(struct timespec *deadline, double period_ns) {
+    uint64_t ns = deadline->tv_nsec + (uint64_t)period_ns;
+
+    deadline->tv_sec += ns / 1000000000ULL;
+    deadline->tv_nsec = ns % 1000000000ULL;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL);
+}
+
+
+static void *sender_thread(void *args) {
+    struct sockaddr_in dest_addr;
+    struct timespec deadline;
+    static uint8_t dmabuf[I2S_BUF_SIZE];
+    static udp_buf_t udp_buf;
+    double period_ns = PACKET_TIME_US * 1000.0 / cfg.speedup;
+    uint32_t n = (uint32_t)(cfg.seconds * 1e6 / PACKET_TIME_US);
+    uint32_t sequence_number;
+    uint64_t t0;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    dest_addr.sin_port = htons(cfg.port);
+    memset(&udp_buf, 0, sizeof(udp_buf));
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    for (sequence_number = 1; sequence_number <= n; sequence_number++) {
+        sleep_until(&deadline, period_ns);                      // the "I2S RX interrupt"
+        wgk_fill_dma_buf(dmabuf, sequence_number);
+        t0 = wgk_host_ns();
+        udp_pack(&udp_buf, dmabuf);
+        udp_buf.sequence_number = sequence_number;
+        timing_add(&t_pack, wgk_host_ns() - t0);
+#ifdef WITH_TIMESTAMP
+        udp_buf.timestamp = get_time_us_in_isr();
+#endif
+        send_time[sequence_number & (SEND_TIME_SLOTS - 1)] = wgk_host_ns();
+        if (sendto(sock, &udp_buf, sizeof(udp_buf), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0) {
+            perror("sendto");
+        }
+        packets_sent++;
+    }
+    close(sock);
+    sender_done = true;
+    return NULL;
+}
+
+
+static void *receiver_thread(void *args) {
+    int sock = *(int *)args;
+    static udp_buf_t udp_buf;
+    uint64_t t0;
+    ssize_t len;
+
+    while (1) {
+        len = recv(sock, &udp_buf, sizeof(udp_buf), 0);
+        if (len < 0) {                                          // timeout
+            if (sender_done) break;                             // and drained
+            continue;
+        }
+        if (len != sizeof(udp_buf_t)) {
+            telem_inc(TC_RX_BAD_LEN);
+            continue;
+        }
+        telem_inc(TC_RX_PACKETS);
+        pthread_mutex_lock(&ring_lock);
+        t0 = wgk_host_ns();
+        ring_buf_put(&udp_buf);
+        timing_add(&t_put, wgk_host_ns() - t0);
+        pthread_mutex_unlock(&ring_lock);
+    }
+    return NULL;
+}
+
+
+typedef struct {
+    uint32_t played, silent, corrupt, out_of_order, last_seq;
+    timing_t latency;                                           // send to play out, ns
+} play_stats_t;
+
+static void *i2s_thread(void *args) {
+    play_stats_t *ps = (play_stats_t *)args;
+    struct timespec deadline;
+    static i2s_buf_t out;                                       // word aligned, like a DMA buffer
+    uint8_t *dma_out = (uint8_t *)&out;
+    double period_ns = PACKET_TIME_US * 1000.0 * (1.0 + cfg.drift_ppm * 1e-6) / cfg.speedup;
+    uint32_t seq, fade_outs, fade_ins;
+    uint64_t t0;
+    bool ok, faded;
+    int bad;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    while (!sender_done || ps->last_seq < packets_sent) {
+        sleep_until(&deadline, period_ns);                      // the "I2S TX interrupt"
+        pthread_mutex_lock(&ring_lock);
+        fade_outs = telem_counter[TC_RX_FADE_OUTS];
+        fade_ins = telem_counter[TC_RX_FADE_INS];
+        t0 = wgk_host_ns();
+        ok = ring_buf_read(dma_out);                            // like i2s_tx_callback() does
+        timing_add(&t_get, wgk_host_ns() - t0);
+        faded = telem_counter[TC_RX_FADE_INS] != fade_ins;
+        if (telem_counter[TC_RX_FADE_OUTS] != fade_outs) ok = false;    // the start of a gap
+        pthread_mutex_unlock(&ring_lock);
+
+        if (!ok) {
+            if (sender_done && ps->played) break;               // the stream has ended
+            if (ps->played) ps->silent++;
+            continue;
+        }
+        bad = wgk_check_dma_buf(dma_out, &seq);
+        ps->played++;
+        if (bad && !faded) ps->corrupt++;                       // a fade in keeps only its last frame
+        if (ps->last_seq && seq != ps->last_seq + 1) ps->out_of_order++;
+        ps->last_seq = seq;
+        timing_add(&ps->latency, wgk_host_ns() - send_time[seq & (SEND_TIME_SLOTS - 1)]);
+    }
+    return NULL;
+}
+
+
+// best effort, needs CAP_SYS_NICE
+static void realtime(pthread_t t, int prio) {
+    struct sched_param sp = { .sched_priority = prio };
+
+    pthread_setschedparam(t, SCHED_FIFO, &sp);
+}
+
+
+static int loopback(void) {
+    pthread_t tx, rx, i2s;
+    struct sockaddr_in addr;
+    struct timeval timeout = { 0, 100000 };
+    play_stats_t ps;
+    int sock, failed;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(cfg.port);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        return 1;
+    }
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    memset(&ps, 0, sizeof(ps));
+    telem_reset_interval();
+    pthread_create(&rx, NULL, receiver_thread, &sock);
+    pthread_create(&i2s, NULL, i2s_thread, &ps);
+    pthread_create(&tx, NULL, sender_thread, NULL);
+    realtime(i2s, 3);                                           // the I2S ISRs first, like on the target
+    realtime(tx, 3);
+    realtime(rx, 2);
+    pthread_join(tx, NULL);
+    pthread_join(rx, NULL);
+    pthread_join(i2s, NULL);
+    close(sock);
+
+    printf("%.1f s, drift %.1f ppm, speedup %.1f\n", cfg.seconds, cfg.drift_ppm, cfg.speedup);
+    printf("  sent %u received %u played %u\n", packets_sent, telem_counter[TC_RX_PACKETS], ps.played);
+    printf("  gaps %u lost %u concealed %u underruns %u silent %u\n", telem_counter[TC_RX_GAPS],
+           telem_counter[TC_RX_LOST], telem_counter[TC_RX_CONCEALED], telem_counter[TC_RX_UNDERRUNS], ps.silent);
+    printf("  corrupt %u out of order %u checksum errors %u\n", ps.corrupt, ps.out_of_order, telem_counter[TC_RX_CHECKSUM]);
+    printf("  latency send -> play avg %.2f ms max %.2f ms\n",
+           ps.latency.n ? ps.latency.sum / 1e6 / ps.latency.n : 0.0, ps.latency.max / 1e6);
+    timing_print("udp_pack", &t_pack);
+    timing_print("ring_buf_put", &t_put);
+    timing_print("ring_buf_read", &t_get);
+
+    failed = ps.corrupt || telem_counter[TC_RX_CHECKSUM] || ps.played == 0
+             || ps.out_of_order > telem_counter[TC_RX_UNDERRUNS] + telem_counter[TC_RX_CONCEALED];
+    printf("%s\n", failed ? "FAIL" : "PASS");
+    return failed;
+}
+
+
+int main(int argc, char **argv) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:d:x:P:h")) != -1) {
+        switch (opt) {
+            case 't': cfg.seconds = atof(optarg); break;
+            case 'd': cfg.drift_ppm = atof(optarg); break;
+            case 'x': cfg.speedup = atof(optarg); break;
+            case 'P': cfg.port = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-t seconds] [-d drift_ppm] [-x speedup] [-P port]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (cfg.speedup <= 0.0) cfg.speedup = 1.0;
+
+    if (!ring_buf_init()) return 1;
+    return loopback();
+}
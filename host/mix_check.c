@@ -0,0 +1,222 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * the multi-sender receiver of RX_MIX: per-sender rings (main/ringbuf.c) and the output
+ * stage (main/mix.c), in virtual time like in impair_sim.c. Built with RX_STREAMS 4.
+ *
+ * Every sender sends a constant level per slot, so every output sample has to be exactly
+ * the sum mix.h says: two senders, then four, a fifth one that finds no free ring, one
+ * of the four going silent, the fifth one taking its ring over once it has been silent
+ * for RING_STREAM_IDLE_US, and both routes, the split one slot by slot in stereo. The
+ * checks skip the packets around a change, where a stream primes, fades or resyncs.
+ *
+ * ./wgk_mixcheck               PASS or FAIL, exit code 1 on FAIL
+ * ./wgk_mixcheck -v            every mismatch
+ */
+
+#include <unistd.h>
+#include "wgk_host.h"
+#include "mix.h"
+
+#ifndef RX_MIX
+#error "build with RX_MIX, see host/CMakeLists.txt"
+#endif
+
+#define SENDERS                 (RX_STREAMS + 1)        // one more than there are rings
+#define SETTLE                  (RINGBUF_OFFSET + 8)    // packets around a change that are not checked
+#define IDLE_TICKS              (RING_STREAM_IDLE_US / PACKET_TIME_US + 1)
+#define MAX_SHOWN               10
+
+typedef struct {
+    uint32_t id;                // what the receiver sees as the source address
+    uint16_t session;
+    uint16_t seq;
+    bool on;
+    int ring;                   // the ring it got, -1 for none
+} sender_t;
+
+static sender_t snd[SENDERS];
+static double now;
+static int failures, shown, verbose;
+
+
+// the level of a sender's slot, 24 bit, both signs
+static int32_t level(int s, int slot) {
+    int32_t v = (s + 1) * 100000 + slot * 1000;
+
+    return (s & 1) ? -v : v;
+}
+
+
+static void fail(const char *what, int tick, int frame, int slot, int32_t got, int32_t want) {
+    failures++;
+    if (verbose && shown++ < MAX_SHOWN) {
+        printf("  %s: tick %d frame %d slot %d: %d, expected %d\n", what, tick, frame, slot, got, want);
+    }
+}
+
+
+// one packet time: every sender that is on sends, then the I2S clock reads. Checks the
+// output against the senders playing on the rings when check is set.
+static void tick(const char *what, int t, bool check) {
+    static udp_buf_t buf;
+    static i2s_buf_t in, out;
+    int32_t want[NUM_SLOTS_I2S];
+    ring_t *r;
+    int s, i, j, o;
+    bool ok;
+
+    for (s = 0; s < SENDERS; s++) {
+        if (!snd[s].on) continue;
+        for (i = 0; i < NFRAMES; i++) {
+            for (j = 0; j < NUM_SLOTS_I2S; j++) in.frame[i].slot[j] = level(s, j) << 8;
+        }
+        udp_pack(&buf, (uint8_t *)&in);
+        buf.sequence_number = ++snd[s].seq;
+        buf.session = snd[s].session;
+        wgk_host_set_time((uint32_t)(now + 1.0 + s));
+        r = ring_lookup(snd[s].id);
+        snd[s].ring = -1;
+        for (i = 0; i < RX_STREAMS; i++) {
+            if (r == ring_stream(i)) snd[s].ring = i;
+        }
+        if (r != NULL) ring_put(r, &buf);
+    }
+    now += PACKET_TIME_US;
+    wgk_host_set_time((uint32_t)now);
+    ok = ring_buf_read((uint8_t *)&out);
+    if (!check) return;
+
+    memset(want, 0, sizeof(want));
+    for (s = 0; s < SENDERS; s++) {
+        if (!snd[s].on || snd[s].ring < 0) continue;
+        for (o = 0; o < NUM_SLOTS_I2S; o++) {
+            want[o] += level(s, mix_route[snd[s].ring][o].src) * mix_route[snd[s].ring][o].gain;
+        }
+    }
+    if (!ok) {
+        fail(what, t, -1, -1, 0, 1);
+        return;
+    }
+    for (i = 0; i < NFRAMES; i++) {
+        for (o = 0; o < NUM_SLOTS_I2S; o++) {
+            if (out.frame[i].slot[o] != want[o]) fail(what, t, i, o, out.frame[i].slot[o], want[o]);
+        }
+    }
+}
+
+
+// n packet times, the last ones checked
+static void run(const char *what, int n) {
+    int t, before = failures;
+
+    for (t = 0; t < n; t++) tick(what, t, t >= SETTLE);
+    printf("%-28s %s\n", what, failures == before ? "ok" : "FAIL");
+}
+
+
+// the gains into an output slot add up to MIX_UNITY at most, and every stream is heard
+static void check_route(const char *what) {
+    int s, o, sum, heard, before = failures;
+
+    for (o = 0; o < NUM_SLOTS_I2S; o++) {
+        for (sum = 0, s = 0; s < RX_STREAMS; s++) sum += mix_route[s][o].gain;
+        if (sum > MIX_UNITY) fail(what, -1, -1, o, sum, MIX_UNITY);
+    }
+    for (s = 0; s < RX_STREAMS; s++) {
+        for (heard = 0, o = 0; o < NUM_SLOTS_I2S; o++) heard += mix_route[s][o].gain != 0;
+        if (heard == 0) fail(what, -1, -1, s, 0, 1);
+    }
+    printf("%-28s %s\n", what, failures == before ? "ok" : "FAIL");
+}
+
+
+static void expect(const char *what, bool cond) {
+    if (!cond) failures++;
+    printf("%-28s %s\n", what, cond ? "ok" : "FAIL");
+}
+
+
+#if NUM_SLOTS_I2S == 2
+// the split in stereo, see mix.h: even streams left, odd ones right, their slot 0 only
+static bool split_stereo(void) {
+    int s, side;
+
+    for (s = 0; s < RX_STREAMS; s++) {
+        side = (RX_STREAMS + 1 - (s & 1)) / 2;          // the streams on that side
+        if (mix_route[s][s & 1].src != 0 || mix_route[s][s & 1].gain != MIX_UNITY / side) return false;
+        if (mix_route[s][(s & 1) ^ 1].gain != 0) return false;
+    }
+    return true;
+}
+#endif
+
+
+int main(int argc, char **argv) {
+    uint32_t dropped;
+    int opt, s;
+
+    while ((opt = getopt(argc, argv, "vh")) != -1) {
+        switch (opt) {
+            case 'v': verbose = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    wgk_host_virtual_time(true);
+    if (!ring_buf_init()) return 1;
+    for (s = 0; s < SENDERS; s++) {
+        snd[s].id = 0x0a04a8c0 + (s << 24);               // 192.168.4.10 and up, network order
+        snd[s].session = 0x1000 + 17 * s;
+        snd[s].seq = 60000 + 1000 * s;                  // some wrap the 16 bits on the way
+    }
+
+    mix_init(MIX_SPLIT);
+    check_route("split route");
+#if NUM_SLOTS_I2S == 2
+    expect("split route, 2 slots", split_stereo());
+    expect("sum at boot, 2 slots", MIX_ROUTE == MIX_SUM);
+#endif
+    snd[0].on = snd[1].on = true;
+    run("split, 2 senders", 100);
+    expect("2 streams heard", ring_streams() == 2);
+    for (s = 2; s < RX_STREAMS; s++) snd[s].on = true;
+    run("split, 4 senders", 100);
+
+    snd[RX_STREAMS].on = true;
+    dropped = telem_counter[TC_RX_NO_STREAM];
+    run("a 5th sender, no ring", 100);
+    expect("5th sender dropped", snd[RX_STREAMS].ring < 0 && telem_counter[TC_RX_NO_STREAM] - dropped == 100);
+
+    snd[1].on = false;
+    run("sender 1 silent", IDLE_TICKS - 1);
+    expect("5th sender waits", snd[RX_STREAMS].ring < 0);
+    run("5th sender takes over", 100);
+    expect("5th sender on ring 1", snd[RX_STREAMS].ring == 1 && ring_streams() == RX_STREAMS);
+
+    mix_init(MIX_SUM);
+    check_route("sum route");
+    run("sum, 4 senders", 100);
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,325 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * PC receiver: plays a Wireless-GK stream into a Linux audio sink, for recording and
+ * monitoring
+ *
+ * the same pipeline as the receiver firmware, built with NUM_SLOTS_I2S 8 so that all eight
+ * UDP slots come out:
+ *
+ * receiver thread    recvfrom() -> ring_buf_put()
+ * clock thread       every PACKET_TIME_US: ring_buf_read() -> sink, see sink.c
+ *
+ * so the jitter buffer (RINGBUF_OFFSET), the concealment in smoothe() and the underrun
+ * handling are exactly the device's, and a clock that drifts against the sender's ends in
+ * underruns or overruns of the ring just like the DAC on the device does. What clocks
+ * ring_buf_read() depends on the sink: CLOCK_MONOTONIC for files, FIFOs and null, the sound
+ * card for ALSA.
+ *
+ * The sender sends to RX_IP_ADDR, so the PC joins the sender's WiFi network with that
+ * address instead of the receiver.
+ *
+ * ./wgk_rx [-o sink] [-t seconds] [-P port] [-v]           receive until ^C or for -t seconds
+ * ./wgk_rx -T seconds [-o sink] [-d drift_ppm] [-v]        self test against a sender thread
+ *
+ * The self test sends the test signal over localhost at real time pace, checks every
+ * sample that comes out and fails (exit 1) like host/loopback.c does. Latency is send to
+ * play out; in a live run, where the send time is unknown, the ring lead is reported instead.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "wgk_host.h"
+#include "sink.h"
+
+#define WGK_PORT                45678                   // PORT in wireless_gk.h
+#define SEND_TIME_SLOTS         4096                    // power of 2
+#define RCVBUF_SIZE             (1 << 20)
+
+static struct {
+    double seconds;                                     // 0: until ^C
+    double drift_ppm;                                   // of the clock thread, unpaced sinks only
+    double test_seconds;                                // > 0: self test
+    int port;
+    int verbose;
+    const char *sink;
+} cfg = { 0.0, 0.0, 0.0, 0, 0, NULL };
+
+typedef struct {
+    uint32_t played, silent, corrupt, out_of_order, last_seq;
+    lat_hist_t latency;                                 // send to play out, self test only
+} play_stats_t;
+
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile bool stop = false;
+static volatile bool sender_done = false;
+static uint32_t packets_sent;
+static uint64_t send_time[SEND_TIME_SLOTS];            // ns, indexed by sequence number
+static sink_t *sink;
+static play_stats_t ps;
+
+
+static void on_signal(int sig) {
+    stop = true;
+}
+
+
+static void sleep_until(struct timespec *deadline, double period_ns) {
+    uint64_t ns = deadline->tv_nsec + (uint64_t)period_ns;
+
+    deadline->tv_sec += ns / 1000000000ULL;
+    deadline->tv_nsec = ns % 1000000000ULL;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL);
+}
+
+
+// the self test's sender, udp_tx_task() at real time pace
+static void *sender_thread(void *args) {
+    struct sockaddr_in dest_addr;
+    struct timespec deadline;
+    static uint8_t dmabuf[I2S_BUF_SIZE];
+    static udp_buf_t udp_buf;
+    uint32_t n = (uint32_t)(cfg.test_seconds * 1e6 / PACKET_TIME_US);
+    uint32_t sequence_number;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    dest_addr.sin_port = htons(cfg.port);
+    memset(&udp_buf, 0, sizeof(udp_buf));
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    for (sequence_number = 1; sequence_number <= n && !stop; sequence_number++) {
+        sleep_until(&deadline, PACKET_TIME_US * 1000.0);
+        wgk_fill_dma_buf(dmabuf, sequence_number);
+        udp_pack(&udp_buf, dmabuf);
+        udp_buf.sequence_number = sequence_number;
+#ifdef WITH_TIMESTAMP
+        udp_buf.timestamp = get_time_us_in_isr();
+#endif
+        send_time[sequence_number & (SEND_TIME_SLOTS - 1)] = wgk_host_ns();
+        if (sendto(sock, &udp_buf, sizeof(udp_buf), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0) {
+            perror("sendto");
+        }
+        packets_sent++;
+    }
+    close(sock);
+    sender_done = true;
+    return NULL;
+}
+
+
+static void *receiver_thread(void *args) {
+    int sock = *(int *)args;
+    static udp_buf_t udp_buf;
+    ssize_t len;
+
+    while (!stop) {
+        len = recv(sock, &udp_buf, sizeof(udp_buf), 0);
+        if (len < 0) {                                          // timeout
+            if (sender_done) break;
+            continue;
+        }
+        if (len != sizeof(udp_buf_t)) {
+            telem_inc(TC_RX_BAD_LEN);
+            continue;
+        }
+        telem_inc(TC_RX_PACKETS);
+        pthread_mutex_lock(&ring_lock);
+        ring_buf_put(&udp_buf);
+        pthread_mutex_unlock(&ring_lock);
+    }
+    return NULL;
+}
+
+
+static void check(const i2s_buf_t *buf) {
+    uint32_t seq;
+
+    // concealment changes NUM_SLOTS_I2S - 1 samples, everything beyond is corruption
+    if (wgk_check_dma_buf((const uint8_t *)buf, &seq) > NUM_SLOTS_I2S) ps.corrupt++;
+    if (ps.last_seq && seq != ps.last_seq + 1) ps.out_of_order++;
+    ps.last_seq = seq;
+    lat_hist_add(&ps.latency, (int32_t)((wgk_host_ns() - send_time[seq & (SEND_TIME_SLOTS - 1)]) / 1000));
+}
+
+
+// the I2S TX ISR: silence while nothing is there, but only once the stream has started
+// for the sinks that record, the sound card needs its samples all along
+static void *clock_thread(void *args) {
+    struct timespec deadline;
+    static i2s_buf_t out;
+    double period_ns = PACKET_TIME_US * 1000.0 * (1.0 + cfg.drift_ppm * 1e-6);
+    bool ok;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    while (!stop) {
+        if (!sink->paced) sleep_until(&deadline, period_ns);
+        pthread_mutex_lock(&ring_lock);
+        ok = ring_buf_read((uint8_t *)&out);                    // like i2s_tx_callback() does
+        pthread_mutex_unlock(&ring_lock);
+
+        if (!ok) {
+            if (cfg.test_seconds > 0.0 && sender_done && ps.last_seq >= packets_sent) break;
+            if (ps.played == 0 && !sink->paced) continue;
+            if (ps.played) ps.silent++;
+            memset(&out, 0, sizeof(out));
+        } else {
+            ps.played++;
+            if (cfg.test_seconds > 0.0) check(&out);
+        }
+        if (sink->write(&out) < 0) {
+            fprintf(stderr, "%s sink failed\n", sink->name);
+            stop = true;
+        }
+        if (cfg.test_seconds > 0.0 && sender_done && ps.last_seq >= packets_sent) break;
+    }
+    return NULL;
+}
+
+
+// best effort, needs CAP_SYS_NICE
+static void realtime(pthread_t t, int prio) {
+    struct sched_param sp = { .sched_priority = prio };
+
+    pthread_setschedparam(t, SCHED_FIFO, &sp);
+}
+
+
+static void status(void) {
+    int32_t lo = telem_gauge[TG_RING_LEAD_MIN], hi = telem_gauge[TG_RING_LEAD_MAX];
+
+    fprintf(stderr, "rx %u gaps %u lost %u concealed %u underruns %u silent %u overflows %u",
+            telem_counter[TC_RX_PACKETS], telem_counter[TC_RX_GAPS], telem_counter[TC_RX_LOST],
+            telem_counter[TC_RX_CONCEALED], telem_counter[TC_RX_UNDERRUNS], ps.silent, sink->overflows);
+    if (lo <= hi) {
+        fprintf(stderr, " | lead %d..%d (%.1f..%.1f ms)", lo, hi, lo * PACKET_TIME_US / 1000.0, hi * PACKET_TIME_US / 1000.0);
+    }
+    fprintf(stderr, "\n");
+    telem_reset_interval();
+}
+
+
+static int receive(void) {
+    pthread_t tx, rx, clk;
+    struct sockaddr_in addr;
+    struct timeval timeout = { 0, 100000 };
+    int sock, rcvbuf = RCVBUF_SIZE, failed = 0;
+    bool test = cfg.test_seconds > 0.0;
+    uint64_t t_end = wgk_host_ns() + (uint64_t)(cfg.seconds * 1e9);
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(test ? INADDR_LOOPBACK : INADDR_ANY);
+    addr.sin_port = htons(cfg.port);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        return 1;
+    }
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    memset(&ps, 0, sizeof(ps));
+    lat_hist_reset(&ps.latency);
+    telem_reset_interval();
+    pthread_create(&rx, NULL, receiver_thread, &sock);
+    pthread_create(&clk, NULL, clock_thread, NULL);
+    realtime(clk, 3);                                           // the I2S ISR first, like on the target
+    realtime(rx, 2);
+    if (test) {
+        pthread_create(&tx, NULL, sender_thread, NULL);
+        realtime(tx, 3);
+    }
+
+    while (!stop && !(test && sender_done && ps.last_seq >= packets_sent)) {
+        sleep(1);
+        if (cfg.seconds > 0.0 && wgk_host_ns() >= t_end) stop = true;
+        if (cfg.verbose || !test) status();
+    }
+    stop = true;
+    if (test) pthread_join(tx, NULL);
+    pthread_join(rx, NULL);
+    pthread_join(clk, NULL);
+    close(sock);
+    sink->close();
+
+    printf("%u channels, %s sink, RINGBUF_OFFSET %d (%.1f ms)\n", NUM_SLOTS_I2S, sink->name,
+           RINGBUF_OFFSET, RINGBUF_OFFSET * PACKET_TIME_US / 1000.0);
+    printf("  received %u played %u silent %u sink overflows %u\n",
+           telem_counter[TC_RX_PACKETS], ps.played, ps.silent, sink->overflows);
+    printf("  gaps %u lost %u concealed %u underruns %u checksum errors %u\n", telem_counter[TC_RX_GAPS],
+           telem_counter[TC_RX_LOST], telem_counter[TC_RX_CONCEALED], telem_counter[TC_RX_UNDERRUNS],
+           telem_counter[TC_RX_CHECKSUM]);
+    if (test) {
+        printf("  sent %u, drift %.1f ppm, corrupt %u out of order %u\n", packets_sent, cfg.drift_ppm,
+               ps.corrupt, ps.out_of_order);
+        printf("  latency send -> play p50 %.2f ms p99 %.2f ms max %.2f ms\n",
+               lat_hist_percentile(&ps.latency, 500) / 1000.0, lat_hist_percentile(&ps.latency, 990) / 1000.0,
+               ps.latency.max / 1000.0);
+        failed = ps.corrupt || telem_counter[TC_RX_CHECKSUM] || ps.played == 0
+                 || ps.out_of_order > telem_counter[TC_RX_UNDERRUNS] + telem_counter[TC_RX_CONCEALED];
+        printf("%s\n", failed ? "FAIL" : "PASS");
+    }
+    return failed;
+}
+
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-o sink] [-t seconds] [-P port] [-v]\n"
+                    "       %s -T seconds [-o sink] [-d drift_ppm] [-v]\n"
+                    "sink is name[:arg], one of ", name, name);
+    sink_list(stderr);
+    fprintf(stderr, "\ndefault wav:wgk_rx.wav, null for the self test\n");
+}
+
+
+int main(int argc, char **argv) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:t:P:T:d:vh")) != -1) {
+        switch (opt) {
+            case 'o': cfg.sink = optarg; break;
+            case 't': cfg.seconds = atof(optarg); break;
+            case 'P': cfg.port = atoi(optarg); break;
+            case 'T': cfg.test_seconds = atof(optarg); break;
+            case 'd': cfg.drift_ppm = atof(optarg); break;
+            case 'v': cfg.verbose = 1; break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (cfg.port == 0) cfg.port = cfg.test_seconds > 0.0 ? HOST_PORT : WGK_PORT;
+    if (cfg.sink == NULL) cfg.sink = cfg.test_seconds > 0.0 ? "null" : "wav:wgk_rx.wav";
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    if (!ring_buf_init()) return 1;
+    sink = sink_open(cfg.sink);
+    if (sink == NULL) return 1;
+    return receive();
+}
@@ -0,0 +1,140 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * software sender: udp_tx_task() on Linux, so that a receiver, the board or wgk_rx, can be
+ * tested without a second board with an ADC
+ *
+ * every PACKET_TIME_US * (1 + drift) on an absolute CLOCK_MONOTONIC timer: one packet of
+ * the signal (siggen.c) -> udp_pack() -> sendto(), in exactly the wire format of the
+ * firmware, 8 channels. A wakeup that comes late sends at once and the timer does not
+ * slip, like the I2S clock of a real sender does not wait for the CPU.
+ *
+ * ./wgk_tx [-s signal] [-a addr] [-P port] [-t seconds] [-d drift_ppm] [-x speedup] [-l dBFS] [-L]
+ *   -s    test, pluck, sweep, impulse or wav:file, default pluck
+ *   -a    default RX_IP_ADDR, i.e. a PC on the sender's network standing in for the sender
+ *   -d    sender clock error in ppm, the receiver has to absorb it
+ *   -x    send faster than real time, for receiver throughput tests
+ *   -L    loop the WAV file
+ *
+ * e.g. build-host/wgk_rx -P 45700 -o wav:out.wav & build-host/wgk_tx -a 127.0.0.1 -P 45700 -d 50
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "wgk_host.h"
+#include "siggen.h"
+
+#define WGK_RX_ADDR             "192.168.4.1"           // RX_IP_ADDR in wireless_gk.h
+#define WGK_PORT                45678                   // PORT in wireless_gk.h
+
+static volatile bool stop = false;
+
+
+static void on_signal(int sig) {
+    stop = true;
+}
+
+
+int main(int argc, char **argv) {
+    const char *signal_spec = "pluck", *addr = WGK_RX_ADDR;
+    double seconds = 0.0, drift_ppm = 0.0, speedup = 1.0, level_db = -6.0, period_ns;
+    int opt, port = WGK_PORT, loop = 0, sock;
+    struct sockaddr_in dest_addr;
+    struct sched_param sp = { .sched_priority = 3 };
+    struct timespec deadline;
+    static i2s_buf_t buf;
+    static udp_buf_t udp_buf;
+    siggen_t gen;
+    uint32_t sequence_number, n, errors = 0, late = 0;
+    uint64_t ns, t_start, lateness, max_late = 0;
+    bool more = true;
+
+    while ((opt = getopt(argc, argv, "s:a:P:t:d:x:l:Lh")) != -1) {
+        switch (opt) {
+            case 's': signal_spec = optarg; break;
+            case 'a': addr = optarg; break;
+            case 'P': port = atoi(optarg); break;
+            case 't': seconds = atof(optarg); break;
+            case 'd': drift_ppm = atof(optarg); break;
+            case 'x': speedup = atof(optarg); break;
+            case 'l': level_db = atof(optarg); break;
+            case 'L': loop = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-s test|pluck|sweep|impulse|wav:file] [-a addr] [-P port] [-t seconds]\n"
+                                "       [-d drift_ppm] [-x speedup] [-l dBFS] [-L]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (speedup <= 0.0) speedup = 1.0;
+    if (siggen_open(&gen, signal_spec, level_db, loop) < 0) return 1;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&dest_addr, 0, sizeof(dest_addr));
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(port);
+    if (sock < 0 || inet_pton(AF_INET, addr, &dest_addr.sin_addr) != 1) {
+        fprintf(stderr, "bad address %s\n", addr);
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);        // best effort, needs CAP_SYS_NICE
+
+    period_ns = PACKET_TIME_US * 1000.0 * (1.0 + drift_ppm * 1e-6) / speedup;
+    n = seconds > 0.0 ? (uint32_t)(seconds * 1e6 / PACKET_TIME_US) : UINT32_MAX;
+    memset(&udp_buf, 0, sizeof(udp_buf));
+    udp_buf.session = (uint16_t)(wgk_host_ns() / 1000);        // restarting wgk_tx makes wgk_rx resync
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    t_start = wgk_host_ns();
+    for (sequence_number = 1; sequence_number <= n && more && !stop; sequence_number++) {
+        // the deadline is kept in ns since the start, so that the drift does not round away
+        ns = t_start + (uint64_t)(sequence_number * period_ns);
+        deadline.tv_sec = ns / 1000000000ULL;
+        deadline.tv_nsec = ns % 1000000000ULL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        lateness = wgk_host_ns() - ns;
+        if (lateness > max_late) max_late = lateness;
+        if (lateness > period_ns) late++;
+
+        more = siggen_fill(&gen, &buf, sequence_number);
+        udp_pack(&udp_buf, (uint8_t *)&buf);
+        udp_buf.sequence_number = sequence_number;
+#ifdef WITH_TIMESTAMP
+        udp_buf.timestamp = get_time_us_in_isr();
+#endif
+        if (sendto(sock, &udp_buf, sizeof(udp_buf), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0) {
+            errors++;
+        }
+    }
+    close(sock);
+    siggen_close(&gen);
+
+    printf("sent %u packets (%.1f s of audio) to %s:%d in %.1f s, drift %.1f ppm\n", sequence_number - 1,
+           (sequence_number - 1) * PACKET_TIME_US / 1e6, addr, port, (wgk_host_ns() - t_start) / 1e9, drift_ppm);
+    printf("  sendto errors %u, wakeups late by more than a packet %u, max %.2f ms\n",
+           errors, late, max_late / 1e6);
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// play out scoring for the virtual time harnesses, see playout.h
+
+#include "playout.h"
+
+#ifndef MIN
+#define MIN(a,b) ((a)<(b)?(a):(b))
+#endif
+
+
+void playout_reset(playout_t *pl, uint32_t base_seq) {
+    memset(pl, 0, sizeof(playout_t));
+    pl->base_seq = base_seq;
+    lat_hist_reset(&pl->latency);
+    memset(telem_counter, 0, sizeof(telem_counter));
+    memset(telem_hist, 0, sizeof(telem_hist));
+    ring_buf_reset();
+}
+
+
+// the test signal only carries the sequence number modulo WGK_TEST_PERIOD
+static uint32_t unwrap(uint32_t s, uint32_t ref) {
+    s += ref - ref % WGK_TEST_PERIOD;
+    if (s > ref + WGK_TEST_PERIOD / 2) s -= WGK_TEST_PERIOD;
+    else if (s + WGK_TEST_PERIOD / 2 < ref) s += WGK_TEST_PERIOD;
+    return s;
+}
+
+
+static void end_dropout(playout_t *pl) {
+    if (pl->run_len > 0) {
+        pl->dropout_events++;
+        if (pl->run_len > pl->longest_dropout) pl->longest_dropout = pl->run_len;
+        pl->run_len = 0;
+    }
+}
+
+
+playout_state_t playout_tick(playout_t *pl, uint32_t last_seq, uint32_t *seq) {
+    static i2s_buf_t out;
+    uint32_t fade_outs = telem_counter[TC_RX_FADE_OUTS], fade_ins = telem_counter[TC_RX_FADE_INS];
+    uint8_t *p = ring_buf_read((uint8_t *)&out) ? (uint8_t *)&out : NULL;
+    uint32_t s;
+
+    // a fade out is the start of a gap, a fade in has all but its last frame scaled
+    if (telem_counter[TC_RX_FADE_OUTS] != fade_outs) p = NULL;
+
+    if (!pl->running) {
+        if (p == NULL) return PLAYOUT_IDLE;
+        wgk_check_dma_buf(p, &s);
+        pl->first_seq = unwrap(s, pl->base_seq);
+        pl->running = true;
+    }
+    if (pl->first_seq + pl->ticks > last_seq || pl->ended) return PLAYOUT_END;
+    pl->ticks++;
+    if (p == NULL) {
+        pl->silent++;
+        pl->run_len++;
+        return PLAYOUT_SILENT;
+    }
+    end_dropout(pl);
+    pl->played++;
+    if (wgk_check_dma_buf(p, &s) > NUM_SLOTS_I2S && telem_counter[TC_RX_FADE_INS] == fade_ins) {
+        pl->corrupt++;                                                  // concealment changes one sample
+    }
+    *seq = unwrap(s, pl->first_seq + pl->ticks - 1);
+    if (*seq >= last_seq) pl->ended = true;
+    return PLAYOUT_PLAYED;
+}
+
+
+void playout_finish(playout_t *pl) {
+    uint32_t b;
+
+    end_dropout(pl);
+    pl->late = 0;
+    for (b = 0; b < LOG_HIST_BINS; b++) pl->late += telem_hist[TH_RING_LATE].bin[b];
+}
+
+
+void playout_print(const playout_t *pl) {
+    printf("| gaps %4u late %4llu | dropouts %6.3f%% %4u events, longest %5.1f ms | concealed %4u corrupt %u "
+           "| latency p50 %5.2f p99 %5.2f max %5.2f ms\n",
+           telem_counter[TC_RX_GAPS], (unsigned long long)pl->late,
+           pl->ticks ? 100.0 * pl->silent / pl->ticks : 0.0, pl->dropout_events,
+           pl->longest_dropout * PACKET_TIME_US / 1000.0,
+           telem_counter[TC_RX_CONCEALED], pl->corrupt,
+           MIN(lat_hist_percentile(&pl->latency, 500), pl->latency.max) / 1000.0,
+           MIN(lat_hist_percentile(&pl->latency, 990), pl->latency.max) / 1000.0, pl->latency.max / 1000.0);
+}
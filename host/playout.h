@@ -0,0 +1,58 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the receiver's I2S side of the virtual time harnesses (impair_sim.c, replay.c): calls
+// ring_buf_read() on every tick and scores what would have been played
+
+#ifndef _PLAYOUT_H
+#define _PLAYOUT_H
+
+#include "wgk_host.h"
+
+typedef enum {
+    PLAYOUT_IDLE = 0,           // the ring buffer is not running yet
+    PLAYOUT_SILENT,             // a tick of the stream without a packet
+    PLAYOUT_PLAYED,             // a packet was played, see seq
+    PLAYOUT_END,                // past the last packet of the stream
+} playout_state_t;
+
+typedef struct {
+    uint32_t base_seq;          // first sequence number of the stream
+    bool running;
+    bool ended;                 // the last packet was played, earlier than ticks says after a resync skipped ahead
+    uint32_t first_seq;         // first packet played
+    uint32_t ticks;             // I2S ticks that were due to play a packet of the stream
+    uint32_t played, silent, corrupt;
+    uint32_t dropout_events, longest_dropout, run_len;
+    uint64_t late;              // packets that arrived after their slot, from TH_RING_LATE
+    lat_hist_t latency;         // filled by the harness, its idea of latency differs
+} playout_t;
+
+// also resets the ring buffer and the telemetry counters and histograms it feeds
+void playout_reset(playout_t *pl, uint32_t base_seq);
+
+// one I2S tick. last_seq is the last sequence number of the stream, *seq the one played.
+playout_state_t playout_tick(playout_t *pl, uint32_t last_seq, uint32_t *seq);
+
+void playout_finish(playout_t *pl);
+
+// "| gaps .. late .. | dropouts .. | concealed .. corrupt .. | latency ..\n"
+void playout_print(const playout_t *pl);
+
+#endif /* _PLAYOUT_H */
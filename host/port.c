@@ -0,0 +1,102 @@
+/* 
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de> 
+
+    This file is part of Wireless-GK.
+    
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// host side of wgk_port.h: logging, the µs clock, the variables main.c and wgk_receiver.c 
+// provide on the target, and the test signal the harnesses send through the pipeline
+
+#include <stdarg.h>
+#include <time.h>
+#include "wgk_host.h"
+
+#ifdef WITH_TEMP
+float rx_temp, tx_temp;
+#endif
+#ifdef LATENCY_PROBE
+clock_sync_t clock_sync;                // never synced on the host, so ring_buf_read() does not measure
+lat_hist_t lat_hist;
+#endif
+
+static bool virtual_time = false;
+static volatile uint32_t now_us;
+
+
+void wgk_log(char level, const char *tag, const char *fmt, ...) {
+    va_list ap;
+
+    fprintf(stderr, "%c (%lu) %s: ", level, (unsigned long)(get_time_us_in_isr() / 1000), tag);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+
+uint64_t wgk_host_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+void wgk_host_virtual_time(bool on) {
+    virtual_time = on;
+}
+
+
+void wgk_host_set_time(uint32_t us) {
+    now_us = us;
+}
+
+
+// wraps at 2^32 µs like the gptimer based one on the target
+uint32_t get_time_us_in_isr(void) {
+    if (virtual_time) return now_us;
+    return (uint32_t)(wgk_host_ns() / 1000);
+}
+
+
+void wgk_fill_dma_buf(uint8_t *dmabuf, uint32_t seq) {
+    i2s_buf_t *buf = (i2s_buf_t *)dmabuf;
+    int i, j;
+
+    for (i = 0; i < NFRAMES; i++) {
+        for (j = 0; j < NUM_SLOTS_I2S; j++) {
+            buf->frame[i].slot[j] = wgk_test_sample(seq, i, j);
+        }
+    }
+}
+
+
+// returns the number of samples that do not belong to the packet the last frame claims 
+// to be from, and that packet's sequence number modulo WGK_TEST_PERIOD. 
+// The last frame because concealment only touches the first ones. 
+int wgk_check_dma_buf(const uint8_t *dmabuf, uint32_t *seq) {
+    const i2s_buf_t *buf = (const i2s_buf_t *)dmabuf;
+    uint32_t pos = ((uint32_t)buf->frame[NFRAMES-1].slot[0] >> 8) & 0xffffff;
+    int i, j, bad = 0;
+
+    *seq = pos / (NFRAMES * NUM_SLOTS_I2S);
+    for (i = 0; i < NFRAMES; i++) {
+        for (j = 0; j < NUM_SLOTS_I2S; j++) {
+            if (buf->frame[i].slot[j] != wgk_test_sample(*seq, i, j)) bad++;
+        }
+    }
+    return bad;
+}
@@ -0,0 +1,586 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * objective audio quality of the pipeline under network impairment
+ *
+ * the reference signal (siggen.c, 8 channels) goes through udp_pack(), the impairment
+ * stage (impair.c), ring_buf_put() and ring_buf_read() in virtual time, like in impair_sim.c,
+ * and what the receiver plays is compared with the reference, sample by sample, per channel:
+ *
+ * snr       10 log10(reference energy / error energy), dB
+ * segsnr    the mean of the SNR over SEG_PACKETS packet segments, clamped to SEG_MIN_DB ..
+ *           SEG_MAX_DB, silent segments skipped. Short bad stretches weigh more than in snr.
+ * lsd       log spectral distance, the RMS over the bins of the dB difference between the
+ *           reference and the output spectrum, FFT_N frames with a Hann window, dB
+ * clicks    discontinuities the reference does not have: the second difference of the error
+ *           above CLICK_LEVEL of full scale, at most one per CLICK_GAP frames
+ *
+ * Slot 7 (GKVOL) is not scored. It carries the sequence number of each packet instead, which
+ * lines the output up with the reference; the concealment in ringbuf.c leaves it alone.
+ *
+ * A run is fast enough for batch sweeps: the reference, its packets and spectra are made
+ * once, and -j forks workers. The core is the current build, so comparing concealment or
+ * codec variants means building them and running the same batch against each.
+ *
+ * ./wgk_quality                                the built-in scenarios
+ * ./wgk_quality -l 0:0.1:0.01 -n 20            random loss 0 .. 10 %, 20 seeds each
+ * ./wgk_quality -j 8 -c batch.txt > out.csv    one scenario per line, CSV per channel
+ *
+ * batch lines are key=value words: name=, seed=, loss=p, ge=p:r:loss_bad, base=us,
+ * jitter=dist:us, reorder=p:us, dup=p:us, rate=kbps:max_queue_us, drift=ppm; '#' comments
+ */
+
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "wgk_host.h"
+#include "impair.h"
+#include "siggen.h"
+
+#if NUM_SLOTS_I2S != 8
+#error "wgk_quality needs the 8 slot core, wgk_core8"
+#endif
+
+#define SCORED_SLOTS            7                       // slot 7 carries the sequence number
+#define CLOCK_PHASE             0.37                    // same as impair_sim.c
+#define SEG_PACKETS             8                       // 15 ms segments
+#define SEG_MIN_DB              -10.0
+#define SEG_MAX_DB              35.0
+#define SEG_FLOOR               1e-6                    // mean square below which a segment is silent
+#define SNR_MAX                 150.0                   // no error at all
+#define FFT_BITS                8
+#define FFT_N                   (1 << FFT_BITS)
+#define FFT_BINS                (FFT_N / 2)
+#define FFT_FLOOR               1e-10                   // -100 dB, keeps log() finite
+#define CLICK_LEVEL             0.05
+#define CLICK_GAP               31                      // frames, 1 ms
+#define MAX_SCENARIOS           100000
+
+typedef struct {
+    char name[48];
+    uint64_t seed;
+    impair_cfg_t cfg;
+    double drift_ppm;
+} scenario_t;
+
+typedef struct {
+    double snr, segsnr, lsd;
+    uint32_t clicks;
+} score_t;
+
+typedef struct {
+    bool done;
+    uint32_t lost, concealed, underruns, played, silent;
+    score_t ch[SCORED_SLOTS];
+} result_t;
+
+// what a channel accumulates during a run
+typedef struct {
+    double sig, err;                                    // whole run
+    double seg_sig, seg_err, segsnr_sum;                // current segment, sum over segments
+    uint32_t seg_n;
+    double lsd_sum;
+    uint32_t lsd_n;
+    double out1, out2, ref1, ref2;                      // previous samples, for the second difference
+    uint32_t since_click, clicks;
+    float frame[FFT_N];                                 // output samples of the current FFT frame
+} acc_t;
+
+static scenario_t *scenarios;
+static uint32_t num_scenarios;
+static i2s_buf_t *ref;                                  // reference packets, ref[seq - 1]
+static udp_buf_t *packed;
+static float *ref_spec;                                 // dB, per FFT frame, slot and bin
+static uint32_t num_packets, num_fft_frames;
+static float window[FFT_N];
+
+static scenario_t builtin[] = {
+    { "clean",          1, { .base_us = 300 }, 0.0 },
+    { "random loss 1%", 1, { .loss_good = 0.01, .base_us = 300 }, 0.0 },
+    { "random loss 5%", 1, { .loss_good = 0.05, .base_us = 300 }, 0.0 },
+    { "burst loss",     1, { .ge_p = 0.005, .ge_r = 0.2, .loss_bad = 0.7, .base_us = 300 }, 0.0 },
+    { "jitter pareto",  1, { .base_us = 300, .jitter_dist = JITTER_PARETO, .jitter_us = 1000 }, 0.0 },
+    { "reorder",        1, { .base_us = 300, .jitter_dist = JITTER_UNIFORM, .jitter_us = 200,
+                             .reorder_p = 0.02, .reorder_us = 3000 }, 0.0 },
+    { "drift 100 ppm",  1, { .base_us = 300, .jitter_dist = JITTER_NORMAL, .jitter_us = 500 }, 100.0 },
+};
+
+
+static double to_float(int32_t v) {
+    return v / 2147483648.0;
+}
+
+
+/*
+ * in place radix 2 FFT, FFT_N points
+ */
+static void fft(float *re, float *im) {
+    static float cos_t[FFT_N / 2], sin_t[FFT_N / 2];
+    static bool init = false;
+    uint32_t i, j, k, len, half, step;
+    float tr, ti;
+
+    if (!init) {
+        for (i = 0; i < FFT_N / 2; i++) {
+            cos_t[i] = cos(2 * M_PI * i / FFT_N);
+            sin_t[i] = -sin(2 * M_PI * i / FFT_N);
+        }
+        init = true;
+    }
+    for (i = 1, j = 0; i < FFT_N; i++) {                        // bit reversal
+        for (k = FFT_N >> 1; j & k; k >>= 1) j ^= k;
+        j |= k;
+        if (i < j) {
+            tr = re[i]; re[i] = re[j]; re[j] = tr;
+            ti = im[i]; im[i] = im[j]; im[j] = ti;
+        }
+    }
+    for (len = 2; len <= FFT_N; len <<= 1) {
+        half = len >> 1;
+        step = FFT_N / len;
+        for (i = 0; i < FFT_N; i += len) {
+            for (j = 0; j < half; j++) {
+                k = i + j + half;
+                tr = re[k] * cos_t[j * step] - im[k] * sin_t[j * step];
+                ti = re[k] * sin_t[j * step] + im[k] * cos_t[j * step];
+                re[k] = re[i + j] - tr;
+                im[k] = im[i + j] - ti;
+                re[i + j] += tr;
+                im[i + j] += ti;
+            }
+        }
+    }
+}
+
+
+// power spectrum in dB of FFT_N samples, FFT_BINS bins without DC
+static void spectrum(const float *x, float *db) {
+    float re[FFT_N], im[FFT_N];
+    int i;
+
+    for (i = 0; i < FFT_N; i++) {
+        re[i] = x[i] * window[i];
+        im[i] = 0.0f;
+    }
+    fft(re, im);
+    for (i = 0; i < FFT_BINS; i++) {
+        db[i] = 10.0f * log10f(re[i + 1] * re[i + 1] + im[i + 1] * im[i + 1] + FFT_FLOOR);
+    }
+}
+
+
+// frame position of a sample in the stream, packet seq counts from 1
+static uint64_t frame_pos(uint32_t seq, int i) {
+    return (uint64_t)(seq - 1) * NFRAMES + i;
+}
+
+
+static int make_reference(const char *spec, double seconds) {
+    siggen_t gen;
+    float x[FFT_N];
+    uint32_t s, f;
+    uint64_t pos;
+    int i, j;
+
+    num_packets = (uint32_t)(seconds * 1e6 / PACKET_TIME_US);
+    num_fft_frames = (uint32_t)((uint64_t)num_packets * NFRAMES / FFT_N);
+    ref = malloc((size_t)num_packets * sizeof(i2s_buf_t));
+    packed = calloc(num_packets, sizeof(udp_buf_t));
+    ref_spec = malloc((size_t)num_fft_frames * SCORED_SLOTS * FFT_BINS * sizeof(float));
+    if (ref == NULL || packed == NULL || ref_spec == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+    if (siggen_open(&gen, spec, -6.0, true) < 0) return -1;
+    for (s = 1; s <= num_packets; s++) {
+        siggen_fill(&gen, &ref[s - 1], s);
+        for (i = 0; i < NFRAMES; i++) ref[s - 1].frame[i].slot[SIGGEN_SLOT_GKVOL] = (int32_t)(s << 8);
+        udp_pack(&packed[s - 1], (uint8_t *)&ref[s - 1]);
+        packed[s - 1].sequence_number = s;
+    }
+    siggen_close(&gen);
+
+    for (i = 0; i < FFT_N; i++) window[i] = 0.5f - 0.5f * cosf(2 * M_PI * i / FFT_N);
+    for (f = 0; f < num_fft_frames; f++) {
+        for (j = 0; j < SCORED_SLOTS; j++) {
+            for (i = 0; i < FFT_N; i++) {
+                pos = (uint64_t)f * FFT_N + i;
+                x[i] = to_float(ref[pos / NFRAMES].frame[pos % NFRAMES].slot[j]);
+            }
+            spectrum(x, &ref_spec[((size_t)f * SCORED_SLOTS + j) * FFT_BINS]);
+        }
+    }
+    return 0;
+}
+
+
+static void score_sample(acc_t *a, int slot, double r, double o, uint64_t pos) {
+    float db[FFT_BINS], *rs;
+    double e = o - r, d, sum;
+    int k;
+
+    a->sig += r * r;
+    a->err += e * e;
+    a->seg_sig += r * r;
+    a->seg_err += e * e;
+
+    d = (o - 2 * a->out1 + a->out2) - (r - 2 * a->ref1 + a->ref2);
+    a->since_click++;
+    if (fabs(d) > CLICK_LEVEL && a->since_click > CLICK_GAP) {
+        a->clicks++;
+        a->since_click = 0;
+    }
+    a->out2 = a->out1;
+    a->out1 = o;
+    a->ref2 = a->ref1;
+    a->ref1 = r;
+
+    a->frame[pos % FFT_N] = (float)o;
+    if (pos % FFT_N == FFT_N - 1 && pos / FFT_N < num_fft_frames) {
+        rs = &ref_spec[((size_t)(pos / FFT_N) * SCORED_SLOTS + slot) * FFT_BINS];
+        spectrum(a->frame, db);
+        for (k = 0, sum = 0.0; k < FFT_BINS; k++) sum += (rs[k] - db[k]) * (rs[k] - db[k]);
+        a->lsd_sum += sqrt(sum / FFT_BINS);
+        a->lsd_n++;
+    }
+}
+
+
+static void end_segment(acc_t *a) {
+    double snr;
+
+    if (a->seg_sig > SEG_FLOOR * SEG_PACKETS * NFRAMES) {
+        snr = a->seg_err > 0.0 ? 10.0 * log10(a->seg_sig / a->seg_err) : SEG_MAX_DB;
+        a->segsnr_sum += snr < SEG_MIN_DB ? SEG_MIN_DB : snr > SEG_MAX_DB ? SEG_MAX_DB : snr;
+        a->seg_n++;
+    }
+    a->seg_sig = a->seg_err = 0.0;
+}
+
+
+typedef struct {
+    double t;
+    uint32_t seq;
+} arrival_t;
+
+static int by_time(const void *a, const void *b) {
+    const arrival_t *x = a, *y = b;
+
+    if (x->t != y->t) return x->t < y->t ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+
+static void run(const scenario_t *sc, result_t *res) {
+    static acc_t acc[SCORED_SLOTS];
+    static arrival_t *arr;
+    static uint32_t arr_size;
+    static i2s_buf_t out;
+    impair_t im;
+    double t_rx = PACKET_TIME_US * (1.0 + sc->drift_ppm * 1e-6), next_tick = CLOCK_PHASE * t_rx, at[2];
+    uint32_t i, s, na = 0, ticks = 0, seq = 0, first = 0, max_ticks = num_packets + 2 * NUM_RINGBUF_ELEMS;
+    int c, copies, f, j;
+    bool ok;
+
+    if (arr_size < 2 * num_packets) {
+        arr_size = 2 * num_packets;
+        arr = realloc(arr, arr_size * sizeof(arrival_t));
+    }
+    impair_init(&im, &sc->cfg, sc->seed);
+    for (s = 1; s <= num_packets; s++) {
+        copies = impair_packet(&im, (double)s * PACKET_TIME_US, sizeof(udp_buf_t), at);
+        for (c = 0; c < copies; c++) {
+            arr[na].t = at[c];
+            arr[na++].seq = s;
+        }
+    }
+    qsort(arr, na, sizeof(arrival_t), by_time);
+
+    memset(telem_counter, 0, sizeof(telem_counter));
+    memset(acc, 0, sizeof(acc));
+    memset(res, 0, sizeof(*res));
+    ring_buf_reset();
+
+    i = 0;
+    while (ticks < max_ticks) {
+        if (i < na && arr[i].t <= next_tick) {
+            wgk_host_set_time((uint32_t)(uint64_t)arr[i].t);
+            telem_inc(TC_RX_PACKETS);
+            ring_buf_put(&packed[arr[i].seq - 1]);
+            i++;
+            continue;
+        }
+        wgk_host_set_time((uint32_t)(uint64_t)next_tick);
+        next_tick += t_rx;
+        ticks++;
+        ok = ring_buf_read((uint8_t *)&out);
+        if (first == 0) {
+            if (!ok) continue;
+            first = (uint32_t)out.frame[0].slot[SIGGEN_SLOT_GKVOL] >> 8;
+            seq = first;
+        } else {
+            seq++;
+        }
+        if (seq > num_packets) break;
+        if (ok) {
+            res->played++;
+        } else {
+            memset(&out, 0, sizeof(out));
+            res->silent++;
+        }
+        for (f = 0; f < NFRAMES; f++) {
+            for (j = 0; j < SCORED_SLOTS; j++) {
+                score_sample(&acc[j], j, to_float(ref[seq - 1].frame[f].slot[j]), to_float(out.frame[f].slot[j]),
+                             frame_pos(seq, f));
+            }
+        }
+        if ((seq - first + 1) % SEG_PACKETS == 0) {
+            for (j = 0; j < SCORED_SLOTS; j++) end_segment(&acc[j]);
+        }
+    }
+
+    res->done = true;
+    res->lost = im.lost + im.queue_drops;
+    res->concealed = telem_counter[TC_RX_CONCEALED];
+    res->underruns = telem_counter[TC_RX_UNDERRUNS];
+    for (j = 0; j < SCORED_SLOTS; j++) {
+        if (first == 0) {
+            res->ch[j].snr = res->ch[j].segsnr = res->ch[j].lsd = NAN;
+            continue;
+        }
+        res->ch[j].snr = acc[j].err > 0.0 ? 10.0 * log10(acc[j].sig / acc[j].err) : SNR_MAX;
+        res->ch[j].segsnr = acc[j].seg_n ? acc[j].segsnr_sum / acc[j].seg_n : NAN;
+        res->ch[j].lsd = acc[j].lsd_n ? acc[j].lsd_sum / acc[j].lsd_n : NAN;
+        res->ch[j].clicks = acc[j].clicks;
+    }
+}
+
+
+static void print_result(const scenario_t *sc, const result_t *r, int csv, int verbose) {
+    double snr = 0.0, segsnr = 0.0, lsd = 0.0, worst = INFINITY;
+    uint32_t clicks = 0;
+    int j;
+
+    if (csv) {
+        for (j = 0; j < SCORED_SLOTS; j++) {
+            printf("%s,%llu,%d,%u,%u,%u,%.2f,%.2f,%.3f,%u\n", sc->name, (unsigned long long)sc->seed, j, r->lost,
+                   r->concealed, r->underruns, r->ch[j].snr, r->ch[j].segsnr, r->ch[j].lsd, r->ch[j].clicks);
+        }
+        return;
+    }
+    for (j = 0; j < SCORED_SLOTS; j++) {
+        snr += r->ch[j].snr;
+        segsnr += r->ch[j].segsnr;
+        lsd += r->ch[j].lsd;
+        clicks += r->ch[j].clicks;
+        if (r->ch[j].snr < worst) worst = r->ch[j].snr;
+    }
+    printf("%-24s %4llu | lost %5u concealed %4u underruns %5u | snr %6.1f (worst %6.1f) segsnr %5.1f lsd %5.2f clicks %5u\n",
+           sc->name, (unsigned long long)sc->seed, r->lost, r->concealed, r->underruns,
+           snr / SCORED_SLOTS, worst, segsnr / SCORED_SLOTS, lsd / SCORED_SLOTS, clicks);
+    if (verbose) {
+        for (j = 0; j < SCORED_SLOTS; j++) {
+            printf("    slot %d snr %6.1f segsnr %5.1f lsd %5.2f clicks %4u\n", j,
+                   r->ch[j].snr, r->ch[j].segsnr, r->ch[j].lsd, r->ch[j].clicks);
+        }
+    }
+}
+
+
+static scenario_t *add_scenario(void) {
+    static uint32_t size;
+
+    if (num_scenarios == MAX_SCENARIOS) return NULL;
+    if (num_scenarios == size) {
+        size = size ? 2 * size : 256;
+        scenarios = realloc(scenarios, size * sizeof(scenario_t));
+    }
+    memset(&scenarios[num_scenarios], 0, sizeof(scenario_t));
+    scenarios[num_scenarios].seed = 1;
+    scenarios[num_scenarios].cfg.base_us = 300;
+    return &scenarios[num_scenarios++];
+}
+
+
+static int parse_line(char *line, int lineno) {
+    scenario_t *sc;
+    char *w, *save, *v, dist[32];
+    impair_cfg_t *c;
+    int ok;
+
+    if ((w = strchr(line, '#')) != NULL) *w = '\0';
+    w = strtok_r(line, " \t\r\n", &save);
+    if (w == NULL) return 0;
+    if ((sc = add_scenario()) == NULL) return -1;
+    c = &sc->cfg;
+    snprintf(sc->name, sizeof(sc->name), "line %d", lineno);
+    for (; w != NULL; w = strtok_r(NULL, " \t\r\n", &save)) {
+        if ((v = strchr(w, '=')) == NULL) break;
+        *v++ = '\0';
+        ok = 1;
+        if (strcmp(w, "name") == 0) snprintf(sc->name, sizeof(sc->name), "%s", v);
+        else if (strcmp(w, "seed") == 0) sc->seed = strtoull(v, NULL, 0);
+        else if (strcmp(w, "loss") == 0) c->loss_good = atof(v);
+        else if (strcmp(w, "ge") == 0) ok = sscanf(v, "%lf:%lf:%lf", &c->ge_p, &c->ge_r, &c->loss_bad) == 3;
+        else if (strcmp(w, "base") == 0) c->base_us = atof(v);
+        else if (strcmp(w, "jitter") == 0) {
+            ok = sscanf(v, "%31[a-z]:%lf", dist, &c->jitter_us) == 2;
+            c->jitter_dist = impair_dist_by_name(dist);
+        }
+        else if (strcmp(w, "reorder") == 0) ok = sscanf(v, "%lf:%lf", &c->reorder_p, &c->reorder_us) == 2;
+        else if (strcmp(w, "dup") == 0) ok = sscanf(v, "%lf:%lf", &c->dup_p, &c->dup_us) == 2;
+        else if (strcmp(w, "rate") == 0) ok = sscanf(v, "%lf:%lf", &c->rate_kbps, &c->max_queue_us) == 2;
+        else if (strcmp(w, "drift") == 0) sc->drift_ppm = atof(v);
+        else ok = 0;
+        if (!ok) break;
+    }
+    if (w != NULL) {
+        fprintf(stderr, "line %d: cannot parse %s\n", lineno, w);
+        return -1;
+    }
+    return 0;
+}
+
+
+static int load_batch(const char *name) {
+    FILE *f = strcmp(name, "-") == 0 ? stdin : fopen(name, "r");
+    char line[512];
+    int lineno = 0;
+
+    if (f == NULL) {
+        perror(name);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (parse_line(line, ++lineno) < 0) return -1;
+    }
+    if (f != stdin) fclose(f);
+    return 0;
+}
+
+
+static int loss_sweep(const char *spec, int seeds) {
+    double from, to, step, loss;
+    scenario_t *sc;
+    int k;
+
+    if (sscanf(spec, "%lf:%lf:%lf", &from, &to, &step) != 3 || step <= 0.0) {
+        fprintf(stderr, "loss sweep is from:to:step\n");
+        return -1;
+    }
+    for (loss = from; loss <= to + step / 2; loss += step) {
+        for (k = 1; k <= seeds; k++) {
+            if ((sc = add_scenario()) == NULL) return -1;
+            snprintf(sc->name, sizeof(sc->name), "loss %.4g", loss);
+            sc->cfg.loss_good = loss;
+            sc->seed = k;
+        }
+    }
+    return 0;
+}
+
+
+// the ring buffer is global state, so the workers are processes sharing the results
+static int run_all(int jobs, int csv, int verbose) {
+    result_t *res;
+    uint32_t i;
+    int w, status, failed = 0;
+    pid_t pid;
+
+    res = mmap(NULL, num_scenarios * sizeof(result_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (res == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    if (jobs <= 1) {
+        for (i = 0; i < num_scenarios; i++) run(&scenarios[i], &res[i]);
+    } else {
+        fflush(stdout);
+        for (w = 0; w < jobs; w++) {
+            pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                return 1;
+            }
+            if (pid == 0) {
+                for (i = w; i < num_scenarios; i += jobs) run(&scenarios[i], &res[i]);
+                _exit(0);
+            }
+        }
+        while (wait(&status) > 0) {
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = 1;
+        }
+    }
+    if (csv) printf("scenario,seed,slot,lost,concealed,underruns,snr_db,segsnr_db,lsd_db,clicks\n");
+    for (i = 0; i < num_scenarios; i++) {
+        if (res[i].done) print_result(&scenarios[i], &res[i], csv, verbose);
+        else failed = 1;
+    }
+    return failed;
+}
+
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-s signal] [-t seconds] [-j jobs] [-c] [-v] [batch.txt|-]\n"
+                    "       %s -l from:to:step [-n seeds] ...     random loss sweep\n"
+                    "signal is pluck, sweep, impulse or wav:file, default pluck\n", name, name);
+}
+
+
+int main(int argc, char **argv) {
+    const char *signal_spec = "pluck", *sweep = NULL;
+    double seconds = 10.0;
+    int opt, jobs = 1, csv = 0, verbose = 0, seeds = 10;
+    uint32_t i;
+
+    while ((opt = getopt(argc, argv, "s:t:j:cvl:n:h")) != -1) {
+        switch (opt) {
+            case 's': signal_spec = optarg; break;
+            case 't': seconds = atof(optarg); break;
+            case 'j': jobs = atoi(optarg); break;
+            case 'c': csv = 1; break;
+            case 'v': verbose = 1; break;
+            case 'l': sweep = optarg; break;
+            case 'n': seeds = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (strcmp(signal_spec, "test") == 0) {
+        fprintf(stderr, "the test signal is not audio, use pluck, sweep, impulse or a WAV file\n");
+        return 2;
+    }
+    if (sweep != NULL && loss_sweep(sweep, seeds) < 0) return 2;
+    if (optind < argc && load_batch(argv[optind]) < 0) return 2;
+    if (num_scenarios == 0) {
+        for (i = 0; i < sizeof(builtin) / sizeof(builtin[0]); i++) *add_scenario() = builtin[i];
+    }
+
+    wgk_host_virtual_time(true);
+    if (!ring_buf_init()) return 1;
+    if (make_reference(signal_spec, seconds) < 0) return 1;
+    if (!csv) {
+        printf("%s, %.0f s, %u scenarios, RINGBUF_OFFSET %d, packet time %d µs\n",
+               signal_spec, seconds, num_scenarios, RINGBUF_OFFSET, PACKET_TIME_US);
+    }
+    return run_all(jobs, csv, verbose);
+}
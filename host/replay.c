@@ -0,0 +1,273 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * replays a field packet capture (main/pkt_capture.h, fetched with tools/capture_fetch.c)
+ * against the real ring buffer and concealment logic
+ *
+ * every captured packet arrives through ring_buf_put() at its recorded time, in virtual
+ * time like in impair_sim.c, and the receiver's I2S clock calls ring_buf_read() every
+ * PACKET_TIME_US. The I2S clock phase was not captured, so it is a parameter, and the
+ * whole range can be swept. The latency reported is arrival to start of play out, which
+ * is what the ring buffer adds.
+ *
+ * ./wgk_replay gig.wgkc                        replay the whole capture
+ * ./wgk_replay -s 300 -t 20 gig.wgkc           20 s starting 300 s into the capture
+ * ./wgk_replay -p all gig.wgkc                 sweep the I2S clock phase
+ * ./wgk_replay -x gig.wgkc                     print the records as text
+ */
+
+#include <unistd.h>
+#include "wgk_host.h"
+#include "playout.h"
+
+#define CLOCK_PHASE             0.37                    // default, same as impair_sim.c
+#define PHASE_STEPS             10
+#define SEQ_BASE                65536                   // so that unwrapping never goes below 0
+#define RECENT                  4096                    // arrival times kept for the latency, power of 2
+
+typedef struct {
+    double t;                   // µs since the first record
+    uint32_t seq;               // unwrapped sequence number
+    bool valid;                 // length as expected, ring_buf_put() would see it
+} packet_t;
+
+typedef struct {
+    uint32_t seq;
+    double t;
+} recent_t;
+
+static capture_info_t info;
+static packet_t *pkt;
+static uint32_t num_pkt;
+
+
+static int load(const char *name) {
+    FILE *f = fopen(name, "rb");
+    capture_rec_t *rec;
+    uint64_t t = 0;
+    uint32_t i, seq = SEQ_BASE, prev_t = 0;
+    bool have_seq = false;
+
+    if (f == NULL) {
+        perror(name);
+        return -1;
+    }
+    if (fread(&info, sizeof(info), 1, f) != 1 || info.magic != CAPTURE_MAGIC) {
+        fprintf(stderr, "%s: not a capture file\n", name);
+        return -1;
+    }
+    if (info.version != CAPTURE_VERSION || info.rec_size != sizeof(capture_rec_t)) {
+        fprintf(stderr, "%s: capture version %u, record size %u not supported\n", name, info.version, info.rec_size);
+        return -1;
+    }
+    rec = malloc(info.count * sizeof(capture_rec_t) + 1);
+    pkt = malloc(info.count * sizeof(packet_t) + 1);
+    if (rec == NULL || pkt == NULL || fread(rec, sizeof(capture_rec_t), info.count, f) != info.count) {
+        fprintf(stderr, "%s: truncated\n", name);
+        return -1;
+    }
+    fclose(f);
+
+    // the timestamps wrap after 71 minutes and the sequence numbers after 65536 packets
+    for (i = 0; i < info.count; i++) {
+        if (i > 0) t += (uint32_t)(rec[i].t_us - prev_t);
+        prev_t = rec[i].t_us;
+        pkt[i].t = (double)t;
+        pkt[i].valid = (rec[i].len == sizeof(udp_buf_t));
+        if (pkt[i].valid) {
+            if (have_seq) seq = seq_unwrap(seq, rec[i].ssn);
+            else seq = SEQ_BASE + rec[i].ssn;
+            have_seq = true;
+        }
+        pkt[i].seq = seq;
+    }
+    num_pkt = info.count;
+    free(rec);
+    return 0;
+}
+
+
+static void dump(void) {
+    uint32_t i;
+
+    printf("# t_us delta_us seq len_ok\n");
+    for (i = 0; i < num_pkt; i++) {
+        printf("%.0f %.0f %u %d\n", pkt[i].t, i ? pkt[i].t - pkt[i - 1].t : 0.0,
+               pkt[i].seq - SEQ_BASE, pkt[i].valid);
+    }
+}
+
+
+// what the network did, independent of the ring buffer
+static void describe(uint32_t from, uint32_t to) {
+    static recent_t seen[RECENT];
+    uint32_t i, valid = 0, dup = 0, reord = 0, lo = UINT32_MAX, hi = 0;
+    double gap, max_gap = 0.0, at = 0.0;
+
+    memset(seen, 0, sizeof(seen));
+    for (i = from; i < to; i++) {
+        if (i > from && (gap = pkt[i].t - pkt[i - 1].t) > max_gap) {
+            max_gap = gap;
+            at = pkt[i - 1].t;
+        }
+        if (!pkt[i].valid) continue;
+        valid++;
+        if (seen[pkt[i].seq & (RECENT - 1)].seq == pkt[i].seq) {
+            dup++;
+            continue;
+        }
+        seen[pkt[i].seq & (RECENT - 1)].seq = pkt[i].seq;
+        if (pkt[i].seq < hi) reord++;
+        if (pkt[i].seq < lo) lo = pkt[i].seq;
+        if (pkt[i].seq > hi) hi = pkt[i].seq;
+    }
+    printf("%u records, %u bad length, %u duplicates, %u reordered, %d lost, longest silence %.1f ms at %.3f s\n",
+           to - from, to - from - valid, dup, reord, valid ? (int)(hi - lo + 1 - (valid - dup)) : 0,
+           max_gap / 1000.0, at / 1e6);
+}
+
+
+static void run(uint32_t from, uint32_t to, double phase, double drift_ppm, int verbose) {
+    static recent_t recent[RECENT];
+    static udp_buf_t buf;
+    static uint8_t dmabuf[I2S_BUF_SIZE];
+    playout_t pl;
+    playout_state_t state = PLAYOUT_IDLE;
+    double t_rx = PACKET_TIME_US * (1.0 + drift_ppm * 1e-6);
+    double t0 = pkt[from].t, next_tick = phase * t_rx, now;
+    double t_end = pkt[to - 1].t - t0 + NUM_RINGBUF_ELEMS * t_rx;
+    uint32_t i, seq, first = UINT32_MAX, last = 0;
+
+    for (i = from; i < to; i++) {
+        if (!pkt[i].valid) continue;
+        if (pkt[i].seq < first) first = pkt[i].seq;
+        if (pkt[i].seq > last) last = pkt[i].seq;
+    }
+    if (first > last) return;
+    memset(recent, 0, sizeof(recent));
+    playout_reset(&pl, first);
+
+    // the virtual clock runs 1 µs ahead, so that the first arrival is not at time 0
+    i = from;
+    while (state != PLAYOUT_END && next_tick < t_end) {
+        if (i < to && pkt[i].t - t0 <= next_tick) {
+            now = pkt[i].t - t0;
+            wgk_host_set_time((uint32_t)(uint64_t)(now + 1.0));
+            if (pkt[i].valid) {
+                // the content is the test signal, replay.c does not need the captured audio
+                wgk_fill_dma_buf(dmabuf, pkt[i].seq);
+                udp_pack(&buf, dmabuf);
+                buf.sequence_number = pkt[i].seq;
+                if (recent[pkt[i].seq & (RECENT - 1)].seq != pkt[i].seq) {
+                    recent[pkt[i].seq & (RECENT - 1)].seq = pkt[i].seq;
+                    recent[pkt[i].seq & (RECENT - 1)].t = now;
+                }
+                telem_inc(TC_RX_PACKETS);
+                ring_buf_put(&buf);
+            } else {
+                telem_inc(TC_RX_BAD_LEN);
+            }
+            i++;
+        } else {
+            now = next_tick;
+            wgk_host_set_time((uint32_t)(uint64_t)(now + 1.0));
+            state = playout_tick(&pl, last, &seq);
+            next_tick += t_rx;
+            if (state == PLAYOUT_PLAYED && recent[seq & (RECENT - 1)].seq == seq) {
+                lat_hist_add(&pl.latency, (int32_t)(now + (NUM_TX_DMA_BUFS - 1) * PACKET_TIME_US
+                                                    - recent[seq & (RECENT - 1)].t));
+            }
+        }
+    }
+    playout_finish(&pl);
+
+    printf("phase %4.2f ", phase);
+    playout_print(&pl);
+    if (verbose) {
+        printf("  %u packets %u..%u, %u ticks, %u played, %u silent, %u underruns\n",
+               telem_counter[TC_RX_PACKETS], first - SEQ_BASE, last - SEQ_BASE,
+               pl.ticks, pl.played, pl.silent, telem_counter[TC_RX_UNDERRUNS]);
+    }
+}
+
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-s start_s] [-t seconds] [-p phase|all] [-d drift_ppm] [-x] [-v] capture.wgkc\n"
+                    "phase is where the I2S ticks fall between two packet times, 0 .. 1\n", name);
+}
+
+
+int main(int argc, char **argv) {
+    double start = 0.0, seconds = 0.0, phase = CLOCK_PHASE, drift_ppm = 0.0;
+    int opt, sweep = 0, text = 0, verbose = 0, k;
+    uint32_t from = 0, to;
+
+    while ((opt = getopt(argc, argv, "s:t:p:d:xvh")) != -1) {
+        switch (opt) {
+            case 's': start = atof(optarg); break;
+            case 't': seconds = atof(optarg); break;
+            case 'p':
+                if (strcmp(optarg, "all") == 0) sweep = 1;
+                else phase = atof(optarg);
+                break;
+            case 'd': drift_ppm = atof(optarg); break;
+            case 'x': text = 1; break;
+            case 'v': verbose = 1; break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (load(argv[optind]) < 0) return 1;
+    if (text) {
+        dump();
+        return 0;
+    }
+
+    while (from < num_pkt && pkt[from].t < start * 1e6) from++;
+    for (to = from; to < num_pkt && (seconds <= 0.0 || pkt[to].t < (start + seconds) * 1e6); to++);
+    if (from == to) {
+        fprintf(stderr, "no packets in that range\n");
+        return 1;
+    }
+
+    printf("capture: %.1f s, RINGBUF_OFFSET %u, packet time %u µs, %u records overwritten before\n",
+           (pkt[num_pkt - 1].t - pkt[0].t) / 1e6, info.ringbuf_offset, info.packet_time_us, info.overwritten);
+    if (info.packet_time_us != PACKET_TIME_US || info.num_ringbuf_elems != NUM_RINGBUF_ELEMS) {
+        printf("warning: captured with packet time %u µs and %u ring elements, replaying with %d and %d\n",
+               info.packet_time_us, info.num_ringbuf_elems, PACKET_TIME_US, NUM_RINGBUF_ELEMS);
+    }
+    printf("replay:  %.1f .. %.1f s, RINGBUF_OFFSET %d, drift %.1f ppm\n",
+           (pkt[from].t - pkt[0].t) / 1e6, (pkt[to - 1].t - pkt[0].t) / 1e6, RINGBUF_OFFSET, drift_ppm);
+    describe(from, to);
+
+    wgk_host_virtual_time(true);
+    if (!ring_buf_init()) return 1;
+    if (sweep) {
+        for (k = 0; k < PHASE_STEPS; k++) run(from, to, (double)k / PHASE_STEPS, drift_ppm, verbose);
+    } else {
+        run(from, to, phase, drift_ppm, verbose);
+    }
+    return 0;
+}
@@ -0,0 +1,318 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * wrap point tests for the sequence numbers, see main/seqnum.h
+ *
+ * seqnum.h on its own, against 64 bit arithmetic: seq_diff() and seq_lt() for every
+ * distance up to half the sequence space from references around 0 and 2^31, and
+ * seq_unwrap() for all 65536 wire values from references around every point where the
+ * low 16 bits or the sign of our sequence numbers wrap.
+ *
+ * the ring buffer: streams in virtual time like in impair_sim.c, with losses, reordering,
+ * duplicates, an outage whose backlog arrives at once, and a sender restart. Each stream
+ * is played once with the sender counting from 1 and then for every first sequence number
+ * from WRAP_WINDOW before the 16 bit wrap to right after it, so that the wrap falls on
+ * every packet of the priming and of the first laps, and on the restart. The play out and
+ * all telemetry counters have to be the same every time. Our own sequence numbers start
+ * at RING_SEQ_ORIGIN, every run crosses their 32 bit wrap as well.
+ *
+ * ./wgk_seqcheck               PASS or FAIL, exit code 1 on FAIL
+ * ./wgk_seqcheck -v            every mismatch, and the reference runs
+ */
+
+#include <unistd.h>
+#include "wgk_host.h"
+#include "playout.h"
+
+#define REF_WINDOW              4096                    // references either side of a wrap point
+#define WRAP_WINDOW             (2 * NUM_RINGBUF_ELEMS) // first sequence numbers before the 16 bit wrap
+#define STREAM_PACKETS          2600                    // 5 s, past the 32 bit wrap at RING_SEQ_ORIGIN
+#define LOCAL_WRAP              (1 - RING_SEQ_ORIGIN)   // the packet that gets our sequence number 0
+#define CLOCK_PHASE             0.37                    // same as impair_sim.c
+#define BASE_US                 300.0
+#define MAX_ARRIVALS            (2 * STREAM_PACKETS)
+#define MAX_SHOWN               10
+
+typedef struct {
+    const char *name;
+    uint32_t lose_every;        // every n-th packet is lost
+    uint32_t burst_at, burst_len;
+    uint32_t swap_every;        // every n-th packet arrives after the next one
+    uint32_t dup_every;         // every n-th packet arrives twice
+    uint32_t outage_at, outage_len;     // these packets arrive together with the one after them
+    uint32_t restart_at, restart_down;  // the sender is down for restart_down packets and counts from the start again
+} stream_t;
+
+static const stream_t streams[] = {
+    { "clean" },
+    { "loss",       .lose_every = 37, .burst_at = LOCAL_WRAP - 10, .burst_len = 20 },
+    { "reorder",    .swap_every = 23 },
+    { "duplicate",  .dup_every = 19 },
+    { "backlog",    .outage_at = 700, .outage_len = 40 },
+    { "restart",    .restart_at = LOCAL_WRAP - 250, .restart_down = 500 },
+};
+#define NUM_STREAMS (sizeof(streams)/sizeof(stream_t))
+
+typedef struct {
+    double t;
+    uint32_t k;                 // the test signal, counts on across restarts
+    wire_seq_t seq;
+    uint16_t session;
+} arrival_t;
+
+typedef struct {
+    uint32_t played, silent, corrupt, dropout_events, longest_dropout;
+    uint32_t backwards;         // packets played that are not newer than the one before
+    uint64_t hash;              // FNV-1a over what every tick played
+    uint32_t counter[TC_NUM_COUNTERS];
+} result_t;
+
+static arrival_t arr[MAX_ARRIVALS];
+static uint32_t num_arr, num_lost;
+static int verbose, failures;
+
+
+/*
+ * seqnum.h
+ */
+
+static void fail(const char *what, uint64_t a, uint64_t b, int64_t got, int64_t want) {
+    if (failures++ < MAX_SHOWN || verbose) {
+        printf("%s(%llu, %llu) = %lld, not %lld\n", what, (unsigned long long)a, (unsigned long long)b,
+               (long long)got, (long long)want);
+    }
+}
+
+
+// every distance from -2^15 .. 2^15 (the wire's half space) and the extremes of the 32 bit one
+static void check_diff(uint64_t center) {
+    int64_t r, d;
+    seq_t ref, a;
+
+    for (r = -REF_WINDOW; r <= REF_WINDOW; r++) {
+        ref = (seq_t)(center + r);
+        for (d = -32768; d <= 32768; d++) {
+            a = ref + (seq_t)d;
+            if (seq_diff(a, ref) != d) fail("seq_diff", a, ref, seq_diff(a, ref), d);
+            if (seq_lt(a, ref) != (d < 0)) fail("seq_lt", a, ref, seq_lt(a, ref), d < 0);
+            if (seq_gt(a, ref) != (d > 0)) fail("seq_gt", a, ref, seq_gt(a, ref), d > 0);
+        }
+        for (d = INT32_MAX - 2; d <= (int64_t)INT32_MAX + 2; d++) {
+            a = ref + (seq_t)d;
+            if (seq_diff(a, ref) != (int32_t)(uint32_t)d) fail("seq_diff", a, ref, seq_diff(a, ref), (int32_t)(uint32_t)d);
+        }
+    }
+}
+
+
+// the closest x with the low 16 bits w, done the slow way. A tie goes back, like the int16_t cast
+static seq_t unwrap_ref(seq_t ref, wire_seq_t w) {
+    int64_t x = ((int64_t)ref & ~0xffffLL) | w;
+
+    while (x - (int64_t)ref >= 32768) x -= 65536;
+    while (x - (int64_t)ref < -32768) x += 65536;
+    return (seq_t)x;
+}
+
+
+static void check_unwrap(uint64_t center) {
+    int64_t r;
+    uint32_t w;
+    seq_t ref, want;
+
+    for (r = -REF_WINDOW; r <= REF_WINDOW; r++) {
+        ref = (seq_t)(center + r);
+        for (w = 0; w < 65536; w++) {
+            want = unwrap_ref(ref, (wire_seq_t)w);
+            if (seq_unwrap(ref, (wire_seq_t)w) != want) fail("seq_unwrap", ref, w, seq_unwrap(ref, (wire_seq_t)w), want);
+        }
+    }
+}
+
+
+/*
+ * the ring buffer
+ */
+
+static int by_time(const void *a, const void *b) {
+    const arrival_t *x = a, *y = b;
+
+    if (x->t != y->t) return x->t < y->t ? -1 : 1;
+    return x->k < y->k ? -1 : (x->k > y->k);
+}
+
+
+static void add(double t, uint32_t k, wire_seq_t seq, uint16_t session) {
+    arr[num_arr++] = (arrival_t){ t, k, seq, session };
+}
+
+
+static void make_stream(const stream_t *st, wire_seq_t first) {
+    uint32_t k;
+    uint16_t session = 1;
+    wire_seq_t seq = first;
+    double t;
+
+    num_arr = num_lost = 0;
+    for (k = 1; k <= STREAM_PACKETS; k++) {
+        if (st->restart_at && k == st->restart_at) {
+            session++;
+            seq = first;
+        }
+        if (st->restart_at && k >= st->restart_at && k < st->restart_at + st->restart_down) continue;
+        t = k * PACKET_TIME_US + BASE_US;
+        if ((st->lose_every && k % st->lose_every == 0) ||
+            (st->burst_len && k >= st->burst_at && k < st->burst_at + st->burst_len)) {
+            num_lost++;
+            seq++;
+            continue;
+        }
+        if (st->swap_every && k % st->swap_every == 0) t += PACKET_TIME_US + 1.0;
+        if (st->outage_len && k >= st->outage_at && k < st->outage_at + st->outage_len) {
+            t = (st->outage_at + st->outage_len) * PACKET_TIME_US + BASE_US - 1.0;
+        }
+        add(t, k, seq, session);
+        if (st->dup_every && k % st->dup_every == 0) add(t + 500.0, k, seq, session);
+        seq++;
+    }
+    qsort(arr, num_arr, sizeof(arrival_t), by_time);
+}
+
+
+static void run(const stream_t *st, wire_seq_t first, result_t *res) {
+    static udp_buf_t buf;
+    static uint8_t dmabuf[I2S_BUF_SIZE];
+    playout_t pl;
+    playout_state_t state = PLAYOUT_IDLE;
+    double next_tick = CLOCK_PHASE * PACKET_TIME_US;
+    uint32_t i = 0, seq, last = 0;
+
+    make_stream(st, first);
+    playout_reset(&pl, 1);
+    memset(res, 0, sizeof(result_t));
+    res->hash = 14695981039346656037ULL;
+    while (state != PLAYOUT_END) {
+        if (i < num_arr && arr[i].t < next_tick) {
+            wgk_host_set_time((uint32_t)arr[i].t);
+            wgk_fill_dma_buf(dmabuf, arr[i].k);
+            udp_pack(&buf, dmabuf);
+            buf.sequence_number = arr[i].seq;
+            buf.session = arr[i].session;
+            telem_inc(TC_RX_PACKETS);
+            ring_buf_put(&buf);
+            i++;
+        } else {
+            wgk_host_set_time((uint32_t)next_tick);
+            state = playout_tick(&pl, STREAM_PACKETS, &seq);
+            next_tick += PACKET_TIME_US;
+            res->hash = (res->hash ^ (state == PLAYOUT_PLAYED ? seq : 0)) * 1099511628211ULL;
+            if (state == PLAYOUT_PLAYED) {
+                if (seq <= last) res->backwards++;
+                last = seq;
+            }
+        }
+    }
+    playout_finish(&pl);
+    res->played = pl.played;
+    res->silent = pl.silent;
+    res->corrupt = pl.corrupt;
+    res->dropout_events = pl.dropout_events;
+    res->longest_dropout = pl.longest_dropout;
+    memcpy(res->counter, telem_counter, sizeof(res->counter));
+}
+
+
+static void print_result(const char *name, const result_t *r) {
+    printf("%-10s played %u silent %u corrupt %u backwards %u dropouts %u longest %u | gaps %u lost %u concealed %u "
+           "underruns %u resyncs %u fades %u/%u\n", name, r->played, r->silent, r->corrupt, r->backwards, r->dropout_events,
+           r->longest_dropout, r->counter[TC_RX_GAPS], r->counter[TC_RX_LOST], r->counter[TC_RX_CONCEALED],
+           r->counter[TC_RX_UNDERRUNS], r->counter[TC_RX_RESYNCS], r->counter[TC_RX_FADE_OUTS],
+           r->counter[TC_RX_FADE_INS]);
+}
+
+
+static void compare(const stream_t *st, wire_seq_t first, const result_t *ref, const result_t *r) {
+    int c;
+
+    if (memcmp(ref, r, sizeof(result_t)) == 0) return;
+    if (failures++ < MAX_SHOWN || verbose) {
+        printf("%s, first sequence number %u differs:\n", st->name, first);
+        print_result("  ref", ref);
+        print_result("  wrapped", r);
+        for (c = 0; c < TC_NUM_COUNTERS; c++) {
+            if (ref->counter[c] != r->counter[c]) printf("  %s %u, not %u\n", telem_counter_name[c], r->counter[c], ref->counter[c]);
+        }
+    }
+}
+
+
+static void check_ring(void) {
+    static result_t ref, res;
+    uint32_t s, f, runs = 0;
+
+    for (s = 0; s < NUM_STREAMS; s++) {
+        run(&streams[s], 1, &ref);
+        if (verbose) print_result(streams[s].name, &ref);
+        // the reference crosses our 32 bit wrap. What it has to come up with is known, but
+        // for the losses counted when reordered packets skip ahead. Nothing outpaces the
+        // play out here, so nothing is concealed and the audio never goes back
+        if (ref.corrupt != 0 || ref.backwards != 0 || ref.counter[TC_RX_CONCEALED] != 0 ||
+            (!streams[s].swap_every && ref.counter[TC_RX_LOST] != num_lost) ||
+            ref.counter[TC_RX_RESYNCS] != (streams[s].restart_at ? 1 : 0) || (s == 0 && ref.silent != 0)) {
+            failures++;
+            printf("%s: the reference run itself is wrong\n", streams[s].name);
+            print_result(streams[s].name, &ref);
+        }
+        for (f = 65536 - WRAP_WINDOW; f <= 65536 + 2; f++, runs++) {
+            run(&streams[s], (wire_seq_t)f, &res);
+            compare(&streams[s], (wire_seq_t)f, &ref, &res);
+        }
+    }
+    printf("ring buffer: %u streams, %u runs\n", (unsigned)NUM_STREAMS, runs);
+}
+
+
+int main(int argc, char **argv) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "vh")) != -1) {
+        switch (opt) {
+            case 'v': verbose = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    check_diff(0);
+    check_diff(1ULL << 31);
+    check_unwrap(0);
+    check_unwrap(1ULL << 16);
+    check_unwrap(1ULL << 31);
+    check_unwrap((1ULL << 31) + (1ULL << 15));
+    printf("seqnum.h: %d failures\n", failures);
+
+    wgk_host_virtual_time(true);
+    if (!ring_buf_init()) return 1;
+    check_ring();
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
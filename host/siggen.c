@@ -0,0 +1,236 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * signal generator for the host sender and the quality benchmark
+ *
+ * pluck     each string is plucked every PLUCK_INTERVAL s, staggered so that they overlap:
+ *           12 harmonics with 1/n^1.2 amplitudes and random but fixed phases, decaying with
+ *           e^-3t, as in tools/fft6.py. Standard tuning, slot 6 is the mix of all strings.
+ * sweep     exponential sine sweep SWEEP_F1 .. SWEEP_F2 in SWEEP_SECONDS on slots 0..6
+ * impulse   one full level sample every IMPULSE_INTERVAL frames on slots 0..6. The interval
+ *           is prime to NFRAMES, so the impulses walk through every position in a packet,
+ *           the packet boundaries included.
+ * wav:file  16, 24 or 32 bit PCM, channel n to slot n, played at SAMPLE_RATE whatever the
+ *           file says
+ * test      the position test signal of port.c, for wgk_check_dma_buf() at the receiving end
+ *
+ * slot 7 is GKVOL and carries a constant, like the volume pot of a GK pickup at rest.
+ */
+
+#include <math.h>
+#include "wgk_host.h"
+#include "siggen.h"
+
+#define FULL_SCALE              2147483392.0            // the largest 24 bit sample, MSB aligned
+#define PLUCK_INTERVAL          2.0                     // s
+#define PLUCK_STAGGER           0.27                    // s between the strings
+#define PLUCK_DECAY             3.0                     // 1/s
+#define SWEEP_F1                20.0
+#define SWEEP_F2                (0.45 * SAMPLE_RATE)
+#define SWEEP_SECONDS           5.0
+#define IMPULSE_INTERVAL        15631                   // frames, ~0.5 s, prime to NFRAMES
+#define GKVOL_LEVEL             0.5
+
+static const double string_f0[SIGGEN_STRINGS] = { 82.41, 110.0, 146.83, 196.0, 246.94, 329.63 };
+
+
+static int32_t sample(double v) {
+    if (v > 1.0) v = 1.0;
+    if (v < -1.0) v = -1.0;
+    return (int32_t)lrint(v * FULL_SCALE) & ~0xff;
+}
+
+
+static int wav_open(siggen_t *g, const char *name) {
+    uint8_t h[40];
+    char id[5] = { 0 };
+    uint32_t size, rate = 0;
+    uint16_t format = 0, bits = 0;
+
+    g->wav = fopen(name, "rb");
+    if (g->wav == NULL) {
+        perror(name);
+        return -1;
+    }
+    if (fread(h, 12, 1, g->wav) != 1 || memcmp(h, "RIFF", 4) != 0 || memcmp(h + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "%s: not a WAV file\n", name);
+        return -1;
+    }
+    // walk the chunks up to "data", "fmt " has to come first
+    while (fread(h, 8, 1, g->wav) == 1) {
+        memcpy(id, h, 4);
+        size = h[4] | h[5] << 8 | h[6] << 16 | (uint32_t)h[7] << 24;
+        if (strcmp(id, "fmt ") == 0 && size >= 16) {
+            if (fread(h, size < sizeof(h) ? size : sizeof(h), 1, g->wav) != 1) break;
+            format = h[0] | h[1] << 8;
+            if (format == 0xfffe && size >= 26) format = h[24] | h[25] << 8;        // the sub format
+            g->wav_channels = h[2] | h[3] << 8;
+            rate = h[4] | h[5] << 8 | h[6] << 16 | (uint32_t)h[7] << 24;
+            bits = h[14] | h[15] << 8;
+            if (size > sizeof(h)) fseek(g->wav, size - sizeof(h), SEEK_CUR);
+        } else if (strcmp(id, "data") == 0) {
+            if (format != 1 || (bits != 16 && bits != 24 && bits != 32) || g->wav_channels < 1) {
+                fprintf(stderr, "%s: only 16, 24 or 32 bit PCM\n", name);
+                return -1;
+            }
+            g->wav_bytes = bits / 8;
+            g->wav_data = ftell(g->wav);
+            g->wav_frames = size / (g->wav_bytes * g->wav_channels);
+            if (rate != SAMPLE_RATE) {
+                fprintf(stderr, "%s: %u Hz, playing it at %d Hz\n", name, rate, SAMPLE_RATE);
+            }
+            if (g->wav_channels > NUM_SLOTS_I2S) {
+                fprintf(stderr, "%s: %d channels, sending the first %d\n", name, g->wav_channels, NUM_SLOTS_I2S);
+            }
+            return 0;
+        } else {
+            fseek(g->wav, size + (size & 1), SEEK_CUR);
+        }
+    }
+    fprintf(stderr, "%s: no PCM data\n", name);
+    return -1;
+}
+
+
+static bool wav_fill(siggen_t *g, i2s_buf_t *buf) {
+    static uint8_t b[NFRAMES * 8 * 4 * 4];                     // up to 32 channels
+    uint64_t left;
+    uint8_t *p;
+    int i, j, k, n = 0, want, frame_size = g->wav_channels * g->wav_bytes;
+    int32_t v;
+
+    memset(buf, 0, sizeof(*buf));
+    while (n < NFRAMES) {
+        left = g->wav_frames - g->pos;
+        if (left == 0) {
+            if (!g->loop || g->wav_frames == 0) return n > 0;
+            g->pos = 0;
+            fseek(g->wav, g->wav_data, SEEK_SET);
+            continue;
+        }
+        want = NFRAMES - n < left ? NFRAMES - n : (int)left;
+        if (want * frame_size > (int)sizeof(b)) want = sizeof(b) / frame_size;
+        if (fread(b, frame_size, want, g->wav) != (size_t)want) {
+            g->wav_frames = g->pos;                             // truncated file, ends here
+            continue;
+        }
+        for (i = 0, p = b; i < want; i++, n++, p += frame_size) {
+            for (j = 0; j < g->wav_channels && j < NUM_SLOTS_I2S; j++) {
+                v = 0;
+                for (k = 0; k < g->wav_bytes; k++) {            // little endian, into the top bytes
+                    v |= (int32_t)((uint32_t)p[j * g->wav_bytes + k] << (8 * (4 - g->wav_bytes + k)));
+                }
+                buf->frame[n].slot[j] = v & ~0xff;
+            }
+        }
+        g->pos += want;
+    }
+    return true;
+}
+
+
+static double pluck(const siggen_t *g, int s, double t) {
+    double tp = t - s * PLUCK_STAGGER, v = 0.0, norm = 0.0, a;
+    int n;
+
+    if (tp < 0.0) return 0.0;
+    tp = fmod(tp, PLUCK_INTERVAL);
+    for (n = 1; n <= SIGGEN_HARMONICS && n * string_f0[s] < SAMPLE_RATE / 2; n++) {
+        a = pow(n, -1.2);
+        v += a * sin(2 * M_PI * n * string_f0[s] * tp + g->phase[s][n - 1]);
+        norm += a;
+    }
+    return v / norm * exp(-PLUCK_DECAY * tp);
+}
+
+
+int siggen_open(siggen_t *g, const char *spec, double level_db, bool loop) {
+    int s, n;
+
+    memset(g, 0, sizeof(*g));
+    g->level = pow(10.0, level_db / 20.0);
+    g->loop = loop;
+    srand(1);                                                   // the same plucks every run
+    for (s = 0; s < SIGGEN_STRINGS; s++) {
+        for (n = 0; n < SIGGEN_HARMONICS; n++) g->phase[s][n] = M_PI * rand() / RAND_MAX;
+    }
+    if (strcmp(spec, "test") == 0) g->kind = SIG_TEST;
+    else if (strcmp(spec, "pluck") == 0) g->kind = SIG_PLUCK;
+    else if (strcmp(spec, "sweep") == 0) g->kind = SIG_SWEEP;
+    else if (strcmp(spec, "impulse") == 0) g->kind = SIG_IMPULSE;
+    else if (strncmp(spec, "wav:", 4) == 0) {
+        g->kind = SIG_WAV;
+        return wav_open(g, spec + 4);
+    } else {
+        fprintf(stderr, "unknown signal %s\n", spec);
+        return -1;
+    }
+    return 0;
+}
+
+
+void siggen_close(siggen_t *g) {
+    if (g->wav) fclose(g->wav);
+    g->wav = NULL;
+}
+
+
+bool siggen_fill(siggen_t *g, i2s_buf_t *buf, uint32_t seq) {
+    double t, v, mix, k = log(SWEEP_F2 / SWEEP_F1);
+    int i, j;
+
+    if (g->kind == SIG_TEST) {
+        wgk_fill_dma_buf((uint8_t *)buf, seq);
+        return true;
+    }
+    if (g->kind == SIG_WAV) return wav_fill(g, buf);
+
+    for (i = 0; i < NFRAMES; i++, g->pos++) {
+        t = (double)g->pos / SAMPLE_RATE;
+        for (j = 0; j < NUM_SLOTS_I2S; j++) buf->frame[i].slot[j] = 0;
+        switch (g->kind) {
+            case SIG_PLUCK:
+                mix = 0.0;
+                for (j = 0; j < SIGGEN_STRINGS; j++) {
+                    v = pluck(g, j, t);
+                    mix += v;
+                    if (j < NUM_SLOTS_I2S) buf->frame[i].slot[j] = sample(g->level * v);
+                }
+                if (SIGGEN_SLOT_MIX < NUM_SLOTS_I2S) {
+                    buf->frame[i].slot[SIGGEN_SLOT_MIX] = sample(g->level * mix / SIGGEN_STRINGS);
+                }
+                break;
+            case SIG_SWEEP:
+                t = fmod(t, SWEEP_SECONDS);
+                v = sin(2 * M_PI * SWEEP_F1 * SWEEP_SECONDS / k * (exp(t / SWEEP_SECONDS * k) - 1.0));
+                for (j = 0; j <= SIGGEN_SLOT_MIX && j < NUM_SLOTS_I2S; j++) buf->frame[i].slot[j] = sample(g->level * v);
+                break;
+            case SIG_IMPULSE:
+                if (g->pos % IMPULSE_INTERVAL == 0) {
+                    for (j = 0; j <= SIGGEN_SLOT_MIX && j < NUM_SLOTS_I2S; j++) buf->frame[i].slot[j] = sample(g->level);
+                }
+                break;
+            default:
+                break;
+        }
+        if (SIGGEN_SLOT_GKVOL < NUM_SLOTS_I2S) buf->frame[i].slot[SIGGEN_SLOT_GKVOL] = sample(GKVOL_LEVEL);
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// synthetic and file based 8-channel GK signals for the host tools, see siggen.c
+
+#ifndef _SIGGEN_H
+#define _SIGGEN_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "wgk_core.h"
+
+#define SIGGEN_STRINGS          6                       // slots 0..5, slot 6 the normal pickup, slot 7 GKVOL
+#define SIGGEN_SLOT_MIX         6
+#define SIGGEN_SLOT_GKVOL       7
+#define SIGGEN_HARMONICS        12
+
+typedef enum {
+    SIG_TEST = 0,               // wgk_fill_dma_buf(), every sample carries its position
+    SIG_PLUCK,                  // decaying harmonic plucks per string, like tools/fft6.py
+    SIG_SWEEP,                  // exponential sine sweep
+    SIG_IMPULSE,                // single sample impulses at a drifting position in the packet
+    SIG_WAV,                    // a WAV file, channel n to slot n
+} sig_kind_t;
+
+typedef struct {
+    sig_kind_t kind;
+    double level;               // peak, 0 .. 1 of full scale
+    bool loop;                  // SIG_WAV: start over at the end
+    uint64_t pos;               // frames generated so far
+    FILE *wav;                  // SIG_WAV, read a packet at a time
+    long wav_data;              // file offset of the samples
+    uint64_t wav_frames;
+    int wav_channels;
+    int wav_bytes;              // per sample, 2, 3 or 4
+    double phase[SIGGEN_STRINGS][SIGGEN_HARMONICS];
+} siggen_t;
+
+// "test", "pluck", "sweep", "impulse" or "wav:file". level_db is the peak in dBFS.
+int siggen_open(siggen_t *g, const char *spec, double level_db, bool loop);
+void siggen_close(siggen_t *g);
+
+// the next packet. Returns false when a WAV file without loop has ended, the rest is silence.
+bool siggen_fill(siggen_t *g, i2s_buf_t *buf, uint32_t seq);
+
+#endif /* _SIGGEN_H */
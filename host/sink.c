@@ -0,0 +1,297 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * audio sinks of the PC receiver. Every sink gets the ring buffer's output as it is, one
+ * packet of NFRAMES frames with NUM_SLOTS_I2S interleaved int32 samples, the 24 bit audio
+ * in the upper three bytes like on the I2S bus.
+ *
+ * wav:file       24 bit WAVE_FORMAT_EXTENSIBLE, the sizes are fixed up on close
+ * raw:file|-     S32_LE interleaved, e.g. | aplay -t raw -f S32_LE -c 8 -r 31250
+ * fifo:path      same format into a named pipe, created if needed. Nothing is written while
+ *                no reader is connected, and a reader that cannot keep up loses packets
+ *                instead of stalling the receiver, so it can come and go during a gig.
+ * null           discards everything, for measurements
+ * alsa:device    a PCM playback device, only when built with ALSA. The sound card clocks
+ *                the ring buffer instead of CLOCK_MONOTONIC.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef WGK_HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+#include "sink.h"
+
+#define WAV_HDR_SIZE            68
+#define WAV_BYTES               3                       // per sample
+
+static FILE *out;
+static int fifo_fd = -1;
+static const char *fifo_path;
+static uint64_t wav_data;                               // bytes
+static sink_t sink_fifo;
+#ifdef WGK_HAVE_ALSA
+static sink_t sink_alsa;
+#endif
+
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+
+static void wav_header(uint8_t *h, uint32_t data_size) {
+    // KSDATAFORMAT_SUBTYPE_PCM, the tail of the GUID after the format tag
+    static const uint8_t pcm_guid[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00,
+                                          0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 };
+
+    memcpy(h, "RIFF", 4);
+    put32(h + 4, WAV_HDR_SIZE - 8 + data_size);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put32(h + 16, 40);
+    put16(h + 20, 0xfffe);                              // WAVE_FORMAT_EXTENSIBLE, needed for > 2 channels
+    put16(h + 22, NUM_SLOTS_I2S);
+    put32(h + 24, SAMPLE_RATE);
+    put32(h + 28, SAMPLE_RATE * NUM_SLOTS_I2S * WAV_BYTES);
+    put16(h + 32, NUM_SLOTS_I2S * WAV_BYTES);
+    put16(h + 34, WAV_BYTES * 8);
+    put16(h + 36, 22);
+    put16(h + 38, WAV_BYTES * 8);                       // valid bits
+    put32(h + 40, 0);                                   // no speaker positions, these are strings
+    put16(h + 44, 1);                                   // PCM
+    memcpy(h + 46, pcm_guid, sizeof(pcm_guid));
+    memcpy(h + 60, "data", 4);
+    put32(h + 64, data_size);
+}
+
+
+static int wav_open(const char *arg) {
+    uint8_t h[WAV_HDR_SIZE];
+
+    out = fopen(arg, "wb");
+    if (out == NULL) {
+        perror(arg);
+        return -1;
+    }
+    wav_data = 0;
+    wav_header(h, 0);
+    return fwrite(h, sizeof(h), 1, out) == 1 ? 0 : -1;
+}
+
+
+static int wav_write(const i2s_buf_t *buf) {
+    uint8_t b[NFRAMES * NUM_SLOTS_I2S * WAV_BYTES], *p = b;
+    int i, j;
+
+    for (i = 0; i < NFRAMES; i++) {
+        for (j = 0; j < NUM_SLOTS_I2S; j++) {
+            put16(p, (uint32_t)buf->frame[i].slot[j] >> 8);
+            p[2] = (uint32_t)buf->frame[i].slot[j] >> 24;
+            p += WAV_BYTES;
+        }
+    }
+    wav_data += sizeof(b);
+    return fwrite(b, sizeof(b), 1, out) == 1 ? 0 : -1;
+}
+
+
+// RIFF sizes are 32 bit, longer recordings keep the maximum, which most readers handle
+static void wav_close(void) {
+    uint8_t h[WAV_HDR_SIZE];
+
+    wav_header(h, wav_data > UINT32_MAX - WAV_HDR_SIZE ? UINT32_MAX - WAV_HDR_SIZE : (uint32_t)wav_data);
+    if (fseek(out, 0, SEEK_SET) == 0) fwrite(h, sizeof(h), 1, out);
+    fclose(out);
+}
+
+
+static int raw_open(const char *arg) {
+    out = (arg[0] == '\0' || strcmp(arg, "-") == 0) ? stdout : fopen(arg, "wb");
+    if (out == NULL) {
+        perror(arg);
+        return -1;
+    }
+    return 0;
+}
+
+
+static int raw_write(const i2s_buf_t *buf) {
+    return fwrite(buf, sizeof(*buf), 1, out) == 1 ? 0 : -1;
+}
+
+
+static void raw_close(void) {
+    if (out != stdout) fclose(out);
+    else fflush(out);
+}
+
+
+static int fifo_open(const char *arg) {
+    struct stat st;
+
+    if (arg[0] == '\0') {
+        fprintf(stderr, "fifo: no path\n");
+        return -1;
+    }
+    if (stat(arg, &st) < 0 && mkfifo(arg, 0644) < 0) {
+        perror(arg);
+        return -1;
+    }
+    if (stat(arg, &st) < 0 || !S_ISFIFO(st.st_mode)) {
+        fprintf(stderr, "%s: not a FIFO\n", arg);
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);                           // a reader going away is EPIPE, not fatal
+    fifo_path = arg;
+    return 0;
+}
+
+
+// a packet is less than PIPE_BUF, so a non blocking write takes all of it or nothing
+static int fifo_write(const i2s_buf_t *buf) {
+    if (fifo_fd < 0) {
+        fifo_fd = open(fifo_path, O_WRONLY | O_NONBLOCK);
+        if (fifo_fd < 0) return 0;                      // ENXIO, no reader yet
+    }
+    if (write(fifo_fd, buf, sizeof(*buf)) < 0) {
+        if (errno == EAGAIN) {
+            sink_fifo.overflows++;
+        } else {
+            close(fifo_fd);
+            fifo_fd = -1;
+        }
+    }
+    return 0;
+}
+
+
+static void fifo_close(void) {
+    if (fifo_fd >= 0) close(fifo_fd);
+    fifo_fd = -1;
+}
+
+
+static int null_open(const char *arg) {
+    return 0;
+}
+
+
+static int null_write(const i2s_buf_t *buf) {
+    return 0;
+}
+
+
+static void null_close(void) {
+}
+
+
+#ifdef WGK_HAVE_ALSA
+static snd_pcm_t *pcm;
+
+static int alsa_open(const char *arg) {
+    int err;
+
+    err = snd_pcm_open(&pcm, arg[0] ? arg : "default", SND_PCM_STREAM_PLAYBACK, 0);
+    if (err < 0) {
+        fprintf(stderr, "alsa: %s\n", snd_strerror(err));
+        return -1;
+    }
+    // as little buffering as the device's two DMA buffers, plug resamples if the card needs it
+    err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S32_LE, SND_PCM_ACCESS_RW_INTERLEAVED, NUM_SLOTS_I2S,
+                             SAMPLE_RATE, 1, NUM_TX_DMA_BUFS * PACKET_TIME_US);
+    if (err < 0) {
+        fprintf(stderr, "alsa: %s\n", snd_strerror(err));
+        snd_pcm_close(pcm);
+        return -1;
+    }
+    return 0;
+}
+
+
+static int alsa_write(const i2s_buf_t *buf) {
+    snd_pcm_sframes_t n;
+    int done = 0;
+
+    while (done < NFRAMES) {
+        n = snd_pcm_writei(pcm, &buf->frame[done], NFRAMES - done);
+        if (n < 0) {
+            sink_alsa.overflows++;                      // an xrun
+            if (snd_pcm_recover(pcm, (int)n, 1) < 0) return -1;
+            continue;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+
+static void alsa_close(void) {
+    snd_pcm_drain(pcm);
+    snd_pcm_close(pcm);
+}
+
+static sink_t sink_alsa = { "alsa", true, alsa_open, alsa_write, alsa_close, 0 };
+#endif
+
+static sink_t sink_wav = { "wav", false, wav_open, wav_write, wav_close, 0 };
+static sink_t sink_raw = { "raw", false, raw_open, raw_write, raw_close, 0 };
+static sink_t sink_fifo = { "fifo", false, fifo_open, fifo_write, fifo_close, 0 };
+static sink_t sink_null = { "null", false, null_open, null_write, null_close, 0 };
+
+static sink_t *sinks[] = {
+    &sink_wav, &sink_raw, &sink_fifo, &sink_null,
+#ifdef WGK_HAVE_ALSA
+    &sink_alsa,
+#endif
+};
+
+
+sink_t *sink_open(const char *spec) {
+    const char *colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    size_t i;
+
+    for (i = 0; i < sizeof(sinks) / sizeof(sinks[0]); i++) {
+        if (strlen(sinks[i]->name) == len && strncmp(spec, sinks[i]->name, len) == 0) {
+            return sinks[i]->open(colon ? colon + 1 : "") < 0 ? NULL : sinks[i];
+        }
+    }
+    fprintf(stderr, "unknown sink %.*s\n", (int)len, spec);
+    return NULL;
+}
+
+
+void sink_list(FILE *f) {
+    size_t i;
+
+    for (i = 0; i < sizeof(sinks) / sizeof(sinks[0]); i++) {
+        fprintf(f, "%s%s", i ? ", " : "", sinks[i]->name);
+    }
+}
@@ -0,0 +1,42 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// audio sinks of the PC receiver, see pc_receiver.c
+
+#ifndef _SINK_H
+#define _SINK_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "wgk_core.h"
+
+typedef struct {
+    const char *name;
+    bool paced;                                         // write() blocks at the audio rate, the sink is the clock
+    int (*open)(const char *arg);                       // arg is what follows "name:" in -o, may be empty
+    int (*write)(const i2s_buf_t *buf);                 // one packet, NFRAMES frames. < 0 on a fatal error
+    void (*close)(void);
+    uint32_t overflows;                                 // packets the sink could not take and dropped
+} sink_t;
+
+// "wav:out.wav", "raw:-", "fifo:/tmp/wgk", "null", "alsa:default" when built with ALSA
+sink_t *sink_open(const char *spec);
+void sink_list(FILE *f);
+
+#endif /* _SINK_H */
@@ -0,0 +1,48 @@
+/* 
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de> 
+
+    This file is part of Wireless-GK.
+    
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// host port of the pipeline core, see port.c
+
+#ifndef _WGK_HOST_H
+#define _WGK_HOST_H
+
+#include <stdint.h>
+#include "wgk_core.h"
+
+#define HOST_PORT               45688                   // loopback harness, away from the firmware ports
+
+// get_time_us_in_isr() follows CLOCK_MONOTONIC unless a harness switches to virtual time
+// and advances the clock itself, which lets simulations run faster than real time
+void wgk_host_virtual_time(bool on);
+void wgk_host_set_time(uint32_t us);
+uint64_t wgk_host_ns(void);                             // CLOCK_MONOTONIC in ns, for benchmarks
+
+// test signal: every 24 bit sample carries its position in the stream, so the
+// receiving end can tell exactly which packet, frame and slot it got. The position
+// wraps after WGK_TEST_PERIOD packets, always at a packet boundary.
+#define WGK_TEST_PERIOD         ((1 << 24) / (NFRAMES * NUM_SLOTS_I2S))
+
+static inline int32_t wgk_test_sample(uint32_t seq, int frame, int slot) {
+    return (int32_t)((((seq % WGK_TEST_PERIOD) * NFRAMES + frame) * NUM_SLOTS_I2S + slot) << 8);
+}
+
+void wgk_fill_dma_buf(uint8_t *dmabuf, uint32_t seq);
+int wgk_check_dma_buf(const uint8_t *dmabuf, uint32_t *seq);
+
+#endif /* _WGK_HOST_H */
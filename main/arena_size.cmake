@@ -0,0 +1,22 @@
+# build-time footprint of the static arenas, see wgk_arena.h. Run after the link:
+#
+# cmake -DNM=<nm> -DELF=<executable> -P arena_size.cmake
+
+execute_process(COMMAND ${NM} -S --defined-only ${ELF}
+                OUTPUT_VARIABLE symbols RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(WARNING "arena_size: ${NM} failed on ${ELF}")
+    return()
+endif()
+
+foreach(arena wgk_arena wgk_ext_arena)
+    if(symbols MATCHES "[0-9a-fA-F]+ ([0-9a-fA-F]+) [bBdD] ${arena}\n")
+        math(EXPR size "0x${CMAKE_MATCH_1}")
+        math(EXPR kb "(${size} + 1023) / 1024")
+        set(${arena}_size "${size} byte (${kb} KB)")
+    else()
+        set(${arena}_size "not linked")
+    endif()
+endforeach()
+get_filename_component(name ${ELF} NAME)
+message("${name}: static arenas, internal RAM ${wgk_arena_size}, PSRAM ${wgk_ext_arena_size}")
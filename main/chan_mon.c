@@ -0,0 +1,177 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// link quality monitor and channel migration state machine, see chan_mon.h
+
+#include <string.h>
+#include "chan_mon.h"
+
+#define CHAN_SCAN_TIMEOUT_TICKS 20                      // the platform did not answer, give up
+
+const uint8_t chan_candidates[CHAN_NUM_CANDIDATES] = { 36, 40, 44, 48, 149, 153, 157, 161, 165 };
+
+static const char *state_name[] = { "monitor", "scan", "announce", "settle" };
+
+
+const char *chan_state_name(chan_state_t state) {
+    return state <= CHAN_SETTLE ? state_name[state] : "?";
+}
+
+
+static void enter(chan_mon_t *cm, chan_state_t state) {
+    cm->state = state;
+    cm->state_ticks = 0;
+}
+
+
+void chan_mon_init(chan_mon_t *cm, uint8_t channel) {
+    memset(cm, 0, sizeof(*cm));
+    cm->channel = channel;
+    cm->rating = 100 << CHAN_EWMA_SHIFT;
+    enter(cm, CHAN_MONITOR);
+}
+
+
+// loss, failed sends, a weak signal and jitter eating into the ring lead all cost points
+int32_t chan_rate(const link_sample_t *s, uint32_t ring_lead_us) {
+    int32_t pen = 0;
+    uint32_t lost, jitter;
+
+    if (s->expected == 0) return 100;
+    lost = s->received < s->expected ? s->expected - s->received : 0;
+    pen += (int32_t)((uint64_t)lost * CHAN_LOSS_PENALTY / s->expected);
+    pen += (int32_t)((uint64_t)s->tx_failed * CHAN_RETRY_PENALTY / s->expected);
+    if (s->rssi != 0 && s->rssi < CHAN_RSSI_FLOOR) pen += (CHAN_RSSI_FLOOR - s->rssi) * CHAN_RSSI_PENALTY;
+    if (ring_lead_us > 0) {
+        jitter = s->jitter_p99_us < 2 * ring_lead_us ? s->jitter_p99_us : 2 * ring_lead_us;
+        pen += (int32_t)(CHAN_JITTER_PENALTY * jitter / ring_lead_us);
+    }
+    return pen >= 100 ? 0 : 100 - pen;
+}
+
+
+// a scan only sees the other networks, not how our link would do there. An empty channel
+// gets a perfect score, which chan_rate() has to beat by CHAN_MIN_GAIN.
+int32_t chan_scan_rating(uint8_t channel, const scan_ap_t *ap, int n_ap) {
+    int32_t score = chan_score(channel, ap, n_ap, -1);
+
+    return score < 0 ? 0 : score > 100 ? 100 : score;
+}
+
+
+chan_action_t chan_mon_tick(chan_mon_t *cm, const link_sample_t *s, uint32_t ring_lead_us) {
+    // expected == 0: no stream, nothing to rate
+    if (s->expected > 0) {
+        cm->rating += chan_rate(s, ring_lead_us) - (cm->rating >> CHAN_EWMA_SHIFT);
+    }
+    cm->state_ticks++;
+    if (cm->cooldown > 0) cm->cooldown--;
+
+    switch (cm->state) {
+        case CHAN_MONITOR:
+            if (s->expected > 0 && chan_mon_rating(cm) < CHAN_DEGRADED) cm->bad_ticks++;
+            else cm->bad_ticks = 0;
+            if (cm->bad_ticks >= CHAN_DEGRADED_TICKS && cm->cooldown == 0) {
+                enter(cm, CHAN_SCAN);
+                return CHAN_ACT_SCAN;
+            }
+            break;
+
+        case CHAN_SCAN:
+            if (cm->state_ticks >= CHAN_SCAN_TIMEOUT_TICKS) {
+                cm->aborted++;
+                cm->cooldown = CHAN_COOLDOWN_TICKS;
+                cm->bad_ticks = 0;
+                enter(cm, CHAN_MONITOR);
+            }
+            break;
+
+        case CHAN_ANNOUNCE:
+            // one more announcement after the ack, it may have crossed a lost one
+            if (cm->acked || cm->state_ticks > CHAN_ANNOUNCE_TICKS) {
+                cm->channel = cm->target;
+                cm->moves++;
+                enter(cm, CHAN_SETTLE);
+                return CHAN_ACT_SWITCH;
+            }
+            return CHAN_ACT_ANNOUNCE;
+
+        case CHAN_SETTLE:
+            // the stream is back once packets arrive again. Until then it is an outage,
+            // which the ring buffer covers with concealment and then silence.
+            if (s->received == 0) cm->outage_ticks++;
+            if (cm->state_ticks >= CHAN_SETTLE_TICKS && s->received > 0) {
+                cm->rating = 100 << CHAN_EWMA_SHIFT;        // a new channel, a new rating
+                cm->bad_ticks = 0;
+                cm->cooldown = CHAN_COOLDOWN_TICKS;
+                enter(cm, CHAN_MONITOR);
+            }
+            break;
+    }
+    return CHAN_ACT_NONE;
+}
+
+
+void chan_mon_scan_done(chan_mon_t *cm, uint8_t best, int32_t best_rating) {
+    if (cm->state != CHAN_SCAN) return;
+    if (best == 0 || best == cm->channel || best_rating < chan_mon_rating(cm) + CHAN_MIN_GAIN) {
+        // nowhere better to go, try again later
+        cm->aborted++;
+        cm->cooldown = CHAN_COOLDOWN_TICKS;
+        cm->bad_ticks = 0;
+        enter(cm, CHAN_MONITOR);
+        return;
+    }
+    cm->target = best;
+    cm->epoch++;
+    cm->acked = false;
+    enter(cm, CHAN_ANNOUNCE);
+}
+
+
+void chan_mon_ack(chan_mon_t *cm, const chan_msg_t *msg) {
+    if (msg->magic == CHAN_MSG_MAGIC && msg->type == CHAN_MSG_ACK && cm->state == CHAN_ANNOUNCE
+        && msg->epoch == cm->epoch && msg->channel == cm->target) {
+        cm->acked = true;
+    }
+}
+
+
+void chan_mon_announce(const chan_mon_t *cm, chan_msg_t *msg) {
+    memset(msg, 0, sizeof(*msg));
+    msg->magic = CHAN_MSG_MAGIC;
+    msg->type = CHAN_MSG_ANNOUNCE;
+    msg->channel = cm->target;
+    msg->countdown = cm->state_ticks < CHAN_ANNOUNCE_TICKS ? CHAN_ANNOUNCE_TICKS - cm->state_ticks : 0;
+    msg->epoch = cm->epoch;
+}
+
+
+// every announcement is acked, the ack of an earlier one may have been lost. A different
+// epoch is a new move: the receiver may have rebooted and started counting from 1 again.
+bool chan_follow(uint16_t *last_epoch, const chan_msg_t *msg, chan_msg_t *ack) {
+    if (msg->magic != CHAN_MSG_MAGIC || msg->type != CHAN_MSG_ANNOUNCE) return false;
+    *last_epoch = msg->epoch;
+    memset(ack, 0, sizeof(*ack));
+    ack->magic = CHAN_MSG_MAGIC;
+    ack->type = CHAN_MSG_ACK;
+    ack->channel = msg->channel;
+    ack->epoch = msg->epoch;
+    return true;
+}
@@ -0,0 +1,143 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// link quality monitor and channel migration. The receiver is the AP, so it decides: it
+// rates the link every CHAN_MON_INTERVAL ms, and when the rating stays bad it scans for a
+// better channel, announces the move in-band on CHAN_PORT and switches the AP. The sender
+// follows the announcement. No ESP-IDF dependencies, host/chan_sim.c runs the very same
+// state machine against simulated channels.
+
+#ifndef _CHAN_MON_H
+#define _CHAN_MON_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "chan_score.h"
+
+#define CHAN_MSG_MAGIC          0x57474b4d              // "WGKM"
+#define CHAN_MON_INTERVAL       250                     // ms between two ratings
+#define CHAN_EWMA_SHIFT         2                       // the rating is averaged with weight 1/4
+#define CHAN_DEGRADED           60                      // a rating below this is bad, 0 .. 100
+#define CHAN_DEGRADED_TICKS     8                       // for this many intervals in a row before we move
+#define CHAN_MIN_GAIN           15                      // a candidate has to be rated this much better
+#define CHAN_ANNOUNCE_TICKS     4                       // announcements before the switch, the sender acks
+#define CHAN_SETTLE_TICKS       8                       // after the switch, until audio has to flow again
+#define CHAN_COOLDOWN_TICKS     120                     // 30 s before the next move, against flapping
+#define CHAN_CSA_COUNT          1                       // beacons the AP announces the switch in, see chan_mon_task()
+#define CHAN_SCAN_DWELL         20                      // ms off channel per candidate, one candidate per interval
+
+// the rating. Every term costs points, see chan_rate()
+#define CHAN_LOSS_PENALTY       2000                    // per unit of loss rate: 5 % loss is 100 points
+#define CHAN_RETRY_PENALTY      1000                    // per failed send per packet sent by the sender
+#define CHAN_RSSI_FLOOR         (-70)                   // dBm, below this every dB costs
+#define CHAN_RSSI_PENALTY       3                       // points per dB
+#define CHAN_JITTER_PENALTY     40                      // points when the p99 jitter eats the whole ring lead
+
+// 5 GHz channels we may move to. No DFS channels: the AP cannot do radar detection, and
+// a radar hit would throw us off the channel for 30 minutes in the middle of a gig.
+#define CHAN_NUM_CANDIDATES     9
+extern const uint8_t chan_candidates[CHAN_NUM_CANDIDATES];
+
+// what the monitor looks at once per interval
+typedef struct {
+    uint32_t expected;          // packets the sender sent in the interval
+    uint32_t received;          // packets that arrived
+    uint32_t tx_failed;         // sends that failed on the sender, the retry limit or ENOMEM
+    int32_t rssi;               // dBm of the other side, 0 if unknown
+    uint32_t jitter_p99_us;     // deviation of the inter-arrival time
+} link_sample_t;
+
+typedef enum {
+    CHAN_MONITOR = 0,           // rating the current channel
+    CHAN_SCAN,                  // degraded, waiting for chan_mon_scan_done()
+    CHAN_ANNOUNCE,              // telling the sender where we go
+    CHAN_SETTLE,                // switched, waiting for the stream to come back
+} chan_state_t;
+
+// what the platform has to do after chan_mon_tick()
+typedef enum {
+    CHAN_ACT_NONE = 0,
+    CHAN_ACT_SCAN,              // scan the candidates, then call chan_mon_scan_done()
+    CHAN_ACT_ANNOUNCE,          // send a CHAN_MSG_ANNOUNCE for chan_mon_t.target
+    CHAN_ACT_SWITCH,            // switch the AP to chan_mon_t.target now
+} chan_action_t;
+
+typedef struct {
+    chan_state_t state;
+    uint8_t channel;            // current
+    uint8_t target;             // where we go
+    uint16_t epoch;             // number of the migration, the sender ignores old announcements
+    int32_t rating;             // EWMA, 0 .. 100, scaled by 1 << CHAN_EWMA_SHIFT
+    uint32_t bad_ticks;
+    uint32_t state_ticks;       // in the current state
+    uint32_t cooldown;          // ticks until a move is allowed again
+    bool acked;                 // the sender confirmed the current announcement
+    // statistics
+    uint32_t moves, aborted, outage_ticks;
+} chan_mon_t;
+
+// the in-band messages on CHAN_PORT. The sender reports once per CHAN_MON_INTERVAL, 
+// the receiver announces a move, the sender acknowledges. Little endian.
+typedef enum {
+    CHAN_MSG_REPORT = 1,        // sender -> receiver
+    CHAN_MSG_ANNOUNCE,          // receiver -> sender
+    CHAN_MSG_ACK,               // sender -> receiver
+} chan_msg_type_t;
+
+typedef struct {
+    uint32_t magic;
+    uint8_t type;
+    uint8_t channel;            // ANNOUNCE, ACK: the new channel. REPORT: the one the sender is on
+    uint8_t countdown;          // ANNOUNCE: announcements left before the switch
+    uint8_t reserved;
+    uint16_t epoch;             // ANNOUNCE, ACK
+    int16_t rssi;               // REPORT: dBm of the AP as the sender sees it
+    uint32_t tx_packets;        // REPORT: cumulative, like the telemetry counters
+    uint32_t tx_failed;
+} chan_msg_t;
+
+void chan_mon_init(chan_mon_t *cm, uint8_t channel);
+
+// 0 .. 100, 100 is a perfect link
+int32_t chan_rate(const link_sample_t *s, uint32_t ring_lead_us);
+
+// what a scan of a candidate promises on the same scale, chan_score() clipped to 0 .. 100
+int32_t chan_scan_rating(uint8_t channel, const scan_ap_t *ap, int n_ap);
+
+// once per CHAN_MON_INTERVAL with the sample of the interval
+chan_action_t chan_mon_tick(chan_mon_t *cm, const link_sample_t *s, uint32_t ring_lead_us);
+
+// the scan found best, rated best_rating on the same scale. 0 if nothing was found.
+void chan_mon_scan_done(chan_mon_t *cm, uint8_t best, int32_t best_rating);
+
+// a CHAN_MSG_ACK arrived
+void chan_mon_ack(chan_mon_t *cm, const chan_msg_t *msg);
+
+void chan_mon_announce(const chan_mon_t *cm, chan_msg_t *msg);
+
+static inline int32_t chan_mon_rating(const chan_mon_t *cm) {
+    return cm->rating >> CHAN_EWMA_SHIFT;
+}
+
+const char *chan_state_name(chan_state_t state);
+
+// the sender's side: returns true and fills ack if msg is a new announcement
+bool chan_follow(uint16_t *last_epoch, const chan_msg_t *msg, chan_msg_t *ack);
+
+#endif /* _CHAN_MON_H */
@@ -0,0 +1,114 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// channel scoring, see chan_score.h
+
+#include <string.h>
+#include "chan_score.h"
+
+// https://en.wikipedia.org/wiki/List_of_WLAN_channels, 20 MHz channels of U-NII-1 to 3
+const uint8_t chan_5g[CHAN_RANK_MAX] = {
+    36, 40, 44, 48, 52, 56, 60, 64,
+    100, 104, 108, 112, 116, 120, 124, 128, 132, 136, 140, 144,
+    149, 153, 157, 161, 165,
+};
+
+
+bool chan_is_dfs(uint8_t channel) {
+    return channel >= 52 && channel <= 144;
+}
+
+
+// percent of the AP's weight that falls on channel
+static int overlap(const scan_ap_t *ap, uint8_t channel) {
+    int half = ap->bw > 20 ? 2 * (ap->bw / 20 - 1) : 0;      // channel numbers from the center to the outer 20 MHz
+    int lo = ap->center - half, hi = ap->center + half;
+
+    if (channel == ap->primary) return 100;
+    if (channel >= lo && channel <= hi) return CHAN_SCORE_SECONDARY;
+    if (ap->rssi >= CHAN_SCORE_ADJ_RSSI && (channel == lo - 4 || channel == hi + 4)) return CHAN_SCORE_ADJACENT;
+    return 0;
+}
+
+
+static int weight(const scan_ap_t *ap) {
+    int w = ap->rssi - CHAN_SCORE_FLOOR;
+
+    if (w < 0) w = 0;
+    if (w > CHAN_SCORE_RSSI_MAX) w = CHAN_SCORE_RSSI_MAX;
+    return CHAN_SCORE_BEACON + w;
+}
+
+
+static int16_t score(uint8_t channel, const scan_ap_t *ap, int n_ap, int busy_permille, uint8_t *aps) {
+    int i, o, pen = 0;
+
+    *aps = 0;
+    for (i = 0; i < n_ap; i++) {
+        if ((o = overlap(&ap[i], channel)) == 0) continue;
+        pen += weight(&ap[i]) * o / 100;
+        (*aps)++;
+    }
+    if (busy_permille >= 0) pen += busy_permille * CHAN_SCORE_BUSY / 1000;
+    if (chan_is_dfs(channel)) pen += CHAN_SCORE_DFS;
+    return (int16_t)(100 - pen);
+}
+
+
+int16_t chan_score(uint8_t channel, const scan_ap_t *ap, int n_ap, int busy_permille) {
+    uint8_t aps;
+
+    return score(channel, ap, n_ap, busy_permille, &aps);
+}
+
+
+int chan_rank(const scan_ap_t *ap, int n_ap, const chan_busy_t *busy, int n_busy, bool allow_dfs, chan_rank_t *rank) {
+    chan_rank_t r;
+    int i, j, k, n = 0, b;
+
+    for (i = 0; i < CHAN_RANK_MAX; i++) {
+        if (chan_is_dfs(chan_5g[i]) && !allow_dfs) continue;
+        for (b = -1, k = 0; k < n_busy; k++) {
+            if (busy[k].channel == chan_5g[i]) b = busy[k].permille;
+        }
+        r.channel = chan_5g[i];
+        r.score = score(r.channel, ap, n_ap, b, &r.aps);
+        // insertion sort, best score first, then fewer APs, then the lower channel
+        for (j = n++; j > 0 && (rank[j - 1].score < r.score
+                                || (rank[j - 1].score == r.score && rank[j - 1].aps > r.aps)); j--) {
+            rank[j] = rank[j - 1];
+        }
+        rank[j] = r;
+    }
+    return n;
+}
+
+
+uint8_t chan_pick(const chan_rank_t *rank, int n, const chan_rank_cache_t *cache) {
+    int i;
+
+    if (n == 0) return cache != NULL && cache->n > 0 ? cache->rank[0].channel : 0;
+    if (cache == NULL || cache->n == 0) return rank[0].channel;
+    for (i = 0; i < n; i++) {
+        if (rank[i].channel == cache->rank[0].channel) {
+            return rank[i].score + CHAN_SCORE_HYSTERESIS >= rank[0].score ? rank[i].channel : rank[0].channel;
+        }
+    }
+    return rank[0].channel;             // not a candidate any more, DFS was switched off
+}
@@ -0,0 +1,92 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// channel scoring of a 5 GHz scan. Every AP the scan saw costs the channels it overlaps,
+// weighted by its signal strength and by how it overlaps: fully on its primary channel,
+// partly on the rest of its width and, when it is strong, on the next 20 MHz beside it.
+// Airtime probes, if there are any, add what the channel is really busy with. DFS channels
+// are left out unless asked for. No ESP-IDF dependencies, host/chan_score_check.c runs
+// it on recorded scans.
+
+#ifndef _CHAN_SCORE_H
+#define _CHAN_SCORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CHAN_SCORE_FLOOR        (-90)                   // dBm, an AP this weak costs only CHAN_SCORE_BEACON
+#define CHAN_SCORE_BEACON       5                       // points for any AP we hear, its beacons take airtime
+#define CHAN_SCORE_RSSI_MAX     50                      // points at most for the signal, from -40 dBm up
+#define CHAN_SCORE_SECONDARY    50                      // percent of the weight within its width, off its primary
+#define CHAN_SCORE_ADJACENT     25                      // percent for the 20 MHz next to its edge, strong APs only
+#define CHAN_SCORE_ADJ_RSSI     (-50)                   // dBm, what counts as strong
+#define CHAN_SCORE_BUSY         100                     // points for a channel that is busy all of the time
+#define CHAN_SCORE_DFS          20                      // points for a DFS channel when they are allowed at all
+#define CHAN_SCORE_HYSTERESIS   10                      // the cached best stays unless beaten by this much
+#define CHAN_RANK_MAX           25                      // 20 MHz channels in 5 GHz we rank
+
+// one AP of a scan. host/chan_score_check.c reads them as "primary center bw rssi [ssid]"
+typedef struct {
+    uint8_t primary;
+    uint8_t center;             // center channel of its whole width, primary for 20 MHz
+    uint8_t bw;                 // MHz, 20, 40, 80 or 160
+    int8_t rssi;                // dBm
+} scan_ap_t;
+
+// an airtime probe: how much of a dwell the channel was busy
+typedef struct {
+    uint8_t channel;
+    uint16_t permille;
+} chan_busy_t;
+
+typedef struct {
+    uint8_t channel;
+    uint8_t aps;                // APs overlapping it
+    int16_t score;              // 100 is an empty channel, may go below 0
+} chan_rank_t;
+
+// the ranking as receiver stores it in NVS, see find_free_channel()
+#define CHAN_RANK_MAGIC         0x57474b52              // "WGKR"
+#define CHAN_RANK_VERSION       1
+
+typedef struct {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t n;
+    uint8_t allow_dfs;
+    uint8_t reserved;
+    chan_rank_t rank[CHAN_RANK_MAX];
+} chan_rank_cache_t;
+
+// the 20 MHz channels in 5 GHz, in the order they are ranked
+extern const uint8_t chan_5g[CHAN_RANK_MAX];
+
+bool chan_is_dfs(uint8_t channel);
+
+// busy_permille < 0 if the channel was not probed
+int16_t chan_score(uint8_t channel, const scan_ap_t *ap, int n_ap, int busy_permille);
+
+// ranks all 5 GHz channels, best first, and returns how many there are
+int chan_rank(const scan_ap_t *ap, int n_ap, const chan_busy_t *busy, int n_busy, bool allow_dfs, chan_rank_t *rank);
+
+// the channel to use: the cached best one stays unless the new best beats it by
+// CHAN_SCORE_HYSTERESIS, so that the receiver does not hop around between boots
+uint8_t chan_pick(const chan_rank_t *rank, int n, const chan_rank_cache_t *cache);
+
+#endif /* _CHAN_SCORE_H */
@@ -0,0 +1,94 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// CPU frequency governor, see cpu_gov.h
+
+#include "wgk_core.h"
+#include "cpu_gov.h"
+
+// what esp_pm_configure() takes as max_freq_mhz on the ESP32-C5
+const uint16_t cpu_gov_mhz[CPU_GOV_LEVELS] = { 80, 160, 240 };
+
+
+void cpu_gov_init(cpu_gov_t *g, int level) {
+    memset(g, 0, sizeof(*g));
+    g->level = level;
+    g->idle_level = level;
+    g->margin = 1000;
+}
+
+
+void IRAM_ATTR cpu_gov_sample_task(cpu_gov_t *g, uint32_t cycles) {
+    if (cycles > g->task_max) g->task_max = cycles;
+    g->packets++;
+}
+
+
+void IRAM_ATTR cpu_gov_sample_isr(cpu_gov_t *g, uint32_t cycles) {
+    if (cycles > g->isr_max) g->isr_max = cycles;
+}
+
+
+int32_t cpu_gov_margin(uint32_t task_cycles, uint32_t isr_cycles, uint32_t mhz) {
+    // cycles / MHz are µs. The callback also takes its share of the packet time.
+    int32_t task = 1000 - (int32_t)((uint64_t)(task_cycles + isr_cycles) * 1000 / ((uint64_t)mhz * PACKET_TIME_US));
+    int32_t isr = 1000 - (int32_t)((uint64_t)isr_cycles * 1000 / ((uint64_t)mhz * CPU_GOV_ISR_US));
+
+    return task < isr ? task : isr;
+}
+
+
+int cpu_gov_lowest(uint32_t task_cycles, uint32_t isr_cycles, int32_t margin) {
+    int l;
+
+    for (l = 0; l < CPU_GOV_LEVELS - 1; l++) {
+        if (cpu_gov_margin(task_cycles, isr_cycles, cpu_gov_mhz[l]) >= margin) break;
+    }
+    return l;
+}
+
+
+bool cpu_gov_decide(cpu_gov_t *g) {
+    int prev = g->level, prev_idle = g->idle_level;
+
+    if (g->packets == 0) return false;
+    g->margin = cpu_gov_margin(g->task_max, g->isr_max, cpu_gov_mhz[g->level]);
+    if (g->margin < CPU_GOV_MARGIN) {
+        // short of the margin: straight to where the worst packet fits, that is above
+        g->level = cpu_gov_lowest(g->task_max, g->isr_max, CPU_GOV_MARGIN);
+        g->down_run = 0;
+    } else if (g->level > 0 &&
+               cpu_gov_margin(g->task_max, g->isr_max, cpu_gov_mhz[g->level - 1]) >= CPU_GOV_MARGIN + CPU_GOV_HYST) {
+        if (++g->down_run >= CPU_GOV_DOWN) {
+            g->level--;
+            g->down_run = 0;
+        }
+    } else {
+        g->down_run = 0;
+    }
+    // the callback alone, it runs at the idle level unless a section holds the lock
+    g->idle_level = cpu_gov_lowest(0, g->isr_max, CPU_GOV_MARGIN + CPU_GOV_HYST);
+    if (g->idle_level > g->level) g->idle_level = g->level;
+
+    // the hot paths may sample in between, a packet lost to this window is in the next
+    g->task_max = 0;
+    g->isr_max = 0;
+    g->packets = 0;
+    return g->level != prev || g->idle_level != prev_idle;
+}
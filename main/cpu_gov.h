@@ -0,0 +1,77 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// CPU frequency governor. The pipeline's work per packet is measured in CPU cycles at
+// the points the trace marks: the pack in udp_tx_task on the sender, ring_buf_put() in
+// udp_rx_task and the I2S callback on the receiver. Cycles hardly change with the clock,
+// so the worst packet of a window says what every frequency of the ladder would leave
+// free of the packet time. The governor picks the lowest one that leaves CPU_GOV_MARGIN,
+// goes up at once when a window falls short and down only after CPU_GOV_DOWN windows in
+// a row would have had CPU_GOV_HYST to spare at the lower one. At a lower clock a PSRAM
+// access costs fewer cycles, not more, so the estimate errs on the safe side going down.
+//
+// The level is the clock while the pipeline holds its PM lock. Between the sections the
+// CPU drops to the idle level, and that is where the I2S callback usually runs, so the
+// idle level is the lowest that keeps the callback's deadline with CPU_GOV_HYST to spare.
+//
+// The margin is large on purpose: lwIP and the WiFi driver run on the same core and
+// are not in the measurement. No ESP-IDF dependencies, host/cpu_gov_check.c runs it and
+// tools/trace_decode.c applies it to a PIPELINE_TRACE dump.
+
+#ifndef _CPU_GOV_H
+#define _CPU_GOV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CPU_GOV_LEVELS          3
+#define CPU_GOV_MARGIN          500                     // permille of the packet time that has to stay free
+#define CPU_GOV_ISR_US          100                     // the I2S callback has to be done in this, interrupts wait
+#define CPU_GOV_HYST            100                     // permille more free at the lower level before going down
+#define CPU_GOV_DOWN            4                       // windows in a row before going down
+#define CPU_GOV_INTERVAL        1000                    // ms, one window
+
+extern const uint16_t cpu_gov_mhz[CPU_GOV_LEVELS];      // the ladder, lowest first
+
+typedef struct {
+    uint32_t task_max;          // cycles, worst packet of the window in the task
+    uint32_t isr_max;           // cycles, worst I2S callback of the window
+    uint32_t packets;           // in the window
+    int level;                  // index into cpu_gov_mhz[], the clock under the PM lock
+    int idle_level;             // the clock without it, never above level
+    int down_run;               // windows in a row the next lower level would have done
+    int32_t margin;             // permille free at level, worst packet of the last window
+} cpu_gov_t;
+
+void cpu_gov_init(cpu_gov_t *g, int level);
+
+// the hot paths, one sample per packet
+void cpu_gov_sample_task(cpu_gov_t *g, uint32_t cycles);
+void cpu_gov_sample_isr(cpu_gov_t *g, uint32_t cycles);
+
+// ends the window. true if g->level or g->idle_level changed. A window without packets changes nothing.
+bool cpu_gov_decide(cpu_gov_t *g);
+
+// permille of the deadlines left at mhz, the smaller of the packet time and CPU_GOV_ISR_US
+int32_t cpu_gov_margin(uint32_t task_cycles, uint32_t isr_cycles, uint32_t mhz);
+
+// the lowest level that leaves at least margin permille, the highest if none does
+int cpu_gov_lowest(uint32_t task_cycles, uint32_t isr_cycles, int32_t margin);
+
+#endif /* _CPU_GOV_H */
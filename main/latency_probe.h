@@ -0,0 +1,89 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// clock offset estimation and latency histogram for the in-band latency probe.
+// This header does not depend on ESP-IDF so that tools/latency_sim.c can use
+// the very same code on the host.
+
+#ifndef _LATENCY_PROBE_H
+#define _LATENCY_PROBE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * NTP style ping exchange on SYNC_PORT. The receiver sends t1 (its own clock),
+ * the sender stamps t2 on reception and t3 just before replying (its own clock),
+ * and the receiver takes t4 when the reply arrives. Then
+ *     offset = ((t2 - t1) + (t3 - t4)) / 2        sender clock minus receiver clock
+ *     delay  = (t4 - t1) - (t3 - t2)              round trip on the air
+ * The offset is only exact if both directions take the same time. Queueing delays
+ * are one-sided, so like NTP's clock filter we keep the last CLOCK_SYNC_WINDOW samples
+ * and use the one with the smallest round trip.
+ */
+#define SYNC_MAGIC              0x57474b53              // "WGKS"
+#define CLOCK_SYNC_WINDOW       16
+#define SYNC_INTERVAL           100                     // ms between two pings
+
+typedef struct {
+    uint32_t magic;
+    uint32_t t1, t2, t3;
+} sync_pkt_t;
+
+typedef struct {
+    int32_t offset[CLOCK_SYNC_WINDOW];
+    uint32_t delay[CLOCK_SYNC_WINDOW];
+    uint32_t n;                     // samples taken so far
+    volatile int32_t best_offset;   // read in ISR context
+    uint32_t best_delay;
+} clock_sync_t;
+
+void clock_sync_init(clock_sync_t *cs);
+void clock_sync_sample(clock_sync_t *cs, uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4);
+
+// inline because both are used in ISR context
+static inline bool clock_sync_valid(const clock_sync_t *cs) {
+    return cs->n >= CLOCK_SYNC_WINDOW;
+}
+
+// convert a timestamp taken with the remote (sender) clock to the local clock
+static inline uint32_t clock_sync_to_local(const clock_sync_t *cs, uint32_t remote) {
+    return remote - (uint32_t)cs->best_offset;
+}
+
+/*
+ * latency histogram with LAT_HIST_RES µs bins. Adding is relaxed atomic increments
+ * so it can be done in ISR context; the last bin collects everything above range.
+ * A reader in another task takes it with lat_hist_take(), not lat_hist_reset().
+ */
+#define LAT_HIST_BINS           256
+#define LAT_HIST_RES            100                     // µs per bin, covers 0 .. 25.5 ms
+
+typedef struct {
+    uint32_t bin[LAT_HIST_BINS];
+    uint32_t count;
+    uint32_t max;
+} lat_hist_t;
+
+void lat_hist_reset(lat_hist_t *h);
+void lat_hist_add(lat_hist_t *h, int32_t us);
+void lat_hist_take(lat_hist_t *snap, lat_hist_t *h);
+uint32_t lat_hist_percentile(const lat_hist_t *h, uint32_t permille);
+
+#endif /* _LATENCY_PROBE_H */
@@ -29,17 +29,31 @@ EventGroupHandle_t s_wifi_event_group;
 
 udp_buf_t *udp_tx_buf, *udp_rx_buf;
 
-#if (defined RX_DEBUG || defined TX_DEBUG)
-DRAM_ATTR volatile int p = 0; 
-DRAM_ATTR volatile log_t _log[NUM];   
-#endif 
-
 // uint32_t time1; 
 
 #ifdef WITH_TEMP
 float rx_temp, tx_temp;
 #endif
 
+bool fast_boot = false;
+DRAM_ATTR volatile uint32_t first_audio_us = 0;        // set from the I2S ISR on the receiver
+
+#if defined(RX_MIX) && defined(CHAN_MON)
+#error "CHAN_MON rates the link of one sender, not of RX_STREAMS"
+#endif
+
+#if defined(RX_SECONDARY) && defined(TX_POWER_SAVE)
+#error "TX_POWER_SAVE would put a RX_SECONDARY receiver to sleep, it shares init_wifi_tx() with the sender"
+#endif
+
+#ifdef CPU_GOV
+#if !CONFIG_PM_ENABLE
+#error "CPU_GOV needs CONFIG_PM_ENABLE=y"
+#endif
+DRAM_ATTR cpu_gov_t cpu_gov;                            // sampled from the I2S ISR
+esp_pm_lock_handle_t cpu_gov_lock;
+#endif
+
 
 // Timer configuration
 #include "driver/gptimer.h"
@@ -76,24 +90,277 @@ uint32_t get_time_us_in_isr(void) {
 static int s_retry_num = 0;
 
 
+// the boot state of FAST_BOOT, see wireless_gk.h. Anything that does not fit this build is ignored.
+bool boot_state_load(char role, boot_state_t *bs) {
+    nvs_handle_t handle;
+    size_t len = sizeof(*bs);
+    bool ok;
+
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return false;
+    ok = nvs_get_blob(handle, "boot", bs, &len) == ESP_OK && len == sizeof(*bs)
+         && bs->magic == BOOT_STATE_MAGIC && bs->version == BOOT_STATE_VERSION
+         && bs->role == (uint8_t)role && bs->format == STREAM_FORMAT && bs->channel != 0;
+    nvs_close(handle);
+    return ok;
+}
+
+
+// written on every channel change, which is rare, and only then
+void boot_state_save(char role, uint8_t channel, uint8_t bandwidth) {
+    boot_state_t bs, old;
+    nvs_handle_t handle;
+
+    memset(&bs, 0, sizeof(bs));
+    bs.magic = BOOT_STATE_MAGIC;
+    bs.version = BOOT_STATE_VERSION;
+    bs.role = (uint8_t)role;
+    bs.channel = channel;
+    bs.bandwidth = bandwidth;
+    bs.format = STREAM_FORMAT;
+    if (boot_state_load(role, &old) && memcmp(&old, &bs, sizeof(bs)) == 0) return;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) return;
+    if (nvs_set_blob(handle, "boot", &bs, sizeof(bs)) == ESP_OK) nvs_commit(handle);
+    nvs_close(handle);
+}
+
+
+
+#ifdef TELEMETRY
+// publishes all telemetry counters and gauges as one binary frame every TELEM_INTERVAL ms
+// and logs a one line summary every TELEM_LOG_INTERVAL frames. 
+// args is the role character, 'T' for the sender and 'R' for the receiver
+void telemetry_task(void *args) {
+    char role = (char)(intptr_t)args;
+    struct sockaddr_in dest_addr;
+    telem_frame_t frame;
+    telem_hist_frame_t hist_frame;
+    static lat_hist_t snap;                 // 1 KB, not on the stack
+    uint32_t seq = 0, hist_seq = 0;
+    int broadcast = 1;
+    bool first_audio_logged = false;
+    TaskHandle_t udp_task = (role == 'T') ? udp_tx_task_handle : udp_rx_task_handle;
+
+    dest_addr.sin_addr.s_addr = inet_addr(TELEM_DEST_ADDR);
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(TELEM_PORT);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to create telemetry socket: errno %d", errno);
+        vTaskDelete(NULL);
+    }
+    setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+    ESP_LOGI(TAG, "publishing telemetry to %s:%d", TELEM_DEST_ADDR, TELEM_PORT);
+    telem_reset_interval();
 
-void monitor_task(void *args) {
-    UBaseType_t hwm; 
-    char *task_name; 
-    bool *sender = (bool *) args;
-    TaskHandle_t tasks[] = { i2s_rx_task_handle, udp_tx_task_handle, i2s_tx_task_handle, udp_rx_task_handle, NULL };
     while (1) {
-        for (int i=0; i<sizeof(tasks)/sizeof(TaskHandle_t); i++) {
-            hwm = uxTaskGetStackHighWaterMark(tasks[i]);
-            task_name = pcTaskGetName(tasks[i]);
-            ESP_LOGI (TAG, "task %s, HWM %d", task_name, hwm);
+        vTaskDelay(TELEM_INTERVAL/portTICK_PERIOD_MS);
+
+        // slow gauges are sampled here, not in the hot paths
+        if (udp_task != NULL) {
+            telem_set(TG_HWM_UDP_TASK, uxTaskGetStackHighWaterMark(udp_task));
+        }
+        telem_set(TG_HWM_TELEM_TASK, uxTaskGetStackHighWaterMark(NULL));
+        telem_set(TG_HEAP_FREE_MIN, esp_get_minimum_free_heap_size());
+#ifdef WITH_TEMP
+        telem_set(TG_TEMP_TX, (int32_t)(tx_temp * 100.0f));
+        if (role == 'R') {
+            telem_set(TG_TEMP_RX, (int32_t)(rx_temp * 100.0f));
+        }
+#endif
+        // esp_timer starts early in the boot, the ROM and second stage bootloader before it are not in here
+        telem_set(TG_FIRST_AUDIO_MS, first_audio_us / 1000);
+        telem_set(TG_FAST_BOOT, fast_boot);
+        telem_set(TG_TX_PS_SCHED, -1);
+#ifdef CPU_GOV
+        telem_set(TG_CPU_MHZ, cpu_gov_mhz[cpu_gov.level]);
+        telem_set(TG_CPU_IDLE_MHZ, cpu_gov_mhz[cpu_gov.idle_level]);
+        telem_set(TG_CPU_MARGIN, cpu_gov.margin);
+#else
+        telem_set(TG_CPU_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+        telem_set(TG_CPU_IDLE_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+        telem_set(TG_CPU_MARGIN, -1);
+#endif
+#ifdef TX_POWER_SAVE
+        if (role == 'T') {
+            telem_set(TG_TX_PS_SCHED, tx_ps_current);
+            telem_set(TG_TX_PS_MA, tx_ps_current_ma(&tx_ps_sched[tx_ps_current]));
+            telem_set(TG_TX_PS_TWT, tx_ps_twt_up);
+        }
+#endif
+        if (first_audio_us != 0 && !first_audio_logged) {
+            ESP_LOGI(TAG, "first audio %s %lu ms after boot, %s boot", role == 'T' ? "sent" : "played",
+                     first_audio_us / 1000, fast_boot ? "fast" : "full");
+            first_audio_logged = true;
+        }
+        if (role == 'R') {
+            // taken, not read and reset: udp_rx_task adds to jitter_hist meanwhile, the I2S ISR to lat_hist
+            lat_hist_take(&snap, &jitter_hist);
+            telem_set(TG_JITTER_P50, lat_hist_percentile(&snap, 500));
+            telem_set(TG_JITTER_P99, lat_hist_percentile(&snap, 990));
+            telem_set(TG_JITTER_MAX, snap.max);
+            telem_set(TG_RX_STREAMS, ring_streams());
+#ifdef LATENCY_PROBE
+            lat_hist_take(&snap, &lat_hist);
+            telem_set(TG_LATENCY_P50, lat_hist_percentile(&snap, 500));
+            telem_set(TG_LATENCY_P99, lat_hist_percentile(&snap, 990));
+#endif
         }
-        ESP_LOGI (TAG, "largest free block: %u", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
-        ESP_LOGI (TAG, "min free heap size: %lu", esp_get_minimum_free_heap_size());
 
-        vTaskDelay (1000/portTICK_PERIOD_MS);
+        telem_fill_frame(&frame, role, seq++, (uint32_t)(esp_timer_get_time() / 1000));
+        telem_reset_interval();
+        sendto(sock, &frame, sizeof(frame), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));   // best effort
+
+        // the receiver's histograms are fed by ring_buf_put(), tools/jitter_tune.c reads them. 
+        // The sender's by udp_tx_task(), one per destination, see telemetry_collect -D
+        if (seq % TELEM_HIST_INTERVAL == 0) {
+            int h_first = (role == 'R') ? 0 : TH_TX_SEND_0;
+            int h_end = (role == 'R') ? TH_TX_SEND_0 : TH_TX_SEND_0 + TX_NUM_DESTS;
+
+            for (int h = h_first; h < h_end; h++) {
+                telem_hist_snapshot(&hist_frame, h, role, hist_seq, frame.uptime_ms);
+                hist_frame.ringbuf_offset = RINGBUF_OFFSET;
+                hist_frame.packet_time_us = PACKET_TIME_US;
+                sendto(sock, &hist_frame, sizeof(hist_frame), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+            }
+            hist_seq++;
+        }
+
+        if (seq % TELEM_LOG_INTERVAL == 0) {
+            if (role == 'T') {
+                ESP_LOGI(TAG, "sent %lu errors %lu enomem %lu Tx %.1f°C", 
+                         frame.counter[TC_TX_PACKETS], frame.counter[TC_TX_ERRORS], 
+                         frame.counter[TC_TX_ENOMEM], frame.gauge[TG_TEMP_TX] / 100.0f);
+            } else {
+                ESP_LOGI(TAG, "received %lu gaps %lu lost %lu concealed %lu underruns %lu lead %ld..%ld "
+                         "jitter p99 %ld µs Rx %.1f°C Tx %.1f°C", 
+                         frame.counter[TC_RX_PACKETS], frame.counter[TC_RX_GAPS], frame.counter[TC_RX_LOST], 
+                         frame.counter[TC_RX_CONCEALED], frame.counter[TC_RX_UNDERRUNS], 
+                         frame.gauge[TG_RING_LEAD_MIN], frame.gauge[TG_RING_LEAD_MAX], frame.gauge[TG_JITTER_P99],
+                         frame.gauge[TG_TEMP_RX] / 100.0f, frame.gauge[TG_TEMP_TX] / 100.0f);
+#ifdef LATENCY_PROBE
+                ESP_LOGI(TAG, "latency p50 %ld p99 %ld µs, clock offset %ld rtt %lu µs", 
+                         frame.gauge[TG_LATENCY_P50], frame.gauge[TG_LATENCY_P99], 
+                         clock_sync.best_offset, clock_sync.best_delay);
+#endif
+            }
+        }
     }
 }
+#endif
+
+#ifdef PKT_CAPTURE
+// answers the export requests of tools/capture_fetch.c on CAPTURE_PORT, see pkt_capture.h
+void capture_task(void *args) {
+    struct sockaddr_in dest_addr, source_addr;
+    socklen_t socklen;
+    capture_req_t req;
+    capture_info_t info;
+    capture_chunk_t *chunk;
+    uint32_t first, end;
+    int len;
+
+    chunk = &wgk_arena.rx.capture_chunk;
+    if (!pkt_capture_init()) {
+        vTaskDelete(NULL);
+    }
+    dest_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(CAPTURE_PORT);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to create capture socket: errno %d", errno);
+        vTaskDelete(NULL);
+    }
+    if (bind(sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0) {
+        ESP_LOGE(TAG, "capture socket unable to bind: errno %d", errno);
+        vTaskDelete(NULL);
+    }
+
+    while (1) {
+        socklen = sizeof(source_addr);
+        len = recvfrom(sock, &req, sizeof(req), 0, (struct sockaddr *)&source_addr, &socklen);
+        if (len != sizeof(req) || req.magic != CAPTURE_MAGIC) continue;
+
+        switch (req.op) {
+            case CAP_FREEZE:
+                pkt_capture_freeze();
+                vTaskDelay(10/portTICK_PERIOD_MS);         // let a pkt_capture_add() in progress finish
+                pkt_capture_info(&info, (uint32_t)(esp_timer_get_time() / 1000));
+                ESP_LOGI(TAG, "capture frozen, %lu records, %lu overwritten", info.count, info.overwritten);
+                sendto(sock, &info, sizeof(info), 0, (struct sockaddr *)&source_addr, socklen);
+                break;
+            case CAP_READ:
+                // this competes with the audio for airtime, so pace it and let the PC ask again for gaps
+                end = req.first + (req.count < CAPTURE_READ_MAX * CAPTURE_CHUNK_RECS ? 
+                                   req.count : CAPTURE_READ_MAX * CAPTURE_CHUNK_RECS);
+                for (first = req.first; first < end; first += CAPTURE_CHUNK_RECS) {
+                    if (pkt_capture_read(chunk, first, end - first) == 0) break;
+                    sendto(sock, chunk, offsetof(capture_chunk_t, rec) + chunk->n * sizeof(capture_rec_t), 0, 
+                           (struct sockaddr *)&source_addr, socklen);
+                    vTaskDelay(1);
+                }
+                break;
+            case CAP_RESUME:
+                pkt_capture_resume();
+                ESP_LOGI(TAG, "capture resumed");
+                break;
+            default:
+                break;
+        }
+    }
+}
+#endif
+
+#ifdef BENCHMARK
+// runs the per-packet microbenchmarks instead of sender or receiver, every BENCH_INTERVAL ms. 
+// Nothing else is running, WiFi is not even started. grep the BENCH, lines out of the log. 
+void bench_task(void *args) {
+    static wgk_bench_result_t res[WGK_BENCH_MAX];
+    int n;
+
+    if (!ring_buf_init()) {
+        vTaskDelete(NULL);
+    }
+    while (1) {
+        n = wgk_bench_run(res, WGK_BENCH_REPS, WGK_BENCH_ITERS);
+        wgk_bench_print(res, n, CONFIG_IDF_TARGET, true, true);
+        vTaskDelay(BENCH_INTERVAL/portTICK_PERIOD_MS);
+    }
+}
+#endif
+
+#ifdef CPU_GOV
+// the clock under cpu_gov_lock and the idle clock, no light sleep: the I2S DMA runs on
+static void cpu_gov_apply(void) {
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = cpu_gov_mhz[cpu_gov.level],
+        .min_freq_mhz = cpu_gov_mhz[cpu_gov.idle_level],
+        .light_sleep_enable = false,
+    };
+
+    ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+}
+
+// starts at the top of the ladder, before the pipeline tasks exist
+void cpu_gov_setup(void) {
+    cpu_gov_init(&cpu_gov, CPU_GOV_LEVELS - 1);
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "wgk_pipeline", &cpu_gov_lock));
+    cpu_gov_apply();
+}
+
+void cpu_gov_task(void *args) {
+    while (1) {
+        vTaskDelay(CPU_GOV_INTERVAL/portTICK_PERIOD_MS);
+        if (cpu_gov_decide(&cpu_gov)) {
+            cpu_gov_apply();
+            ESP_LOGI(TAG, "CPU %u MHz, idle %u MHz, margin %ld permille", cpu_gov_mhz[cpu_gov.level],
+                     cpu_gov_mhz[cpu_gov.idle_level], cpu_gov.margin);
+        }
+    }
+}
+#endif
 
 #ifdef WITH_TEMP    
 #include "driver/temperature_sensor.h"
@@ -129,21 +396,6 @@ void rx_temp_task(void *args) {
 #endif
 
 
-// calculate simple XOR checksum based on uint32_t, which is much faster than using uint8_t
-// there are 4x less XOR operations
-// and ESP32 does not support unaligned uint8_t accesses and will always generate an exception
-uint32_t calculate_checksum(uint32_t *buffer, size_t size) {
-    uint32_t checksum = 0;
-    int i; 
-    
-    for (i = 0; i < size; i++) {  
-        checksum ^= *(buffer + i);
-    }
-    return checksum; 
-}
-
-
-
 void app_main(void) {
 
     bool sender = false; 
@@ -160,6 +412,11 @@ void app_main(void) {
     }
     ESP_ERROR_CHECK(ret);
     s_wifi_event_group = xEventGroupCreate();
+
+#ifdef BENCHMARK
+    xTaskCreate(bench_task, "bench_task", 8192, NULL, 5, NULL);
+    return;
+#endif
     
     // check if we're sender or receiver. The sender has ID_PIN = 0
     gpio_reset_pin(ID_PIN);
@@ -172,6 +429,11 @@ void app_main(void) {
     gpio_reset_pin(ID_PIN);
 
     init_hardware_timer();
+
+#ifdef CPU_GOV
+    cpu_gov_setup();
+    xTaskCreate(cpu_gov_task, "cpu_gov_task", 4096, NULL, 5, NULL);
+#endif
     
     if (sender) {
         // initialize GPIO pins
@@ -186,15 +448,17 @@ void app_main(void) {
         // initialize Wifi STA
         init_wifi_tx(setup_requested);
         
+#ifndef FAST_BOOT
         // let it settle. 
         vTaskDelay(200/portTICK_PERIOD_MS);
+#endif
 
 #ifdef WITH_TEMP    
         xTaskCreate(tx_temp_task, "tx_temp_task", 4096, NULL, 5, NULL);
 #endif
         
-        // create udp send buffer explicitly in RAM
-        udp_tx_buf = (udp_buf_t *)heap_caps_calloc(1, sizeof(udp_buf_t), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);         
+        // udp send buffer in internal RAM
+        udp_tx_buf = wgk_arena.tx.udp_buf;
         
         // set up I2S receive channel on the Sender
         i2s_new_channel(&i2s_rx_chan_cfg, NULL, &i2s_rx_handle);
@@ -214,7 +478,25 @@ void app_main(void) {
         // create UDP Tx task
         xTaskCreate(udp_tx_task, "udp_tx_task", 4096, NULL, 18, &udp_tx_task_handle);
 
-        // xTaskCreate(monitor_task, "monitor_task", 4096, &sender, 3, NULL);
+#ifdef TELEMETRY
+        xTaskCreate(telemetry_task, "telemetry_task", 4096, (void *)'T', 3, NULL);
+#endif
+
+#ifdef PIPELINE_TRACE
+        xTaskCreate(trace_task, "trace_task", 4096, (void *)'T', 3, NULL);
+#endif
+
+#ifdef LATENCY_PROBE
+        xTaskCreate(sync_tx_task, "sync_tx_task", 4096, NULL, 10, NULL);
+#endif
+
+#ifdef CHAN_MON
+        xTaskCreate(chan_follow_task, "chan_follow_task", 4096, NULL, 5, NULL);
+#endif
+
+#ifdef TX_PS_MEASURE
+        xTaskCreate(tx_ps_task, "tx_ps_task", 4096, NULL, 5, NULL);
+#endif
 
         // create I2S rx on_recv callback
         i2s_event_callbacks_t cbs = {
@@ -242,10 +524,17 @@ void app_main(void) {
 
         // TODO check if we had WiFi credentials in NVS, if not, setup. 
     
+#ifdef RX_SECONDARY
+        // join the first receiver's AP, with WPS on setup just like a sender
+        init_wifi_tx(setup_requested);
+#else
         // initialize Wifi AP
         init_wifi_rx(setup_requested);
+#endif
+#ifndef FAST_BOOT
         // let it settle. 
         vTaskDelay(200/portTICK_PERIOD_MS);
+#endif
         
 #ifdef WITH_TEMP    
         xTaskCreate(rx_temp_task, "rx_temp_task", 4096, NULL, 5, NULL);
@@ -255,8 +544,11 @@ void app_main(void) {
         if (!ring_buf_init()) {              // This Should Not Happen[TM]
             vTaskDelete(NULL); 
         }
+#ifdef RX_MIX
+        mix_init(MIX_ROUTE);
+#endif
         // and the UDP receive buffer
-        udp_rx_buf = (udp_buf_t *)heap_caps_calloc(1, sizeof(udp_buf_t), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL); 
+        udp_rx_buf = &wgk_arena.rx.udp_buf; 
             
         // set up I2S send channel on the Receiver
         i2s_new_channel(&i2s_tx_chan_cfg, &i2s_tx_handle, NULL);
@@ -270,11 +562,36 @@ void app_main(void) {
         // create UDP Rx task
         xTaskCreate(udp_rx_task, "udp_rx_task", 4096, NULL, 18, &udp_rx_task_handle);
         
-#ifdef RX_STATS
+#ifdef SSN_STATS
         xTaskCreate(rx_stats_task, "rx_stats_task", 4096, NULL, 5, NULL); 
 #endif        
 
-        // xTaskCreate(monitor_task, "monitor_task", 4096, NULL, 3, NULL);
+#ifdef TELEMETRY
+        xTaskCreate(telemetry_task, "telemetry_task", 4096, (void *)'R', 3, NULL);
+#endif
+
+#ifdef PIPELINE_TRACE
+        xTaskCreate(trace_task, "trace_task", 4096, (void *)'R', 3, NULL);
+#endif
+
+#ifdef PKT_CAPTURE
+        xTaskCreate(capture_task, "capture_task", 4096, NULL, 3, NULL);
+#endif
+
+#ifdef LATENCY_PROBE
+        xTaskCreate(sync_rx_task, "sync_rx_task", 4096, NULL, 10, NULL);
+#endif
+
+// the AP's channel is the first receiver's business, a secondary one follows it like the sender
+#if defined(CHAN_MON) && !defined(RX_SECONDARY)
+        xTaskCreate(chan_mon_task, "chan_mon_task", 4096, NULL, 5, NULL);
+#endif
+
+#if defined(FAST_BOOT) && !defined(RX_SECONDARY)
+        if (fast_boot) {
+            xTaskCreate(boot_scan_task, "boot_scan_task", 4096, NULL, 3, NULL);
+        }
+#endif
 
         // create I2S tx on_sent callback
         i2s_event_callbacks_t cbs = {
@@ -287,12 +604,11 @@ void app_main(void) {
 
         i2s_channel_enable(i2s_tx_handle);
         // time1 = get_time_us_in_isr();
-        // stats[0] = -1000;
-        // stats[1] = 1000; 
         // ESP_LOGI(TAG, "sizeof(udp_rx_buf) = %d", sizeof(udp_buf_t));
         // ESP_LOGI(TAG, "sizeof(ringbuf)    = %d", ring_buf_size());
     }
     
+    wgk_arena_print();
     ESP_LOGI (TAG, "largest free block: %u", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
     ESP_LOGI (TAG, "min free heap size: %lu", esp_get_minimum_free_heap_size());
 
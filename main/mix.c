@@ -0,0 +1,85 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the receiver's output stage, see mix.h
+
+#include "mix.h"
+#include "wgk_arena.h"
+
+static const char *TAG = "wgk_mix";
+
+DRAM_ATTR mix_tap_t mix_route[RX_STREAMS][NUM_SLOTS_I2S];
+
+
+void mix_init(mix_mode_t mode) {
+    int share[NUM_SLOTS_I2S] = { 0 };               // streams into each output slot
+    int s, o, k, g; 
+
+    memset(mix_route, 0, sizeof(mix_route)); 
+    g = (NUM_SLOTS_I2S / RX_STREAMS > 0) ? NUM_SLOTS_I2S / RX_STREAMS : 1; 
+    for (s=0; s<RX_STREAMS; s++) {
+        for (k=0; k<(mode == MIX_SUM ? NUM_SLOTS_I2S : g); k++) {
+            // more streams than slots split: they take turns, and share a slot
+            o = (mode == MIX_SUM) ? k : (s * g + k) % NUM_SLOTS_I2S; 
+            mix_route[s][o].src = k; 
+            mix_route[s][o].gain = 1; 
+            share[o]++; 
+        }
+    }
+    // the gains into each output slot add up to MIX_UNITY at most, see mix.h 
+    for (s=0; s<RX_STREAMS; s++) {
+        for (o=0; o<NUM_SLOTS_I2S; o++) {
+            if (mix_route[s][o].gain != 0) mix_route[s][o].gain = MIX_UNITY / share[o]; 
+        }
+    }
+    ESP_LOGI(TAG, "%d streams, %s", RX_STREAMS, mode == MIX_SUM ? "sum" : "split"); 
+}
+
+
+#ifdef RX_MIX
+IRAM_ATTR bool mix_read(uint8_t *dmabuf) {
+    i2s_buf_t *out = (i2s_buf_t *)dmabuf, *in = &wgk_arena.rx.mix_in; 
+    const mix_tap_t *t; 
+    bool live = false; 
+    int s, o, i; 
+
+    for (s=0; s<RX_STREAMS; s++) {
+        if (!ring_read(ring_stream(s), (uint8_t *)in)) continue; 
+        if (!live) {
+            memset(out, 0, I2S_BUF_SIZE); 
+            live = true; 
+        }
+        for (o=0; o<NUM_SLOTS_I2S; o++) {
+            t = &mix_route[s][o]; 
+            if (t->gain == 0) continue; 
+            for (i=0; i<NFRAMES; i++) {
+                out->frame[i].slot[o] += (in->frame[i].slot[t->src] >> 8) * t->gain; 
+            }
+        }
+    }
+    return live; 
+}
+
+#else 
+
+// one stream, nothing to mix
+IRAM_ATTR bool mix_read(uint8_t *dmabuf) {
+    return ring_read(ring_stream(0), dmabuf); 
+}
+#endif  /* RX_MIX */
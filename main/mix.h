@@ -0,0 +1,71 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the receiver's output stage with RX_MIX (wgk_core.h). i2s_tx_callback() reads every 
+// stream's ring into one scratch buffer in turn and adds it to the DMA buffer: each output 
+// slot gets the stream slot its tap names, times the tap's gain. A stream that has nothing 
+// to play adds nothing, and only when none has is the output silence. 
+//
+// The gains are in 1/MIX_UNITY and those into one output slot add up to MIX_UNITY at most. 
+// The samples are 24 bit, left aligned, so (sample >> 8) * gain is the scaled sample, left 
+// aligned again, and the sum cannot overflow: no 64 bit products and no saturation in the 
+// ISR. What it costs for 2 to 4 streams, concealment and fades included, is in the 
+// "i2s_tx_callback mix" lines of wgk_bench.c, to hold against CPU_GOV_ISR_US (cpu_gov.h). 
+// host/mix_check.c runs it on the host. 
+
+#ifndef _MIX_H
+#define _MIX_H
+
+#include "wgk_core.h"
+
+#define MIX_UNITY               256
+
+#if RX_STREAMS > 4
+#error "RX_STREAMS is 4 at most"
+#endif
+
+// MIX_SPLIT gives each stream NUM_SLOTS_I2S / RX_STREAMS output slots (one at least), and 
+// those carry the stream's first slots only, the rest of it is not heard: with 2 slots every 
+// guitar is its slot 0 on one side, with 8 slots and 2 streams slots 4 to 7 are gone. 
+typedef enum {
+    MIX_SPLIT = 0,              // the output slots shared out, every stream gets its first ones, a guitar per output
+    MIX_SUM,                    // slot i of every stream into slot i, each at 1 / RX_STREAMS
+} mix_mode_t;
+
+// what mix_init() sets up at boot. A split is for a stream in 2 slots at least 
+#if NUM_SLOTS_I2S >= 2 * RX_STREAMS
+#define MIX_ROUTE               MIX_SPLIT
+#else
+#define MIX_ROUTE               MIX_SUM
+#endif
+
+typedef struct {
+    int32_t src;                // the stream's slot
+    int32_t gain;               // 1/MIX_UNITY, 0 if the stream does not go to this output slot
+} mix_tap_t;
+
+extern mix_tap_t mix_route[RX_STREAMS][NUM_SLOTS_I2S];     // [stream][output slot]
+
+// fills mix_route[]. Call it before the I2S TX channel is enabled. 
+void mix_init(mix_mode_t mode);
+
+// the next packet of all streams into an I2S_BUF_SIZE buffer, false = play silence. ISR. 
+bool mix_read(uint8_t *dmabuf);
+
+#endif /* _MIX_H */
@@ -0,0 +1,104 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// field packet capture ring, see pkt_capture.h. 
+// udp_rx_task is the only writer, capture_task in main.c only reads while the ring is frozen.
+
+#include <string.h>
+#include "wgk_arena.h"
+#include "pkt_capture.h"
+
+static const char *CAP_TAG = "wgk_capture";
+
+static capture_rec_t *cap_ring = NULL;
+static uint32_t cap_head = 0;                   // records written since the last resume
+static bool cap_frozen = false;
+
+
+bool pkt_capture_init(void) {
+#ifdef WGK_ARENA_CAPTURE
+    cap_ring = wgk_ext_arena.rx.capture;                // PSRAM, see wgk_arena.h
+#else
+    ESP_LOGE(CAP_TAG, "built without PKT_CAPTURE");
+    return false;
+#endif
+    ESP_LOGI(CAP_TAG, "capturing the last %d packets", CAPTURE_RECORDS);
+    return true;
+}
+
+
+// called for every recvfrom() that returned. Overwrites the oldest record when full.
+void pkt_capture_add(uint32_t t_us, uint32_t ssn, int len) {
+    uint32_t head;
+    capture_rec_t *r;
+
+    if (cap_ring == NULL || __atomic_load_n(&cap_frozen, __ATOMIC_RELAXED)) return;
+    head = cap_head;
+    r = &cap_ring[head & (CAPTURE_RECORDS - 1)];
+    r->t_us = t_us;
+    r->ssn = (uint16_t)ssn;
+    r->len = len > 0 ? (uint16_t)len : 0;
+    __atomic_store_n(&cap_head, head + 1, __ATOMIC_RELEASE);
+}
+
+
+// the writer may be just past the frozen check, so give it a packet time before pkt_capture_info()
+void pkt_capture_freeze(void) {
+    __atomic_store_n(&cap_frozen, true, __ATOMIC_RELAXED);
+}
+
+
+void pkt_capture_info(capture_info_t *info, uint32_t uptime_ms) {
+    uint32_t head = __atomic_load_n(&cap_head, __ATOMIC_ACQUIRE);
+
+    memset(info, 0, sizeof(capture_info_t));
+    info->magic = CAPTURE_MAGIC;
+    info->version = CAPTURE_VERSION;
+    info->rec_size = sizeof(capture_rec_t);
+    info->packet_time_us = PACKET_TIME_US;
+    info->ringbuf_offset = RINGBUF_OFFSET;
+    info->num_ringbuf_elems = NUM_RINGBUF_ELEMS;
+    info->count = head < CAPTURE_RECORDS ? head : CAPTURE_RECORDS;
+    info->overwritten = head - info->count;
+    info->uptime_ms = uptime_ms;
+}
+
+
+// copies records first .. first + n - 1, counted from the oldest one. Returns how many.
+uint32_t pkt_capture_read(capture_chunk_t *chunk, uint32_t first, uint32_t n) {
+    uint32_t head = __atomic_load_n(&cap_head, __ATOMIC_ACQUIRE);
+    uint32_t count = head < CAPTURE_RECORDS ? head : CAPTURE_RECORDS, oldest = head - count, i;
+
+    if (n > CAPTURE_CHUNK_RECS) n = CAPTURE_CHUNK_RECS;
+    if (first >= count) n = 0;
+    else if (first + n > count) n = count - first;
+    chunk->magic = CAPTURE_MAGIC;
+    chunk->first = first;
+    chunk->n = n;
+    for (i = 0; i < n; i++) {
+        chunk->rec[i] = cap_ring[(oldest + first + i) & (CAPTURE_RECORDS - 1)];
+    }
+    return n;
+}
+
+
+void pkt_capture_resume(void) {
+    __atomic_store_n(&cap_head, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&cap_frozen, false, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,92 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// field packet capture: the receiver records arrival time, sequence number and length of
+// every datagram into a ring in PSRAM. capture_task() in main.c exports it on CAPTURE_PORT,
+// tools/capture_fetch.c saves it to a file and host/replay.c plays it back against the
+// ring buffer. No ESP-IDF dependencies, the host tools use the same structs.
+//
+// Export protocol, all fields little endian:
+//   PC -> receiver   capture_req_t CAP_FREEZE     recording stops, answer is a capture_info_t
+//   PC -> receiver   capture_req_t CAP_READ       answer is one capture_chunk_t per
+//                                                 CAPTURE_CHUNK_RECS records of the range
+//   PC -> receiver   capture_req_t CAP_RESUME     recording restarts with an empty ring
+// Records are numbered from 0 = the oldest one still in the ring.
+// A capture file is a capture_info_t followed by info.count records.
+
+#ifndef _PKT_CAPTURE_H
+#define _PKT_CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CAPTURE_MAGIC           0x57474b43              // "WGKC"
+#define CAPTURE_VERSION         1
+#define CAPTURE_RECORDS         (1 << 18)               // 2 MB of PSRAM, 8.4 minutes. Needs to be a power of 2
+#define CAPTURE_CHUNK_RECS      160                     // records per export datagram, 1280 byte payload
+#define CAPTURE_READ_MAX        32                      // chunks answered per CAP_READ request
+
+// 8 byte per packet. The sequence number is truncated to 16 bit, which is 2 minutes of
+// packets; the replayer unwraps it against the previous record.
+typedef struct {
+    uint32_t t_us;              // arrival time, get_time_us_in_isr()
+    uint16_t ssn;               // low 16 bits of the sequence number, 0 if the length is wrong
+    uint16_t len;               // recvfrom() result
+} capture_rec_t;
+
+typedef enum {
+    CAP_FREEZE = 1,
+    CAP_READ,
+    CAP_RESUME,
+} capture_op_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t op;                // capture_op_t
+    uint32_t first;             // CAP_READ: first record
+    uint32_t count;             // CAP_READ: number of records
+} capture_req_t;
+
+typedef struct {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t rec_size;           // sizeof(capture_rec_t)
+    uint16_t packet_time_us;
+    uint16_t ringbuf_offset;
+    uint16_t num_ringbuf_elems;
+    uint32_t count;             // records available, at most CAPTURE_RECORDS
+    uint32_t overwritten;       // older records lost because the ring wrapped
+    uint32_t uptime_ms;         // when the capture was frozen
+} capture_info_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t first;             // number of the first record in this chunk
+    uint32_t n;                 // records in this chunk
+    capture_rec_t rec[CAPTURE_CHUNK_RECS];
+} capture_chunk_t;
+
+bool pkt_capture_init(void);
+void pkt_capture_add(uint32_t t_us, uint32_t ssn, int len);
+void pkt_capture_freeze(void);
+void pkt_capture_info(capture_info_t *info, uint32_t uptime_ms);
+uint32_t pkt_capture_read(capture_chunk_t *chunk, uint32_t first, uint32_t n);
+void pkt_capture_resume(void);
+
+#endif /* _PKT_CAPTURE_H */
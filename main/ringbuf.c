@@ -20,32 +20,97 @@
 // in fact, this is not actually a ring buffer as far as the writes 
 // because data is written to the buffer number that corresponds with its sequence number
 // but the ring buffer is read sequentially after all, so ... 
+//
+// The ring has two tiers. The NUM_HOT_ELEMS slots around rsn, the playout window, are in 
+// internal RAM, so that ring_buf_get() and the memcpy in i2s_tx_callback() never touch PSRAM 
+// in the ISR. All NUM_RINGBUF_ELEMS slots are in PSRAM and keep the history. ring_buf_put() 
+// runs in udp_rx_task and does all the moving: a packet inside the window is unpacked into 
+// its hot slot, the packet it displaces is written back to PSRAM, a packet further ahead is 
+// unpacked into PSRAM and promoted into the window once rsn has caught up. bufssn[] still 
+// says which packet is the latest for a ring slot; hotssn[] and coldssn[] say where its 
+// samples are. ring_buf_get() falls back to PSRAM when a promotion has not happened yet. 
+//
+// With RING_PACKED both tiers hold the samples in the 24 bit UDP format, packed_buf_t, 
+// and ring_buf_read() unpacks them straight into the DMA buffer. Without, they hold 
+// i2s_buf_t, ready to be copied. 
+//
+// The stream goes through sessions. Every start of the sender is a new one, with a new 
+// session number and its sequence numbers from 1 again. seq_base maps them onto ours, which 
+// keep increasing across sessions, so nothing of an old session is ever taken for a newer 
+// packet. A new session while running, or packets out of place for RING_RESYNC_RUN in a row, 
+// resync: the playout point moves to RINGBUF_OFFSET behind the newest packet without priming 
+// again. ring_buf_read() fades out at the start of every gap and in at its end. 
+//
+// Our sequence numbers wrap, and so do the sender's 16 bit ones on the wire. They are only 
+// compared with the serial number arithmetic of seqnum.h, and an empty slot is marked with 
+// EMPTY(), a number that never maps to it, since any number, 0 included, is a valid one. 
+//
+// Each sender has a ring of its own, a ring_t, with all of the above. There is one, or 
+// RX_STREAMS with RX_MIX, where ring_lookup() hands them out by sender ID and mix_read() 
+// (mix.c) plays them together. ring_buf_put() and ring_buf_read() are stream 0, or the mix. 
+
+#include "wgk_arena.h"
+#include "mix.h"
+#ifdef SSN_STATS
+#include "wireless_gk.h"                            // rx_stats_task() needs FreeRTOS and the I2S driver, target only
+#endif
+
+typedef enum {
+    RING_IDLE = 0,              // nothing received since ring_buf_reset()
+    RING_PRIMING,               // counting in sequence packets before the playout starts
+    RING_RUNNING,               // playing out
+} ring_state_t;
 
-#include "wireless_gk.h"
+typedef enum {
+    FADE_NONE = 0,
+    FADE_IN,
+    FADE_OUT,
+    FADE_REPEAT,                // a fade out of the packet just played, its seam is smoothed in the output
+} fade_t;
 
 // using uint32_t for small values looks like a waste of memory but 
 // a) we have plenty of RAM and 
 // b) ESP32 cannot handle non-32bit-aligned variables like uint8_t very well
 // so using a 32-bit variable is in fact more run-time efficient 
-static uint32_t write_idx;             
+struct ring {
+    uint32_t id;                                    // the sender, 0 while the ring is free, see ring_lookup()
+    seq_t ssn, rsn, prev_ssn;                       // send_sequence_number, read_sequence_number, previous send_sequence_number
+    int diffsn; 
+    uint32_t init_count; 
+    uint32_t session;                               // the sender's session
+    seq_t seq_base;                                 // the sender's sequence numbers plus this are ours, modulo 2^16
+    uint32_t resync_run;                            // packets in a row that arrived out of place
+    ring_elem_t *cold;                              // PSRAM, the history, NUM_RINGBUF_ELEMS
+    ring_elem_t *hot;                               // internal RAM, the playout window, NUM_HOT_ELEMS
+    seq_t bufssn[NUM_RINGBUF_ELEMS];                // the latest packet for each ring slot
+    seq_t coldssn[NUM_RINGBUF_ELEMS];               // the packet cold[] actually holds
+    seq_t hotssn[NUM_HOT_ELEMS];                    // the packet hot[] holds
+#ifdef LATENCY_PROBE
+    uint32_t bufts[NUM_RINGBUF_ELEMS];              // sender capture timestamps, sender clock
+#endif
+    uint32_t state;                                 // ring_state_t, will be used in an ISR context
+    seq_t rsn_jump;                                 // where the playout continues after a resync
+    bool jump_pending;                              // publishes rsn_jump to the ISR, see resync()
+    uint32_t time2; 
+    bool done; 
+    uint32_t arr_time, last_arr_time; 
+    seq_t last_valid_rsn;                           // used by next_elem() only
+    bool stalled;                                   // in a gap, the next packet fades in
+};
+
+DRAM_ATTR static ring_t rings[RX_STREAMS];         // the ISR reads them, so internal RAM
 static uint32_t idx_mask; 
-static uint32_t ssn=1, rsn=1, prev_ssn;             // send_sequence_number, read_sequence_number, previous send_sequence_number
-DRAM_ATTR static int diffsn; 
-static uint32_t init_count = 0; 
-static i2s_buf_t *ring_buf[NUM_RINGBUF_ELEMS];
-DRAM_ATTR static uint32_t bufssn[NUM_RINGBUF_ELEMS];  // TODO is being read only, does not need to be DRAM_ATTR. 
+DRAM_ATTR static uint32_t hot_mask; 
+#define EMPTY(slot)             ((slot) ^ 1)        // in hotssn[], coldssn[]: differs from the slot in the low bit
+#define AUDIO_SLOTS             (NUM_SLOTS_I2S == 8 ? NUM_SLOTS_I2S - 1 : NUM_SLOTS_I2S)    // slot7 of 8 is GKVOL, not audio
 // static bool duplicated[NUM_RINGBUF_ELEMS];      // initialized to all zeroes = false
 static const char *TAG = "wgk_ring_buf";
-static uint32_t slot_mask = 0; 
-DRAM_ATTR static bool running = false;              // will be used in an ISR context
-static uint32_t time2; 
-DRAM_ATTR uint32_t time3 = 0;  
-static bool done = false; 
+DRAM_ATTR uint32_t time3 = 0;                       // the first fetch of any stream
 static bool logging = true;                         // will be deactivated by the output routine
-static uint32_t arr_time, last_arr_time = 0, diff_arr_time; 
+#ifdef TELEMETRY
+lat_hist_t jitter_hist;                             // deviation of the inter-arrival time, read by telemetry_task
+#endif
 
-#define SMOOTHE_SHORT 3
-#define SMOOTHE_LONG 5
 static i2s_frame_t *frame[SMOOTHE_LONG];    // just in case, works also when we use SHORT. 
 
 #ifdef SSN_STATS
@@ -59,63 +124,206 @@ ssn_stat_t ssn_stat[SSN_STAT_ENTRIES];
 uint32_t n = 0; 
 #endif
 
+// the middle one of three frames becomes the mean of its neighbours
+IRAM_ATTR static void smoothe_seam(const i2s_frame_t *f0, i2s_frame_t *f1, const i2s_frame_t *f2) {
+    int i; 
+
+    for (i=0; i<AUDIO_SLOTS; i++) {             // we ignore slot7 which is GKVOL! 
+        // f1 = (f0 + f2)/2 can cause an int overflow! 
+        // step = (frame[2]->slot[i] - frame[0]->slot[i]) / 2; 
+        // frame[1]->slot[i] = frame[0]->slot[i] + step;    
+        f1->slot[i] = (f0->slot[i] / 2) + (f2->slot[i] / 2);    
+    }
+}
+
+
 // smoothe does a linear interpolation to remove discontinuities
 // generated when we duplicate a packet to replace a missing packet
 // see tools/interp.c for a discussion 
 // NEW: only called by _get() in ISR context
-IRAM_ATTR static void smoothe(i2s_buf_t *buf1, i2s_buf_t *buf2, int smooth_mode) {
+IRAM_ATTR void smoothe(i2s_buf_t *buf1, i2s_buf_t *buf2, int smooth_mode) {
     int step, i, j; 
 
     if (smooth_mode == SMOOTHE_LONG) {
-        frame[0] = (i2s_frame_t *) buf1 + (NFRAMES-2)*sizeof(i2s_frame_t);   // these are the two last frames of the previous packet
-        frame[1] = (i2s_frame_t *) buf1 + (NFRAMES-1)*sizeof(i2s_frame_t);
-        frame[2] = (i2s_frame_t *) buf2;
-        frame[3] = (i2s_frame_t *) buf2 + sizeof(i2s_frame_t);
-        frame[4] = (i2s_frame_t *) buf2 + 2 * sizeof(i2s_frame_t);
+        frame[0] = &buf1->frame[NFRAMES-2];     // these are the two last frames of the previous packet
+        frame[1] = &buf1->frame[NFRAMES-1];
+        frame[2] = &buf2->frame[0];
+        frame[3] = &buf2->frame[1];
+        frame[4] = &buf2->frame[2];
         
-        for (i=0; i<NUM_SLOTS_I2S-1; i++) {     // we ignore slot7 which is GKVOL!
+        for (i=0; i<AUDIO_SLOTS; i++) {         // we ignore slot7 which is GKVOL!
             step = (frame[4]->slot[i] - frame[0]->slot[i]) / 4; 
             for (j=0; j<3; j++) {
                 frame[j+1]->slot[i] = frame[j]->slot[i] + step;    
             }
         }
     } else if (smooth_mode == SMOOTHE_SHORT) {
-        // easier: 
-        // frame[0] = &(buf1->frame[NFRAMES-1]); 
-        // frame[1] = &(buf2->frame[0]);
-        // frame[2] = &(buf2->frame[1]); 
-        frame[0] = (i2s_frame_t *) buf1 + (NFRAMES-1)*sizeof(i2s_frame_t);
-        frame[1] = (i2s_frame_t *) buf2;
-        frame[2] = (i2s_frame_t *) buf2 + sizeof(i2s_frame_t);
+        frame[0] = &buf1->frame[NFRAMES-1]; 
+        frame[1] = &buf2->frame[0];
+        frame[2] = &buf2->frame[1]; 
         
-        for (i=0; i<NUM_SLOTS_I2S-1; i++) {     // we ignore slot7 which is GKVOL! 
-            // f1 = (f0 + f2)/2 can cause an int overflow! 
-            // step = (frame[2]->slot[i] - frame[0]->slot[i]) / 2; 
-            // frame[1]->slot[i] = frame[0]->slot[i] + step;    
-            frame[1]->slot[i] = (frame[0]->slot[i] / 2) + (frame[2]->slot[i] / 2);    
-        }
+        smoothe_seam(frame[0], frame[1], frame[2]); 
     } else {
         // oops, this should not happen
     }
 }
 
 
-bool ring_buf_init(void) {
+// a linear ramp over one packet. A fade in leaves the last frame as it is, a fade out (or 
+// repeat) ends in silence. 
+IRAM_ATTR static void fade(i2s_buf_t *buf, uint32_t dir) {
+    int i, j, gain; 
+
+    for (i=0; i<NFRAMES-1; i++) {
+        gain = (dir == FADE_IN) ? i + 1 : NFRAMES - 1 - i; 
+        for (j=0; j<AUDIO_SLOTS; j++) {         // we ignore slot7 which is GKVOL! 
+            buf->frame[i].slot[j] = buf->frame[i].slot[j] / NFRAMES * gain; 
+        }
+    }
+    if (dir != FADE_IN) {
+        for (j=0; j<AUDIO_SLOTS; j++) {
+            buf->frame[NFRAMES-1].slot[j] = 0; 
+        }
+    }
+}
+
+
+static void ring_reset(ring_t *r) {
     int i; 
+
+    r->id = 0; 
+    r->state = RING_IDLE; 
+    r->jump_pending = false; 
+    r->ssn = r->rsn = RING_SEQ_ORIGIN; 
+    r->prev_ssn = RING_SEQ_ORIGIN - 1; 
+    r->init_count = 0; 
+    r->session = r->seq_base = 0; 
+    r->resync_run = 0; 
+    r->last_valid_rsn = RING_SEQ_ORIGIN; 
+    r->stalled = false; 
+    r->last_arr_time = 0; 
+    r->done = false; 
     for (i=0; i<NUM_RINGBUF_ELEMS; i++) {
-        // calloc ring_buffers explicitly in SPIRAM
-        ring_buf[i] = (i2s_buf_t *)heap_caps_calloc(1, sizeof(i2s_buf_t), MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM); // INTERNAL); 
-        if (ring_buf[i] == NULL) {               // This Should Not Happen[TM]
-            ESP_LOGE(TAG, "%s: calloc failed: errno %d", __func__, errno); 
-            return false; 
-        }
-        // ESP_LOGI(TAG, "ringbuf[%d] = 0x%08x", i, (uint32_t)ring_buf[i]);
-    }    
+        r->bufssn[i] = (RING_SEQ_ORIGIN & ~(NUM_RINGBUF_ELEMS - 1)) - NUM_RINGBUF_ELEMS + i;     // a lap before the first packet
+        r->coldssn[i] = EMPTY(i); 
+    }
+    memset(r->cold, 0, NUM_RINGBUF_ELEMS * sizeof(ring_elem_t)); 
+    for (i=0; i<NUM_HOT_ELEMS; i++) {
+        r->hotssn[i] = EMPTY(i); 
+    }
+    memset(r->hot, 0, NUM_HOT_ELEMS * sizeof(ring_elem_t)); 
+}
+
+
+bool ring_buf_init(void) {
+    int i; 
+
+    // both tiers of every stream are in the static arenas, see wgk_arena.h 
+    for (i=0; i<RX_STREAMS; i++) {
+        rings[i].hot = wgk_arena.rx.hot[i]; 
+        rings[i].cold = wgk_ext_arena.rx.ring[i]; 
+    }
+    hot_mask = NUM_HOT_ELEMS - 1; 
     idx_mask = NUM_RINGBUF_ELEMS - 1; 
+    ring_buf_reset();                       // the slots need their EMPTY() marks, 0 is no sequence number to spare 
     return true; 
 }
 
 
+// back to the state right after ring_buf_init(), so that a new stream starts from scratch. 
+// Must not run concurrently with ring_buf_get(), i.e. with the I2S TX channel disabled. 
+void ring_buf_reset(void) {
+    int i; 
+
+    for (i=0; i<RX_STREAMS; i++) {
+        ring_reset(&rings[i]); 
+    }
+    time3 = 0; 
+}
+
+
+IRAM_ATTR ring_t *ring_stream(int i) {
+    return &rings[i]; 
+}
+
+
+// the ring of sender id, which must not be 0. A new sender gets a free ring, or one whose 
+// sender has been silent for RING_STREAM_IDLE_US. It continues that ring as a new session, 
+// so the ISR, which may be playing its tail, never sees it reset. NULL if all are busy. 
+ring_t *ring_lookup(uint32_t id) {
+    uint32_t now = get_time_us_in_isr(); 
+    ring_t *r, *free = NULL; 
+    int i; 
+
+    for (i=0; i<RX_STREAMS; i++) {
+        r = &rings[i]; 
+        if (r->id == id) return r; 
+        if (free == NULL && (r->id == 0 || now - r->last_arr_time >= RING_STREAM_IDLE_US)) free = r; 
+    }
+    if (free != NULL) {
+        ESP_LOGI(TAG, "stream %d: sender %08lx, was %08lx", (int)(free - rings), (unsigned long)id, (unsigned long)free->id); 
+        free->id = id; 
+        free->session = UINT32_MAX;                 // no 16 bit session matches, the next put starts a new one
+    } else {
+#ifdef TELEMETRY
+        telem_inc(TC_RX_NO_STREAM); 
+#endif
+    }
+    return free; 
+}
+
+
+// the streams that have had a packet within RING_STREAM_IDLE_US
+int ring_streams(void) {
+    uint32_t now = get_time_us_in_isr(); 
+    int i, n = 0; 
+
+    for (i=0; i<RX_STREAMS; i++) {
+        if (rings[i].state != RING_IDLE && now - rings[i].last_arr_time < RING_STREAM_IDLE_US) n++; 
+    }
+    return n; 
+}
+
+
+// where the samples of packet s are, NULL if neither tier has them (any more). 
+IRAM_ATTR static ring_elem_t *locate(const ring_t *r, seq_t s) {
+    if (r->hotssn[s & hot_mask] == s) return &r->hot[s & hot_mask]; 
+    if (r->coldssn[s & idx_mask] == s) return &r->cold[s & idx_mask]; 
+    return NULL; 
+}
+
+
+// frees the hot slot of packet s. The packet there has been played already, it goes back 
+// to PSRAM as history unless a newer one owns its ring slot. The ISR may run in between 
+// any two steps, hotssn[] is only set when the samples are complete. 
+static void hot_claim(ring_t *r, seq_t s) {
+    uint32_t h = s & hot_mask; 
+    seq_t old = r->hotssn[h]; 
+
+    if (old != EMPTY(h) && old != s && r->bufssn[old & idx_mask] == old && r->coldssn[old & idx_mask] != old) {
+        r->coldssn[old & idx_mask] = EMPTY(old & idx_mask); 
+        memcpy(&r->cold[old & idx_mask], &r->hot[h], sizeof(ring_elem_t)); 
+        r->coldssn[old & idx_mask] = old; 
+    }
+    r->hotssn[h] = EMPTY(h); 
+}
+
+
+// moves packets that arrived early, into PSRAM, into the window now that rsn has caught up
+static void promote(ring_t *r) {
+    seq_t rsn = r->rsn, s;                  // the ISR advances rsn, one snapshot is enough
+
+    if (r->state != RING_RUNNING) return; 
+    for (s = rsn; s != rsn + NUM_HOT_ELEMS; s++) {
+        if (r->hotssn[s & hot_mask] != s && r->coldssn[s & idx_mask] == s) {
+            hot_claim(r, s); 
+            memcpy(&r->hot[s & hot_mask], &r->cold[s & idx_mask], sizeof(ring_elem_t)); 
+            r->hotssn[s & hot_mask] = s; 
+        }
+    }
+}
+
+
 /*
  * duplicate packet to slot[idx2], smoothe and set dupe = true
  */
@@ -128,34 +336,112 @@ void duplicate (uint32_t idx1, uint32_t idx2) {
 }
 */
 
-void ring_buf_put(udp_buf_t *udp_buf) {
-    int i, j, d; 
+// a new session starts right after the last one, and while running, not before 
+// RINGBUF_OFFSET ahead of what is playing. Its first packet counts as in sequence. 
+static void new_session(ring_t *r, const udp_buf_t *udp_buf) {
+    seq_t first = r->prev_ssn + 1; 
+
+    if (r->state == RING_IDLE) {
+        first = RING_SEQ_ORIGIN;                    // there is nothing to keep apart yet
+        r->state = RING_PRIMING; 
+    } else if (r->state == RING_RUNNING) {
+        if (seq_lt(first, r->rsn + RINGBUF_OFFSET)) first = r->rsn + RINGBUF_OFFSET; 
+        ESP_LOGI(TAG, "new session %08lx, resync", (unsigned long)udp_buf->session); 
+#ifdef TELEMETRY
+        telem_inc(TC_RX_RESYNCS); 
+#endif
+    } else {
+        r->init_count = 0;                          // priming starts over
+    }
+    r->session = udp_buf->session; 
+    r->seq_base = first - udp_buf->sequence_number; 
+    r->prev_ssn = first - 1; 
+    r->resync_run = 0; 
+}
+
 
-    ssn = udp_buf->sequence_number;
-#ifdef RX_STATS    
-    arr_time = get_time_us_in_isr();
+// moves the playout point to RINGBUF_OFFSET behind ssn. Late packets move ahead, so that our 
+// sequence numbers keep increasing, a lead too long makes the ISR skip forward. 
+static void resync(ring_t *r, int d) {
+    if (d < 0) {
+        r->seq_base += RINGBUF_OFFSET - d; 
+        r->ssn += RINGBUF_OFFSET - d; 
+        r->prev_ssn = r->ssn - 1; 
+    } else {
+        // rsn_jump first, the ISR reads it once it sees jump_pending 
+        r->rsn_jump = r->ssn - RINGBUF_OFFSET; 
+        __atomic_store_n(&r->jump_pending, true, __ATOMIC_RELEASE); 
+    }
+    r->resync_run = 0; 
+    ESP_LOGI(TAG, "resync, lead was %d", d); 
+#ifdef TELEMETRY
+    telem_inc(TC_RX_RESYNCS); 
 #endif
+}
+
+
+void ring_put(ring_t *r, udp_buf_t *udp_buf) {
+    int i, d; 
+    uint32_t write_idx; 
+    ring_elem_t *dst; 
+    bool hot; 
+
+    if (r->state == RING_IDLE || udp_buf->session != r->session) {
+        new_session(r, udp_buf); 
+    }
+    r->ssn = seq_unwrap(r->prev_ssn + 1, udp_buf->sequence_number + r->seq_base);
+    r->arr_time = get_time_us_in_isr();
+
+    // the sender and we normally agree on where the stream is. Late after an outage, when the 
+    // backlog arrives at once, is what the history is for. Out of place at the packet rate, 
+    // like with a drifting clock, the playout point follows the sender. 
+    if (r->state == RING_RUNNING && !__atomic_load_n(&r->jump_pending, __ATOMIC_ACQUIRE)) {
+        d = seq_diff(r->ssn, r->rsn); 
+        if (d >= 0 && d <= RING_RESYNC_AHEAD) {
+            r->resync_run = 0; 
+        } else if (r->arr_time - r->last_arr_time >= PACKET_TIME_US / 2) {
+            r->resync_run++; 
+        }
+        if (r->resync_run >= RING_RESYNC_RUN || d >= NUM_RINGBUF_ELEMS / 2 || d <= -NUM_RINGBUF_ELEMS / 2) {
+            resync(r, d); 
+        }
+    }
     
-    if (ssn == prev_ssn + 1) {             // we're in the correct sequence but this appears to always be true.
+    if (r->ssn == r->prev_ssn + 1) {       // we're in the correct sequence but this appears to always be true.
         //if (ssn > rsn) {                   // this is a legitimate packet
-        write_idx = ssn & idx_mask;     // no modulo, no if-else
-        // unpack
+        write_idx = r->ssn & idx_mask;  // no modulo, no if-else
+        // inside the playout window straight into internal RAM, late or far ahead into PSRAM 
+        hot = (r->ssn - r->rsn < NUM_HOT_ELEMS); 
+        if (hot) {
+            hot_claim(r, r->ssn); 
+            dst = &r->hot[r->ssn & hot_mask]; 
+        } else {
+            r->coldssn[write_idx] = EMPTY(write_idx); 
+            dst = &r->cold[write_idx]; 
+        }
+#ifdef RING_PACKED
+        // keep the slots we play, ring_read() unpacks them
         for (i=0; i<NFRAMES; i++) {
-            for (j=NUM_SLOTS_I2S-1; j>=0; j--) {
-                // the offset of a sample in the DMA buffer is (i * NUM_SLOTS_I2S + j) * SLOT_SIZE_I2S + 1
-                // the offset of a sample in the UDP buffer is (i * NUM_SLOTS_UDP + j) * SLOT_SIZE_UDP
-                memcpy ((uint8_t *)ring_buf[write_idx] + (i * NUM_SLOTS_I2S + j) * SLOT_SIZE_I2S + 1, 
-                        (uint8_t *)udp_buf + (i * NUM_SLOTS_UDP + j) * SLOT_SIZE_UDP, 
-                        SLOT_SIZE_UDP); 
-            }
+            memcpy(dst->frame[i].slot, udp_buf->frame[i].slot, sizeof(packed_frame_t)); 
         }
+#else
+        udp_unpack((uint8_t *)dst, (const uint8_t *)udp_buf, sizeof(udp_frame_t)); 
+#endif
         // if the buffer on the left was duped -> smoothe. 
         // if (duplicated[(ssn - 1) & idx_mask]) {
         //     smoothe (ring_buf[(ssn - 1) & idx_mask], ring_buf[write_idx], SMOOTHE_SHORT);
         // }
         // this was a ligitimate packet, so we mark it accordingly. 
         // duplicated[write_idx] = false; 
-        bufssn[write_idx] = ssn;
+        if (hot) {
+            r->hotssn[r->ssn & hot_mask] = r->ssn; 
+        } else {
+            r->coldssn[write_idx] = r->ssn; 
+        }
+        r->bufssn[write_idx] = r->ssn;
+#ifdef LATENCY_PROBE
+        r->bufts[write_idx] = udp_buf->timestamp;
+#endif
         // duplicate the current packet to the next slot to mitigate errors in the next step
         // duplicate (write_idx, (ssn + 1) & idx_mask); 
         // also smoothe the gap after the duplicate in case we see > 12 ms outages
@@ -167,7 +453,7 @@ void ring_buf_put(udp_buf_t *udp_buf) {
         // duplicate twice? 
         // duplicate ((ssn + 1) & idx_mask, (ssn + 2) & idx_mask); 
         // and keep track of the sequencing
-        init_count++;               // this needs only to be done when not running yet, 
+        r->init_count++;            // this needs only to be done when not running yet, 
                                     // but the ADDI is so fast that it makes no sense to check if running first. 
         // }    
 /*
@@ -184,103 +470,127 @@ void ring_buf_put(udp_buf_t *udp_buf) {
 #ifdef WITH_TEMP
         tx_temp = udp_buf->tx_temp; 
 #endif    
+    } else {
+        if (r->state == RING_PRIMING) r->init_count = 0;    // the packets to start with have to be consecutive
+#ifdef TELEMETRY
+        telem_inc(TC_RX_GAPS);
+        if (seq_gt(r->ssn, r->prev_ssn)) {
+            telem_add(TC_RX_LOST, r->ssn - r->prev_ssn - 1);
+        }
+#endif
     } 
 
 #ifdef SSN_STATS
     if (logging) {
         ssn_stat[n].timestamp = get_time_us_in_isr();
-        ssn_stat[n].sn = (int) ssn;
-        ssn_stat[n].bufssn = (ssn > rsn) ? 1 : 0;      // we mark this as inserted if ssn > rsn else not
+        ssn_stat[n].sn = (int) r->ssn;
+        ssn_stat[n].bufssn = seq_gt(r->ssn, r->rsn) ? 1 : 0;    // we mark this as inserted if ssn > rsn else not
         n = (n+1) & 0x00001fff;       // ring 
     }
 #endif
 
 
     // keep track of the sequencing
-    prev_ssn = ssn; 
+    r->prev_ssn = r->ssn; 
             
-#ifdef RX_STATS            
-    if (running) {
-        diff_arr_time = arr_time - last_arr_time;
-        last_arr_time = arr_time; 
-        if (diff_arr_time > 4000) {
-            ESP_LOGW(TAG, "%10lu", diff_arr_time);        
-        }
+#ifdef TELEMETRY            
+    if (r->state == RING_RUNNING) {
+        uint32_t diff_arr_time = r->arr_time - r->last_arr_time;
+        lat_hist_add(&jitter_hist, abs((int32_t)diff_arr_time - PACKET_TIME_US));
+        telem_hist_add(TH_INTERARRIVAL, diff_arr_time);
     }
-#endif    
+#endif
+    r->last_arr_time = r->arr_time;     
     
-    // TODO: init_count should be reset to 0 when an error occurs during startup,
-    // so that we actually have consecutive packets. But then, we never saw missing 
-    // or out of order packets .. 
-    if (!running && (init_count >= RINGBUF_OFFSET + 2)) {       // if we have enough consecutive valid packets: start replay. 
-        running = true;
-        time2 = get_time_us_in_isr(); 
-        rsn = ssn - RINGBUF_OFFSET;                         // initial value. 
+    if (r->state == RING_PRIMING && (r->init_count >= RINGBUF_OFFSET + 2)) {  // if we have enough consecutive valid packets: start replay. 
+        r->state = RING_RUNNING;
+        r->time2 = get_time_us_in_isr(); 
+        r->rsn = r->ssn - RINGBUF_OFFSET;                   // initial value. 
         // vTaskDelay (...); 
         // i2s_channel_enable(i2s_tx_handle);
         ESP_LOGI(TAG, "running"); 
         // TODO: LED "running" 
     }
     
-#ifdef RX_STATS 
-    if (!done && running && (time3 != 0)) {
+#ifdef TELEMETRY 
+    if (!r->done && r->state == RING_RUNNING && (time3 != 0)) {
         // float quot = (float) (time3 - time2) / (1.0e6 * (float) NFRAMES / (float) SAMPLE_RATE);
-        uint32_t diff = time3 - time2;
-        ESP_LOGW(TAG, "--- time2 %lu time3 %lu diff %lu", time2, time3, diff); 
-        done = true; 
+        uint32_t diff = time3 - r->time2;
+        ESP_LOGW(TAG, "--- time2 %lu time3 %lu diff %lu", r->time2, time3, diff); 
+        r->done = true; 
     }
 
-    if (running) {
-        d = ssn - rsn;
-        if (d > stats[0]) stats[0] = d;
-        if (d < stats[1]) stats[1] = d;
-        // if (ssn <= rsn)   stats[2]++;
+    if (r->state == RING_RUNNING) {
+        d = seq_diff(r->ssn, r->rsn);
+        telem_min(TG_RING_LEAD_MIN, d);
+        telem_max(TG_RING_LEAD_MAX, d);
+        if (d >= 0) {
+            telem_hist_add(TH_RING_LEAD, d);
+        } else {
+            telem_hist_add(TH_RING_LATE, -d);
+        }
     }
 #endif            
 
 
     // for now, we ignore the checksum but sum up checksum errors for the statistics. 
-#ifdef RX_STATS
+#ifdef TELEMETRY
     if ( udp_buf->checksum != calculate_checksum((uint32_t *)udp_buf, NFRAMES * sizeof(udp_frame_t) / 4) ) {
-        // stats[6]++; 
+        telem_inc(TC_RX_CHECKSUM); 
     }     
 #endif            
 
+    promote(r); 
+    TRACE(TRACE_RX_PUT, r->ssn);
+}
+
+
+void ring_buf_put(udp_buf_t *udp_buf) {
+    ring_put(&rings[0], udp_buf); 
 }
 
 
 // This will be called in an ISR context so beware! 
-IRAM_ATTR uint8_t *ring_buf_get(void) {
-    uint8_t *p;
-    static uint32_t last_valid_rsn;
-    static bool stalled; 
+// The element to play for rsn, NULL for silence. When the packet for rsn is missing and a 
+// newer one is played instead, *prev is the last valid one, to smoothe the seam with. 
+// *fade says if ring_read() fades it in or out. 
+IRAM_ATTR static ring_elem_t *next_elem(ring_t *r, ring_elem_t **prev, uint32_t *fade) {
+    ring_elem_t *p;
+    seq_t rsn = r->rsn; 
     
-    if (!running) return NULL; 
+    *prev = NULL; 
+    *fade = FADE_NONE; 
+    if (r->state != RING_RUNNING) return NULL; 
     
 #ifdef SSN_STATS
     if (logging) {
         ssn_stat[n].timestamp = get_time_us_in_isr();
         ssn_stat[n].sn = - (int) rsn;                   // negative to mark a get entry. 
-        ssn_stat[n].bufssn = bufssn[rsn & idx_mask];    // ssn of the packet that is in the slot
+        ssn_stat[n].bufssn = r->bufssn[rsn & idx_mask]; // ssn of the packet that is in the slot
         n = (n+1) & 0x00001fff;       // ring 
     }
 #endif
 
     // if (bufssn[rsn & idx_mask] == rsn)  this is a regular packet, and we are exactly on track. Must be first in if-else. 
-    // if (bufssn[rsn & idx_mask] >  rsn)  we observe a burst outpacing rsn. smoothe with the last valid packet. 
-    // if (bufssn[rsn & idx_mask] <  rsn)  we observe a stall and return silence
+    // if (bufssn[rsn & idx_mask] after rsn, within a lap)  we observe a burst outpacing rsn. smoothe with the last valid packet. 
+    // otherwise we observe a stall and return silence. A slot further ahead is from a later lap, or so stale that it wrapped. 
     
-    diffsn = rsn - bufssn[rsn & idx_mask];
-    if (bufssn[rsn & idx_mask] == rsn) {              // sender is ahead of us: OK. 
-        p = (uint8_t *)ring_buf[rsn & idx_mask];        
-        last_valid_rsn = rsn;
-        stalled = false; 
-    } else if (bufssn[rsn & idx_mask] > rsn) {
-        // always smoothe with the last valid packet, it could be a burst outpacing rsn
-        smoothe (ring_buf[last_valid_rsn & idx_mask], ring_buf[rsn & idx_mask], SMOOTHE_SHORT);
-        p = (uint8_t *)ring_buf[rsn & idx_mask];        
-        last_valid_rsn = rsn;
-        stalled = false; 
+    r->diffsn = seq_diff(rsn, r->bufssn[rsn & idx_mask]);
+    if (r->diffsn == 0) {                           // sender is ahead of us: OK. 
+        p = locate(r, rsn);        
+#ifdef TELEMETRY
+        if (r->hotssn[rsn & hot_mask] != rsn) telem_inc(TC_RX_COLD_READS);
+#endif
+        r->last_valid_rsn = rsn;
+    } else if (r->diffsn < 0 && r->diffsn > -NUM_RINGBUF_ELEMS) {
+        // always smoothe with the last valid packet, it could be a burst outpacing rsn. 
+        // The slot holds that newer packet, wherever its samples are. 
+        p = locate(r, r->bufssn[rsn & idx_mask]); 
+        *prev = (p != NULL) ? locate(r, r->bufssn[r->last_valid_rsn & idx_mask]) : NULL; 
+        r->last_valid_rsn = rsn;
+#ifdef TELEMETRY
+        telem_inc(TC_RX_CONCEALED);
+#endif
     } else {                        // sending has stalled; return silence
         // smoothe once with itself in case we're stalled
 /*
@@ -290,14 +600,49 @@ IRAM_ATTR uint8_t *ring_buf_get(void) {
         }
         p = (uint8_t *)ring_buf[last_valid_rsn & idx_mask];
 */
-        if (diffsn >= NUM_RINGBUF_ELEMS) {     // now that was really an overrun!  
+        if (r->diffsn >= NUM_RINGBUF_ELEMS) {  // now that was really an overrun!  
             // rsn = rsn - NUM_RINGBUF_ELEMS  ;   
         }
-        stats[2]++;
+#ifdef TELEMETRY
+        telem_inc(TC_RX_UNDERRUNS);
+#endif
         p = NULL; 
+        if (!r->stalled) {
+            // the last packet once more, faded out, instead of cutting to silence. No *prev, 
+            // smoothe() would write into the ring slot it is played from: ring_read() smoothes 
+            // the seam with itself in the DMA buffer 
+            p = locate(r, r->bufssn[r->last_valid_rsn & idx_mask]); 
+            *fade = FADE_REPEAT; 
+            r->stalled = true; 
+        }
+    }
+    if (p != NULL && r->stalled && *fade == FADE_NONE) {
+        *fade = FADE_IN; 
+        r->stalled = false; 
     }
 
-    rsn = rsn + 1; 
+#ifdef LATENCY_PROBE
+    // the DMA buffer we are about to fill starts playing when the other DMA buffers are through. 
+    // The sender's timestamp marks the end of the capture, the first sample is one packet time older. 
+    // ADC and DAC group delays are not included. Only stream 0 has a clock_sync. 
+    if (p != NULL && *fade != FADE_OUT && *fade != FADE_REPEAT && r == &rings[0] && clock_sync_valid(&clock_sync)) {
+        lat_hist_add(&lat_hist, (int32_t)(get_time_us_in_isr() + (NUM_TX_DMA_BUFS - 1) * PACKET_TIME_US
+                                          - clock_sync_to_local(&clock_sync, r->bufts[rsn & idx_mask]) + PACKET_TIME_US));
+    }
+#endif
+
+    TRACE(TRACE_RX_GET, rsn);
+    r->rsn = rsn + 1; 
+    if (__atomic_load_n(&r->jump_pending, __ATOMIC_ACQUIRE)) {  // a resync, this one fades out and the one at rsn_jump in 
+        if (p != NULL && *fade != FADE_REPEAT) *fade = FADE_OUT; 
+        r->stalled = true; 
+        r->rsn = r->rsn_jump; 
+        __atomic_store_n(&r->jump_pending, false, __ATOMIC_RELEASE); 
+    }
+#ifdef TELEMETRY
+    if (p != NULL && (*fade == FADE_OUT || *fade == FADE_REPEAT)) telem_inc(TC_RX_FADE_OUTS); 
+    if (p != NULL && *fade == FADE_IN) telem_inc(TC_RX_FADE_INS); 
+#endif
     if (time3 == 0) {                   // when does the first fetch occur. 
         time3 = get_time_us_in_isr();
     }
@@ -305,94 +650,118 @@ IRAM_ATTR uint8_t *ring_buf_get(void) {
 }
 
 
-/* 
- * RX stats
- * 0 received
- * 1 ssn == prev_ssn + 1
- * 2 ssn <= rsn
- */
- 
-#ifdef RX_STATS
-static char stats_msg[][20] = { "received", "ssn == prev_ssn + 1", "ssn <= rsn", }; 
-                       
-void rx_stats_task(void *args) {
-    uint32_t overall_stats[NUM_STATS] = {0}; 
-    uint32_t last_ssn = 0, packets_sent, overall_packets_sent = 0;
-    int i; 
-    uint32_t stat_count = 0; 
-    char *TAG = "rx_stats";
-    
-    while (1) {
-#if 0    
-        packets_sent = ssn - last_ssn;
-        last_ssn = ssn; 
-        overall_packets_sent += packets_sent; 
-        stat_count++; 
-        printf ("%-10s %8lu : %10s %10s\n", "stats", stat_count, "intvl", "overall");  
-        printf ("%-20s: %10lu %10lu\n", "packets sent", packets_sent, overall_packets_sent);
-        for (i=0; i<NUM_STATS; i++) {
-            overall_stats[i] += stats[i];
-            printf ("%-20s: %10lu %10lu\n", stats_msg[i], stats[i], overall_stats[i]);
-            stats[i] = 0;   
+#ifndef RING_PACKED
+IRAM_ATTR static i2s_buf_t *get_elem(ring_t *r, uint32_t *dir) {
+    i2s_buf_t *prev, *cur = next_elem(r, &prev, dir); 
+
+    if (prev != NULL) smoothe (prev, cur, SMOOTHE_SHORT);
+    return cur;
+}
+
+
+// without the fades, the pointer is into the ring of stream 0
+IRAM_ATTR uint8_t *ring_buf_get(void) {
+    uint32_t dir; 
+
+    return (uint8_t *)get_elem(&rings[0], &dir);
+}
+
+
+IRAM_ATTR bool ring_read(ring_t *r, uint8_t *dmabuf) {
+    uint32_t dir; 
+    i2s_buf_t *p = get_elem(r, &dir), *out = (i2s_buf_t *)dmabuf; 
+
+    if (p == NULL) return false; 
+    memcpy(dmabuf, p, I2S_BUF_SIZE); 
+    if (dir == FADE_REPEAT) smoothe_seam(&p->frame[NFRAMES-1], &out->frame[0], &out->frame[1]); 
+    if (dir != FADE_NONE) fade(out, dir); 
+    return true; 
+}
+
+#else 
+
+// one pass from the ring into the DMA buffer. The seam is smoothed in the DMA buffer, 
+// the ring keeps what was received. 
+IRAM_ATTR bool ring_read(ring_t *r, uint8_t *dmabuf) {
+    uint32_t dir; 
+    packed_buf_t *prev, *cur = next_elem(r, &prev, &dir); 
+    i2s_buf_t *out = (i2s_buf_t *)dmabuf; 
+    i2s_frame_t last; 
+    const uint8_t *s; 
+    int j; 
+
+    if (cur == NULL) return false; 
+    udp_unpack(dmabuf, (const uint8_t *)cur, sizeof(packed_frame_t)); 
+    if (prev != NULL || dir == FADE_REPEAT) {
+        s = (prev != NULL ? prev : cur)->frame[NFRAMES-1].slot; 
+        for (j=0; j<NUM_SLOTS_I2S; j++, s += SLOT_SIZE_UDP) {
+            last.slot[j] = (int)(((uint32_t)s[0] << 8) | ((uint32_t)s[1] << 16) | ((uint32_t)s[2] << 24)); 
         }
-        printf ("\n"); 
-#endif 
-        vTaskDelay(10000/ portTICK_PERIOD_MS); // every ~ 10 seconds 
-        if (stats[2] >= 0) {
-            int delta_t, delta_t_ssn;
-            uint32_t last_ts = 0, last_ssn_ts = 0;
-            overall_stats[2] += stats[2]; 
-            ESP_LOGI(TAG, "%10lu %10lu Rx %.1f°C Tx %.1f°C %d", stats[2], overall_stats[2], rx_temp, tx_temp, diffsn);
-            stats[2] = 0; 
+        smoothe_seam(&last, &out->frame[0], &out->frame[1]); 
+    }
+    if (dir != FADE_NONE) fade(out, dir); 
+    return true; 
+}
+#endif  /* RING_PACKED */
 
-#ifdef SSN_STATS
-            logging = false; 
-            i2s_channel_disable(i2s_tx_handle);
-            vTaskDelete(udp_rx_task_handle);
-            vTaskDelay(1000/portTICK_PERIOD_MS);
-            printf ("\nssn_stats\n");
-            for (int m=0; m<SSN_STAT_ENTRIES; m++) {
-                if (ssn_stat[m].sn > 0) {                                       // we have a put entry
-                    delta_t = ssn_stat[m].timestamp - last_ts;
-                    delta_t_ssn = ssn_stat[m].timestamp - last_ssn_ts;
-                    last_ssn_ts = last_ts = ssn_stat[m].timestamp;
-                    if (ssn_stat[m].bufssn) {                                   // packet was inserted
-                        printf ("%10lu %10d ssn %10lu -> slot %lu and %lu\n", 
-                                ssn_stat[m].timestamp,
-                                delta_t_ssn,                                    // time since last valid packet
-                                (uint32_t) ssn_stat[m].sn, 
-                                (uint32_t) ssn_stat[m].sn & idx_mask,           // own slot
-                                ((uint32_t) ssn_stat[m].sn + 1) & idx_mask      // next slot b/c duplicated
-                                ); 
-                    } else {                                                    // packet was logged but not inserted
-                        printf ("%10lu %10d ssn %10lu\n", 
-                                ssn_stat[m].timestamp,
-                                delta_t_ssn,                                    // time since last valid packet
-                                (uint32_t) ssn_stat[m].sn
-                                );                     
-                    }
-                } else {                     // a get entry
-                    delta_t = ssn_stat[m].timestamp - last_ts;
-                    last_ts = ssn_stat[m].timestamp;
-                    printf ("%10lu %10d rsn %10lu reads ssn %10lu from slot %lu\n", 
-                            ssn_stat[m].timestamp,
-                            delta_t,                                        // time since last event
-                            (uint32_t) (- ssn_stat[m].sn),                  // the rsn
-                            ssn_stat[m].bufssn,                             // ssn that is in the slot
-                            (uint32_t) (- ssn_stat[m].sn) & idx_mask);      // own slot number
-                
-                }
-            
-            }
 
-#endif  /* SSN_STATS */
-        }        
-        stat_count++;
-        if (stat_count == 60) {         // after 10 minutes
-            ESP_LOGW(TAG, "10 minutes %10lu mindiff %d maxdiff %d", overall_stats[2], stats[1], stats[0]);
-        } 
+// what i2s_tx_callback() plays: stream 0, or all of them through the output stage
+IRAM_ATTR bool ring_buf_read(uint8_t *dmabuf) {
+#if RX_STREAMS > 1
+    return mix_read(dmabuf); 
+#else
+    return ring_read(&rings[0], dmabuf); 
+#endif
+}
 
+
+#ifdef SSN_STATS
+// dumps the SSN_STATS put/get log once after 10 seconds and stops the receiver. 
+// Periodic statistics are published by telemetry_task(). 
+void rx_stats_task(void *args) {
+    int delta_t, delta_t_ssn;
+    uint32_t last_ts = 0, last_ssn_ts = 0;
+    
+    vTaskDelay(10000/ portTICK_PERIOD_MS);
+    logging = false; 
+    i2s_channel_disable(i2s_tx_handle);
+    vTaskDelete(udp_rx_task_handle);
+    vTaskDelay(1000/portTICK_PERIOD_MS);
+    printf ("\nssn_stats\n");
+    for (int m=0; m<SSN_STAT_ENTRIES; m++) {
+        if (ssn_stat[m].sn > 0) {                                       // we have a put entry
+            delta_t = ssn_stat[m].timestamp - last_ts;
+            delta_t_ssn = ssn_stat[m].timestamp - last_ssn_ts;
+            last_ssn_ts = last_ts = ssn_stat[m].timestamp;
+            if (ssn_stat[m].bufssn) {                                   // packet was inserted
+                printf ("%10lu %10d ssn %10lu -> slot %lu and %lu\n", 
+                        ssn_stat[m].timestamp,
+                        delta_t_ssn,                                    // time since last valid packet
+                        (uint32_t) ssn_stat[m].sn, 
+                        (uint32_t) ssn_stat[m].sn & idx_mask,           // own slot
+                        ((uint32_t) ssn_stat[m].sn + 1) & idx_mask      // next slot b/c duplicated
+                        ); 
+            } else {                                                    // packet was logged but not inserted
+                printf ("%10lu %10d ssn %10lu\n", 
+                        ssn_stat[m].timestamp,
+                        delta_t_ssn,                                    // time since last valid packet
+                        (uint32_t) ssn_stat[m].sn
+                        );                     
+            }
+        } else {                     // a get entry
+            delta_t = ssn_stat[m].timestamp - last_ts;
+            last_ts = ssn_stat[m].timestamp;
+            printf ("%10lu %10d rsn %10lu reads ssn %10lu from slot %lu\n", 
+                    ssn_stat[m].timestamp,
+                    delta_t,                                        // time since last event
+                    (uint32_t) (- ssn_stat[m].sn),                  // the rsn
+                    ssn_stat[m].bufssn,                             // ssn that is in the slot
+                    (uint32_t) (- ssn_stat[m].sn) & idx_mask);      // own slot number
+        
+        }
+    
     }
+    vTaskDelete(NULL);
 }
-#endif  /* RX_STATS */
+#endif  /* SSN_STATS */
 
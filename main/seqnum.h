@@ -0,0 +1,57 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// serial number arithmetic (RFC 1982) for the sequence numbers of the stream. No ESP-IDF
+// dependencies, the host harnesses and tools use it as well.
+//
+// On the wire a packet carries the low 16 bits of the sender's count, which wrap after
+// 65536 packets, about 2 minutes. The receiver extends them to its own 32 bit sequence
+// numbers against the one it expects next, and those wrap after 2^32 packets. Neither is
+// ever compared with < or >: a is before b if the difference a - b, taken modulo the
+// sequence space, is negative. That holds as long as the two are less than half the space
+// apart, 32768 packets (63 s) on the wire.
+
+#ifndef _SEQNUM_H
+#define _SEQNUM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint32_t seq_t;         // the receiver's sequence numbers, ringbuf.c
+typedef uint16_t wire_seq_t;    // udp_buf_t.sequence_number
+
+// how far a is ahead of b, negative if behind
+static inline int32_t seq_diff(seq_t a, seq_t b) {
+    return (int32_t)(a - b);
+}
+
+static inline bool seq_lt(seq_t a, seq_t b) {
+    return seq_diff(a, b) < 0;
+}
+
+static inline bool seq_gt(seq_t a, seq_t b) {
+    return seq_diff(a, b) > 0;
+}
+
+// the sequence number with the low bits w that is closest to ref
+static inline seq_t seq_unwrap(seq_t ref, wire_seq_t w) {
+    return ref + (int16_t)(wire_seq_t)(w - (wire_seq_t)ref);
+}
+
+#endif /* _SEQNUM_H */
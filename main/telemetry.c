@@ -0,0 +1,121 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// telemetry counter storage and frame encoding, see telemetry.h.
+// The publishing task lives in main.c because it needs sockets and FreeRTOS.
+
+#include <string.h>
+#include <limits.h>
+#include "telemetry.h"
+#include "wgk_port.h"
+
+// touched from ISR context, so keep them in internal RAM
+DRAM_ATTR uint32_t telem_counter[TC_NUM_COUNTERS];
+DRAM_ATTR int32_t telem_gauge[TG_NUM_GAUGES];
+DRAM_ATTR log_hist_t telem_hist[TH_NUM_HISTS];
+
+const char *telem_counter_name[TC_NUM_COUNTERS] = {
+    "tx_packets", "tx_errors", "tx_enomem",
+    "rx_packets", "rx_errors", "rx_bad_len", "rx_checksum",
+    "rx_gaps", "rx_lost", "rx_concealed", "rx_underruns", "rx_cold_reads",
+    "heap_allocs", "heap_allocs_pipeline",
+    "rx_resyncs", "rx_fade_outs", "rx_fade_ins",
+    "rx_no_stream",
+    "tx_dest_errors_0", "tx_dest_errors_1", "tx_dest_errors_2", "tx_dest_errors_3",
+    "tx_datagrams",
+};
+
+const char *telem_gauge_name[TG_NUM_GAUGES] = {
+    "ring_lead_min", "ring_lead_max",
+    "jitter_p50_us", "jitter_p99_us", "jitter_max_us",
+    "latency_p50_us", "latency_p99_us",
+    "hwm_udp_task", "hwm_telem_task", "heap_free_min",
+    "temp_tx_centi", "temp_rx_centi",
+    "first_audio_ms", "fast_boot",
+    "tx_ps_sched", "tx_ps_ma", "tx_ps_twt",
+    "cpu_mhz", "cpu_idle_mhz", "cpu_margin",
+    "rx_streams",
+};
+
+const char *telem_hist_name[TH_NUM_HISTS] = {
+    "interarrival_us", "ring_lead", "ring_late",
+    "tx_send_0_us", "tx_send_1_us", "tx_send_2_us", "tx_send_3_us",
+};
+
+
+// smallest and largest value that falls into a bucket
+uint32_t log_hist_lower(uint32_t bucket) {
+    uint32_t octave, sub;
+
+    if (bucket < LOG_HIST_LINEAR) return bucket;
+    octave = (bucket - LOG_HIST_LINEAR) >> LOG_HIST_SUB_BITS;
+    sub = (bucket - LOG_HIST_LINEAR) & (LOG_HIST_SUB - 1);
+    return (LOG_HIST_SUB + sub) << (octave + LOG_HIST_LINEAR_BITS - LOG_HIST_SUB_BITS);
+}
+
+uint32_t log_hist_upper(uint32_t bucket) {
+    if (bucket >= LOG_HIST_BINS - 1) return UINT32_MAX;
+    return log_hist_lower(bucket + 1) - 1;
+}
+
+
+// min/max gauges start from the opposite end so that the first update wins
+void telem_reset_interval(void) {
+    telem_set(TG_RING_LEAD_MIN, INT32_MAX);
+    telem_set(TG_RING_LEAD_MAX, INT32_MIN);
+}
+
+
+void telem_fill_frame(telem_frame_t *f, char role, uint32_t seq, uint32_t uptime_ms) {
+    int i;
+
+    f->magic = TELEM_MAGIC;
+    f->version = TELEM_VERSION;
+    f->role = (uint8_t)role;
+    f->num_counters = TC_NUM_COUNTERS;
+    f->num_gauges = TG_NUM_GAUGES;
+    f->seq = seq;
+    f->uptime_ms = uptime_ms;
+    for (i = 0; i < TC_NUM_COUNTERS; i++) {
+        f->counter[i] = __atomic_load_n(&telem_counter[i], __ATOMIC_RELAXED);
+    }
+    for (i = 0; i < TG_NUM_GAUGES; i++) {
+        f->gauge[i] = __atomic_load_n(&telem_gauge[i], __ATOMIC_RELAXED);
+    }
+    // an interval without a single update reports 0 rather than INT32_MAX/MIN
+    if (f->gauge[TG_RING_LEAD_MIN] == INT32_MAX) f->gauge[TG_RING_LEAD_MIN] = 0;
+    if (f->gauge[TG_RING_LEAD_MAX] == INT32_MIN) f->gauge[TG_RING_LEAD_MAX] = 0;
+}
+
+
+// takes the bins and clears them in one go, so no update between two snapshots gets lost
+void telem_hist_snapshot(telem_hist_frame_t *f, telem_hist_t h, char role, uint32_t seq, uint32_t uptime_ms) {
+    int i;
+
+    f->magic = TELEM_HIST_MAGIC;
+    f->version = TELEM_VERSION;
+    f->role = (uint8_t)role;
+    f->hist = (uint8_t)h;
+    f->num_bins = LOG_HIST_BINS;
+    f->seq = seq;
+    f->uptime_ms = uptime_ms;
+    for (i = 0; i < LOG_HIST_BINS; i++) {
+        f->bin[i] = __atomic_exchange_n(&telem_hist[h].bin[i], 0, __ATOMIC_RELAXED);
+    }
+}
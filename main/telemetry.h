@@ -0,0 +1,196 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// typed telemetry counters and gauges, and the binary frame that telemetry_task()
+// broadcasts on TELEM_PORT. No ESP-IDF dependencies, tools/telemetry_collect.c uses this as well.
+
+#ifndef _TELEMETRY_H
+#define _TELEMETRY_H
+
+#include <stdint.h>
+
+#define TELEM_MAGIC             0x57474b54              // "WGKT"
+#define TELEM_VERSION           1
+#define TELEM_INTERVAL          1000                    // ms between two frames
+#define TELEM_LOG_INTERVAL      10                      // frames between two console summaries
+#define TELEM_HIST_MAGIC        0x57474b48              // "WGKH"
+#define TELEM_HIST_INTERVAL     10                      // frames between two histogram snapshots
+#define TELEM_MAX_DESTS         4                       // receivers a MULTI_RX sender can report on
+
+// counters are cumulative since boot and wrap at 2^32. The collector computes rates.
+// Append new entries at the end only, the collector matches them by index.
+typedef enum {
+    TC_TX_PACKETS = 0,          // packets sent, to the first of TX_DESTS
+    TC_TX_ERRORS,               // sendto() failures other than ENOMEM
+    TC_TX_ENOMEM,               // sendto() failed with ENOMEM
+    TC_RX_PACKETS,              // datagrams received with the expected size
+    TC_RX_ERRORS,               // recvfrom() failures and timeouts
+    TC_RX_BAD_LEN,              // datagrams with an unexpected size
+    TC_RX_CHECKSUM,             // checksum mismatches
+    TC_RX_GAPS,                 // sequence discontinuities, ssn != prev_ssn + 1
+    TC_RX_LOST,                 // packets missing in those gaps
+    TC_RX_CONCEALED,            // packets played with smoothing because the expected one was overtaken
+    TC_RX_UNDERRUNS,            // packets replaced by silence because nothing was there in time
+    TC_RX_COLD_READS,           // packets played straight from PSRAM, not promoted into the hot window in time
+    TC_HEAP_ALLOCS,             // heap allocations since the stream started, HEAP_WATCH only
+    TC_HEAP_ALLOCS_PIPELINE,    // of those, inside a pipeline section. Has to stay 0
+    TC_RX_RESYNCS,              // playout point moved: a new sender session, or packets out of place for too long
+    TC_RX_FADE_OUTS,            // packets played faded out at the start of a gap, the last one again or before a resync
+    TC_RX_FADE_INS,             // packets played faded in after a gap
+    TC_RX_NO_STREAM,            // packets of a further sender while all RX_STREAMS rings were busy, dropped
+    TC_TX_DEST_ERRORS_0,        // sendto() failures per destination of TX_DESTS, the receiver is skipped
+    TC_TX_DEST_ERRORS_1,        // for the rest of the burst. Only those of the first one back off
+    TC_TX_DEST_ERRORS_2,
+    TC_TX_DEST_ERRORS_3,
+    TC_TX_DATAGRAMS,            // datagrams sent, TX_NUM_DESTS per packet with MULTI_RX. tx_packets counts each packet once
+    TC_NUM_COUNTERS
+} telem_counter_t;
+
+// gauges are snapshots taken at publishing time, or min/max over the last interval
+typedef enum {
+    TG_RING_LEAD_MIN = 0,       // ssn - rsn, minimum over the interval
+    TG_RING_LEAD_MAX,           // ssn - rsn, maximum over the interval
+    TG_JITTER_P50,              // µs, deviation of the packet inter-arrival time from PACKET_TIME_US
+    TG_JITTER_P99,
+    TG_JITTER_MAX,
+    TG_LATENCY_P50,             // µs, capture-to-DAC latency (LATENCY_PROBE only)
+    TG_LATENCY_P99,
+    TG_HWM_UDP_TASK,            // stack high water mark of udp_tx_task / udp_rx_task, bytes
+    TG_HWM_TELEM_TASK,          // stack high water mark of telemetry_task, bytes
+    TG_HEAP_FREE_MIN,           // minimum free heap since boot, bytes
+    TG_TEMP_TX,                 // sender MCU temperature, 1/100 °C
+    TG_TEMP_RX,                 // receiver MCU temperature, 1/100 °C
+    TG_FIRST_AUDIO_MS,          // ms from boot to the first packet sent (sender) or played (receiver), 0 before
+    TG_FAST_BOOT,               // 1 if this boot took the FAST_BOOT path
+    TG_TX_PS_SCHED,             // sender power save schedule, index into tx_ps_sched[], -1 without TX_POWER_SAVE
+    TG_TX_PS_MA,                // modelled sender current of that schedule, mA, see tx_ps.h
+    TG_TX_PS_TWT,               // 1 while the sender has a TWT agreement with the AP
+    TG_CPU_MHZ,                 // CPU clock while the pipeline runs, see cpu_gov.h
+    TG_CPU_IDLE_MHZ,            // CPU clock in between
+    TG_CPU_MARGIN,              // permille of the deadlines left at that clock, -1 without CPU_GOV
+    TG_RX_STREAMS,              // senders the receiver hears, see ring_streams()
+    TG_NUM_GAUGES
+} telem_gauge_t;
+
+// all fields little endian, which is what both the ESP32 and x86/ARM hosts use
+typedef struct {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t role;               // 'T' sender, 'R' receiver
+    uint8_t num_counters;
+    uint8_t num_gauges;
+    uint32_t seq;               // frame number
+    uint32_t uptime_ms;
+    uint32_t counter[TC_NUM_COUNTERS];
+    int32_t gauge[TG_NUM_GAUGES];
+} telem_frame_t;
+
+/*
+ * log scale histograms with fixed buckets. Values below LOG_HIST_LINEAR get a bucket each,
+ * above that every octave is split into LOG_HIST_SUB buckets, so the relative resolution
+ * is 25 % or better. The last bucket collects everything from 57344 up.
+ */
+#define LOG_HIST_LINEAR_BITS    4
+#define LOG_HIST_LINEAR         (1 << LOG_HIST_LINEAR_BITS)
+#define LOG_HIST_SUB_BITS       2
+#define LOG_HIST_SUB            (1 << LOG_HIST_SUB_BITS)
+#define LOG_HIST_BINS           64
+
+typedef enum {
+    TH_INTERARRIVAL = 0,        // µs between two received packets
+    TH_RING_LEAD,               // ssn - rsn at each put, packets, ssn >= rsn
+    TH_RING_LATE,               // rsn - ssn at each put, packets, ssn < rsn: arrived too late to be played
+    TH_TX_SEND_0,               // sender, µs from the end of the pack to sendto() returning, per destination
+    TH_TX_SEND_1,               // of TX_DESTS. The later ones wait for the sendto() before them
+    TH_TX_SEND_2,
+    TH_TX_SEND_3,
+    TH_NUM_HISTS
+} telem_hist_t;
+
+typedef struct {
+    uint32_t bin[LOG_HIST_BINS];
+} log_hist_t;
+
+// one histogram snapshot. The receiver sends one frame per histogram every
+// TELEM_HIST_INTERVAL telemetry frames, bins count since the previous snapshot. The
+// sender does the same for its TH_TX_SEND_x of the destinations it has.
+typedef struct {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t role;
+    uint8_t hist;               // telem_hist_t
+    uint8_t num_bins;
+    uint32_t seq;               // snapshot number, consecutive per histogram
+    uint32_t uptime_ms;
+    uint16_t ringbuf_offset;    // RINGBUF_OFFSET the lead was measured with
+    uint16_t packet_time_us;    // PACKET_TIME_US
+    uint32_t bin[LOG_HIST_BINS];
+} telem_hist_frame_t;
+
+extern uint32_t telem_counter[TC_NUM_COUNTERS];
+extern int32_t telem_gauge[TG_NUM_GAUGES];
+extern log_hist_t telem_hist[TH_NUM_HISTS];
+extern const char *telem_counter_name[TC_NUM_COUNTERS];
+extern const char *telem_gauge_name[TG_NUM_GAUGES];
+extern const char *telem_hist_name[TH_NUM_HISTS];
+
+// hot path helpers. Relaxed atomics only, no locks and no ordering constraints, safe in ISRs.
+static inline void telem_inc(telem_counter_t c) {
+    __atomic_fetch_add(&telem_counter[c], 1, __ATOMIC_RELAXED);
+}
+
+static inline void telem_add(telem_counter_t c, uint32_t n) {
+    __atomic_fetch_add(&telem_counter[c], n, __ATOMIC_RELAXED);
+}
+
+static inline void telem_set(telem_gauge_t g, int32_t v) {
+    __atomic_store_n(&telem_gauge[g], v, __ATOMIC_RELAXED);
+}
+
+// single writer min/max, the publisher resets them after each frame
+static inline void telem_min(telem_gauge_t g, int32_t v) {
+    if (v < __atomic_load_n(&telem_gauge[g], __ATOMIC_RELAXED)) telem_set(g, v);
+}
+
+static inline void telem_max(telem_gauge_t g, int32_t v) {
+    if (v > __atomic_load_n(&telem_gauge[g], __ATOMIC_RELAXED)) telem_set(g, v);
+}
+
+static inline uint32_t log_hist_bucket(uint32_t v) {
+    uint32_t msb, b;
+
+    if (v < LOG_HIST_LINEAR) return v;
+    msb = 31 - __builtin_clz(v);
+    b = LOG_HIST_LINEAR + ((msb - LOG_HIST_LINEAR_BITS) << LOG_HIST_SUB_BITS)
+        + ((v >> (msb - LOG_HIST_SUB_BITS)) & (LOG_HIST_SUB - 1));
+    return b < LOG_HIST_BINS ? b : LOG_HIST_BINS - 1;
+}
+
+// a single relaxed increment, nothing is allocated
+static inline void telem_hist_add(telem_hist_t h, uint32_t v) {
+    __atomic_fetch_add(&telem_hist[h].bin[log_hist_bucket(v)], 1, __ATOMIC_RELAXED);
+}
+
+uint32_t log_hist_lower(uint32_t bucket);
+uint32_t log_hist_upper(uint32_t bucket);
+void telem_reset_interval(void);
+void telem_fill_frame(telem_frame_t *f, char role, uint32_t seq, uint32_t uptime_ms);
+void telem_hist_snapshot(telem_hist_frame_t *f, telem_hist_t h, char role, uint32_t seq, uint32_t uptime_ms);
+
+#endif /* _TELEMETRY_H */
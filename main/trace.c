@@ -0,0 +1,104 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// pipeline trace ring
+//
+// trace_event() is called from ISRs and tasks alike. A slot is reserved with a single
+// atomic add on the free running head index, so there is no lock and no critical section,
+// and an ISR preempting a task in the middle of trace_event() simply gets the next slot.
+// The ring overwrites the oldest entries; the dump freezes it for as long as it takes
+// to print, so a dump always shows the most recent TRACE_ENTRIES events.
+//
+// Dump format, one block per dump:
+//   WGKTRACE <version> <role T|R> <cpu_hz> <num events>
+//   <hex bytes of 16 trace_event_t structs per line, in memory order (little endian)>
+//   ...
+//   WGKTRACE END
+// so that the console output captured by idf.py monitor can be fed to tools/trace_decode.c.
+
+#include "wireless_gk.h"
+
+#ifdef PIPELINE_TRACE
+
+#include "esp_cpu.h"
+#include "esp_private/esp_clk.h"
+
+#define TRACE_VERSION 1
+#define TRACE_EVENTS_PER_LINE 16
+
+static const char *TAG = "wgk_trace";
+
+static trace_event_t *const trace_ring = wgk_arena.trace;    // internal RAM, see wgk_arena.h
+DRAM_ATTR static uint32_t trace_head = 0;           // free running, masked on access
+DRAM_ATTR static volatile bool trace_frozen = false;
+
+
+IRAM_ATTR void trace_event(uint8_t stage, uint16_t arg) {
+    uint32_t idx;
+    trace_event_t *e;
+
+    if (trace_frozen) return;
+    idx = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED) & (TRACE_ENTRIES - 1);
+    e = &trace_ring[idx];
+    e->cycles = esp_cpu_get_cycle_count();
+    e->arg = arg;
+    e->stage = stage;
+    e->flags = 0;
+}
+
+
+void trace_dump(char role) {
+    uint32_t head, first, num, i, k;
+    uint8_t *b;
+
+    trace_frozen = true;
+    vTaskDelay(1);                  // let a writer which was preempted in trace_event() finish its slot
+    head = __atomic_load_n(&trace_head, __ATOMIC_RELAXED);
+    num = MIN(head, TRACE_ENTRIES);
+    first = head - num;
+
+    printf("WGKTRACE %d %c %d %lu\n", TRACE_VERSION, role, esp_clk_cpu_freq(), num);
+    for (i = 0; i < num; i++) {
+        b = (uint8_t *)&trace_ring[(first + i) & (TRACE_ENTRIES - 1)];
+        for (k = 0; k < sizeof(trace_event_t); k++) {
+            printf("%02x", b[k]);
+        }
+        if ((i % TRACE_EVENTS_PER_LINE) == TRACE_EVENTS_PER_LINE - 1 || i == num - 1) {
+            printf("\n");
+        }
+    }
+    printf("WGKTRACE END\n");
+
+    __atomic_store_n(&trace_head, 0, __ATOMIC_RELAXED);
+    trace_frozen = false;
+}
+
+
+// args is the role character, 'T' for the sender and 'R' for the receiver
+void trace_task(void *args) {
+    char role = (char)(intptr_t)args;
+
+    ESP_LOGI(TAG, "tracing %d events, dump every %d ms", TRACE_ENTRIES, TRACE_DUMP_INTERVAL);
+    while (1) {
+        vTaskDelay(TRACE_DUMP_INTERVAL/portTICK_PERIOD_MS);
+        trace_dump(role);
+    }
+}
+
+#endif  /* PIPELINE_TRACE */
@@ -0,0 +1,79 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// power save schedules of the sender, see tx_ps.h
+
+#include "wgk_core.h"
+#include "tx_ps.h"
+
+const tx_ps_sched_t tx_ps_sched[] = {
+    { "awake",    TX_PS_AWAKE, 1 },
+    { "modem",    TX_PS_MODEM, 1 },
+    { "modem x2", TX_PS_MODEM, 2 },
+    { "modem x4", TX_PS_MODEM, 4 },
+    { "twt",      TX_PS_TWT,   1 },
+    { "twt x2",   TX_PS_TWT,   2 },
+    { "twt x4",   TX_PS_TWT,   4 },
+};
+const int tx_ps_num_sched = sizeof(tx_ps_sched) / sizeof(tx_ps_sched_t);
+
+
+void tx_ps_twt_interval(int burst, uint16_t *mant, uint8_t *expn) {
+    uint32_t v = (uint32_t)burst * PACKET_TIME_US;
+    uint8_t e = 0;
+
+    // only a long interval loses bits, PACKET_TIME_US * TX_PS_BURST_MAX fits the mantissa
+    while (v > 0xffff) {
+        v = (v + 1) >> 1;
+        e++;
+    }
+    *mant = (uint16_t)v;
+    *expn = e;
+}
+
+
+uint8_t tx_ps_twt_min_wake(int burst) {
+    uint32_t units = ((uint32_t)burst * TX_PS_AIRTIME_US + TX_PS_TWT_UNIT_US - 1) / TX_PS_TWT_UNIT_US;
+
+    if (units < 1) units = 1;
+    if (units > 255) units = 255;
+    return (uint8_t)units;
+}
+
+
+uint32_t tx_ps_hold_us(int burst, int pos) {
+    return (uint32_t)(burst - 1 - pos) * PACKET_TIME_US;
+}
+
+
+uint32_t tx_ps_current_ma(const tx_ps_sched_t *s) {
+    uint32_t interval = (uint32_t)s->burst * PACKET_TIME_US;
+    uint32_t tx = (uint32_t)s->burst * TX_PS_AIRTIME_US * 1000 / interval;        // permille on air
+    uint32_t awake;
+
+    if (s->mode == TX_PS_AWAKE) {
+        return (TX_PS_MA_AWAKE * (1000 - tx) + TX_PS_MA_TX * tx + 500) / 1000;
+    }
+    // the radio wakes once per burst, modem sleep also for the beacons. The airtime is the
+    // same for every schedule, what a longer burst saves is the wake ups.
+    awake = TX_PS_WAKE_US * 1000 / interval + (s->mode == TX_PS_MODEM ? TX_PS_BEACON_PERMILLE : 0);
+    if (awake + tx > 1000) awake = 1000 - tx;
+    return (TX_PS_MA_SLEEP * 1000 + (TX_PS_MA_AWAKE - TX_PS_MA_SLEEP) * awake
+            + (TX_PS_MA_TX - TX_PS_MA_SLEEP) * tx + 500) / 1000;
+}
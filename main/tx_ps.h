@@ -0,0 +1,76 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// power save schedules of the sender. The radio can only sleep between two packets if
+// it is not needed in between, so a schedule holds `burst` packets back and sends them
+// in one wake: the capture-to-air delay of every packet is then fixed by its place in
+// the burst, up to (burst - 1) packet times, and the receiver sees the same sawtooth
+// every time instead of jitter. The wake either comes from an 802.11ax individual TWT
+// agreement with the interval of one burst, or, where the AP does not take part in TWT
+// (the receiver's softAP does not), from modem sleep, which wakes the radio for what
+// we send and for the DTIM beacons.
+//
+// The current is a model from datasheet figures, meant to order the schedules and to
+// be replaced with a meter reading. TX_PS_MEASURE in wgk_core.h cycles through them,
+// tools/telemetry_collect.c -W prints the table against the measured latency and
+// host/impair_sim.c -P the same in virtual time. No ESP-IDF dependencies.
+
+#ifndef _TX_PS_H
+#define _TX_PS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TX_PS_BURST_MAX         4                       // packets at most in one wake, the tx arena holds them
+#define TX_PS_AIRTIME_US        300                     // one packet on air, contention and ACK included
+#define TX_PS_WAKE_US           500                     // radio up from modem sleep and down again
+#define TX_PS_BEACON_PERMILLE   20                      // awake for the DTIM beacons, modem sleep only
+#define TX_PS_MA_SLEEP          30                      // mA, CPU and I2S running, radio off
+#define TX_PS_MA_AWAKE          80                      // mA, radio listening
+#define TX_PS_MA_TX             300                     // mA, radio sending
+#define TX_PS_TWT_UNIT_US       256                     // unit of the TWT nominal minimum wake duration
+
+typedef enum {
+    TX_PS_AWAKE = 0,            // WIFI_PS_NONE, what the sender did before
+    TX_PS_MODEM,                // WIFI_PS_MIN_MODEM
+    TX_PS_TWT,                  // individual TWT, modem sleep if the AP declines
+} tx_ps_mode_t;
+
+typedef struct {
+    const char *name;
+    uint8_t mode;               // tx_ps_mode_t
+    uint8_t burst;              // packets per wake, 1 .. TX_PS_BURST_MAX
+} tx_ps_sched_t;
+
+extern const tx_ps_sched_t tx_ps_sched[];
+extern const int tx_ps_num_sched;
+
+// TWT wake interval of a burst as mantissa * 2^exponent µs, exact for the packet times we have
+void tx_ps_twt_interval(int burst, uint16_t *mant, uint8_t *expn);
+
+// TWT nominal minimum wake duration in TX_PS_TWT_UNIT_US, the airtime of a burst rounded up
+uint8_t tx_ps_twt_min_wake(int burst);
+
+// µs a packet waits for the rest of its burst, pos 0 is the first one captured
+uint32_t tx_ps_hold_us(int burst, int pos);
+
+// modelled mean current of a schedule in mA
+uint32_t tx_ps_current_ma(const tx_ps_sched_t *s);
+
+#endif /* _TX_PS_H */
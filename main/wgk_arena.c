@@ -0,0 +1,92 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the static memory arenas and the heap watch, see wgk_arena.h
+
+#include "wgk_arena.h"
+#if defined(HEAP_WATCH) && defined(ESP_PLATFORM)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#if !CONFIG_SPIRAM_ALLOW_BSS_SEG_EXTERNAL_MEMORY
+#error "wgk_ext_arena needs CONFIG_SPIRAM_ALLOW_BSS_SEG_EXTERNAL_MEMORY=y, see sdkconfig.defaults"
+#endif
+#else
+#define EXT_RAM_BSS_ATTR
+#endif
+
+static const char *TAG = "wgk_arena";
+
+DRAM_ATTR wgk_arena_t wgk_arena;
+EXT_RAM_BSS_ATTR wgk_ext_arena_t wgk_ext_arena;
+
+
+void wgk_arena_print(void) {
+    ESP_LOGI(TAG, "internal RAM %u byte: sender %u, receiver %u, of that hot ring %u x %u x %u", 
+             (unsigned)sizeof(wgk_arena), (unsigned)sizeof(wgk_tx_arena_t), (unsigned)sizeof(wgk_rx_arena_t), 
+             RX_STREAMS, NUM_HOT_ELEMS, (unsigned)sizeof(ring_elem_t)); 
+#if defined(PIPELINE_TRACE) && defined(ESP_PLATFORM)
+    ESP_LOGI(TAG, "internal RAM, both roles: trace ring %u byte", (unsigned)sizeof(wgk_arena.trace)); 
+#endif
+    ESP_LOGI(TAG, "PSRAM %u byte: ring %u x %u x %u", 
+             (unsigned)sizeof(wgk_ext_arena), RX_STREAMS, NUM_RINGBUF_ELEMS, (unsigned)sizeof(ring_elem_t)); 
+#ifdef WGK_ARENA_CAPTURE
+    ESP_LOGI(TAG, "PSRAM, of that packet capture %u byte", (unsigned)sizeof(wgk_ext_arena.rx.capture)); 
+#endif
+}
+
+
+#if defined(HEAP_WATCH) && defined(ESP_PLATFORM)
+#if !CONFIG_HEAP_USE_HOOKS
+#error "HEAP_WATCH needs CONFIG_HEAP_USE_HOOKS=y"
+#endif
+
+DRAM_ATTR void *volatile heap_watch_owner = NULL;      // the task inside a pipeline section
+DRAM_ATTR static volatile bool heap_watch_armed = false; 
+
+
+// called when the stream runs, every allocation from now on is counted
+void heap_watch_arm(void) {
+    if (heap_watch_armed) return; 
+    heap_watch_armed = true; 
+    ESP_LOGI(TAG, "stream running, watching the heap"); 
+}
+
+
+// called by the heap component for every successful allocation, possibly with its lock held: 
+// count and get out. 
+IRAM_ATTR void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps) {
+    if (!heap_watch_armed) return; 
+    telem_inc(TC_HEAP_ALLOCS); 
+    if (heap_watch_owner != NULL && heap_watch_owner == (void *)xTaskGetCurrentTaskHandle()) {
+        telem_inc(TC_HEAP_ALLOCS_PIPELINE); 
+#ifdef HEAP_WATCH_ABORT
+        ESP_EARLY_LOGE(TAG, "%u byte, caps 0x%lx allocated in a pipeline section", (unsigned)size, caps); 
+        abort(); 
+#endif
+    }
+}
+
+
+IRAM_ATTR void esp_heap_trace_free_hook(void *ptr) {
+}
+#endif  /* HEAP_WATCH */
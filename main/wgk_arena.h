@@ -0,0 +1,104 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the static memory arenas. Everything the audio path needs is laid out here at compile time 
+// from the stream format, so that app_main() and ring_buf_init() allocate nothing and the 
+// footprint shows up in the link map. There is one arena in internal RAM and one in PSRAM, 
+// each a union of the two roles, since a board only ever runs one. The build prints the 
+// footprint, see arena_size.cmake, and wgk_arena_print() logs the layout at boot. 
+//
+// HEAP_WATCH (wgk_core.h) proves the steady state allocation free, see wgk_arena.c. 
+
+#ifndef _WGK_ARENA_H
+#define _WGK_ARENA_H
+
+#include "wgk_core.h"
+
+#ifdef TX_POWER_SAVE
+#include "tx_ps.h"
+#define TX_BURST_BUFS           TX_PS_BURST_MAX         // a burst waits here for its last packet
+#else
+#define TX_BURST_BUFS           1
+#endif
+
+#if defined(PKT_CAPTURE) || !defined(ESP_PLATFORM)
+#define WGK_ARENA_CAPTURE                               // the host harnesses can always capture
+#endif
+
+// the sender, internal RAM
+typedef struct {
+    udp_buf_t udp_buf[TX_BURST_BUFS];                   // udp_pack() -> sendto()
+} wgk_tx_arena_t;
+
+// the receiver, internal RAM
+typedef struct {
+    ring_elem_t hot[RX_STREAMS][NUM_HOT_ELEMS];         // the playout window of each stream's ring, see ringbuf.c
+    udp_buf_t udp_buf;                                  // recvfrom() -> ring_buf_put()
+#ifdef RX_MIX
+    i2s_buf_t mix_in;                                   // one stream at a time, ring_read() -> mix_read()
+#endif
+#ifdef PKT_CAPTURE
+    capture_chunk_t capture_chunk;                      // export datagram of capture_task()
+#endif
+} wgk_rx_arena_t;
+
+// the receiver, PSRAM. The sender has nothing there. 
+typedef struct {
+    ring_elem_t ring[RX_STREAMS][NUM_RINGBUF_ELEMS];    // the history of each stream's ring
+#ifdef WGK_ARENA_CAPTURE
+    capture_rec_t capture[CAPTURE_RECORDS];             // see pkt_capture.h
+#endif
+} wgk_rx_ext_arena_t;
+
+typedef struct {
+#if defined(PIPELINE_TRACE) && defined(ESP_PLATFORM)
+    trace_event_t trace[TRACE_ENTRIES];                 // both roles, see trace.c
+#endif
+    union {
+        wgk_tx_arena_t tx;
+        wgk_rx_arena_t rx;
+    };
+} wgk_arena_t;
+
+typedef union {
+    wgk_rx_ext_arena_t rx;
+} wgk_ext_arena_t;
+
+extern wgk_arena_t wgk_arena;
+extern wgk_ext_arena_t wgk_ext_arena;
+
+void wgk_arena_print(void);
+
+// HEAP_WATCH counts every heap allocation after the stream has started in telemetry, 
+// heap_allocs, and those made inside a pipeline section of udp_tx_task or udp_rx_task, 
+// heap_allocs_pipeline, which has to stay 0. HEAP_WATCH_ABORT aborts at the first one of 
+// those, the panic backtrace shows who it was. Target only, needs CONFIG_HEAP_USE_HOOKS. 
+#if defined(HEAP_WATCH) && defined(ESP_PLATFORM)
+extern void *volatile heap_watch_owner;
+void heap_watch_arm(void);
+#define HEAP_WATCH_ARM()        heap_watch_arm()
+#define HEAP_WATCH_ENTER()      (heap_watch_owner = xTaskGetCurrentTaskHandle())
+#define HEAP_WATCH_LEAVE()      (heap_watch_owner = NULL)
+#else
+#define HEAP_WATCH_ARM()
+#define HEAP_WATCH_ENTER()
+#define HEAP_WATCH_LEAVE()
+#endif
+
+#endif /* _WGK_ARENA_H */
@@ -0,0 +1,318 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// microbenchmarks of the per-packet kernels, see wgk_bench.h
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "wgk_core.h"
+#include "wgk_bench.h"
+#include "mix.h"
+
+static const char *BENCH_TAG = "wgk_bench";
+
+// a kernel runs iters calls and returns the cycles they took
+typedef uint32_t (*kernel_t)(uint32_t iters);
+
+static udp_buf_t *udp_src;
+static i2s_buf_t *i2s_a, *i2s_b;
+static uint8_t *dma_buf;                                // stands in for the I2S DMA buffer
+static uint8_t *mem_src, *mem_dst;                      // for the copies, set per kernel
+static uint32_t mem_len;
+static uint32_t seq;
+static volatile uint32_t sink;
+#ifdef RX_MIX
+static int mix_streams;                                 // fed, the others stay idle
+static bool mix_lossy;                                  // every fourth packet lost, see k_mix_isr()
+#endif
+
+
+static uint32_t k_udp_pack(uint32_t iters) {
+    uint32_t t0 = wgk_cycles(), i;
+
+    for (i = 0; i < iters; i++) udp_pack(udp_src, (uint8_t *)i2s_a);
+    return wgk_cycles() - t0;
+}
+
+
+static uint32_t k_checksum(uint32_t iters) {
+    uint32_t t0 = wgk_cycles(), i;
+
+    for (i = 0; i < iters; i++) sink ^= calculate_checksum((uint32_t *)udp_src, NFRAMES * sizeof(udp_frame_t) / 4);
+    return wgk_cycles() - t0;
+}
+
+
+static uint32_t k_udp_unpack(uint32_t iters) {
+    uint32_t t0 = wgk_cycles(), i;
+
+    for (i = 0; i < iters; i++) udp_unpack(dma_buf, (const uint8_t *)udp_src, sizeof(udp_frame_t));
+    return wgk_cycles() - t0;
+}
+
+
+// the ring stays running: every batch of puts is followed by as many gets, only one
+// of the two is timed. read is what i2s_tx_callback() does, ring_buf_read() into the DMA buffer
+static uint32_t put_get(uint32_t iters, bool time_put, bool read) {
+    uint32_t t0, t = 0, i;
+
+    t0 = wgk_cycles();
+    for (i = 0; i < iters; i++) {
+        udp_src->sequence_number = seq++;
+        ring_buf_put(udp_src);
+    }
+    if (time_put) t = wgk_cycles() - t0;
+    t0 = wgk_cycles();
+    for (i = 0; i < iters; i++) {
+#ifndef RING_PACKED
+        if (!read) {
+            sink ^= (uint32_t)(uintptr_t)ring_buf_get();
+            continue;
+        }
+#endif
+        sink ^= ring_buf_read(dma_buf);
+    }
+    if (!time_put) t = wgk_cycles() - t0;
+    return t;
+}
+
+
+static uint32_t k_put(uint32_t iters) {
+    return put_get(iters, true, false);
+}
+
+
+#ifndef RING_PACKED
+static uint32_t k_get(uint32_t iters) {
+    return put_get(iters, false, false);
+}
+#endif
+
+
+static uint32_t k_tx_isr(uint32_t iters) {
+    return put_get(iters, false, true);
+}
+
+
+#ifdef RX_MIX
+// i2s_tx_callback() with mix_streams senders: a put per stream, then one timed mix_read().
+// Lossy, every fourth packet is lost and the one after it is a gap to the ring as well, so
+// all streams go through fade out, silence, fade in and a clean packet in step. The
+// maximum is then every stream fading at once, the most the ISR does per packet.
+static uint32_t k_mix_isr(uint32_t iters) {
+    uint32_t t0, i;
+    int s;
+
+    for (i = 0; i < iters; i++, seq++) {
+        if (mix_lossy && (seq & 3) == 0) continue;
+        udp_src->sequence_number = seq;
+        for (s = 0; s < mix_streams; s++) ring_put(ring_stream(s), udp_src);
+    }
+    t0 = wgk_cycles();
+    for (i = 0; i < iters; i++) sink ^= ring_buf_read(dma_buf);
+    return wgk_cycles() - t0;
+}
+#endif
+
+
+static uint32_t k_smoothe_short(uint32_t iters) {
+    uint32_t t0 = wgk_cycles(), i;
+
+    for (i = 0; i < iters; i++) smoothe(i2s_a, i2s_b, SMOOTHE_SHORT);
+    return wgk_cycles() - t0;
+}
+
+
+static uint32_t k_smoothe_long(uint32_t iters) {
+    uint32_t t0 = wgk_cycles(), i;
+
+    for (i = 0; i < iters; i++) smoothe(i2s_a, i2s_b, SMOOTHE_LONG);
+    return wgk_cycles() - t0;
+}
+
+
+static uint32_t k_copy(uint32_t iters) {
+    uint32_t t0 = wgk_cycles(), i;
+
+    for (i = 0; i < iters; i++) memcpy(mem_dst, mem_src, mem_len);
+    return wgk_cycles() - t0;
+}
+
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+static void measure(wgk_bench_result_t *r, const char *name, uint32_t bytes, kernel_t k, uint32_t reps, uint32_t iters) {
+    static double sample[WGK_BENCH_REPS_MAX];
+    double sum = 0.0, sq = 0.0;
+    uint32_t i;
+
+    k(iters);                                                   // warm up caches and branch predictors
+    for (i = 0; i < reps; i++) {
+        sample[i] = (double)k(iters) / iters;
+        sum += sample[i];
+    }
+    r->name = name;
+    r->bytes = bytes;
+    r->mean = sum / reps;
+    for (i = 0; i < reps; i++) sq += (sample[i] - r->mean) * (sample[i] - r->mean);
+    r->stdev = reps > 1 ? sqrt(sq / (reps - 1)) : 0.0;
+    qsort(sample, reps, sizeof(double), cmp_double);
+    r->min = sample[0];
+    r->median = sample[reps / 2];
+    r->max = sample[reps - 1];
+}
+
+
+// copies of one ring element between internal RAM and PSRAM, the ring_buf[] placement question
+static int measure_copies(wgk_bench_result_t *res, int n, uint32_t reps, uint32_t iters) {
+    static const char *names[4] = { "copy DRAM->DRAM", "copy DRAM->SPIRAM", "copy SPIRAM->DRAM", "copy SPIRAM->SPIRAM" };
+    uint8_t *dram[2], *spiram[2];
+    int i;
+
+    mem_len = sizeof(i2s_buf_t);
+    for (i = 0; i < 2; i++) {
+        dram[i] = heap_caps_calloc(1, mem_len, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+        spiram[i] = heap_caps_calloc(1, mem_len, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+    }
+    for (i = 0; i < 4; i++) {
+        mem_src = (i & 2) ? spiram[0] : dram[0];
+        mem_dst = (i & 1) ? spiram[1] : dram[1];
+        if (mem_src == NULL || mem_dst == NULL) {
+            ESP_LOGW(BENCH_TAG, "%s: no memory, skipped", names[i]);
+            continue;
+        }
+        measure(&res[n++], names[i], mem_len, k_copy, reps, iters);
+    }
+    for (i = 0; i < 2; i++) {
+        heap_caps_free(dram[i]);
+        heap_caps_free(spiram[i]);
+    }
+    return n;
+}
+
+
+#ifdef RX_MIX
+// 2 .. RX_STREAMS streams, clean and lossy
+static int measure_mix(wgk_bench_result_t *res, int n) {
+    static const char *names[3][2] = {
+        { "i2s_tx_callback mix 2", "mix 2 lossy" },
+        { "i2s_tx_callback mix 3", "mix 3 lossy" },
+        { "i2s_tx_callback mix 4", "mix 4 lossy" },
+    };
+    int lossy, s;
+
+    mix_init(MIX_ROUTE);
+    for (mix_streams = 2; mix_streams <= RX_STREAMS; mix_streams++) {
+        for (lossy = 0; lossy < 2; lossy++) {
+            ring_buf_reset();
+            for (seq = 1; seq <= RINGBUF_OFFSET + 2; seq++) {
+                udp_src->sequence_number = seq;
+                for (s = 0; s < mix_streams; s++) ring_put(ring_stream(s), udp_src);
+            }
+            mix_lossy = lossy;
+            measure(&res[n++], names[mix_streams - 2][lossy], I2S_BUF_SIZE, k_mix_isr, WGK_BENCH_REPS_MAX, 1);
+        }
+    }
+    ring_buf_reset();
+    return n;
+}
+#endif
+
+
+int wgk_bench_run(wgk_bench_result_t *res, uint32_t reps, uint32_t iters) {
+    int n = 0, i, j;
+
+    if (iters == 0 || iters > NUM_RINGBUF_ELEMS / 2) iters = WGK_BENCH_ITERS;
+    if (reps == 0 || reps > WGK_BENCH_REPS_MAX) reps = WGK_BENCH_REPS;
+    udp_src = heap_caps_calloc(1, sizeof(udp_buf_t), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    i2s_a = heap_caps_calloc(1, sizeof(i2s_buf_t), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    i2s_b = heap_caps_calloc(1, sizeof(i2s_buf_t), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    dma_buf = heap_caps_calloc(1, I2S_BUF_SIZE, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    if (udp_src == NULL || i2s_a == NULL || i2s_b == NULL || dma_buf == NULL) {
+        ESP_LOGE(BENCH_TAG, "no memory");
+        return 0;
+    }
+    for (i = 0; i < NFRAMES; i++) {
+        for (j = 0; j < NUM_SLOTS_I2S; j++) {
+            i2s_a->frame[i].slot[j] = (i * NUM_SLOTS_I2S + j) << 12;
+            i2s_b->frame[i].slot[j] = -((i * NUM_SLOTS_I2S + j) << 12);
+        }
+    }
+    udp_pack(udp_src, (uint8_t *)i2s_a);
+
+    measure(&res[n++], "udp_pack", sizeof(udp_buf_t), k_udp_pack, reps, iters);
+    measure(&res[n++], "calculate_checksum", NFRAMES * sizeof(udp_frame_t), k_checksum, reps, iters);
+    measure(&res[n++], "udp_unpack", I2S_BUF_SIZE, k_udp_unpack, reps, iters);
+
+    // prime the ring so that it is running, then every get finds its packet
+    ring_buf_reset();
+    for (seq = 1; seq <= RINGBUF_OFFSET + 2; seq++) {
+        udp_src->sequence_number = seq;
+        ring_buf_put(udp_src);
+    }
+    measure(&res[n++], "ring_buf_put", sizeof(udp_buf_t), k_put, reps, iters);
+#ifdef RING_PACKED
+    measure(&res[n++], "i2s_tx_callback packed", I2S_BUF_SIZE, k_tx_isr, WGK_BENCH_REPS_MAX, 1);
+#else
+    measure(&res[n++], "ring_buf_get", 0, k_get, reps, iters);
+    measure(&res[n++], "i2s_tx_callback", I2S_BUF_SIZE, k_tx_isr, WGK_BENCH_REPS_MAX, 1);
+#endif
+    ring_buf_reset();
+#ifdef RX_MIX
+    n = measure_mix(res, n);
+#endif
+
+    measure(&res[n++], "smoothe short", 0, k_smoothe_short, reps, iters);
+    measure(&res[n++], "smoothe long", 0, k_smoothe_long, reps, iters);
+    n = measure_copies(res, n, reps, iters);
+
+    heap_caps_free(udp_src);
+    heap_caps_free(i2s_a);
+    heap_caps_free(i2s_b);
+    heap_caps_free(dma_buf);
+    return n;
+}
+
+
+void wgk_bench_print(const wgk_bench_result_t *res, int n, const char *label, bool table, bool csv) {
+    int i;
+
+    if (table) {
+        printf("%-22s %10s %10s %10s %8s %10s %10s   (cycles, %d frames of %d slots)\n",
+               "kernel", "/packet", "min", "mean", "stdev", "max", "/frame", NFRAMES, NUM_SLOTS_I2S);
+        for (i = 0; i < n; i++) {
+            printf("%-22s %10.1f %10.1f %10.1f %8.1f %10.1f %10.2f\n", res[i].name, res[i].median, res[i].min,
+                   res[i].mean, res[i].stdev, res[i].max, res[i].median / NFRAMES);
+        }
+    }
+    if (csv) {
+        printf("BENCH,label,kernel,slots,bytes,median,min,mean,stdev,max,per_frame\n");
+        for (i = 0; i < n; i++) {
+            printf("BENCH,%s,%s,%d,%lu,%.1f,%.1f,%.1f,%.1f,%.1f,%.2f\n", label ? label : "", res[i].name, NUM_SLOTS_I2S,
+                   (unsigned long)res[i].bytes, res[i].median, res[i].min, res[i].mean, res[i].stdev, res[i].max,
+                   res[i].median / NFRAMES);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// microbenchmarks of the per-packet kernels, the same code on the target (BENCHMARK in
+// wgk_core.h) and on the host (host/bench.c). No ESP-IDF dependencies besides wgk_port.h.
+//
+// Every kernel runs WGK_BENCH_REPS times a batch of iterations, the cycle counter is read
+// around each batch, so every repetition gives one cycles-per-call sample. The report has
+// the median, minimum, mean, standard deviation and maximum of those samples, per packet and
+// per frame, as a table and as "BENCH," CSV lines that can be grepped out of a console log.
+// The I2S TX ISR body is timed one call per sample, so its maximum is the worst case.
+
+#ifndef _WGK_BENCH_H
+#define _WGK_BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WGK_BENCH_REPS          31                      // repetitions per kernel, odd for the median
+#define WGK_BENCH_REPS_MAX      255
+#define WGK_BENCH_ITERS         64                      // calls per repetition, well below NUM_RINGBUF_ELEMS
+#define WGK_BENCH_MAX           24                      // kernels
+
+typedef struct {
+    const char *name;
+    uint32_t bytes;             // moved or touched per call, 0 if not meaningful
+    double median, min, mean, stdev, max;               // cycles per call
+} wgk_bench_result_t;
+
+// runs all kernels, returns the number of results. Uses the ring buffer, so the pipeline
+// must not be running; the ring is reset afterwards.
+int wgk_bench_run(wgk_bench_result_t *res, uint32_t reps, uint32_t iters);
+
+// label goes into the CSV lines, e.g. a commit hash, may be NULL
+void wgk_bench_print(const wgk_bench_result_t *res, int n, const char *label, bool table, bool csv);
+
+#endif /* _WGK_BENCH_H */
@@ -0,0 +1,73 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// packing, unpacking and checksum, shared by the sender and the host harnesses. See wgk_core.h. 
+
+#include "wgk_core.h"
+
+
+// calculate simple XOR checksum based on uint32_t, which is much faster than using uint8_t
+// there are 4x less XOR operations
+// and ESP32 does not support unaligned uint8_t accesses and will always generate an exception
+uint32_t calculate_checksum(uint32_t *buffer, size_t size) {
+    uint32_t checksum = 0;
+    int i; 
+    
+    for (i = 0; i < size; i++) {  
+        checksum ^= *(buffer + i);
+    }
+    return checksum; 
+}
+
+
+// packs one I2S DMA buffer (32 bit slots, MSB aligned) into the 24 bit UDP format 
+// and inserts the XOR checksum after the sample data. Slots beyond NUM_SLOTS_I2S are left alone. 
+void udp_pack(udp_buf_t *udp_buf, const uint8_t *dmabuf) {
+    int i, j; 
+
+    for (i=0; i<NFRAMES; i++) {
+        for (j=0; j<NUM_SLOTS_I2S; j++) {                
+            // the offset of a sample in the DMA buffer is (i * NUM_SLOTS_I2S + j) * SLOT_SIZE_I2S + 1 
+            // the offset of a sample in the UDP buffer is (i * NUM_SLOTS_UDP + j) * SLOT_SIZE_UDP
+            memcpy ((uint8_t *)udp_buf + (i * NUM_SLOTS_UDP + j) * SLOT_SIZE_UDP, 
+                    dmabuf + (i * NUM_SLOTS_I2S + j) * SLOT_SIZE_I2S + 1,             
+                    SLOT_SIZE_UDP);
+        }                    
+    }
+    udp_buf->checksum = calculate_checksum((uint32_t *)udp_buf, NFRAMES * sizeof(udp_frame_t) / 4);
+}
+
+
+// the inverse of udp_pack(): the first NUM_SLOTS_I2S slots of every frame of src, 3 byte 
+// samples, frame_size byte apart, into 32 bit MSB aligned slots. Whole words are stored with 
+// the low byte cleared, which is what the memcpy to offset 1 of a zeroed slot gives, in one 
+// pass, so that it can go straight into a DMA buffer. Called in the I2S ISR with RING_PACKED. 
+IRAM_ATTR void udp_unpack(uint8_t *dmabuf, const uint8_t *src, size_t frame_size) {
+    uint32_t *dst = (uint32_t *)dmabuf; 
+    const uint8_t *s; 
+    int i, j; 
+
+    for (i=0; i<NFRAMES; i++) {
+        s = src + i * frame_size; 
+        for (j=0; j<NUM_SLOTS_I2S; j++) {
+            *dst++ = ((uint32_t)s[0] << 8) | ((uint32_t)s[1] << 16) | ((uint32_t)s[2] << 24); 
+            s += SLOT_SIZE_UDP; 
+        }
+    }
+}
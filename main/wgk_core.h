@@ -0,0 +1,287 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the audio pipeline core: wire format, buffer layout, packing, the receive ring and 
+// concealment. Nothing in here depends on ESP-IDF, so ringbuf.c and wgk_core.c are also 
+// built for Linux by host/CMakeLists.txt. wireless_gk.h adds the target specific parts. 
+//
+// The platform has to provide get_time_us_in_isr() and, WITH_TEMP, the tx_temp variable. 
+// On the target they live in main.c, on the host in host/port.c. 
+
+#ifndef _WGK_CORE_H
+#define _WGK_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include "wgk_port.h"
+#include "seqnum.h"
+#include "latency_probe.h"
+#include "telemetry.h"
+#include "pkt_capture.h"
+#include "wgk_bench.h"
+#include "chan_score.h"
+#include "chan_mon.h"
+
+
+// TODO remove for production compilation 
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-but-set-variable"
+
+
+// #define PIPELINE_TRACE               // record per-stage timestamps in the trace ring, see trace.c
+// #define LATENCY_MEAS                 // activate this if you want to do a UDP latency measurement. 
+                                        // Connect Tx SIG_PIN to Rx ISR_PIN and GND to GND. 
+// #define LATENCY_PROBE                // in-band capture-to-DAC latency measurement without any wiring, 
+                                        // see latency_probe.c. Reports percentiles in rx_stats_task. 
+#define WITH_TEMP
+
+
+/* ***************************************************************
+ * Logging
+ * ***************************************************************/
+
+// The trace ring replaces the old _log[] array. Every pipeline stage drops an 8 byte event
+// with the CPU cycle counter into a lock-free ring which is periodically dumped to the console
+// in hex. tools/trace_decode.c turns the dump into latency histograms and Chrome trace JSON.
+#define TRACE_ENTRIES           1024                    // needs to be a power of 2
+#define TRACE_DUMP_INTERVAL     10000                   // ms between two dumps
+
+typedef enum {
+    TRACE_I2S_RX_ISR = 0,       // sender: I2S on_recv callback
+    TRACE_TX_NOTIFY,            // sender: udp_tx_task woken up
+    TRACE_TX_PACK,              // sender: packing and checksum done
+    TRACE_TX_SENDTO,            // sender: sendto() returned
+    TRACE_RX_RECVFROM,          // receiver: recvfrom() returned
+    TRACE_RX_PUT,               // receiver: ring_buf_put() done
+    TRACE_I2S_TX_ISR,           // receiver: I2S on_sent callback
+    TRACE_RX_GET,               // receiver: ring_buf_get() done
+    TRACE_NUM_STAGES
+} trace_stage_t;
+
+typedef struct {
+    uint32_t cycles;            // CPU cycle counter
+    uint16_t arg;               // low 16 bits of the sequence number, or a size
+    uint8_t stage;              // trace_stage_t
+    uint8_t flags;              // reserved
+} trace_event_t;
+
+#if defined(PIPELINE_TRACE) && defined(ESP_PLATFORM)     // trace.c is target only
+#define TRACE(stage, arg) trace_event((stage), (uint16_t)(arg))
+#else
+#define TRACE(stage, arg)
+#endif
+
+void trace_event(uint8_t stage, uint16_t arg);
+
+/* ***************************************************************
+ * Buffer Defines
+ * ***************************************************************/
+
+/*
+ * Definitions for I2S
+ * SAMPLE  is a single sample for one channel (32 bit data block containing a 16, 24, or 32 bit ADC sample)
+ * FRAME   is a collection of NUM_SLOTS slots (mono samples per channel)
+ *         see MSB format in 
+ *         https://docs.espressif.com/projects/esp-idf/en/latest/esp32c5/api-reference/peripherals/i2s.html#tdm-mode
+ * NFRAMES is the number of frames we want to send in one datagram in order to minimize UDP protocol overhead.
+ *         this is intended to fill one UDP payload so that no IP fragmentation takes place.
+ *         The default MTU size for WiFi is 1500, resulting in a maximum payload of 1472 byte.
+ *         We send NSAMPLES * NUM_SLOTS_UDP * SLOT_SIZE_UDP byte = 1440 byte. 61 frames would work as well. 
+ */ 
+#define NFRAMES                 60                      // the number of frames we want to send in a datagram 
+#ifndef NUM_SLOTS_I2S                                   // host/pc_receiver.c builds the core with 8
+#define NUM_SLOTS_I2S           2                       // number of channels in one sample, 2 for stereo, 8 for 8-channel audio
+#endif
+#define SLOT_SIZE_I2S           4                       // I2S has slots with 4 byte each. The data type is int. 
+#define NUM_SLOTS_UDP           8                       // we always send 8 slot frames
+#define SLOT_SIZE_UDP           3                       // UDP format has 3-byte samples.
+#define SLOT_BIT_WIDTH          SLOT_SIZE_I2S * 8       // bits per slot
+#define NUM_RX_DMA_BUFS         4                       // Number of DMA buffers in the sender.  RX is here I2S RX
+#define NUM_TX_DMA_BUFS         2                       // the receiver only uses 2. TX is here I2S TX
+
+#define I2S_BUF_SIZE            NFRAMES * NUM_SLOTS_I2S * SLOT_SIZE_I2S  // Size of each I2S or DMA buffer
+
+#define UDP_BUF_SIZE            NFRAMES * NUM_SLOTS_UDP * SLOT_SIZE_UDP
+#define NUM_RINGBUF_ELEMS       256                      // this needs to be a power of 2. 
+// #define UDP_PAYLOAD_SIZE        UDP_BUF_SIZE + 16       // 
+#define RINGBUF_OFFSET          3                       // when do we start to shuffle data to I2S. 
+#define NUM_HOT_ELEMS           16                      // playout window around rsn in internal RAM, power of 2. 
+                                                        // The rest of the ring is history in PSRAM, see ringbuf.c 
+#define RING_RESYNC_RUN         32                      // packets in a row out of place before the playout point moves 
+#define RING_RESYNC_AHEAD       NUM_HOT_ELEMS           // a lead beyond this is out of place, and so is any late packet 
+#define RING_SEQ_ORIGIN         (0u - 2048)             // our first sequence number. Like the kernel's INITIAL_JIFFIES, the 
+                                                        // 32 bit wrap comes 4 s into every stream and not after 95 days 
+// #define RING_PACKED                  // keep the 24 bit samples in the ring and unpack them in ring_buf_read(), 
+                                        // straight into the DMA buffer. A quarter less ring memory and one pass 
+                                        // over the samples in the ISR instead of two, see tools/cbuf.c 
+// #define RX_MIX                       // accept RX_STREAMS senders, a ring each, and route or mix them into 
+                                        // the output slots, see mix.h. Every stream adds a ring in both tiers 
+#ifdef RX_MIX
+#ifndef RX_STREAMS                                      // host/CMakeLists.txt builds the core with 4
+#define RX_STREAMS              2                       // a duo, up to 4
+#endif
+#else
+#undef RX_STREAMS
+#define RX_STREAMS              1
+#endif
+#define RING_STREAM_IDLE_US     2000000                 // a sender this long silent gives its ring up to a new one 
+
+#define NUM_I2S_BUFS            4 
+// #define I2S_CBUF_SIZE           I2S_BUF_SIZE * NUM_I2S_BUFS  // ring buffer size 
+
+#define SAMPLE_RATE             31250                   // 48000 should work as well, or anything less
+#define PACKET_TIME_US          (NFRAMES * 1000000 / SAMPLE_RATE)   // audio time per packet
+
+/* ***************************************************************
+ * buffer stuff 
+ * ***************************************************************/
+ 
+typedef struct {
+    int slot[NUM_SLOTS_I2S];
+} i2s_frame_t;
+
+typedef struct {
+    i2s_frame_t frame[NFRAMES];
+} i2s_buf_t;     
+
+
+typedef struct {
+    uint8_t slot[NUM_SLOTS_UDP * SLOT_SIZE_UDP];
+} udp_frame_t;
+
+// a ring element with RING_PACKED: the NUM_SLOTS_I2S slots we play, in the UDP sample format
+typedef struct {
+    uint8_t slot[NUM_SLOTS_I2S * SLOT_SIZE_UDP];
+} packed_frame_t;
+
+typedef struct {
+    packed_frame_t frame[NFRAMES];
+} packed_buf_t;
+
+#ifdef RING_PACKED
+typedef packed_buf_t ring_elem_t; 
+#else
+typedef i2s_buf_t ring_elem_t; 
+#endif
+
+// #define WITH_TIMESTAMP
+#ifdef LATENCY_PROBE
+#define WITH_TIMESTAMP                  // the probe needs the capture time of each packet
+#endif
+
+typedef struct {
+    udp_frame_t frame[NFRAMES];
+    uint32_t checksum;
+    wire_seq_t sequence_number; // low 16 bits of the sender's count, see seqnum.h
+    uint16_t session;           // random per sender start, a new one makes the receiver resync
+#ifdef WITH_TIMESTAMP    
+    uint32_t timestamp; 
+#endif    
+#ifdef WITH_TEMP
+    float tx_temp;
+#endif    
+    uint32_t switches;
+} udp_buf_t;
+
+bool ring_buf_init(void);
+void ring_buf_reset(void);
+size_t ring_buf_size(void); 
+void ring_buf_put(udp_buf_t *udp_buf);              // into stream 0
+bool ring_buf_read(uint8_t *dmabuf);                 // next packet into an I2S_BUF_SIZE buffer, false = play silence
+#ifndef RING_PACKED
+uint8_t *ring_buf_get(void);                        // the same for stream 0, the caller copies
+#endif
+
+// the per-stream rings behind those, one per sender, see ringbuf.c and mix.h
+typedef struct ring ring_t; 
+ring_t *ring_stream(int i);                         // 0 .. RX_STREAMS - 1
+ring_t *ring_lookup(uint32_t id);                   // the ring of sender id, != 0. NULL if all are busy
+int ring_streams(void);                             // the rings that hear their sender
+void ring_put(ring_t *r, udp_buf_t *udp_buf); 
+bool ring_read(ring_t *r, uint8_t *dmabuf);         // like ring_buf_read(), one stream unmixed
+
+#define SMOOTHE_SHORT 3
+#define SMOOTHE_LONG 5
+void smoothe(i2s_buf_t *buf1, i2s_buf_t *buf2, int smooth_mode);     // public for wgk_bench.c
+
+void udp_pack(udp_buf_t *udp_buf, const uint8_t *dmabuf);
+void udp_unpack(uint8_t *dmabuf, const uint8_t *src, size_t frame_size);
+extern uint32_t time3; 
+
+
+/* 
+ * Telemetry: typed counters and gauges (see telemetry.h), broadcast as a binary frame 
+ * every TELEM_INTERVAL ms on TELEM_PORT. Collect them with tools/telemetry_collect.c. 
+ * The receiver also sends inter-arrival and ring lead histograms every TELEM_HIST_INTERVAL 
+ * frames, tools/jitter_tune.c turns them into a RINGBUF_OFFSET recommendation. 
+ */
+  
+#define TELEMETRY 
+#ifdef TELEMETRY 
+extern lat_hist_t jitter_hist;
+#endif
+// #define PKT_CAPTURE                  // record every packet's arrival in a PSRAM ring for later replay, 
+                                        // see pkt_capture.h, tools/capture_fetch.c and host/replay.c
+// #define BENCHMARK                    // boot into the per-packet microbenchmarks of wgk_bench.c instead of 
+                                        // sender or receiver, see bench_task() in main.c and host/bench.c
+#define BENCH_INTERVAL          10000                   // ms between two runs
+// #define HEAP_WATCH                   // count heap allocations once the stream runs, needs CONFIG_HEAP_USE_HOOKS. 
+                                        // Pipeline sections have to stay at 0, see wgk_arena.h 
+// #define HEAP_WATCH_ABORT             // and abort at the first one in a pipeline section 
+// #define CHAN_MON                     // rate the link and move to a better 5 GHz channel when it degrades, 
+                                        // see chan_mon.h and host/chan_sim.c. Needs TELEMETRY 
+// #define FAST_BOOT                    // start on the channel of the last boot, kept in NVS, and scan in the 
+                                        // background instead. See boot_state_t in wireless_gk.h 
+// #define CHAN_ALLOW_DFS               // let find_free_channel() pick DFS channels. The AP has to listen for 
+                                        // radar for 60 s before it may send, and a radar hit throws it off 
+// #define CHAN_AIRTIME_PROBE           // listen on the best ranked channels for what they are busy with, 
+                                        // see find_free_channel() 
+// #define TX_POWER_SAVE                // let the sender's radio sleep between bursts of packets, with TWT or 
+                                        // modem sleep. See tx_ps.h and host/impair_sim.c -P 
+#define TX_PS_SCHED             5                       // the schedule, index into tx_ps_sched[], "twt x2" 
+// #define TX_PS_MEASURE                // cycle through all schedules instead, TX_PS_DWELL s each, and compare 
+                                        // them with tools/telemetry_collect.c -W. Needs TELEMETRY 
+#define TX_PS_DWELL             60
+// #define CPU_GOV                      // run the pipeline at the lowest CPU clock that keeps its deadlines, 
+                                        // see cpu_gov.h. Needs CONFIG_PM_ENABLE 
+// #define MULTI_RX                     // one sender feeds several receivers: each packet is packed once and 
+                                        // sent to all of TX_DESTS (wireless_gk.h). The AP admits them all 
+// #define RX_SECONDARY                 // a receiver that joins the AP of the first one at RX_SECONDARY_ADDR, 
+                                        // like a sender, instead of being an AP itself 
+// #define SSN_STATS                    // dump the put/get log once after 10 s and stop, see rx_stats_task()
+// #define SSN_TRACE
+
+#ifdef LATENCY_PROBE
+extern clock_sync_t clock_sync;
+extern lat_hist_t lat_hist;
+#endif
+
+#ifdef WITH_TEMP
+extern float rx_temp, tx_temp; 
+#endif
+
+uint32_t get_time_us_in_isr(void);
+uint32_t calculate_checksum(uint32_t *buffer, size_t size); 
+
+#endif /* _WGK_CORE_H */
@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2024 Harald Milz <hm@seneca.muc.de>
+
+    This file is part of Wireless-GK.
+
+    Wireless-GK is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Wireless-GK is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Wireless-GK.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the few ESP-IDF facilities the pipeline core uses, mapped to libc when building 
+// for the host. Only what ringbuf.c, wgk_core.c and the other IDF-free modules need. 
+
+#ifndef _WGK_PORT_H
+#define _WGK_PORT_H
+
+#ifdef ESP_PLATFORM
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_cpu.h"
+
+#define wgk_cycles()            esp_cpu_get_cycle_count()
+
+#else
+
+#include <stdlib.h>
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#define MALLOC_CAP_8BIT         0
+#define MALLOC_CAP_INTERNAL     0
+#define MALLOC_CAP_SPIRAM       0
+#define heap_caps_calloc(n, size, caps)     calloc((n), (size))
+#define heap_caps_malloc(size, caps)        malloc(size)
+#define heap_caps_free(p)                   free(p)
+
+// the format strings use %lu for uint32_t like the target does, so no format checking here
+void wgk_log(char level, const char *tag, const char *fmt, ...);
+#define ESP_LOGE(tag, fmt, ...) wgk_log('E', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) wgk_log('W', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) wgk_log('I', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) 
+
+// a free running counter for the benchmarks: the TSC on x86, ns elsewhere
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint32_t wgk_cycles(void) { return (uint32_t)__rdtsc(); }
+#else
+#include <time.h>
+static inline uint32_t wgk_cycles(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+#endif
+
+#endif /* ESP_PLATFORM */
+
+#endif /* _WGK_PORT_H */
@@ -36,14 +36,13 @@ TaskHandle_t udp_rx_task_handle = NULL;
 
 static esp_wps_config_t wps_config = WPS_CONFIG_INIT_DEFAULT(WPS_TYPE_PBC);
 
-#ifdef RX_DEBUG
-static char t[][20] = {"ISR", "begin i2s_tx loop", "after notify", "unpacking", "before recvfrom", "after recvfrom", "end i2s_tx loop" }; 
+#ifdef LATENCY_PROBE
+clock_sync_t clock_sync;
+lat_hist_t lat_hist;
+static struct sockaddr_in sender_addr;          // learnt from the first audio packet
+static volatile bool sender_known = false;
 #endif
 
-#ifdef RX_STATS
-int stats[NUM_STATS];  
-#endif     
-
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
 		int32_t event_id, void* event_data)
 {
@@ -100,30 +99,148 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
 }
 
 /*
- * scan the network for the best free channel
+ * scan the network for the best free channel, see chan_score.h
  */ 
 
-#define MAX_AP_RECORDS 20
-#define CHAN_MAX 177
-// https://en.wikipedia.org/wiki/List_of_WLAN_channels
-static int channels[] = { 36, 40, 44, 48, 52, 56, 60, 64, 68, 96, 100, 104, 
-                          108, 112, 116, 120, 124, 128, 132, 136, 140, 144, 
-                          149, 153, 157, 161, 165, 169, 173, 177 }; 
-static int channel_usage[CHAN_MAX+1] = {0};  // For 5GHz use 
+#define MAX_AP_RECORDS 32
+#define CHAN_PROBE_TOP          4                       // channels of the ranking we probe the airtime of
+#define CHAN_PROBE_DWELL        100                     // ms per channel
+#define CHAN_PROBE_RATE         24                      // Mbit/s we assume, the rate is not in every chip's rx_ctrl
+#define CHAN_PROBE_PREAMBLE     40                      // µs per frame for preamble and SIFS
+
 static wifi_ap_record_t ap_records[MAX_AP_RECORDS];
+static scan_ap_t scan_aps[MAX_AP_RECORDS];
+
+#ifdef CHAN_ALLOW_DFS
+#define ALLOW_DFS true
+#else
+#define ALLOW_DFS false
+#endif
 
 // TODO as soon as ESP-IDF supports country settings for 5G, use them, 
 // preferably a safe mode that works internationally
 // very possible that wifi_scan_config_t will be set correctly anyway. 
 // in MCS7, the transmit power is internally set to 13 dBm for HT20 which is equivalent to ~20 mW. 
+
+static void scan_ap_from_record(const wifi_ap_record_t *rec, scan_ap_t *ap) {
+    ap->primary = rec->primary;
+    ap->center = rec->primary;
+    ap->bw = 20;
+    ap->rssi = rec->rssi;
+    if (rec->bandwidth == WIFI_BW160 && rec->vht_ch_freq1 != 0) {
+        ap->bw = 160;
+        ap->center = rec->vht_ch_freq1;
+    } else if ((rec->bandwidth == WIFI_BW80 || rec->bandwidth == WIFI_BW80_BW80) && rec->vht_ch_freq1 != 0) {
+        ap->bw = 80;                                // of 80+80 only the segment with the primary
+        ap->center = rec->vht_ch_freq1;
+    } else if (rec->second != WIFI_SECOND_CHAN_NONE) {
+        ap->bw = 40;
+        ap->center = rec->second == WIFI_SECOND_CHAN_ABOVE ? rec->primary + 2 : rec->primary - 2;
+    }
+}
+
+
+#ifdef CHAN_AIRTIME_PROBE
+static volatile uint32_t probe_airtime_us;
+
+static void probe_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type) {
+    const wifi_promiscuous_pkt_t *pkt = (const wifi_promiscuous_pkt_t *)buf;
+
+    probe_airtime_us += CHAN_PROBE_PREAMBLE + pkt->rx_ctrl.sig_len * 8 / CHAN_PROBE_RATE;
+}
+
+// listens on channel for CHAN_PROBE_DWELL ms and adds up the airtime of what it hears
+static uint16_t chan_probe_airtime(uint8_t channel) {
+    uint32_t busy;
+
+    probe_airtime_us = 0;
+    esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+    vTaskDelay(CHAN_PROBE_DWELL / portTICK_PERIOD_MS);
+    busy = probe_airtime_us / CHAN_PROBE_DWELL;     // µs per ms is permille
+    return busy > 1000 ? 1000 : busy;
+}
+#endif
+
+
+static bool chan_rank_load(chan_rank_cache_t *cache) {
+    nvs_handle_t handle;
+    size_t len = sizeof(*cache);
+    bool ok;
+
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) return false;
+    ok = nvs_get_blob(handle, "chan_rank", cache, &len) == ESP_OK && len == sizeof(*cache)
+         && cache->magic == CHAN_RANK_MAGIC && cache->version == CHAN_RANK_VERSION && cache->n <= CHAN_RANK_MAX;
+    nvs_close(handle);
+    return ok;
+}
+
+
+// only when it changed, the flash does not need a write on every boot
+static void chan_rank_save(const chan_rank_cache_t *old, const chan_rank_t *rank, int n) {
+    chan_rank_cache_t cache;
+    nvs_handle_t handle;
+
+    memset(&cache, 0, sizeof(cache));
+    cache.magic = CHAN_RANK_MAGIC;
+    cache.version = CHAN_RANK_VERSION;
+    cache.n = n;
+    cache.allow_dfs = ALLOW_DFS;
+    memcpy(cache.rank, rank, n * sizeof(chan_rank_t));
+    if (old != NULL && memcmp(old, &cache, sizeof(cache)) == 0) return;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) return;
+    if (nvs_set_blob(handle, "chan_rank", &cache, sizeof(cache)) == ESP_OK) nvs_commit(handle);
+    nvs_close(handle);
+}
+
+
+#if defined(CHAN_MON) || defined(FAST_BOOT)
+static SemaphoreHandle_t scan_lock;             // chan_mon_task() and boot_scan_task() share ap_records
+
+// scans a single channel while the AP is up, actively with a dwell of dwell ms, DFS channels
+// passively as they have to be. The AP is off its channel meanwhile, the few packets that
+// miss it are concealed like any other loss. Returns the number of APs put in aps.
+static int scan_channel(uint8_t channel, uint32_t dwell, scan_ap_t *aps) {
+    wifi_scan_config_t scan_config = {
+        .ssid = NULL,
+        .bssid = NULL,
+        .channel = channel,
+        .show_hidden = true,
+        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+        .scan_time.active = { .min = dwell / 2, .max = dwell },
+    };
+    uint16_t ap_count = 0;
+
+    if (chan_is_dfs(channel)) {
+        scan_config.scan_type = WIFI_SCAN_TYPE_PASSIVE;
+        scan_config.scan_time.passive = BOOT_SCAN_PASSIVE;
+    }
+    xSemaphoreTake(scan_lock, portMAX_DELAY);
+    if (esp_wifi_scan_start(&scan_config, true) == ESP_OK) {
+        esp_wifi_scan_get_ap_num(&ap_count);
+        if (ap_count > MAX_AP_RECORDS) ap_count = MAX_AP_RECORDS;
+        esp_wifi_scan_get_ap_records(&ap_count, ap_records);
+        for (int i = 0; i < ap_count; i++) {
+            scan_ap_from_record(&ap_records[i], &aps[i]);
+        }
+    }
+    xSemaphoreGive(scan_lock);
+    return ap_count;
+}
+#endif
+
+
 int find_free_channel(void) {
     // country settings? 
+    static chan_rank_t rank[CHAN_RANK_MAX];
+    chan_rank_cache_t cache;
+    bool cached;
+    int n, best_channel;
     
     wifi_scan_config_t scan_config = {
         .ssid = NULL,
         .bssid = NULL,
         .channel = 0,      // Scan all channels
-        .show_hidden = false,
+        .show_hidden = true,                        // hidden networks take airtime as well
         .scan_type = WIFI_SCAN_TYPE_PASSIVE,
     };
 
@@ -148,23 +265,39 @@ int find_free_channel(void) {
 
     ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&ap_count, ap_records));
 
-    // Analyze channel usage
+    // in the format of host/chan_score_check.c, grep the log for "scan:" to record a venue
     for (int i = 0; i < ap_count; i++) {
-        ESP_LOGI(RX_TAG, "SSID: %s, Channel: %d, RSSI: %d", ap_records[i].ssid, ap_records[i].primary, ap_records[i].rssi);
-        channel_usage[ap_records[i].primary]++;
+        scan_ap_from_record(&ap_records[i], &scan_aps[i]);
+        ESP_LOGI(RX_TAG, "scan: %d %d %d %d %s", scan_aps[i].primary, scan_aps[i].center, scan_aps[i].bw, 
+                 scan_aps[i].rssi, ap_records[i].ssid);
     }
+    n = chan_rank(scan_aps, ap_count, NULL, 0, ALLOW_DFS, rank);
+
+#ifdef CHAN_AIRTIME_PROBE
+    // the scan only sees beacons. What the top channels are really busy with decides between them.
+    chan_busy_t busy[CHAN_PROBE_TOP];
+    int n_busy = n < CHAN_PROBE_TOP ? n : CHAN_PROBE_TOP;
+
+    esp_wifi_set_promiscuous_rx_cb(probe_rx_cb);
+    esp_wifi_set_promiscuous(true);
+    for (int i = 0; i < n_busy; i++) {
+        busy[i].channel = rank[i].channel;
+        busy[i].permille = chan_probe_airtime(rank[i].channel);
+        ESP_LOGI(RX_TAG, "scan: busy %d %d", busy[i].channel, busy[i].permille);
+    }
+    esp_wifi_set_promiscuous(false);
+    n = chan_rank(scan_aps, ap_count, busy, n_busy, ALLOW_DFS, rank);
+#endif
 
-    // Select the channel with the least congestion (least number of APs) 
-    int best_channel = 0;
-    int min_usage = INT_MAX;
-    for (int i = 0; i < sizeof(channels)/sizeof(int); i++) {
-        if (channel_usage[channels[i]] < min_usage) {
-            best_channel = channels[i];
-            min_usage = channel_usage[channels[i]];
-        }
+    cached = chan_rank_load(&cache);
+    best_channel = chan_pick(rank, n, cached ? &cache : NULL);
+    for (int i = 0; i < n && i < 5; i++) {
+        ESP_LOGI(RX_TAG, "rank %d: channel %d score %d, %d access points", i + 1, rank[i].channel, rank[i].score, rank[i].aps);
     }
+    ESP_LOGI(RX_TAG, "Best channel: %d%s", best_channel, 
+             cached && best_channel == cache.rank[0].channel ? ", as on the last boot" : "");
+    chan_rank_save(cached ? &cache : NULL, rank, n);
 
-    ESP_LOGI(RX_TAG, "Best channel: %d with usage count: %d", best_channel, min_usage);
     // esp_wifi_set_mode(WIFI_MODE_NULL); 
     ESP_ERROR_CHECK(esp_wifi_stop());
     esp_netif_destroy_default_wifi(WIFI_IF_STA);
@@ -172,6 +305,45 @@ int find_free_channel(void) {
 }
 
 
+#ifdef FAST_BOOT
+// a fast boot takes the channel from NVS instead of scanning first. This catches up on the
+// scan in the background, one channel per BOOT_SCAN_INTERVAL ms, and stores the ranking
+// for the next full boot. Moving the AP, if it has to, is left to chan_mon_task().
+void boot_scan_task(void *args) {
+    static scan_ap_t aps[MAX_AP_RECORDS];
+    static chan_rank_t rank[CHAN_RANK_MAX];
+    scan_ap_t found[MAX_AP_RECORDS];
+    chan_rank_cache_t cache;
+    wifi_config_t wifi_config;
+    bool cached;
+    int n_aps = 0, n, best;
+
+    for (int i = 0; i < CHAN_RANK_MAX; i++) {
+        if (chan_is_dfs(chan_5g[i]) && !ALLOW_DFS) continue;
+        vTaskDelay(BOOT_SCAN_INTERVAL / portTICK_PERIOD_MS);
+        n = scan_channel(chan_5g[i], CHAN_SCAN_DWELL, found);
+        for (int k = 0; k < n && n_aps < MAX_AP_RECORDS; k++) {
+            aps[n_aps++] = found[k];
+            ESP_LOGI(RX_TAG, "scan: %d %d %d %d", found[k].primary, found[k].center, found[k].bw, found[k].rssi);
+        }
+    }
+    n = chan_rank(aps, n_aps, NULL, 0, ALLOW_DFS, rank);
+    cached = chan_rank_load(&cache);
+    best = chan_pick(rank, n, cached ? &cache : NULL);
+    chan_rank_save(cached ? &cache : NULL, rank, n);
+
+    esp_wifi_get_config(WIFI_IF_AP, &wifi_config);
+    if (best != wifi_config.ap.channel) {
+        ESP_LOGW(RX_TAG, "boot scan: %d access points, channel %d would be better than %d", n_aps, best, 
+                 wifi_config.ap.channel);
+    } else {
+        ESP_LOGI(RX_TAG, "boot scan: %d access points, channel %d is still the best", n_aps, best);
+    }
+    vTaskDelete(NULL);
+}
+#endif
+
+
 #define MAXLEN 32
 
 void init_wifi_rx(bool setup_requested) {
@@ -180,13 +352,32 @@ void init_wifi_rx(bool setup_requested) {
     char ssid[MAXLEN];
     char pass[MAXLEN];
 
+    int channel;
+    uint8_t bandwidth = 0;
+#ifdef FAST_BOOT
+    boot_state_t bs;
+#endif
+
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
+#if defined(CHAN_MON) || defined(FAST_BOOT)
+    scan_lock = xSemaphoreCreateMutex();
+#endif
+
 #ifdef TX_TEST
-    int channel = WIFI_CHANNEL;
+    channel = WIFI_CHANNEL;
 #else    
-    int channel = find_free_channel(); 
+#ifdef FAST_BOOT
+    // setup wants a fresh look at the air, otherwise the last channel is good enough to start with
+    if (!setup_requested && boot_state_load('R', &bs)) {
+        channel = bs.channel;
+        bandwidth = bs.bandwidth;
+        fast_boot = true;
+        ESP_LOGI(RX_TAG, "fast boot, channel %d from the last run", channel);
+    } else 
+#endif
+    channel = find_free_channel(); 
 #endif    
     ESP_LOGI(RX_TAG, "using free channel %d", channel);
     
@@ -229,11 +420,16 @@ void init_wifi_rx(bool setup_requested) {
         strncpy((char*)wifi_config.ap.password, pass, sizeof(wifi_config.ap.password));
         wifi_config.ap.ssid_len = strlen(ssid);
 #endif
-        wifi_config.ap.channel = channel;
         wifi_config.ap.max_connection = 2;          // TODO for debugging maybe, should be 1 in production
         wifi_config.ap.authmode = WIFI_AUTH_WPA3_PSK;
         wifi_config.ap.pmf_cfg.required = true;
     }    
+    // a stored config has the channel of its last run, the scan may have found a better one
+    wifi_config.ap.channel = channel;
+#if defined(MULTI_RX) || defined(RX_MIX)
+    // the senders, the other receivers and a PC for the telemetry
+    wifi_config.ap.max_connection = RX_STREAMS + TX_NUM_DESTS;
+#endif
     
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
 
@@ -241,13 +437,26 @@ void init_wifi_rx(bool setup_requested) {
     proto_config.ghz_2g = 0;
     proto_config.ghz_5g = WIFI_PROTOCOL_11AX;                    // we want 5 GHz 11AX WPA3. 
 
+#if defined(CHAN_MON) || defined(FAST_BOOT)
+    esp_netif_create_default_wifi_sta();            // scan_channel() scans through the STA interface
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA)); 
+#else
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP)); 
+#endif
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config));    
 
     ESP_ERROR_CHECK(esp_wifi_start());
     ESP_ERROR_CHECK(esp_wifi_set_band_mode(WIFI_BAND_MODE_5G_ONLY));
     ESP_ERROR_CHECK(esp_wifi_set_protocols(WIFI_IF_AP, &proto_config));            
     esp_wifi_set_ps(WIFI_PS_NONE);    // prevent  ENOMEM?             
+    if (bandwidth != 0) {
+        esp_wifi_set_bandwidth(WIFI_IF_AP, (wifi_bandwidth_t)bandwidth);
+    }
+#ifdef FAST_BOOT
+    wifi_bandwidth_t bw = 0;
+    esp_wifi_get_bandwidth(WIFI_IF_AP, &bw);
+    boot_state_save('R', channel, (uint8_t)bw);
+#endif
     
     if (setup_requested) {
     	ESP_ERROR_CHECK(esp_wifi_ap_wps_enable(&wps_config));
@@ -263,7 +472,7 @@ void init_wifi_rx(bool setup_requested) {
 
 // on_sent callback, used to determine the pointer to the most recently emptied dma buffer
 IRAM_ATTR bool i2s_tx_callback(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx) {
-    uint8_t *i2sbuf, *dmabuf;
+    uint8_t *dmabuf;
     size_t size;
 
 
@@ -271,22 +480,18 @@ IRAM_ATTR bool i2s_tx_callback(i2s_chan_handle_t handle, i2s_event_data_t *event
     dmabuf = (uint8_t *)event->dma_buf;
     size = event->size;
 
-#ifdef RX_DEBUG
-    _log[p].loc = 0;
-    _log[p].time = get_time_us_in_isr();
-    _log[p].ptr = event->dma_buf;
-    _log[p].size = event->size; 
-    p++;
-#endif
+    TRACE(TRACE_I2S_TX_ISR, size);
+    CPU_GOV_ENTER_ISR();
 
-    // fetch current ringbuf entry
-    i2sbuf = ring_buf_get(); 
-    if (i2sbuf == NULL) {           // this is the case when filling the buffer on system start 
+    // write the current ringbuf entry to the most recently free'd DMA buffer, 
+    // copied or, with RING_PACKED, unpacked
+    if (!ring_buf_read(dmabuf)) {   // this is the case when filling the buffer on system start 
                                     // or when recovering from a buffer overrun
         memset(dmabuf, 0, size);    // silence
-    } else {                        // write data to most recently free'd DMA buffer
-        memcpy(dmabuf, i2sbuf, size); 
+    } else if (first_audio_us == 0) {
+        first_audio_us = (uint32_t)esp_timer_get_time();     // µs since boot, not since the gptimer started
     }        
+    CPU_GOV_LEAVE_ISR();
     return false; 
 }    
 
@@ -317,7 +522,7 @@ void udp_rx_task(void *args) {
     struct sockaddr_in dest_addr;
     struct timeval timeout;
     
-    dest_addr.sin_addr.s_addr = inet_addr(RX_IP_ADDR); 
+    dest_addr.sin_addr.s_addr = inet_addr(RX_BIND_ADDR); 
     dest_addr.sin_family = AF_INET;
     dest_addr.sin_port = htons(PORT);
 
@@ -345,16 +550,19 @@ void udp_rx_task(void *args) {
 
         while(1) {
 
-#ifdef RX_DEBUG        
-            _log[p].loc = 4;
-            _log[p].time = get_time_us_in_isr(); 
-            p++;
+#if defined(LATENCY_PROBE) || defined(RX_MIX)
+            socklen = sizeof(source_addr);
+            int len = recvfrom(sock, udp_rx_buf, sizeof(udp_buf_t), 0, (struct sockaddr *)&source_addr, &socklen);
+#ifdef LATENCY_PROBE
+            if (len > 0 && !sender_known) {
+                memcpy(&sender_addr, &source_addr, sizeof(sender_addr));
+                sender_known = true; 
+            }
 #endif
+#else
             int len = recvfrom(sock, udp_rx_buf, sizeof(udp_buf_t), 0, NULL, NULL); // (struct sockaddr *)&source_addr, &socklen);
-
-#ifdef RX_STATS
-            // stats[0]++;
 #endif
+
             
 #ifdef LATENCY_MEAS
             stop_time = get_time_us_in_isr();
@@ -377,14 +585,17 @@ void udp_rx_task(void *args) {
     	    }
 #endif
 
-#ifdef RX_DEBUG        
-            _log[p].loc = 5;
-            _log[p].time = get_time_us_in_isr(); 
-            _log[p].size = (uint32_t)len; 
-            p++;
+            TRACE(TRACE_RX_RECVFROM, len == sizeof(udp_buf_t) ? udp_rx_buf->sequence_number : 0);
+#ifdef PKT_CAPTURE
+            if (len >= 0) {
+                pkt_capture_add(get_time_us_in_isr(), len == sizeof(udp_buf_t) ? udp_rx_buf->sequence_number : 0, len);
+            }
 #endif
 
             if (len == sizeof(udp_buf_t)) {
+#ifdef TELEMETRY
+                telem_inc(TC_RX_PACKETS);
+#endif
                 // ESP_LOGW(RX_TAG, "len ok");
                 // assume success. verify checksum 
                 // checksum = udp_rx_buf->checksum; 
@@ -392,7 +603,18 @@ void udp_rx_task(void *args) {
                 // mychecksum = calculate_checksum((uint32_t *)udp_rx_buf, NFRAMES * sizeof(udp_frame_t) / 4); 
                 // if (checksum == mychecksum) {
                     // ESP_LOGW(RX_TAG, "checksum ok");
+                    HEAP_WATCH_ENTER();
+                    CPU_GOV_ENTER();
+#ifdef RX_MIX
+                    // the sender's address is its ID, every one has a ring of its own 
+                    ring_t *ring = ring_lookup(((struct sockaddr_in *)&source_addr)->sin_addr.s_addr);
+                    if (ring != NULL) ring_put(ring, udp_rx_buf);
+#else
                     ring_buf_put(udp_rx_buf);
+#endif
+                    CPU_GOV_LEAVE();
+                    HEAP_WATCH_LEAVE();
+                    HEAP_WATCH_ARM();
 #if 0
             	    count_processed = (count_processed + 1) & numpackets;
             	    if (count_processed == 0) {               // hier müsste man einen extra counter machen.
@@ -426,23 +648,211 @@ void udp_rx_task(void *args) {
 #endif                
             } else if (len < 0) {
                 // we ignore broken packets for now. 
-#ifdef RX_STATS
-                stats[7]++;
+#ifdef TELEMETRY
+                telem_inc(TC_RX_ERRORS);
 #endif
                 ESP_LOGW(RX_TAG, "UDP receive error: %d", errno);
                 continue; 
-            }
-            
-#ifdef RX_DEBUG        
-            _log[p].loc = 4;
-            _log[p].time = get_time_us_in_isr(); 
-            p++;
+#ifdef TELEMETRY
+            } else {
+                telem_inc(TC_RX_BAD_LEN);
 #endif
+            }
         }    
     }
 }
 
 
+#ifdef LATENCY_PROBE
+// pings the sender on SYNC_PORT and feeds the clock offset estimator, see latency_probe.h
+void sync_rx_task(void *args) {
+    struct sockaddr_in dest_addr;
+    struct timeval timeout;
+    sync_pkt_t pkt;
+    uint32_t t1, t4;
+    int len;
+
+    clock_sync_init(&clock_sync);
+    lat_hist_reset(&lat_hist);
+
+    while (!sender_known) {
+        vTaskDelay(SYNC_INTERVAL/portTICK_PERIOD_MS);
+    }
+    memcpy(&dest_addr, &sender_addr, sizeof(dest_addr));
+    dest_addr.sin_port = htons(SYNC_PORT);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(RX_TAG, "Unable to create sync socket: errno %d", errno);
+        vTaskDelete(NULL);
+    }
+    timeout.tv_sec = 0;
+    timeout.tv_usec = SYNC_INTERVAL * 1000 / 2;
+    setsockopt (sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ESP_LOGI(RX_TAG, "Sync socket created, pinging sender port %d", SYNC_PORT);
+
+    while (1) {
+        pkt.magic = SYNC_MAGIC;
+        pkt.t1 = t1 = get_time_us_in_isr();
+        pkt.t2 = pkt.t3 = 0;
+        if (sendto(sock, &pkt, sizeof(pkt), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) == sizeof(pkt)) {
+            // late replies to earlier pings may still be queued, skip them
+            do {
+                len = recvfrom(sock, &pkt, sizeof(pkt), 0, NULL, NULL);
+                t4 = get_time_us_in_isr();
+            } while (len == sizeof(pkt) && pkt.t1 != t1);
+            if (len == sizeof(pkt) && pkt.magic == SYNC_MAGIC) {
+                clock_sync_sample(&clock_sync, pkt.t1, pkt.t2, pkt.t3, t4);
+            }
+        }
+        vTaskDelay(SYNC_INTERVAL/portTICK_PERIOD_MS);
+    }
+}
+#endif
+
+
+#ifdef CHAN_MON
+#ifndef TELEMETRY
+#error "CHAN_MON needs TELEMETRY, the link sample comes from its counters"
+#endif
+
+// scans one candidate with a short active dwell, see scan_channel()
+static int32_t chan_scan_candidate(uint8_t channel) {
+    scan_ap_t aps[MAX_AP_RECORDS];
+    int32_t rating;
+    int n;
+
+    n = scan_channel(channel, CHAN_SCAN_DWELL, aps);
+    // only the APs with their primary here answer, wide ones from next door go unseen
+    rating = chan_scan_rating(channel, aps, n);
+    ESP_LOGI(RX_TAG, "channel %d: %d access points, rated %ld", channel, n, rating);
+    return rating;
+}
+
+
+// rates the link every CHAN_MON_INTERVAL ms and moves the AP when chan_mon_tick() says so.
+// The sender reports on CHAN_PORT, its address is where the announcements go.
+void chan_mon_task(void *args) {
+    struct sockaddr_in bind_addr, peer_addr;
+    socklen_t socklen;
+    struct timeval timeout;
+    wifi_config_t wifi_config;
+    wifi_sta_list_t sta_list;
+    chan_mon_t cm;
+    chan_msg_t msg, report = {0}, prev_report = {0};
+    link_sample_t s;
+    uint32_t now, last_tick, prev_rx = 0;
+    int32_t rating, best_rating = 0;
+    uint8_t best = 0;
+    int len, scan_idx = CHAN_NUM_CANDIDATES;
+    bool have_peer = false;
+
+    esp_wifi_get_config(WIFI_IF_AP, &wifi_config);
+    chan_mon_init(&cm, wifi_config.ap.channel);
+
+    bind_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    bind_addr.sin_family = AF_INET;
+    bind_addr.sin_port = htons(CHAN_PORT);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(RX_TAG, "Unable to create channel monitor socket: errno %d", errno);
+        vTaskDelete(NULL);
+    }
+    if (bind(sock, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) < 0) {
+        ESP_LOGE(RX_TAG, "channel monitor socket unable to bind: errno %d", errno);
+        close(sock);
+        vTaskDelete(NULL);
+    }
+    timeout.tv_sec = 0;
+    timeout.tv_usec = CHAN_MON_INTERVAL * 1000 / 4;
+    setsockopt (sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ESP_LOGI(RX_TAG, "channel monitor on channel %d, port %d", cm.channel, CHAN_PORT);
+    last_tick = get_time_us_in_isr();
+
+    while (1) {
+        socklen = sizeof(peer_addr);
+        len = recvfrom(sock, &msg, sizeof(msg), 0, (struct sockaddr *)&peer_addr, &socklen);
+        if (len == sizeof(msg) && msg.magic == CHAN_MSG_MAGIC) {
+            if (msg.type == CHAN_MSG_REPORT) {
+                report = msg;
+                have_peer = true;
+            } else if (msg.type == CHAN_MSG_ACK) {
+                chan_mon_ack(&cm, &msg);
+            }
+        }
+        now = get_time_us_in_isr();
+        if (now - last_tick < CHAN_MON_INTERVAL * 1000) continue;
+
+        // the stream has a fixed rate, so while the sender sends we expect a packet per
+        // PACKET_TIME_US. Its reports only tell us that it does, and how many sends failed.
+        memset(&s, 0, sizeof(s));
+        if (report.tx_packets != prev_report.tx_packets || cm.state == CHAN_SETTLE) {
+            s.expected = (now - last_tick) / PACKET_TIME_US;
+        }
+        s.received = telem_counter[TC_RX_PACKETS] - prev_rx;
+        s.tx_failed = report.tx_failed - prev_report.tx_failed;
+        s.rssi = report.rssi;
+        // with MULTI_RX the first station may be another receiver, the report has the sender's
+        if (TX_NUM_DESTS == 1 && esp_wifi_ap_get_sta_list(&sta_list) == ESP_OK && sta_list.num > 0) {
+            s.rssi = sta_list.sta[0].rssi;
+        }
+        s.jitter_p99_us = telem_gauge[TG_JITTER_P99];
+        prev_rx += s.received;
+        prev_report = report;
+        last_tick = now;
+
+        switch (chan_mon_tick(&cm, &s, RINGBUF_OFFSET * PACKET_TIME_US)) {
+            case CHAN_ACT_SCAN:
+                ESP_LOGW(RX_TAG, "channel %d degraded, rating %ld, scanning", cm.channel, chan_mon_rating(&cm));
+                scan_idx = 0;
+                best = 0;
+                best_rating = 0;
+                break;
+            case CHAN_ACT_ANNOUNCE:
+                if (have_peer) {
+                    chan_mon_announce(&cm, &msg);
+                    peer_addr.sin_port = htons(CHAN_PORT);
+                    sendto(sock, &msg, sizeof(msg), 0, (struct sockaddr *)&peer_addr, sizeof(peer_addr));
+                }
+                break;
+            case CHAN_ACT_SWITCH:
+                // the AP announces the switch in its beacons as well, for a sender that missed ours
+                ESP_LOGW(RX_TAG, "moving to channel %d%s", cm.channel, cm.acked ? "" : ", not acknowledged");
+                esp_wifi_get_config(WIFI_IF_AP, &wifi_config);
+                wifi_config.ap.channel = cm.channel;
+                wifi_config.ap.csa_count = CHAN_CSA_COUNT;
+                esp_wifi_set_config(WIFI_IF_AP, &wifi_config);
+#ifdef FAST_BOOT
+                wifi_bandwidth_t bw = 0;
+                esp_wifi_get_bandwidth(WIFI_IF_AP, &bw);
+                boot_state_save('R', cm.channel, (uint8_t)bw);
+#endif
+                break;
+            default:
+                break;
+        }
+
+        // one candidate per interval, so the AP is never away for long
+        if (cm.state == CHAN_SCAN && scan_idx < CHAN_NUM_CANDIDATES) {
+            if (chan_candidates[scan_idx] != cm.channel) {
+                rating = chan_scan_candidate(chan_candidates[scan_idx]);
+                if (rating > best_rating) {
+                    best = chan_candidates[scan_idx];
+                    best_rating = rating;
+                }
+            }
+            if (++scan_idx == CHAN_NUM_CANDIDATES) {
+                chan_mon_scan_done(&cm, best, best_rating);
+                ESP_LOGI(RX_TAG, "best candidate %d rated %ld against %ld, %s", best, best_rating, 
+                         chan_mon_rating(&cm), chan_state_name(cm.state));
+            }
+        }
+    }
+}
+#endif
+
+
 #ifdef LATENCY_MEAS
 // latency measurement
 static void IRAM_ATTR handle_interrupt(void *args) {
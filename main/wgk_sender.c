@@ -19,6 +19,9 @@
  
 #include "wireless_gk.h"
 #include "esp_private/wifi.h"
+#ifdef TX_POWER_SAVE
+#include "esp_wifi_he.h"
+#endif
 
 
 #define LED_PIN                 GPIO_NUM_10             // 
@@ -37,6 +40,11 @@ static esp_wps_config_t config = WPS_CONFIG_INIT_DEFAULT(WPS_TYPE_PBC);   // we
 static wifi_config_t wps_ap_creds[MAX_WPS_AP_CRED];
 static int s_ap_creds_num = 0;
 static int s_retry_num = 0;
+#ifdef TX_POWER_SAVE
+volatile int tx_ps_current = TX_PS_SCHED;
+volatile bool tx_ps_twt_up = false;
+static int twt_flow_id = -1;
+#endif
 
 
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
@@ -50,6 +58,19 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
             break;
         case WIFI_EVENT_STA_DISCONNECTED:
             ESP_LOGI(TX_TAG, "WIFI_EVENT_STA_DISCONNECTED");
+#ifdef FAST_BOOT
+            // the receiver is not on the channel of the last run any more, look everywhere
+            if (fast_boot && !(xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT)) {
+                wifi_config_t wifi_config;
+
+                ESP_LOGW(TX_TAG, "receiver not found on the last channel, full scan");
+                fast_boot = false;
+                if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK) {
+                    wifi_config.sta.channel = 0;
+                    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+                }
+            }
+#endif
             if (s_retry_num < MAX_RETRY) {
                 esp_wifi_connect();
                 s_retry_num++;
@@ -112,27 +133,110 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
             ESP_ERROR_CHECK(esp_wifi_wps_enable(&config));
             ESP_ERROR_CHECK(esp_wifi_wps_start(0));
             break;
+#ifdef TX_POWER_SAVE
+        case WIFI_EVENT_ITWT_SETUP:
+            {
+                wifi_event_sta_itwt_setup_t *setup = (wifi_event_sta_itwt_setup_t *)event_data;
+
+                // modem sleep is on already, without an agreement the radio wakes for every burst by itself
+                tx_ps_twt_up = (setup->status == ITWT_SETUP_SUCCESS);
+                if (tx_ps_twt_up) {
+                    twt_flow_id = setup->config.flow_id;
+                    ESP_LOGI(TX_TAG, "TWT flow %d, wake interval %u * 2^%u µs", setup->config.flow_id,
+                             setup->config.wake_invl_mant, setup->config.wake_invl_expn);
+                } else {
+                    ESP_LOGW(TX_TAG, "AP declined TWT (status %d, reason %d), modem sleep only",
+                             (int)setup->status, setup->reason);
+                }
+            }
+            break;
+        case WIFI_EVENT_ITWT_TEARDOWN:
+            ESP_LOGI(TX_TAG, "TWT torn down");
+            tx_ps_twt_up = false;
+            twt_flow_id = -1;
+            break;
+#endif
         default:
             break;
     }
 }
 
 
+#ifdef TX_POWER_SAVE
+// switch the radio to a schedule of tx_ps_sched[]. udp_tx_task() picks up its burst at the
+// start of the next one. Needs the connection, the TWT agreement is made with the AP.
+static void tx_ps_apply(int sched) {
+    const tx_ps_sched_t *s = &tx_ps_sched[sched];
+    wifi_itwt_setup_config_t twt = {
+        .setup_cmd = TWT_REQUEST,
+        .trigger = 0,                   // we only send, nothing to trigger
+        .flow_type = 1,                 // unannounced, no PS-Poll at the start of the wake
+        .flow_id = 0,
+        .wake_duration_unit = 0,        // 256 µs
+        .timeout_time_ms = 5000,
+    };
+    esp_err_t err;
+    uint16_t mant;
+    uint8_t expn;
+
+    if (twt_flow_id >= 0) {
+        esp_wifi_sta_itwt_teardown(twt_flow_id);
+        twt_flow_id = -1;
+        tx_ps_twt_up = false;
+    }
+    // lwIP used to run out of buffers with power save, which is why it was left off. A burst
+    // is sent from the tx arena in one go, so the radio is up for all of it.
+    esp_wifi_set_ps(s->mode == TX_PS_AWAKE ? WIFI_PS_NONE : WIFI_PS_MIN_MODEM);
+    if (s->mode == TX_PS_TWT) {
+        tx_ps_twt_interval(s->burst, &mant, &expn);
+        twt.wake_invl_mant = mant;
+        twt.wake_invl_expn = expn;                                  // a bit field
+        twt.min_wake_dura = tx_ps_twt_min_wake(s->burst);
+        if ((err = esp_wifi_sta_itwt_setup(&twt)) != ESP_OK) {
+            ESP_LOGW(TX_TAG, "TWT setup failed: %s, modem sleep only", esp_err_to_name(err));
+        }
+    }
+    tx_ps_current = sched;
+    ESP_LOGI(TX_TAG, "power save %s, burst %d, %lu mA modelled", s->name, s->burst, tx_ps_current_ma(s));
+}
+#endif
+
+
 static void got_ip_event_handler(void* arg, esp_event_base_t event_base,
                                  int32_t event_id, void* event_data) {
     ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
     ESP_LOGI(TX_TAG, "got ip: " IPSTR, IP2STR(&event->ip_info.ip));
     xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+#ifdef TX_POWER_SAVE
+    // again after every reconnect, an agreement does not survive the association
+    tx_ps_apply(tx_ps_current);
+#endif
 }
 
 
-// Sender is WIFI_STA
+// Sender is WIFI_STA, and so is a receiver built with RX_SECONDARY
 void init_wifi_tx(bool setup_requested) {
     esp_err_t err; 
+    esp_netif_t *sta_netif;
+#ifdef FAST_BOOT
+    boot_state_t bs;
+    wifi_ap_record_t ap_info;
+#endif
+#ifdef RX_SECONDARY
+    esp_netif_ip_info_t ip_info = { 0 };
+#endif
     
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    sta_netif = esp_netif_create_default_wifi_sta();
+#ifdef RX_SECONDARY
+    // the sender sends to a fixed address, see TX_DESTS. esp_netif reports it as got ip on connect
+    ip_info.ip.addr = esp_ip4addr_aton(RX_SECONDARY_ADDR);
+    ip_info.netmask.addr = esp_ip4addr_aton(RX_SECONDARY_MASK);
+    ip_info.gw.addr = esp_ip4addr_aton(RX_IP_ADDR);
+    ESP_ERROR_CHECK(esp_netif_dhcpc_stop(sta_netif));
+    ESP_ERROR_CHECK(esp_netif_set_ip_info(sta_netif, &ip_info));
+#endif
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
@@ -165,6 +269,16 @@ void init_wifi_tx(bool setup_requested) {
     }
     wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA3_PSK;                                // not more, not less.     
 #endif
+#ifdef FAST_BOOT
+    // with a channel the connect scans only that one instead of all of 5 GHz. If the receiver
+    // moved meanwhile, wifi_event_handler() falls back to the full scan.
+    wifi_config.sta.channel = 0;
+    if (!setup_requested && boot_state_load('T', &bs)) {
+        wifi_config.sta.channel = bs.channel;
+        fast_boot = true;
+        ESP_LOGI(TX_TAG, "fast boot, channel %d from the last run", bs.channel);
+    }
+#endif
     
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
@@ -181,7 +295,7 @@ void init_wifi_tx(bool setup_requested) {
         ESP_LOGI(TX_TAG, "normal STA startup...");
     }        
     
-    // esp_wifi_set_ps(WIFI_PS_NONE);    // prevent  ENOMEM?
+    // esp_wifi_set_ps(WIFI_PS_NONE);    // prevent  ENOMEM?     with TX_POWER_SAVE see tx_ps_apply()
     
     // ESP_LOGI(TX_TAG, "wifi_init_sta finished.");
 
@@ -198,6 +312,12 @@ void init_wifi_tx(bool setup_requested) {
         int ret = esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
         ESP_LOGI(TX_TAG, "connected to ap SSID:%s password:%s",
                  wifi_config.sta.ssid, wifi_config.sta.password);
+#if defined(FAST_BOOT) && !defined(RX_SECONDARY)
+        // a secondary receiver always does the full boot, its state would pass for a sender's
+        if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+            boot_state_save('T', ap_info.primary, 0);
+        }
+#endif
     } else if (bits & WIFI_FAIL_BIT) {
         ESP_LOGW(TX_TAG, "Failed to connect to SSID:%s, password:%s",
                  wifi_config.sta.ssid, wifi_config.sta.password);
@@ -207,29 +327,25 @@ void init_wifi_tx(bool setup_requested) {
 }
 
 DRAM_ATTR static uint8_t *dmabuf; 
+#ifdef WITH_TIMESTAMP
+DRAM_ATTR static uint32_t capture_time;     // when the DMA buffer was complete
+#endif
 
 IRAM_ATTR bool i2s_rx_callback(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx) {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     
     dmabuf = (uint8_t *)(event->dma_buf);
-    
-#ifdef TX_DEBUG
-    _log[p].loc = 0;
-    _log[p].time = get_time_us_in_isr();
-    _log[p].ptr = event->dma_buf;
-    _log[p].size = event->size; 
-    p++;
+#ifdef WITH_TIMESTAMP
+    capture_time = get_time_us_in_isr();
 #endif
+    
+    TRACE(TRACE_I2S_RX_ISR, event->size);
 
     xTaskNotifyFromISR(udp_tx_task_handle, 0, eNoAction, &xHigherPriorityTaskWoken);
     return (xHigherPriorityTaskWoken == pdTRUE);
 }    
 
 
-#ifdef TX_DEBUG
-static char t[][20] = {"ISR", "beg. i2s_rx_task", "i2s_rx_task notif.", "i2s_rx notify udp", "udp_tx_t. notif.", "udp sent" }; 
-#endif
-
 
 /*
  * UDP stuff
@@ -242,19 +358,30 @@ static char t[][20] = {"ISR", "beg. i2s_rx_task", "i2s_rx_task notif.", "i2s_rx
 static heap_trace_record_t trace_record[NUM_RECORDS]; 
 */ 
 
+#if TX_NUM_DESTS > TELEM_MAX_DESTS
+#error "TX_DESTS has more receivers than telemetry can report on"
+#endif
+
 void udp_tx_task(void *args) {
-    struct sockaddr_in dest_addr;
+    static const char *dests[TX_NUM_DESTS] = TX_DESTS;
+    struct sockaddr_in dest_addr[TX_NUM_DESTS];
     struct timeval timeout;
 
-    int err; 
-    int i, j; 
+    int err, tx_errno = 0, i, d; 
+    bool failed[TX_NUM_DESTS];          // in this burst, the receiver is skipped for the rest of it
+    int64_t packed;                     // µs, when the burst was ready to go
+    int held = 0, burst = 1;            // packets packed and not sent yet, and how many go in one wake
+    udp_buf_t *buf; 
     uint32_t count = 0; 
     uint32_t checksum; 
-    uint32_t sequence_number = 1;    // we start at 1 to avoid having to deal with the 0 on the Rx side when the system starts. 
+    uint32_t sequence_number = 1;    // only the low 16 bits go on the air, the Rx side unwraps them, see seqnum.h
+    uint32_t session = esp_random();    // a new one after every restart, so the Rx side resyncs instead of waiting for our old sequence numbers
     
-    dest_addr.sin_addr.s_addr = inet_addr(RX_IP_ADDR);
-    dest_addr.sin_family = AF_INET;
-    dest_addr.sin_port = htons(PORT);
+    for (d = 0; d < TX_NUM_DESTS; d++) {
+        dest_addr[d].sin_addr.s_addr = inet_addr(dests[d]);
+        dest_addr[d].sin_family = AF_INET;
+        dest_addr[d].sin_port = htons(PORT);
+    }
 
     timeout.tv_sec = 10;
     timeout.tv_usec = 0;
@@ -274,76 +401,103 @@ void udp_tx_task(void *args) {
         // int buf_size = 5760; 
         // setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &buf_size, sizeof(buf_size));
 
-        ESP_LOGI(TX_TAG, "Socket created, sending to %s:%d", RX_IP_ADDR, PORT);
+        for (d = 0; d < TX_NUM_DESTS; d++) {
+            ESP_LOGI(TX_TAG, "Socket created, sending to %s:%d", dests[d], PORT);
+        }
 
         while (1) {
 
             xTaskNotifyWait(0, ULONG_MAX, NULL, portMAX_DELAY);
 
-#ifdef TX_DEBUG        
-            _log[p].loc = 4;
-            _log[p].time = get_time_us_in_isr(); 
-            p++;
-#endif    
-
-            // packing 
-            // memset (udp_tx_buf, 0, UDP_PAYLOAD_SIZE);                           
-            for (i=0; i<NFRAMES; i++) {
-                for (j=0; j<NUM_SLOTS_I2S; j++) {                
-                    // the offset of a sample in the DMA buffer is (i * NUM_SLOTS_I2S + j) * SLOT_SIZE_I2S + 1 
-                    // the offset of a sample in the UDP buffer is (i * NUM_SLOTS_UDP + j) * SLOT_SIZE_UDP
-                    memcpy ((uint8_t *)udp_tx_buf + (i * NUM_SLOTS_UDP + j) * SLOT_SIZE_UDP, 
-                            dmabuf + (i * NUM_SLOTS_I2S + j) * SLOT_SIZE_I2S + 1,             
-                            SLOT_SIZE_UDP);
-                }                    
-            }
-                           
-            // insert XOR checksum after the sample data
-            // checksum = calculate_checksum((uint32_t *)udp_tx_buf, UDP_BUF_SIZE/4); 
-            udp_tx_buf->checksum = calculate_checksum((uint32_t *)udp_tx_buf, NFRAMES * sizeof(udp_frame_t) / 4);
-            udp_tx_buf->sequence_number = sequence_number++;        
+            TRACE(TRACE_TX_NOTIFY, sequence_number);
+            HEAP_WATCH_ENTER();
+            CPU_GOV_ENTER();
+
+#ifdef TX_POWER_SAVE
+            // a new schedule starts with the next burst
+            if (held == 0) burst = tx_ps_sched[tx_ps_current].burst;
+#endif
+            // packing and XOR checksum
+            buf = &udp_tx_buf[held++];
+            udp_pack(buf, dmabuf);
+            buf->sequence_number = sequence_number++;        
+            buf->session = session;
             // we might as well truncate to the correct number of bits, then it's the slot number. 
+            TRACE(TRACE_TX_PACK, buf->sequence_number);
             
 #ifdef WITH_TIMESTAMP    
-            udp_tx_buf->timestamp = get_time_us_in_isr();    // keep this for now
+            buf->timestamp = capture_time;
 #endif
 #ifdef WITH_TEMP
-            udp_tx_buf->tx_temp = tx_temp;
+            buf->tx_temp = tx_temp;
 #endif
             // TODO insert S1, S2 in the last byte
             
+            CPU_GOV_LEAVE();
+            HEAP_WATCH_LEAVE();                 // lwIP and the WiFi driver may allocate, heap_allocs shows how often
+            if (held < burst) {
+                continue;                       // the radio sleeps on until the burst is complete, see tx_ps.h
+            }
+
             // UDP latency measurement
 #ifdef LATENCY_MEAS            
             gpio_set_level(SIG_PIN, 1);    
 #endif            
-            err = sendto(sock, udp_tx_buf, sizeof(udp_buf_t), MSG_DONTWAIT, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+            // back to back, the same packed buffer to every receiver in the order of TX_DESTS. 
+            // The receivers are independent: one that fails is skipped for the rest of the burst 
+            // and the others go on. Only a failure of the first, the AP, backs off below. 
+            packed = esp_timer_get_time();
+            memset(failed, 0, sizeof(failed));
+            for (i = 0, err = 0; i < held; i++) {
+                for (d = 0; d < TX_NUM_DESTS; d++) {
+                    if (failed[d]) continue;
+                    if (sendto(sock, &udp_tx_buf[i], sizeof(udp_buf_t), MSG_DONTWAIT, (struct sockaddr *)&dest_addr[d], sizeof(dest_addr[d])) < 0) {
+                        failed[d] = true;
+                        if (d == 0) {
+                            err = -1;
+                            tx_errno = errno;           // the later sends overwrite errno
+                        }
+#ifdef TELEMETRY
+                        telem_inc(TC_TX_DEST_ERRORS_0 + d);
+                        if (d == 0) telem_inc(tx_errno == ENOMEM ? TC_TX_ENOMEM : TC_TX_ERRORS);
+#endif
+                    } else {
+#ifdef TELEMETRY
+                        if (d == 0) telem_inc(TC_TX_PACKETS);      // packets, as the AP gets them
+                        telem_inc(TC_TX_DATAGRAMS);
+                        telem_hist_add(TH_TX_SEND_0 + d, (uint32_t)(esp_timer_get_time() - packed));
+#endif
+                    }
+                    if (d == 0) TRACE(TRACE_TX_SENDTO, udp_tx_buf[i].sequence_number);
+                }
+            }
+            held = 0;
 #ifdef LATENCY_MEAS            
             gpio_set_level(SIG_PIN, 0);    
 #endif
             
-#ifdef TX_DEBUG        
-            _log[p].loc = 5;
-            _log[p].time = get_time_us_in_isr(); 
-            p++;
-#endif    
             // ESP_LOGI(TX_TAG, "err=%d errno=%d", err, errno);
+            if (err >= 0) HEAP_WATCH_ARM();
+            if (err >= 0 && first_audio_us == 0) {
+                first_audio_us = (uint32_t)esp_timer_get_time();
+            }
             if (err < 0) {
-        	    if (errno == ENOMEM) {
-        	        ESP_LOGW(TX_TAG, "lwip_sendto fail ENOMEM. %d", errno);
+        	    if (tx_errno == ENOMEM) {
+        	        ESP_LOGW(TX_TAG, "lwip_sendto fail ENOMEM. %d", tx_errno);
         	        vTaskDelay(10);
-        	    } else if (errno == 118) {
-        	        ESP_LOGE(TX_TAG, "network not connected, errno %d", errno);
+        	    } else if (tx_errno == 118) {
+        	        ESP_LOGE(TX_TAG, "network not connected, errno %d", tx_errno);
         	        // BLINK! 
         	        vTaskDelay(500/portTICK_PERIOD_MS); // gracefully try again. 
                     break;
-        	    } else if (errno == EAGAIN) {
+        	    } else if (tx_errno == EAGAIN) {
                     ESP_LOGE(TX_TAG, "sendto: EAGAIN");                            	    
                     vTaskDelay(10);
-        	    } else if (errno == EWOULDBLOCK) {
+        	    } else if (tx_errno == EWOULDBLOCK) {
                     ESP_LOGE(TX_TAG, "sendto: EWOULDBLOCK");                            	    
                     vTaskDelay(10);
         	    } else {
-        	        ESP_LOGE(TX_TAG, "sendto lwip_sendto fail. %d", errno);
+        	        ESP_LOGE(TX_TAG, "sendto lwip_sendto fail. %d", tx_errno);
                     break;
                 }
     	    }
@@ -354,32 +508,6 @@ void udp_tx_task(void *args) {
     	    }
 #endif
                 
-#ifdef TX_DEBUG
-            if (p >= NUM) {
-                i2s_channel_disable(i2s_rx_handle); // also stop all interrupts
-                int q; 
-                uint32_t curr_time, prev_time=0;
-                for (q=0; q<p; q++) {
-                    switch (_log[q].loc) {
-                        case 0:         // ISR
-                            curr_time = _log[q].time;
-                            printf("%20s %lu diff %lu dma_buf 0x%08lx size %lu \n", 
-                                    t[_log[q].loc], _log[q].time, 
-                                    curr_time - prev_time,
-                                    (uint32_t) _log[q].ptr, _log[q].size);
-                            prev_time = curr_time;
-                            break; 
-                        default:
-                            printf("%20s %lu diff %lu dma_buf 0x%08lx size %lu \n", 
-                                    t[_log[q].loc], _log[q].time, _log[q].time-_log[q-1].time, (uint32_t)_log[q].ptr, _log[q].size);
-                            break;
-                    } 
-                    vTaskDelay(10/portTICK_PERIOD_MS);                       
-                }
-                vTaskDelete(i2s_rx_task_handle); 
-                vTaskDelete (NULL); 
-            }
-#endif
         }
 
         if (sock != -1) {
@@ -442,6 +570,132 @@ void latency_meas_task(void *args) {
 
 
 
+#ifdef LATENCY_PROBE
+// answers the receiver's clock sync pings, see latency_probe.h
+// t2 and t3 are both taken here, so the time we spend in between does not matter
+void sync_tx_task(void *args) {
+    struct sockaddr_in bind_addr, source_addr;
+    socklen_t socklen;
+    sync_pkt_t pkt;
+    uint32_t t2;
+    int len;
+
+    bind_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    bind_addr.sin_family = AF_INET;
+    bind_addr.sin_port = htons(SYNC_PORT);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(TX_TAG, "Unable to create sync socket: errno %d", errno);
+        vTaskDelete(NULL);
+    }
+    if (bind(sock, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) < 0) {
+        ESP_LOGE(TX_TAG, "Sync socket unable to bind: errno %d", errno);
+        close(sock);
+        vTaskDelete(NULL);
+    }
+    ESP_LOGI(TX_TAG, "Sync socket bound, port %d", SYNC_PORT);
+
+    while (1) {
+        socklen = sizeof(source_addr);
+        len = recvfrom(sock, &pkt, sizeof(pkt), 0, (struct sockaddr *)&source_addr, &socklen);
+        t2 = get_time_us_in_isr();
+        if (len != sizeof(pkt) || pkt.magic != SYNC_MAGIC) {
+            continue;
+        }
+        pkt.t2 = t2;
+        pkt.t3 = get_time_us_in_isr();
+        sendto(sock, &pkt, sizeof(pkt), 0, (struct sockaddr *)&source_addr, socklen);
+    }
+}
+#endif
+
+
+#ifdef TX_PS_MEASURE
+// the measurement mode: every schedule of tx_ps_sched[] for TX_PS_DWELL s, round and round.
+// The telemetry says which one runs, tools/telemetry_collect.c -W sets the receiver's latency
+// against it. The first TELEM_INTERVAL of a dwell still shows the one before.
+void tx_ps_task(void *args) {
+    int sched = tx_ps_current;
+
+    while (1) {
+        vTaskDelay(TX_PS_DWELL * 1000 / portTICK_PERIOD_MS);
+        if (!(xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT)) {
+            continue;
+        }
+        sched = (sched + 1) % tx_ps_num_sched;
+        tx_ps_apply(sched);
+    }
+}
+#endif
+
+
+#ifdef CHAN_MON
+// reports to the receiver's channel monitor every CHAN_MON_INTERVAL ms and follows its
+// announcements, see chan_mon.h. The station follows the AP's channel switch announcement
+// by itself; setting the channel here makes a reconnect after a missed one go straight
+// to the new channel instead of scanning them all.
+void chan_follow_task(void *args) {
+    struct sockaddr_in dest_addr, source_addr;
+    socklen_t socklen;
+    struct timeval timeout;
+    wifi_config_t wifi_config;
+    wifi_second_chan_t second;
+    chan_msg_t msg, ack;
+    uint16_t epoch = 0, prev_epoch;
+    uint32_t now, last_report = 0;
+    uint8_t channel;
+    int rssi, len;
+
+    dest_addr.sin_addr.s_addr = inet_addr(RX_IP_ADDR);
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(CHAN_PORT);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(TX_TAG, "Unable to create channel socket: errno %d", errno);
+        vTaskDelete(NULL);
+    }
+    timeout.tv_sec = 0;
+    timeout.tv_usec = CHAN_MON_INTERVAL * 1000 / 4;
+    setsockopt (sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ESP_LOGI(TX_TAG, "Channel socket created, reporting to port %d", CHAN_PORT);
+
+    while (1) {
+        now = get_time_us_in_isr();
+        if (now - last_report >= CHAN_MON_INTERVAL * 1000) {
+            memset(&msg, 0, sizeof(msg));
+            msg.magic = CHAN_MSG_MAGIC;
+            msg.type = CHAN_MSG_REPORT;
+            if (esp_wifi_get_channel(&channel, &second) == ESP_OK) msg.channel = channel;
+            if (esp_wifi_sta_get_rssi(&rssi) == ESP_OK) msg.rssi = rssi;
+            msg.tx_packets = telem_counter[TC_TX_PACKETS];
+            msg.tx_failed = telem_counter[TC_TX_ERRORS] + telem_counter[TC_TX_ENOMEM];
+            sendto(sock, &msg, sizeof(msg), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));   // best effort
+            last_report = now;
+        }
+
+        socklen = sizeof(source_addr);
+        len = recvfrom(sock, &msg, sizeof(msg), 0, (struct sockaddr *)&source_addr, &socklen);
+        prev_epoch = epoch;
+        if (len != sizeof(msg) || !chan_follow(&epoch, &msg, &ack)) {
+            continue;
+        }
+        if (epoch != prev_epoch) {
+            ESP_LOGW(TX_TAG, "receiver moves to channel %d", msg.channel);
+            if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK) {
+                wifi_config.sta.channel = msg.channel;
+                esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+            }
+#ifdef FAST_BOOT
+            boot_state_save('T', msg.channel, 0);
+#endif
+        }
+        sendto(sock, &ack, sizeof(ack), 0, (struct sockaddr *)&source_addr, socklen);
+    }
+}
+#endif
+
 
 bool init_gpio_tx (void) {
     bool setup_needed = false; 
@@ -27,6 +27,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "esp_event.h"
 #include "esp_heap_caps.h"
@@ -45,20 +46,17 @@
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
 #include "lwip/errno.h"
+#include "wgk_core.h"
+#include "wgk_arena.h"
+#ifdef CPU_GOV
+#include "esp_pm.h"
+#include "esp_cpu.h"
+#include "cpu_gov.h"
+#endif
+#include "mix.h"
 // #include "ringbuf.h" 
 
 
-// TODO remove for production compilation 
-#pragma GCC diagnostic ignored "-Wunused-variable"
-#pragma GCC diagnostic ignored "-Wunused-but-set-variable"
-
-
-// #define TX_DEBUG
-// #define RX_DEBUG
-// #define LATENCY_MEAS                 // activate this if you want to do a UDP latency measurement. 
-                                        // Connect Tx SIG_PIN to Rx ISR_PIN and GND to GND. 
-#define WITH_TEMP
-
 // during development, we use STD with PCM1808 ADC and PCM5102 DAC
 #define I2S_STD
 // #define I2S_TDM
@@ -82,6 +80,29 @@
 #endif
 #define RX_IP_ADDR "192.168.4.1"
 #define PORT 45678
+#define SYNC_PORT (PORT + 1)            // clock offset ping exchange for LATENCY_PROBE
+#define TELEM_PORT (PORT + 2)           // telemetry frames, see telemetry.h
+#define CAPTURE_PORT (PORT + 3)         // packet capture export, see pkt_capture.h
+#define CHAN_PORT (PORT + 4)            // link reports and channel move announcements, see chan_mon.h
+#define TELEM_DEST_ADDR "192.168.4.255" // broadcast on the AP's subnet so that any listening PC gets them
+
+// MULTI_RX: the receivers the sender feeds, the AP first. Each of the others is built with
+// RX_SECONDARY and its own RX_SECONDARY_ADDR, a static address above the AP's DHCP pool.
+#ifdef MULTI_RX
+#define TX_NUM_DESTS 3
+#define TX_DESTS { RX_IP_ADDR, "192.168.4.201", "192.168.4.202" }
+#else
+#define TX_NUM_DESTS 1
+#define TX_DESTS { RX_IP_ADDR }
+#endif
+#define RX_SECONDARY_ADDR "192.168.4.201"
+#define RX_SECONDARY_MASK "255.255.255.0"
+#ifdef RX_SECONDARY
+#define RX_BIND_ADDR RX_SECONDARY_ADDR
+#else
+#define RX_BIND_ADDR RX_IP_ADDR
+#endif
+#define NVS_NAMESPACE "wgk"             // our own keys, the WiFi driver keeps the credentials in its own
 
 #define MAX_RETRY 5
 
@@ -92,62 +113,15 @@ extern EventGroupHandle_t s_wifi_event_group;
 void event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
 
 
-/* ***************************************************************
- * Logging
- * ***************************************************************/
-
-#if (defined RX_DEBUG || defined TX_DEBUG)
-#define NUM 50
-typedef struct { 
-    uint8_t loc;        // location
-    uint32_t time;      // timestamp in µs
-    uint8_t *ptr;       // pointer to buffer
-    uint32_t size;        // data size
-    uint32_t uint32ptr;       // converted pointer to buffer
-} log_t; 
-extern volatile int p;
-extern volatile log_t _log[];
-#endif 
-
 /* ***************************************************************
  * I2S Defines
  * ***************************************************************/
 
 #define I2S_MCLK_MULTIPLE I2S_MCLK_MULTIPLE_256
 #define I2S_DATA_BIT_WIDTH I2S_DATA_BIT_WIDTH_32BIT
-
-/*
- * Definitions for I2S
- * SAMPLE  is a single sample for one channel (32 bit data block containing a 16, 24, or 32 bit ADC sample)
- * FRAME   is a collection of NUM_SLOTS slots (mono samples per channel)
- *         see MSB format in 
- *         https://docs.espressif.com/projects/esp-idf/en/latest/esp32c5/api-reference/peripherals/i2s.html#tdm-mode
- * NFRAMES is the number of frames we want to send in one datagram in order to minimize UDP protocol overhead.
- *         this is intended to fill one UDP payload so that no IP fragmentation takes place.
- *         The default MTU size for WiFi is 1500, resulting in a maximum payload of 1472 byte.
- *         We send NSAMPLES * NUM_SLOTS_UDP * SLOT_SIZE_UDP byte = 1440 byte. 61 frames would work as well. 
- */ 
-#define NFRAMES                 60                      // the number of frames we want to send in a datagram 
-#define NUM_SLOTS_I2S           2                       // number of channels in one sample, 2 for stereo, 8 for 8-channel audio
-#define SLOT_SIZE_I2S           4                       // I2S has slots with 4 byte each. The data type is int. 
-#define NUM_SLOTS_UDP           8                       // we always send 8 slot frames
-#define SLOT_SIZE_UDP           3                       // UDP format has 3-byte samples.
-#define SLOT_BIT_WIDTH          SLOT_SIZE_I2S * 8       // bits per slot
-#define NUM_RX_DMA_BUFS         4                       // Number of DMA buffers in the sender.  RX is here I2S RX
-#define NUM_TX_DMA_BUFS         2                       // the receiver only uses 2. TX is here I2S TX
-
-#define I2S_BUF_SIZE            NFRAMES * NUM_SLOTS_I2S * SLOT_SIZE_I2S  // Size of each I2S or DMA buffer
-
-#define UDP_BUF_SIZE            NFRAMES * NUM_SLOTS_UDP * SLOT_SIZE_UDP
-#define NUM_RINGBUF_ELEMS       256                      // this needs to be a power of 2. 
-// #define UDP_PAYLOAD_SIZE        UDP_BUF_SIZE + 16       // 
-#define RINGBUF_OFFSET          3                       // when do we start to shuffle data to I2S. 
-
-#define NUM_I2S_BUFS            4 
-// #define I2S_CBUF_SIZE           I2S_BUF_SIZE * NUM_I2S_BUFS  // ring buffer size 
-
 #define I2S_NUM                 I2S_NUM_AUTO
-#define SAMPLE_RATE             31250                   // 48000 should work as well, or anything less
+
+// the buffer geometry (NFRAMES, SAMPLE_RATE, ...) is in wgk_core.h
 
 
 /* ***************************************************************
@@ -244,62 +218,10 @@ static i2s_tdm_config_t i2s_tx_cfg = {
     },
 };
 
-/* ***************************************************************
- * buffer stuff 
- * ***************************************************************/
- 
-typedef struct {
-    int slot[NUM_SLOTS_I2S];
-} i2s_frame_t;
-
-typedef struct {
-    i2s_frame_t frame[NFRAMES];
-} i2s_buf_t;     
-
-
-typedef struct {
-    uint8_t slot[NUM_SLOTS_UDP * SLOT_SIZE_UDP];
-} udp_frame_t;
-
-// #define WITH_TIMESTAMP
-
-typedef struct {
-    udp_frame_t frame[NFRAMES];
-    uint32_t checksum;
-    uint32_t sequence_number;
-#ifdef WITH_TIMESTAMP    
-    uint32_t timestamp; 
-#endif    
-#ifdef WITH_TEMP
-    float tx_temp;
-#endif    
-    uint32_t switches;
-} udp_buf_t;
-
-bool ring_buf_init(void);
-size_t ring_buf_size(void); 
-void ring_buf_put(udp_buf_t *udp_buf); 
-uint8_t *ring_buf_get(void);
-
 // TODO: these can be privatized too. 
 extern udp_buf_t *udp_tx_buf, *udp_rx_buf;
 
 
-/* 
- * RX stats
- * 0 maxdiff
- * 1 mindiff
- * 2 num ssn<=rsn
- */
-  
-#define RX_STATS 
-#ifdef RX_STATS 
-#define NUM_STATS 5
-extern int stats[NUM_STATS];  
-#endif
-// #define SSN_STATS
-// #define SSN_TRACE
-
 /* ***************************************************************
  * Function prototypes
  * ***************************************************************/
@@ -316,6 +238,34 @@ bool init_gpio_tx(void);
 void tx_setup (void);
 void latency_meas_task(void *args); 
 void tx_temp_task(void *args); 
+void sync_tx_task(void *args);
+void chan_follow_task(void *args);
+void telemetry_task(void *args);
+void tx_ps_task(void *args);
+#ifdef TX_POWER_SAVE
+extern volatile int tx_ps_current;                      // the schedule, index into tx_ps_sched[]
+extern volatile bool tx_ps_twt_up;                      // the AP agreed to our TWT
+#endif
+
+// CPU_GOV: the pipeline sections hold cpu_gov_lock, so that the clock stays up while they
+// run, and report their cycles to the governor. The I2S callback cannot take a PM lock,
+// the task's lock and the governor's level cover it.
+void cpu_gov_setup(void);
+void cpu_gov_task(void *args);
+#ifdef CPU_GOV
+extern cpu_gov_t cpu_gov;
+extern esp_pm_lock_handle_t cpu_gov_lock;
+#define CPU_GOV_ENTER()         uint32_t cpu_gov_t0 = (esp_pm_lock_acquire(cpu_gov_lock), wgk_cycles())
+#define CPU_GOV_LEAVE()         do { cpu_gov_sample_task(&cpu_gov, wgk_cycles() - cpu_gov_t0); \
+                                     esp_pm_lock_release(cpu_gov_lock); } while (0)
+#define CPU_GOV_ENTER_ISR()     uint32_t cpu_gov_t0 = wgk_cycles()
+#define CPU_GOV_LEAVE_ISR()     cpu_gov_sample_isr(&cpu_gov, wgk_cycles() - cpu_gov_t0)
+#else
+#define CPU_GOV_ENTER()
+#define CPU_GOV_LEAVE()
+#define CPU_GOV_ENTER_ISR()
+#define CPU_GOV_LEAVE_ISR()
+#endif
 
 // Receiver stuff
 extern i2s_chan_handle_t i2s_tx_handle;
@@ -329,11 +279,36 @@ bool init_gpio_rx(void);
 int find_free_channel(void);
 void rx_stats_task(void *args);
 void rx_temp_task(void *args); 
-extern uint32_t time3; 
+void sync_rx_task(void *args);
+void chan_mon_task(void *args);
+void capture_task(void *args);
+void bench_task(void *args);
 
-#ifdef WITH_TEMP
-extern float rx_temp, tx_temp; 
-#endif
+/*
+ * what FAST_BOOT restores, one NVS blob per device. The credentials need nothing extra,
+ * the WiFi driver keeps them in NVS already. The stream format is fixed at compile time,
+ * so a boot state written by a build with a different one is ignored.
+ */
+#define BOOT_STATE_MAGIC        0x57474b42              // "WGKB"
+#define BOOT_STATE_VERSION      1
+#define STREAM_FORMAT           (((uint32_t)SAMPLE_RATE << 14) | (NFRAMES << 6) | (NUM_SLOTS_UDP << 2) | SLOT_SIZE_UDP)
+#define BOOT_SCAN_INTERVAL      1000                    // ms between two channels of the background scan
+#define BOOT_SCAN_PASSIVE       110                     // ms on a DFS channel, where we may only listen for a beacon
+
+typedef struct {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t role;               // 'T' or 'R'
+    uint8_t channel;            // the receiver's AP was on, the sender connected on
+    uint8_t bandwidth;          // wifi_bandwidth_t of the AP, 0 on the sender
+    uint32_t format;            // STREAM_FORMAT
+} boot_state_t;
+
+extern bool fast_boot;
+extern volatile uint32_t first_audio_us;                // µs after boot, 0 until the first packet was sent or played
+bool boot_state_load(char role, boot_state_t *bs);
+void boot_state_save(char role, uint8_t channel, uint8_t bandwidth);
+void boot_scan_task(void *args);
 
 // main stuff
 typedef struct { 
@@ -341,9 +316,9 @@ typedef struct {
     uint32_t size;        // data size
 } dma_params_t; 
 
+void trace_dump(char role);
+void trace_task(void *args);
 
-uint32_t get_time_us_in_isr(void);
-uint32_t calculate_checksum(uint32_t *buffer, size_t size); 
 
 #define NEOPIX_PIN GPIO_NUM_27              // for the DevKit-C
 #ifndef MIN
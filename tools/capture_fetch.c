@@ -0,0 +1,164 @@
+/*
+ * fetches the field packet capture from the receiver, see main/pkt_capture.h
+ *
+ * build the receiver with PKT_CAPTURE, play the gig, and when a dropout was heard connect
+ * the PC to the receiver's WiFi network and run this tool. It freezes the capture, so the
+ * interesting part is not overwritten, pulls all records, asks again for chunks that got
+ * lost, writes the capture file and lets the receiver record again. host/replay.c replays
+ * the file against the ring buffer.
+ *
+ * gcc -O2 -Wall -I../main -o capture_fetch capture_fetch.c
+ * ./capture_fetch [-a receiver_ip] [-P port] [-k] out.wgkc
+ *   -k   keep the capture frozen, e.g. to fetch it again
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "pkt_capture.h"
+
+#define DEFAULT_ADDR            "192.168.4.1"           // RX_IP_ADDR in wireless_gk.h
+#define DEFAULT_PORT            (45678 + 3)             // CAPTURE_PORT in wireless_gk.h
+#define TIMEOUT_MS              300
+#define MAX_ROUNDS              50                      // requests without any progress before we give up
+
+
+static int sock;
+static struct sockaddr_in dest;
+
+
+static void request(capture_op_t op, uint32_t first, uint32_t count) {
+    capture_req_t req = { CAPTURE_MAGIC, op, first, count };
+
+    sendto(sock, &req, sizeof(req), 0, (struct sockaddr *)&dest, sizeof(dest));
+}
+
+
+static int freeze(capture_info_t *info) {
+    int i, len;
+
+    for (i = 0; i < 5; i++) {
+        request(CAP_FREEZE, 0, 0);
+        while ((len = recv(sock, info, sizeof(capture_info_t), 0)) > 0) {
+            if (len == sizeof(capture_info_t) && info->magic == CAPTURE_MAGIC) return 0;
+        }
+    }
+    return -1;
+}
+
+
+// reads chunks until the socket times out. Returns the number of new chunks.
+static uint32_t receive_chunks(capture_rec_t *rec, uint8_t *have, uint32_t count) {
+    static capture_chunk_t chunk;
+    uint32_t got = 0, c;
+    int len;
+
+    while ((len = recv(sock, &chunk, sizeof(chunk), 0)) > 0) {
+        if (len < (int)offsetof(capture_chunk_t, rec) || chunk.magic != CAPTURE_MAGIC) continue;
+        if (chunk.first % CAPTURE_CHUNK_RECS != 0 || chunk.first + chunk.n > count || chunk.n > CAPTURE_CHUNK_RECS ||
+            len != (int)(offsetof(capture_chunk_t, rec) + chunk.n * sizeof(capture_rec_t))) continue;
+        c = chunk.first / CAPTURE_CHUNK_RECS;
+        if (have[c]) continue;
+        memcpy(&rec[chunk.first], chunk.rec, chunk.n * sizeof(capture_rec_t));
+        have[c] = 1;
+        got++;
+    }
+    return got;
+}
+
+
+int main(int argc, char **argv) {
+    const char *addr = DEFAULT_ADDR, *out;
+    int port = DEFAULT_PORT, keep = 0, opt, rounds = 0;
+    struct timeval tv = { 0, TIMEOUT_MS * 1000 };
+    capture_info_t info;
+    capture_rec_t *rec;
+    uint8_t *have;
+    uint32_t chunks, done = 0, c, n;
+    FILE *f;
+
+    while ((opt = getopt(argc, argv, "a:P:kh")) != -1) {
+        switch (opt) {
+            case 'a': addr = optarg; break;
+            case 'P': port = atoi(optarg); break;
+            case 'k': keep = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-a receiver_ip] [-P port] [-k] out.wgkc\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-a receiver_ip] [-P port] [-k] out.wgkc\n", argv[0]);
+        return 2;
+    }
+    out = argv[optind];
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return 1;
+    }
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(port);
+    dest.sin_addr.s_addr = inet_addr(addr);
+
+    if (freeze(&info) < 0) {
+        fprintf(stderr, "no answer from %s:%d, is PKT_CAPTURE enabled?\n", addr, port);
+        return 1;
+    }
+    if (info.version != CAPTURE_VERSION || info.rec_size != sizeof(capture_rec_t)) {
+        fprintf(stderr, "capture version %u, record size %u not supported\n", info.version, info.rec_size);
+        return 1;
+    }
+    printf("%u records (%.1f s), %u overwritten, RINGBUF_OFFSET %u, packet time %u µs\n",
+           info.count, info.count * info.packet_time_us / 1e6, info.overwritten,
+           info.ringbuf_offset, info.packet_time_us);
+
+    chunks = (info.count + CAPTURE_CHUNK_RECS - 1) / CAPTURE_CHUNK_RECS;
+    rec = calloc(info.count + 1, sizeof(capture_rec_t));
+    have = calloc(chunks + 1, 1);
+    if (rec == NULL || have == NULL) {
+        perror("calloc");
+        return 1;
+    }
+
+    // ask for the first missing run of chunks, at most CAPTURE_READ_MAX at a time
+    while (done < chunks && rounds < MAX_ROUNDS) {
+        for (c = 0; have[c]; c++);
+        for (n = 0; c + n < chunks && !have[c + n] && n < CAPTURE_READ_MAX; n++);
+        request(CAP_READ, c * CAPTURE_CHUNK_RECS, n * CAPTURE_CHUNK_RECS);
+        n = receive_chunks(rec, have, info.count);
+        done += n;
+        rounds = n ? 0 : rounds + 1;
+        fprintf(stderr, "\r%u of %u chunks", done, chunks);
+    }
+    fprintf(stderr, "\n");
+    if (done < chunks) {
+        fprintf(stderr, "gave up with %u chunks missing\n", chunks - done);
+        return 1;
+    }
+
+    f = fopen(out, "wb");
+    if (f == NULL) {
+        perror(out);
+        return 1;
+    }
+    if (fwrite(&info, sizeof(info), 1, f) != 1 || fwrite(rec, sizeof(capture_rec_t), info.count, f) != info.count) {
+        perror(out);
+        return 1;
+    }
+    fclose(f);
+    printf("wrote %s\n", out);
+
+    if (!keep) request(CAP_RESUME, 0, 0);
+    return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * recommends a RINGBUF_OFFSET from the ring lead and inter-arrival histograms the
+ * receiver broadcasts every TELEM_HIST_INTERVAL telemetry frames (see telemetry.h)
+ *
+ * at each put the receiver records the lead ssn - rsn, i.e. how many packets ahead of
+ * the player the packet arrived, or for how many packets it was too late. Replay starts
+ * with a lead of RINGBUF_OFFSET, so lead - RINGBUF_OFFSET is the arrival deviation in
+ * packets, and with an offset O a packet is missed when lead - RINGBUF_OFFSET + O < 0.
+ * The tool picks the smallest O that keeps the predicted miss rate below the target.
+ * Lead buckets are exact up to 15 packets; beyond that the pessimistic bucket edge is used.
+ *
+ * gcc -O2 -Wall -I../main -o jitter_tune jitter_tune.c ../main/telemetry.c
+ * ./jitter_tune [-P port] [-n snapshots] [-d dropout_rate] [-v]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "telemetry.h"
+
+#define DEFAULT_PORT            (45678 + 2)             // TELEM_PORT in wireless_gk.h
+#define MAX_OFFSET              64                      // well below NUM_RINGBUF_ELEMS / 2
+
+static uint64_t hist[TH_NUM_HISTS][LOG_HIST_BINS];
+static uint32_t snapshots[TH_NUM_HISTS];
+
+
+static uint64_t hist_total(int h) {
+    uint64_t n = 0;
+    int b;
+
+    for (b = 0; b < LOG_HIST_BINS; b++) n += hist[h][b];
+    return n;
+}
+
+
+static void print_hist(int h) {
+    uint64_t n = hist_total(h), sum = 0;
+    int b;
+
+    printf("%s, %llu samples\n", telem_hist_name[h], (unsigned long long)n);
+    for (b = 0; b < LOG_HIST_BINS; b++) {
+        if (hist[h][b] == 0) continue;
+        sum += hist[h][b];
+        if (b == LOG_HIST_BINS - 1) {
+            printf("  %6u ..         %10llu  %8.4f%%\n", log_hist_lower(b),
+                   (unsigned long long)hist[h][b], 100.0 * sum / n);
+        } else {
+            printf("  %6u .. %6u  %10llu  %8.4f%%\n", log_hist_lower(b), log_hist_upper(b),
+                   (unsigned long long)hist[h][b], 100.0 * sum / n);
+        }
+    }
+}
+
+
+// packets that would have been missed with offset o
+static uint64_t misses(int ringbuf_offset, int o) {
+    uint64_t m = 0;
+    int b;
+
+    for (b = 0; b < LOG_HIST_BINS; b++) {
+        // the lowest lead in the bucket, and the largest lateness
+        int64_t lead = log_hist_lower(b);
+        int64_t late = (b == LOG_HIST_BINS - 1) ? log_hist_lower(b) : log_hist_upper(b);
+        if (lead - ringbuf_offset + o < 0) m += hist[TH_RING_LEAD][b];
+        if (-late - ringbuf_offset + o < 0) m += hist[TH_RING_LATE][b];
+    }
+    return m;
+}
+
+
+// smallest inter-arrival gap that is exceeded with at most the given rate
+static uint32_t interarrival_quantile(double rate) {
+    uint64_t n = hist_total(TH_INTERARRIVAL), above = n;
+    int b;
+
+    for (b = 0; b < LOG_HIST_BINS; b++) {
+        above -= hist[TH_INTERARRIVAL][b];
+        if (above <= rate * n) return log_hist_upper(b);
+    }
+    return UINT32_MAX;
+}
+
+
+int main(int argc, char **argv) {
+    int port = DEFAULT_PORT, opt, sock, one = 1, verbose = 0, o, rec = -1, ia_offset;
+    int ringbuf_offset = 0, packet_time_us = 0;
+    long wanted = 6;
+    double target = 1e-4;
+    uint64_t n;
+    uint32_t gap;
+    struct sockaddr_in addr;
+    telem_hist_frame_t f;
+
+    while ((opt = getopt(argc, argv, "P:n:d:vh")) != -1) {
+        switch (opt) {
+            case 'P': port = atoi(optarg); break;
+            case 'n': wanted = atol(optarg); break;
+            case 'd': target = atof(optarg); break;
+            case 'v': verbose = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-P port] [-n snapshots] [-d dropout_rate] [-v]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) { perror("socket"); return 1; }
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));      // may run next to telemetry_collect
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) { perror("bind"); return 1; }
+    fprintf(stderr, "waiting for %ld histogram snapshots on port %d\n", wanted, port);
+
+    while (snapshots[TH_INTERARRIVAL] < wanted || snapshots[TH_RING_LEAD] < wanted || snapshots[TH_RING_LATE] < wanted) {
+        ssize_t len = recv(sock, &f, sizeof(f), 0);
+        if (len < 0) { perror("recv"); return 1; }
+        if (len != sizeof(f) || f.magic != TELEM_HIST_MAGIC || f.version != TELEM_VERSION) continue;
+        if (f.role != 'R' || f.hist >= TH_NUM_HISTS || f.num_bins != LOG_HIST_BINS) continue;
+        for (int b = 0; b < LOG_HIST_BINS; b++) hist[f.hist][b] += f.bin[b];
+        snapshots[f.hist]++;
+        ringbuf_offset = f.ringbuf_offset;
+        packet_time_us = f.packet_time_us;
+    }
+
+    if (verbose) {
+        for (int h = 0; h < TH_TX_SEND_0; h++) print_hist(h);
+    }
+
+    n = hist_total(TH_RING_LEAD) + hist_total(TH_RING_LATE);
+    if (n == 0) {
+        printf("no packets were received while the receiver was running\n");
+        return 1;
+    }
+    printf("%llu packets, measured with RINGBUF_OFFSET %d, packet time %d µs, target dropout rate %g\n",
+           (unsigned long long)n, ringbuf_offset, packet_time_us, target);
+    printf("offset  predicted dropouts   added latency\n");
+    for (o = 0; o <= MAX_OFFSET; o++) {
+        uint64_t m = misses(ringbuf_offset, o);
+        if (rec < 0 && m <= target * n) rec = o;
+        if (o <= ringbuf_offset + 8 || o == rec) {
+            printf("%6d  %10llu %8.2e  %6.2f ms%s\n", o, (unsigned long long)m, (double)m / n,
+                   o * packet_time_us / 1000.0, o == rec ? "  <--" : "");
+        }
+        if (rec >= 0 && o > ringbuf_offset + 8) break;
+    }
+
+    // cross check: a single gap of g µs after an on-time packet needs (g - T) / T packets of slack
+    gap = interarrival_quantile(target);
+    if (gap == UINT32_MAX || packet_time_us == 0) {
+        ia_offset = -1;
+    } else {
+        ia_offset = gap > (uint32_t)packet_time_us ? (gap - 1) / packet_time_us : 0;
+    }
+    if (ia_offset >= 0) {
+        printf("inter-arrival gaps exceed %u µs at the target rate, which alone needs an offset of %d\n", gap, ia_offset);
+    } else {
+        printf("inter-arrival gaps exceed the histogram range at the target rate\n");
+    }
+
+    if (rec < 0) {
+        printf("no offset up to %d meets the target, the link is too lossy\n", MAX_OFFSET);
+        return 1;
+    }
+    printf("recommended: #define RINGBUF_OFFSET %d\n", rec < 1 ? 1 : rec);
+    return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * host stand-in for both ends of the in-band latency probe (LATENCY_PROBE)
+ *
+ * simulates a sender and a receiver clock with a configurable offset and drift,
+ * and a link with asymmetric, jittery one-way delays and occasional queueing spikes.
+ * The receiver pings the sender every SYNC_INTERVAL ms exactly like sync_rx_task()
+ * and sync_tx_task() do, and feeds the real estimator from main/latency_probe.c.
+ * Meanwhile audio packets are stamped with the sender clock and "played" on the
+ * receiver, and the capture-to-DAC latency computed like ring_buf_get() does it
+ * is compared against the true latency.
+ *
+ * gcc -O2 -Wall -I../main -o latency_sim latency_sim.c ../main/latency_probe.c -lm
+ * ./latency_sim                 run the built-in scenarios
+ * ./latency_sim -o 123456789 -d 40 -j 800 -s 0.05 -a 300 -t 120
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "latency_probe.h"
+
+// must match wireless_gk.h
+#define SAMPLE_RATE             31250
+#define NFRAMES                 60
+#define PACKET_TIME_US          (NFRAMES * 1000000 / SAMPLE_RATE)
+#define NUM_TX_DMA_BUFS         2
+#define RINGBUF_OFFSET          3
+
+typedef struct {
+    const char *name;
+    double offset_us;           // sender clock minus receiver clock at t = 0
+    double drift_ppm;           // sender clock rate error
+    double base_us;             // minimum one-way delay
+    double jitter_us;           // mean of the exponential delay jitter
+    double spike_prob;          // probability of a queueing spike per packet
+    double spike_us;            // maximum spike length
+    double asym_us;             // extra delay on the sender -> receiver direction
+    double duration_s;
+    double max_err_us;          // pass/fail criterion for the latency error
+} scenario_t;
+
+// an asymmetric link biases any NTP style estimate by half the asymmetry, so the 
+// asymmetric scenario allows for that, and a congested venue is expected to be worse. 
+static scenario_t scenarios[] = {
+    { "ideal link",              1000000.0,   0.0, 300.0,    0.0, 0.0,      0.0,   0.0,  30.0,    2.0 },
+    { "jitter",                  -5.0e6,     10.0, 300.0,  400.0, 0.0,      0.0,   0.0,  60.0,  150.0 },
+    { "jitter + spikes",          3.0e9,    -20.0, 300.0,  400.0, 0.05,  8000.0,   0.0,  60.0,  250.0 },
+    { "asymmetric link",          7.7e6,     20.0, 300.0,  200.0, 0.01,  4000.0, 150.0,  60.0,  200.0 },
+    { "congested venue",         -2.0e9,     40.0, 500.0, 1500.0, 0.15, 15000.0,   0.0, 120.0, 1000.0 },
+};
+#define NUM_SCENARIOS (sizeof(scenarios)/sizeof(scenario_t))
+
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+static double uniform(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (double)(rng_state >> 11) / (double)(1ULL << 53);
+}
+
+
+static double one_way_delay(const scenario_t *sc, int to_receiver) {
+    double d = sc->base_us - sc->jitter_us * log(1.0 - uniform());
+    if (uniform() < sc->spike_prob) d += sc->spike_us * uniform();
+    if (to_receiver) d += sc->asym_us;
+    return d;
+}
+
+
+// both clocks are 32 bit µs counters like get_time_us_in_isr()
+static uint32_t rx_clock(double t) {
+    return (uint32_t)(uint64_t)llround(t);
+}
+
+
+static uint32_t tx_clock(const scenario_t *sc, double t) {
+    return (uint32_t)(int64_t)llround(sc->offset_us + t * (1.0 + sc->drift_ppm * 1e-6));
+}
+
+
+static int run(const scenario_t *sc) {
+    clock_sync_t cs;
+    lat_hist_t est, truth;
+    double t_ping = 0.0, t_pkt = PACKET_TIME_US, end = sc->duration_s * 1e6;
+    double sum_err2 = 0.0, max_err = 0.0;
+    uint32_t n_err = 0;
+
+    clock_sync_init(&cs);
+    lat_hist_reset(&est);
+    lat_hist_reset(&truth);
+
+    while (t_ping < end || t_pkt < end) {
+        if (t_ping <= t_pkt) {
+            // receiver pings, sender answers after a short processing time
+            double t2 = t_ping + one_way_delay(sc, 0);
+            double t3 = t2 + 5.0 + 45.0 * uniform();
+            double t4 = t3 + one_way_delay(sc, 1);
+            clock_sync_sample(&cs, rx_clock(t_ping), tx_clock(sc, t2), tx_clock(sc, t3), rx_clock(t4));
+            t_ping += SYNC_INTERVAL * 1000.0;
+        } else {
+            // an audio packet captured at t_pkt arrives after the one-way delay and is played
+            // RINGBUF_OFFSET packets later, on the next I2S tick of the receiver
+            double arrival = t_pkt + one_way_delay(sc, 1);
+            double t_get = ceil((arrival + RINGBUF_OFFSET * PACKET_TIME_US) / PACKET_TIME_US) * PACKET_TIME_US;
+            if (clock_sync_valid(&cs)) {
+                uint32_t stamp = tx_clock(sc, t_pkt);
+                int32_t l_est = (int32_t)(rx_clock(t_get) + (NUM_TX_DMA_BUFS - 1) * PACKET_TIME_US
+                                          - clock_sync_to_local(&cs, stamp) + PACKET_TIME_US);
+                int32_t l_true = (int32_t)llround(t_get + (NUM_TX_DMA_BUFS - 1) * PACKET_TIME_US
+                                                  - t_pkt + PACKET_TIME_US);
+                double err = fabs((double)(l_est - l_true));
+                lat_hist_add(&est, l_est);
+                lat_hist_add(&truth, l_true);
+                sum_err2 += err * err;
+                if (err > max_err) max_err = err;
+                n_err++;
+            }
+            t_pkt += PACKET_TIME_US;
+        }
+    }
+
+    printf("%-20s offset %12.0f drift %5.1f ppm  err rms %6.1f max %6.1f µs  "
+           "p50 %5u/%5u p99 %5u/%5u  %s\n",
+           sc->name, sc->offset_us, sc->drift_ppm,
+           n_err ? sqrt(sum_err2 / n_err) : 0.0, max_err,
+           lat_hist_percentile(&est, 500), lat_hist_percentile(&truth, 500),
+           lat_hist_percentile(&est, 990), lat_hist_percentile(&truth, 990),
+           max_err <= sc->max_err_us ? "PASS" : "FAIL");
+    return max_err <= sc->max_err_us ? 0 : 1;
+}
+
+
+int main(int argc, char **argv) {
+    scenario_t custom = { "custom", 0.0, 0.0, 300.0, 200.0, 0.0, 0.0, 0.0, 60.0, 200.0 };
+    int opt, use_custom = 0, failed = 0;
+    size_t i;
+
+    while ((opt = getopt(argc, argv, "o:d:b:j:s:m:a:t:e:r:h")) != -1) {
+        use_custom |= (opt != 'r');
+        switch (opt) {
+            case 'o': custom.offset_us = atof(optarg); break;
+            case 'd': custom.drift_ppm = atof(optarg); break;
+            case 'b': custom.base_us = atof(optarg); break;
+            case 'j': custom.jitter_us = atof(optarg); break;
+            case 's': custom.spike_prob = atof(optarg); break;
+            case 'm': custom.spike_us = atof(optarg); break;
+            case 'a': custom.asym_us = atof(optarg); break;
+            case 't': custom.duration_s = atof(optarg); break;
+            case 'e': custom.max_err_us = atof(optarg); break;
+            case 'r': rng_state = strtoull(optarg, NULL, 0) | 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-o offset_us] [-d drift_ppm] [-b base_us] [-j jitter_us]\n"
+                                "       [-s spike_prob] [-m spike_us] [-a asym_us] [-t seconds] [-e max_err_us] [-r seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    printf("latency percentiles are estimated/true in µs\n");
+    if (use_custom) {
+        failed = run(&custom);
+    } else {
+        for (i = 0; i < NUM_SCENARIOS; i++) {
+            failed += run(&scenarios[i]);
+        }
+    }
+    return failed ? 1 : 0;
+}
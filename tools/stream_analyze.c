@@ -0,0 +1,625 @@
+/*
+ * analyzer for raw stream captures, replaces frame_parser.py, player.py and resample.c
+ *
+ * the input is a tools/udp_capture.c file (stream_file.h, recognized by its magic), what
+ * udpserver.py or netcat write, the datagrams back to back as udp_buf_t records, or a raw
+ * file of 24 byte frames (-F). udp_capture.c files can hold several streams, -S selects
+ * one, and their receive timestamps give an inter-arrival histogram. The file is memory mapped and
+ * split into one piece per thread at record boundaries, and each thread decodes its piece:
+ * sequence numbers, checksums, temperature and switches, and in frame mode the test counter
+ * frame_parser.py looked for (slot 1 = ff 00 00, slot 0 = 24 bit big endian counter). The
+ * pieces are stitched together afterwards, so a gap across a boundary is found as well.
+ * Channels can be extracted to WAV or raw S24_3LE, every thread writes its own part of the
+ * output file with pwrite().
+ *
+ * gcc -O2 -Wall -pthread -I../main -o stream_analyze stream_analyze.c ../main/wgk_core.c
+ * ./stream_analyze [-F] [-r record_size] [-T] [-S stream] [-c 0,1] [-o out.wav] [-s rate] [-j threads] [-k] [-v] capture
+ *   -F   raw 24 byte frames instead of udp_buf_t records
+ *   -S   stream of a udp_capture.c file, default 0
+ *   -r   record size if the capture was made with other flags than this build, see layout()
+ *   -T   a 4 byte extra field in the record is the LATENCY_PROBE timestamp, not tx_temp
+ *   -c   channels to extract, default 0,1
+ *   -o   output file, WAV if the name ends in .wav, raw otherwise
+ *   -k   check the test counter (frame mode)
+ *   -v   list every event, not just the first MAX_EVENTS
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "wgk_core.h"
+#include "stream_file.h"
+
+#define FRAME_SIZE              (NUM_SLOTS_UDP * SLOT_SIZE_UDP)     // 24 byte
+#define BASE_SIZE               (UDP_BUF_SIZE + 8)                  // samples, checksum, sequence_number and session
+#define MAX_THREADS             64
+#define MAX_EVENTS              50                                  // printed without -v
+#define OUT_BUF_SIZE            (1 << 20)
+#define IA_BIN_US               100                                 // inter-arrival histogram
+#define IA_BINS                 1000
+
+typedef enum {
+    EV_GAP = 0,                 // sequence number jumped forward, a = expected, b = got
+    EV_BACK,                    // sequence number went back or repeated
+    EV_CHECKSUM,                // a = received, b = computed
+    EV_SWITCHES,                // a = old, b = new
+    EV_COUNTER,                 // test counter discontinuity, a = expected, b = got
+} event_type_t;
+
+static const char *event_name[] = { "gap", "back", "checksum", "switches", "counter" };
+
+typedef struct {
+    uint64_t rec;               // record (or frame) number
+    uint8_t type;
+    uint32_t a, b;
+} event_t;
+
+// where the fields are in a record, see udp_buf_t
+typedef struct {
+    size_t size;
+    int timestamp;              // offsets, -1 if absent
+    int temp;
+    int switches;
+} layout_t;
+
+typedef struct {
+    // input
+    uint64_t first, n;          // records (frames in frame mode)
+    uint64_t out_first;         // selected records before this piece, for the output offset
+    // results
+    uint64_t n_sel, first_sel;  // records of the selected stream, and the first one
+    uint64_t bad_len;
+    bool have_t;
+    uint64_t first_t, last_t;   // receive timestamps, ns
+    uint32_t ia_hist[IA_BINS];
+    bool have_seq;
+    uint32_t first_seq, last_seq;
+    uint32_t first_counter, last_counter;
+    bool have_counter;
+    bool have_switches;
+    uint32_t first_switches, last_switches;
+    uint64_t lost, back, checksum_errors, counter_errors;
+    float temp_min, temp_max;
+    double temp_sum;
+    uint64_t temp_n;
+    event_t *ev;
+    uint32_t num_ev, size_ev;
+} piece_t;
+
+static const uint8_t *data;
+static size_t data_off, stride;                 // where the records start, and their distance
+static bool stream_file;                        // records have a stream_rec_hdr_t
+static int sel_stream;
+static layout_t lay;
+static bool frame_mode, check_counter;
+static int channels[NUM_SLOTS_UDP], num_channels;
+static int out_fd = -1;
+static size_t out_header;
+
+
+// the optional fields sit between session and switches, in the order of udp_buf_t
+static int layout(size_t size, bool timestamp_only) {
+    lay.size = size;
+    lay.timestamp = lay.temp = -1;
+    lay.switches = size - 4;
+    switch (size - BASE_SIZE) {
+        case 4:     // switches only
+            break;
+        case 8:
+            if (timestamp_only) lay.timestamp = BASE_SIZE;
+            else lay.temp = BASE_SIZE;
+            break;
+        case 12:
+            lay.timestamp = BASE_SIZE;
+            lay.temp = BASE_SIZE + 4;
+            break;
+        default:
+            fprintf(stderr, "record size %zu does not match any udp_buf_t layout\n", size);
+            return -1;
+    }
+    return 0;
+}
+
+
+static void add_event(piece_t *p, uint64_t rec, event_type_t type, uint32_t a, uint32_t b) {
+    if (p->num_ev == p->size_ev) {
+        p->size_ev = p->size_ev ? 2 * p->size_ev : 256;
+        p->ev = realloc(p->ev, p->size_ev * sizeof(event_t));
+        if (p->ev == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    p->ev[p->num_ev++] = (event_t){ rec, type, a, b };
+}
+
+
+static uint32_t get32(const uint8_t *p) {
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+static uint16_t get16(const uint8_t *p) {
+    uint16_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+// copies the selected channels of nframes frames to out
+static size_t extract(uint8_t *out, const uint8_t *frames, uint32_t nframes) {
+    uint8_t *o = out;
+    uint32_t i;
+    int c;
+
+    for (i = 0; i < nframes; i++) {
+        for (c = 0; c < num_channels; c++) {
+            memcpy(o, frames + i * FRAME_SIZE + channels[c] * SLOT_SIZE_UDP, SLOT_SIZE_UDP);
+            o += SLOT_SIZE_UDP;
+        }
+    }
+    return o - out;
+}
+
+
+static void flush_out(uint8_t *buf, size_t *len, off_t *off) {
+    if (*len == 0) return;
+    if (pwrite(out_fd, buf, *len, *off) != (ssize_t)*len) {
+        perror("pwrite");
+        exit(1);
+    }
+    *off += *len;
+    *len = 0;
+}
+
+
+static void check_frame_counter(piece_t *p, uint64_t frame, const uint8_t *f) {
+    uint32_t counter;
+
+    if (f[3] != 0xff || f[4] != 0x00 || f[5] != 0x00) return;
+    counter = (f[0] << 16) | (f[1] << 8) | f[2];
+    if (!p->have_counter) {
+        p->first_counter = counter;
+        p->have_counter = true;
+    } else if (counter != ((p->last_counter + 1) & 0xffffff)) {
+        p->counter_errors++;
+        add_event(p, frame, EV_COUNTER, (p->last_counter + 1) & 0xffffff, counter);
+    }
+    p->last_counter = counter;
+}
+
+
+// the first pass for udp_capture.c files, see main()
+static void *count_selected(void *arg) {
+    piece_t *p = (piece_t *)arg;
+    uint64_t r;
+
+    for (r = p->first; r < p->first + p->n; r++) {
+        const stream_rec_hdr_t *h = (const stream_rec_hdr_t *)(data + data_off + r * stride);
+        if (h->stream == sel_stream && h->len == lay.size) p->n_sel++;
+    }
+    return NULL;
+}
+
+
+static void *worker(void *arg) {
+    piece_t *p = (piece_t *)arg;
+    size_t frames_per_rec = frame_mode ? 1 : NFRAMES;
+    size_t out_per_rec = frames_per_rec * num_channels * SLOT_SIZE_UDP;
+    uint8_t *out = NULL;
+    size_t out_len = 0;
+    off_t out_off = out_header + p->out_first * out_per_rec;
+    uint64_t r, ia;
+    uint32_t seq, sum, sw;
+    float temp;
+
+    if (out_fd >= 0) out = malloc(OUT_BUF_SIZE + out_per_rec);
+    p->temp_min = 1e9f;
+    p->temp_max = -1e9f;
+
+    for (r = p->first; r < p->first + p->n; r++) {
+        const uint8_t *rec = data + data_off + r * stride;
+
+        if (stream_file) {
+            const stream_rec_hdr_t *h = (const stream_rec_hdr_t *)rec;
+            if (h->stream != sel_stream) continue;
+            if (p->have_t) {
+                ia = (h->t_ns - p->last_t) / 1000 / IA_BIN_US;
+                p->ia_hist[ia < IA_BINS ? ia : IA_BINS - 1]++;
+            } else {
+                p->first_t = h->t_ns;
+                p->have_t = true;
+            }
+            p->last_t = h->t_ns;
+            if (h->len != lay.size) {
+                p->bad_len++;
+                continue;
+            }
+            rec += sizeof(stream_rec_hdr_t);
+        }
+        if (p->n_sel++ == 0) p->first_sel = r;
+
+        if (out != NULL) {
+            out_len += extract(out + out_len, rec, frames_per_rec);
+            if (out_len >= OUT_BUF_SIZE) flush_out(out, &out_len, &out_off);
+        }
+        if (frame_mode) {
+            if (check_counter) check_frame_counter(p, r, rec);
+            continue;
+        }
+
+        // 16 bits on the wire, unwrapped against the previous record. A piece starts at the
+        // raw value, the stitching moves it next to the one before
+        seq = get16(rec + UDP_BUF_SIZE + 4);
+        if (!p->have_seq) {
+            p->first_seq = seq;
+            p->have_seq = true;
+        } else if ((seq = seq_unwrap(p->last_seq, seq)) == p->last_seq + 1) {
+            // the normal case
+        } else if (seq_gt(seq, p->last_seq)) {
+            p->lost += seq - p->last_seq - 1;
+            add_event(p, r, EV_GAP, p->last_seq + 1, seq);
+        } else {
+            p->back++;
+            add_event(p, r, EV_BACK, p->last_seq + 1, seq);
+        }
+        p->last_seq = seq;
+
+        sum = calculate_checksum((uint32_t *)rec, UDP_BUF_SIZE / 4);
+        if (sum != get32(rec + UDP_BUF_SIZE)) {
+            p->checksum_errors++;
+            add_event(p, r, EV_CHECKSUM, get32(rec + UDP_BUF_SIZE), sum);
+        }
+
+        if (lay.temp >= 0) {
+            memcpy(&temp, rec + lay.temp, sizeof(temp));
+            if (temp < p->temp_min) p->temp_min = temp;
+            if (temp > p->temp_max) p->temp_max = temp;
+            p->temp_sum += temp;
+            p->temp_n++;
+        }
+
+        sw = get32(rec + lay.switches);
+        if (!p->have_switches) p->first_switches = sw;
+        else if (sw != p->last_switches) add_event(p, r, EV_SWITCHES, p->last_switches, sw);
+        p->have_switches = true;
+        p->last_switches = sw;
+    }
+    if (out != NULL) {
+        flush_out(out, &out_len, &out_off);
+        free(out);
+    }
+    return NULL;
+}
+
+
+static void put16(uint8_t *p, uint16_t v) { memcpy(p, &v, 2); }
+static void put32(uint8_t *p, uint32_t v) { memcpy(p, &v, 4); }
+
+// 24 bit PCM, little endian like the samples in udp_buf_t
+static void write_wav_header(uint64_t data_bytes, uint32_t rate) {
+    uint8_t h[44];
+    uint32_t block = num_channels * SLOT_SIZE_UDP;
+
+    if (data_bytes > UINT32_MAX - 36) {
+        fprintf(stderr, "warning: more than 4 GB of audio, the WAV header sizes are clipped\n");
+        data_bytes = UINT32_MAX - 36;
+    }
+    memcpy(h, "RIFF", 4);
+    put32(h + 4, (uint32_t)(36 + data_bytes));
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put32(h + 16, 16);
+    put16(h + 20, 1);                           // PCM
+    put16(h + 22, num_channels);
+    put32(h + 24, rate);
+    put32(h + 28, rate * block);
+    put16(h + 32, block);
+    put16(h + 34, SLOT_SIZE_UDP * 8);
+    memcpy(h + 36, "data", 4);
+    put32(h + 40, (uint32_t)data_bytes);
+    if (pwrite(out_fd, h, sizeof(h), 0) != sizeof(h)) perror("pwrite");
+}
+
+
+static int parse_channels(const char *s) {
+    char *end;
+    long c;
+
+    num_channels = 0;
+    while (*s) {
+        c = strtol(s, &end, 10);
+        if (end == s || c < 0 || c >= NUM_SLOTS_UDP || num_channels == NUM_SLOTS_UDP) return -1;
+        channels[num_channels++] = (int)c;
+        s = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != 0) return -1;
+    }
+    return num_channels > 0 ? 0 : -1;
+}
+
+
+static void print_event(const event_t *e) {
+    printf("  %10llu  %-8s  ", (unsigned long long)e->rec, event_name[e->type]);
+    switch (e->type) {
+        case EV_GAP:      printf("expected %u got %u, %u lost\n", e->a, e->b, e->b - e->a); break;
+        case EV_CHECKSUM: printf("received %08x computed %08x\n", e->a, e->b); break;
+        case EV_SWITCHES: printf("%08x -> %08x\n", e->a, e->b); break;
+        default:          printf("expected %u got %u\n", e->a, e->b); break;
+    }
+}
+
+
+// percentiles of the receive time differences, from the 100 µs bins
+static void print_interarrival(const piece_t *p) {
+    static const uint32_t permille[] = { 500, 990, 999 };
+    uint64_t n = 0, sum;
+    uint32_t b, k, max = 0, late = 0;
+
+    for (b = 0; b < IA_BINS; b++) {
+        n += p->ia_hist[b];
+        if (p->ia_hist[b]) max = b;
+        if (b * IA_BIN_US >= 2 * PACKET_TIME_US) late += p->ia_hist[b];
+    }
+    if (n == 0) return;
+    printf("inter-arrival");
+    for (k = 0; k < sizeof(permille) / sizeof(permille[0]); k++) {
+        for (sum = 0, b = 0; b < IA_BINS && sum * 1000 < n * permille[k]; b++) sum += p->ia_hist[b];
+        printf(" p%g %.1f", permille[k] / 10.0, b * IA_BIN_US / 1000.0);
+    }
+    printf(" max %s%.1f ms, %u over 2 packet times, over %.1f s\n", max == IA_BINS - 1 ? ">" : "",
+           (max + 1) * IA_BIN_US / 1000.0, late, (p->last_t - p->first_t) / 1e9);
+}
+
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-F] [-r record_size] [-T] [-S stream] [-c 0,1] [-o out.wav] [-s rate] [-j threads] [-k] [-v] capture\n", name);
+}
+
+
+int main(int argc, char **argv) {
+    piece_t piece[MAX_THREADS], total;
+    pthread_t tid[MAX_THREADS];
+    size_t rec_size = sizeof(udp_buf_t);
+    const char *out_name = NULL;
+    bool timestamp_only = false, verbose = false;
+    int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN), opt, fd, t;
+    uint32_t rate = SAMPLE_RATE, i;
+    uint64_t nrec, nsel, per, audio_bytes;
+    struct timespec t0, t1;
+    struct stat st;
+    double secs;
+
+    parse_channels("0,1");
+    while ((opt = getopt(argc, argv, "Fr:TS:c:o:s:j:kvh")) != -1) {
+        switch (opt) {
+            case 'F': frame_mode = true; break;
+            case 'r': rec_size = strtoul(optarg, NULL, 0); break;
+            case 'T': timestamp_only = true; break;
+            case 'c':
+                if (parse_channels(optarg) < 0) {
+                    fprintf(stderr, "bad channel list %s, channels are 0 .. %d\n", optarg, NUM_SLOTS_UDP - 1);
+                    return 2;
+                }
+                break;
+            case 'o': out_name = optarg; break;
+            case 's': rate = strtoul(optarg, NULL, 0); break;
+            case 'j': nthreads = atoi(optarg); break;
+            case 'S': sel_stream = atoi(optarg); break;
+            case 'k': check_counter = true; break;
+            case 'v': verbose = true; break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+    fd = open(argv[optind], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+
+    // a udp_capture.c file tells the record size, the datagram layout is still up to us
+    if (!frame_mode && st.st_size >= (off_t)sizeof(stream_file_hdr_t) && get32(data) == STREAM_MAGIC) {
+        const stream_file_hdr_t *h = (const stream_file_hdr_t *)data;
+        if (h->version != STREAM_VERSION) {
+            fprintf(stderr, "%s: stream file version %u not supported\n", argv[optind], h->version);
+            return 1;
+        }
+        stream_file = true;
+        data_off = h->hdr_size;
+        stride = h->rec_size;
+        if (sel_stream >= (int)h->num_streams) {
+            fprintf(stderr, "%s: no stream %d, the file has %u\n", argv[optind], sel_stream, h->num_streams);
+            return 1;
+        }
+        for (i = 0; i < h->num_streams; i++) {
+            struct in_addr a = { h->stream[i].addr };
+            printf("%sstream %u: %s:%u -> port %u, %llu packets\n", (int)i == sel_stream ? "* " : "  ", i,
+                   inet_ntoa(a), h->stream[i].port, h->stream[i].local_port, (unsigned long long)h->stream[i].packets);
+        }
+        if (h->kernel_drops) printf("the capture lost %llu datagrams in the socket buffers\n", (unsigned long long)h->kernel_drops);
+    }
+    if (frame_mode) lay.size = FRAME_SIZE;
+    else if (layout(rec_size, timestamp_only) < 0) return 1;
+    if (!stream_file) stride = lay.size;
+
+    nrec = (st.st_size - data_off) / stride;
+    if (nrec == 0) {
+        fprintf(stderr, "%s: less than one record\n", argv[optind]);
+        return 1;
+    }
+    if ((st.st_size - data_off) % stride) {
+        fprintf(stderr, "warning: %llu trailing bytes ignored, wrong record size?\n",
+                (unsigned long long)((st.st_size - data_off) % stride));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if ((uint64_t)nthreads > nrec) nthreads = (int)nrec;
+    per = nrec / nthreads;
+    for (t = 0; t < nthreads; t++) {
+        memset(&piece[t], 0, sizeof(piece_t));
+        piece[t].first = t * per;
+        piece[t].n = (t == nthreads - 1) ? nrec - t * per : per;
+    }
+
+    // where each piece's audio goes. With several streams in the file that takes a pass over the headers.
+    nsel = nrec;
+    if (stream_file) {
+        for (t = 0; t < nthreads; t++) pthread_create(&tid[t], NULL, count_selected, &piece[t]);
+        for (t = 0; t < nthreads; t++) pthread_join(tid[t], NULL);
+        for (nsel = 0, t = 0; t < nthreads; t++) {
+            piece[t].out_first = nsel;
+            nsel += piece[t].n_sel;
+            piece[t].n_sel = 0;
+        }
+    } else {
+        for (t = 0; t < nthreads; t++) piece[t].out_first = piece[t].first;
+    }
+
+    audio_bytes = nsel * (frame_mode ? 1 : NFRAMES) * num_channels * SLOT_SIZE_UDP;
+    if (out_name != NULL) {
+        size_t n = strlen(out_name);
+        out_fd = open(out_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0) {
+            perror(out_name);
+            return 1;
+        }
+        if (n > 4 && strcmp(out_name + n - 4, ".wav") == 0) {
+            out_header = 44;
+            write_wav_header(audio_bytes, rate);
+        }
+        if (ftruncate(out_fd, out_header + audio_bytes) < 0) perror("ftruncate");
+    }
+
+    for (t = 0; t < nthreads; t++) pthread_create(&tid[t], NULL, worker, &piece[t]);
+    for (t = 0; t < nthreads; t++) pthread_join(tid[t], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    // stitch the pieces: boundaries are checked like consecutive records in a piece
+    memset(&total, 0, sizeof(total));
+    total.temp_min = 1e9f;
+    total.temp_max = -1e9f;
+    for (t = 0; t < nthreads; t++) {
+        piece_t *p = &piece[t];
+        uint32_t shift = 0;
+        if (t > 0 && p->have_seq && total.have_seq) {
+            shift = seq_unwrap(total.last_seq + 1, p->first_seq) - p->first_seq;
+            p->first_seq += shift;
+            p->last_seq += shift;
+            if (seq_gt(p->first_seq, total.last_seq + 1)) {
+                total.lost += p->first_seq - total.last_seq - 1;
+                add_event(&total, p->first_sel, EV_GAP, total.last_seq + 1, p->first_seq);
+            } else if (!seq_gt(p->first_seq, total.last_seq)) {
+                total.back++;
+                add_event(&total, p->first_sel, EV_BACK, total.last_seq + 1, p->first_seq);
+            }
+        }
+        if (p->have_switches && total.have_switches && p->first_switches != total.last_switches) {
+            add_event(&total, p->first_sel, EV_SWITCHES, total.last_switches, p->first_switches);
+        }
+        if (p->have_t && total.have_t) {
+            uint64_t ia = (p->first_t - total.last_t) / 1000 / IA_BIN_US;
+            total.ia_hist[ia < IA_BINS ? ia : IA_BINS - 1]++;
+        }
+        if (t > 0 && p->have_counter && total.have_counter &&
+            p->first_counter != ((total.last_counter + 1) & 0xffffff)) {
+            total.counter_errors++;
+            add_event(&total, p->first, EV_COUNTER, (total.last_counter + 1) & 0xffffff, p->first_counter);
+        }
+        for (i = 0; i < p->num_ev; i++) {
+            event_t *e = &p->ev[i];
+            if (e->type == EV_GAP || e->type == EV_BACK) add_event(&total, e->rec, e->type, e->a + shift, e->b + shift);
+            else add_event(&total, e->rec, e->type, e->a, e->b);
+        }
+        free(p->ev);
+        if (p->have_seq) {
+            if (!total.have_seq) total.first_seq = p->first_seq;
+            total.last_seq = p->last_seq;
+            total.have_seq = true;
+        }
+        if (p->have_counter) {
+            if (!total.have_counter) total.first_counter = p->first_counter;
+            total.last_counter = p->last_counter;
+            total.have_counter = true;
+        }
+        if (p->have_switches) {
+            total.last_switches = p->last_switches;
+            total.have_switches = true;
+        }
+        if (p->have_t) {
+            if (!total.have_t) total.first_t = p->first_t;
+            total.last_t = p->last_t;
+            total.have_t = true;
+        }
+        for (i = 0; i < IA_BINS; i++) total.ia_hist[i] += p->ia_hist[i];
+        total.n_sel += p->n_sel;
+        total.bad_len += p->bad_len;
+        total.lost += p->lost;
+        total.back += p->back;
+        total.checksum_errors += p->checksum_errors;
+        total.counter_errors += p->counter_errors;
+        if (p->temp_n) {
+            if (p->temp_min < total.temp_min) total.temp_min = p->temp_min;
+            if (p->temp_max > total.temp_max) total.temp_max = p->temp_max;
+            total.temp_sum += p->temp_sum;
+            total.temp_n += p->temp_n;
+        }
+    }
+
+    if (frame_mode) {
+        printf("%llu frames, %.1f s at %u Hz\n", (unsigned long long)nrec, (double)nrec / rate, rate);
+        if (check_counter) printf("test counter: %llu discontinuities\n", (unsigned long long)total.counter_errors);
+    } else {
+        printf("%llu records of %zu byte, %.1f s at %u Hz\n", (unsigned long long)total.n_sel, lay.size,
+               (double)total.n_sel * NFRAMES / rate, rate);
+        if (total.bad_len) printf("%llu datagrams with a different size skipped\n", (unsigned long long)total.bad_len);
+        printf("sequence %u .. %u, %llu lost (%.3f%%), %llu out of order, %llu checksum errors\n",
+               total.first_seq, total.last_seq, (unsigned long long)total.lost,
+               100.0 * total.lost / (total.n_sel + total.lost), (unsigned long long)total.back,
+               (unsigned long long)total.checksum_errors);
+        if (total.have_t) print_interarrival(&total);
+        if (total.temp_n) {
+            printf("tx_temp %.1f .. %.1f °C, mean %.1f °C\n", total.temp_min, total.temp_max, total.temp_sum / total.temp_n);
+        }
+    }
+    if (total.num_ev) {
+        printf("%u events:\n", total.num_ev);
+        // boundary events go in before the events of the next piece, so the list is in record order
+        for (i = 0; i < total.num_ev && (verbose || i < MAX_EVENTS); i++) print_event(&total.ev[i]);
+        if (i < total.num_ev) printf("  ... %u more, -v lists all\n", total.num_ev - i);
+    }
+    if (out_fd >= 0) {
+        close(out_fd);
+        printf("wrote channels");
+        for (t = 0; t < num_channels; t++) printf(" %d", channels[t]);
+        printf(" to %s\n", out_name);
+    }
+    fprintf(stderr, "%.1f MB in %.3f s with %d threads, %.0f MB/s\n",
+            nrec * lay.size / 1e6, secs, nthreads, nrec * lay.size / 1e6 / secs);
+    return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * file format of tools/udp_capture.c, read by tools/stream_analyze.c
+ *
+ * a stream_file_hdr_t, then fixed size records: a stream_rec_hdr_t followed by the
+ * datagram, padded or truncated to payload_size. Fixed sizes keep the analyzer's split
+ * into pieces trivial. All fields little endian.
+ */
+
+#ifndef _STREAM_FILE_H
+#define _STREAM_FILE_H
+
+#include <stdint.h>
+
+#define STREAM_MAGIC            0x57474b53              // "WGKS"
+#define STREAM_VERSION          1
+#define STREAM_MAX_STREAMS      16
+#define STREAM_HDR_SIZE         512
+
+#define STREAM_FLAG_TRUNC       0x01                    // the datagram was longer than payload_size
+
+// a stream is one source address and port sending to one local port
+typedef struct {
+    uint32_t addr;              // network byte order
+    uint16_t port;              // host byte order
+    uint16_t local_port;
+    uint64_t packets;
+} stream_info_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t hdr_size;          // STREAM_HDR_SIZE, the records start here
+    uint32_t rec_size;          // sizeof(stream_rec_hdr_t) + payload_size
+    uint32_t payload_size;
+    uint64_t start_ns;          // CLOCK_REALTIME when the capture started
+    uint64_t kernel_drops;      // SO_RXQ_OVFL, datagrams the socket buffers dropped
+    uint32_t num_streams;
+    uint32_t reserved;
+    stream_info_t stream[STREAM_MAX_STREAMS];
+    uint8_t pad[STREAM_HDR_SIZE - 40 - STREAM_MAX_STREAMS * sizeof(stream_info_t)];
+} stream_file_hdr_t;
+
+typedef struct {
+    uint64_t t_ns;              // SO_TIMESTAMPNS, CLOCK_REALTIME when the kernel received it
+    uint16_t len;               // datagram length
+    uint8_t stream;             // index into stream_file_hdr_t.stream
+    uint8_t flags;
+    uint32_t reserved;
+} stream_rec_hdr_t;
+
+#endif /* _STREAM_FILE_H */
@@ -0,0 +1,275 @@
+/*
+ * collector for the telemetry frames broadcast by telemetry_task() on TELEM_PORT
+ *
+ * the PC has to be connected to the receiver's WiFi network (max_connection allows one
+ * extra station). Every frame is written as one CSV line, and optionally the latest frame
+ * of each role is kept as a Prometheus text exposition file, e.g. for the node_exporter
+ * textfile collector.
+ *
+ * -W tabulates a sender built with TX_PS_MEASURE: every power save schedule it cycles through
+ * (main/tx_ps.h) against the receiver's latency, jitter and losses meanwhile. The receiver
+ * needs LATENCY_PROBE for the latency columns. The table goes to stderr whenever the sender
+ * moves on, and at the end.
+ *
+ * -D prints the send timings of a MULTI_RX sender, one line per destination and histogram
+ * snapshot: µs from the end of the pack until sendto() returned, in the order of TX_DESTS
+ * (main/wireless_gk.h). Bucket upper edges, so the percentiles err on the late side.
+ *
+ * gcc -O2 -Wall -I../main -o telemetry_collect telemetry_collect.c ../main/telemetry.c ../main/tx_ps.c
+ * ./telemetry_collect [-P port] [-c out.csv] [-p wgk.prom] [-n frames] [-W] [-D]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "telemetry.h"
+#include "tx_ps.h"
+
+#define DEFAULT_PORT            (45678 + 2)             // TELEM_PORT in wireless_gk.h
+#define HEADER_SIZE             offsetof(telem_frame_t, counter)
+
+static telem_frame_t last[2];                           // latest frame per role, 0 = sender, 1 = receiver
+static int have_last[2];
+
+// per power save schedule, from the receiver frames while the sender ran it
+typedef struct {
+    uint32_t frames, twt_frames;
+    double ma, lat_p50, lat_p99, jitter_p99;
+    int32_t lat_p99_max;
+    uint32_t lost, underruns;
+} ps_stats_t;
+
+#define PS_SCHED_MAX            16
+
+static ps_stats_t ps_stats[PS_SCHED_MAX];
+
+
+static const char *role_name(uint8_t role) {
+    return role == 'T' ? "tx" : "rx";
+}
+
+
+static void write_csv_header(FILE *f) {
+    int i;
+
+    fprintf(f, "host_time,role,seq,uptime_ms");
+    for (i = 0; i < TC_NUM_COUNTERS; i++) fprintf(f, ",%s", telem_counter_name[i]);
+    for (i = 0; i < TG_NUM_GAUGES; i++) fprintf(f, ",%s", telem_gauge_name[i]);
+    fprintf(f, "\n");
+}
+
+
+static void write_csv(FILE *f, const telem_frame_t *t, double now) {
+    int i;
+
+    fprintf(f, "%.3f,%s,%u,%u", now, role_name(t->role), t->seq, t->uptime_ms);
+    for (i = 0; i < TC_NUM_COUNTERS; i++) fprintf(f, ",%u", t->counter[i]);
+    for (i = 0; i < TG_NUM_GAUGES; i++) fprintf(f, ",%d", t->gauge[i]);
+    fprintf(f, "\n");
+    fflush(f);
+}
+
+
+// written to a temporary file and renamed, so a scraper never sees a half written file
+static int write_prom(const char *name) {
+    char tmp[4096];
+    FILE *f;
+    int i, r;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", name);
+    f = fopen(tmp, "w");
+    if (f == NULL) {
+        perror(tmp);
+        return -1;
+    }
+    fprintf(f, "# TYPE wgk_uptime_seconds gauge\n");
+    for (r = 0; r < 2; r++) {
+        if (have_last[r]) fprintf(f, "wgk_uptime_seconds{role=\"%s\"} %.3f\n", role_name(last[r].role), last[r].uptime_ms / 1000.0);
+    }
+    for (i = 0; i < TC_NUM_COUNTERS; i++) {
+        fprintf(f, "# TYPE wgk_%s_total counter\n", telem_counter_name[i]);
+        for (r = 0; r < 2; r++) {
+            if (have_last[r]) fprintf(f, "wgk_%s_total{role=\"%s\"} %u\n", telem_counter_name[i], role_name(last[r].role), last[r].counter[i]);
+        }
+    }
+    for (i = 0; i < TG_NUM_GAUGES; i++) {
+        fprintf(f, "# TYPE wgk_%s gauge\n", telem_gauge_name[i]);
+        for (r = 0; r < 2; r++) {
+            if (have_last[r]) fprintf(f, "wgk_%s{role=\"%s\"} %d\n", telem_gauge_name[i], role_name(last[r].role), last[r].gauge[i]);
+        }
+    }
+    fclose(f);
+    return rename(tmp, name);
+}
+
+
+// rx is the receiver frame that just came in, last[1] still the one before
+static void ps_add(const telem_frame_t *tx, const telem_frame_t *rx, const telem_frame_t *prev_rx) {
+    int s = tx->gauge[TG_TX_PS_SCHED];
+    ps_stats_t *p;
+
+    if (s < 0 || s >= PS_SCHED_MAX) return;
+    p = &ps_stats[s];
+    p->frames++;
+    p->twt_frames += tx->gauge[TG_TX_PS_TWT] != 0;
+    p->ma += tx->gauge[TG_TX_PS_MA];
+    p->lat_p50 += rx->gauge[TG_LATENCY_P50];
+    p->lat_p99 += rx->gauge[TG_LATENCY_P99];
+    p->jitter_p99 += rx->gauge[TG_JITTER_P99];
+    if (rx->gauge[TG_LATENCY_P99] > p->lat_p99_max) p->lat_p99_max = rx->gauge[TG_LATENCY_P99];
+    p->lost += rx->counter[TC_RX_LOST] - prev_rx->counter[TC_RX_LOST];
+    p->underruns += rx->counter[TC_RX_UNDERRUNS] - prev_rx->counter[TC_RX_UNDERRUNS];
+}
+
+
+// the current is what the sender's model says, measure it and put it next to it
+static void ps_print(FILE *f) {
+    int s;
+    ps_stats_t *p;
+
+    fprintf(f, "schedule  burst  mA model  twt  frames | latency p50   p99   max ms | jitter p99 µs | lost underruns\n");
+    for (s = 0; s < PS_SCHED_MAX; s++) {
+        p = &ps_stats[s];
+        if (p->frames == 0) continue;
+        fprintf(f, "%-9s %5d  %8.0f %3.0f%%  %6u |        %5.2f %5.2f %5.2f    | %13.0f | %4u %9u\n",
+                s < tx_ps_num_sched ? tx_ps_sched[s].name : "?", s < tx_ps_num_sched ? tx_ps_sched[s].burst : 0,
+                p->ma / p->frames, 100.0 * p->twt_frames / p->frames, p->frames,
+                p->lat_p50 / p->frames / 1000.0, p->lat_p99 / p->frames / 1000.0, p->lat_p99_max / 1000.0,
+                p->jitter_p99 / p->frames, p->lost, p->underruns);
+    }
+}
+
+
+// the value below which permille of the samples fall, at the bucket's upper edge
+static uint32_t hist_percentile(const telem_hist_frame_t *h, uint64_t n, int permille) {
+    uint64_t sum = 0;
+    int b;
+
+    for (b = 0; b < LOG_HIST_BINS - 1; b++) {
+        sum += h->bin[b];
+        if (sum * 1000 >= n * permille) break;
+    }
+    return b < LOG_HIST_BINS - 1 ? log_hist_upper(b) : log_hist_lower(b);
+}
+
+
+static void dest_print(FILE *f, const telem_hist_frame_t *h) {
+    uint64_t n = 0;
+    int b, max = 0;
+
+    for (b = 0; b < LOG_HIST_BINS; b++) {
+        n += h->bin[b];
+        if (h->bin[b] != 0) max = b;
+    }
+    fprintf(f, "dest %d  snapshot %5u  sent %7llu", h->hist - TH_TX_SEND_0, h->seq, (unsigned long long)n);
+    if (n > 0) {
+        fprintf(f, "  send p50 %5u  p99 %5u  max %5u µs", hist_percentile(h, n, 500), hist_percentile(h, n, 990),
+                max < LOG_HIST_BINS - 1 ? log_hist_upper(max) : log_hist_lower(max));
+    }
+    fprintf(f, "\n");
+}
+
+
+// accepts frames from older firmware with fewer counters or gauges; missing values read as 0
+static int decode(const uint8_t *buf, ssize_t len, telem_frame_t *t) {
+    telem_frame_t in;
+    int nc, ng;
+
+    if (len < (ssize_t)HEADER_SIZE) return -1;
+    memcpy(&in, buf, HEADER_SIZE);
+    if (in.magic != TELEM_MAGIC || in.version != TELEM_VERSION) return -1;
+    if (len < (ssize_t)(HEADER_SIZE + 4 * (in.num_counters + in.num_gauges))) return -1;
+    nc = in.num_counters < TC_NUM_COUNTERS ? in.num_counters : TC_NUM_COUNTERS;
+    ng = in.num_gauges < TG_NUM_GAUGES ? in.num_gauges : TG_NUM_GAUGES;
+
+    memset(t, 0, sizeof(*t));
+    memcpy(t, &in, HEADER_SIZE);
+    memcpy(t->counter, buf + HEADER_SIZE, 4 * nc);
+    memcpy(t->gauge, buf + HEADER_SIZE + 4 * in.num_counters, 4 * ng);
+    return 0;
+}
+
+
+int main(int argc, char **argv) {
+    int port = DEFAULT_PORT, opt, sock, one = 1, ps_table = 0, ps_sched = -1, settled = 0, dest_table = 0;
+    long frames = -1;
+    const char *csv_name = NULL, *prom_name = NULL;
+    FILE *csv = stdout;
+    struct sockaddr_in addr;
+    uint8_t buf[2048];
+    telem_frame_t t;
+
+    while ((opt = getopt(argc, argv, "P:c:p:n:WDh")) != -1) {
+        switch (opt) {
+            case 'P': port = atoi(optarg); break;
+            case 'c': csv_name = optarg; break;
+            case 'p': prom_name = optarg; break;
+            case 'n': frames = atol(optarg); break;
+            case 'W': ps_table = 1; break;
+            case 'D': dest_table = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-P port] [-c out.csv] [-p metrics.prom] [-n frames] [-W] [-D]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (csv_name) {
+        csv = fopen(csv_name, "a");
+        if (csv == NULL) { perror(csv_name); return 1; }
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) { perror("socket"); return 1; }
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) { perror("bind"); return 1; }
+    fprintf(stderr, "listening for telemetry on port %d\n", port);
+
+    write_csv_header(csv);
+    while (frames != 0) {
+        struct timespec ts;
+        ssize_t len = recv(sock, buf, sizeof(buf), 0);
+        if (len < 0) { perror("recv"); return 1; }
+        if (len >= 4 && *(uint32_t *)buf == TELEM_HIST_MAGIC) {
+            // the receiver's are for jitter_tune.c
+            telem_hist_frame_t *h = (telem_hist_frame_t *)buf;
+            if (dest_table && len == sizeof(*h) && h->role == 'T' && h->num_bins == LOG_HIST_BINS &&
+                h->hist >= TH_TX_SEND_0 && h->hist < TH_TX_SEND_0 + TELEM_MAX_DESTS) {
+                dest_print(stderr, h);
+            }
+            continue;
+        }
+        if (decode(buf, len, &t) < 0) {
+            fprintf(stderr, "ignoring %zd byte datagram\n", len);
+            continue;
+        }
+        clock_gettime(CLOCK_REALTIME, &ts);
+        write_csv(csv, &t, ts.tv_sec + ts.tv_nsec * 1e-9);
+        if (ps_table && t.role == 'T' && t.gauge[TG_TX_PS_SCHED] != ps_sched) {
+            if (ps_sched >= 0) ps_print(stderr);
+            ps_sched = t.gauge[TG_TX_PS_SCHED];
+            settled = 0;
+        }
+        if (ps_table && t.role != 'T' && have_last[0] && have_last[1]) {
+            // the receiver's first interval under a new schedule is partly the old one
+            if (settled++ > 0) ps_add(&last[0], &t, &last[1]);
+        }
+        last[t.role == 'T' ? 0 : 1] = t;
+        have_last[t.role == 'T' ? 0 : 1] = 1;
+        if (prom_name) write_prom(prom_name);
+        if (frames > 0) frames--;
+    }
+    if (ps_table) ps_print(stderr);
+    if (csv != stdout) fclose(csv);
+    return 0;
+}
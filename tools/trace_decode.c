@@ -0,0 +1,337 @@
+/*
+ * decoder for the WGKTRACE dumps written by main/trace.c
+ *
+ * reads the console output of a sender or receiver (e.g. captured with
+ * idf.py monitor | tee trace.log), extracts all WGKTRACE blocks and prints
+ * per-stage latency statistics and log2 histograms. Optionally writes a
+ * Chrome trace JSON file that can be loaded into chrome://tracing or ui.perfetto.dev.
+ * The worst packet's cycles in the pipeline sections go through the CPU_GOV governor
+ * (main/cpu_gov.h), which shows the clock it would pick and the margin at every level.
+ *
+ * gcc -O2 -Wall -I../main -o trace_decode trace_decode.c ../main/cpu_gov.c
+ * ./trace_decode [-j trace.json] trace.log
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "cpu_gov.h"
+
+// must match trace_stage_t in main/wireless_gk.h
+enum {
+    TRACE_I2S_RX_ISR = 0,
+    TRACE_TX_NOTIFY,
+    TRACE_TX_PACK,
+    TRACE_TX_SENDTO,
+    TRACE_RX_RECVFROM,
+    TRACE_RX_PUT,
+    TRACE_I2S_TX_ISR,
+    TRACE_RX_GET,
+    TRACE_NUM_STAGES
+};
+
+static const char *stage_name[TRACE_NUM_STAGES] = {
+    "i2s_rx_isr", "tx_notify", "tx_pack", "tx_sendto",
+    "rx_recvfrom", "rx_put", "i2s_tx_isr", "rx_get",
+};
+
+#define EVENT_SIZE 8            // sizeof(trace_event_t)
+#define ARG_SLOTS 256           // remembered args per stage for matching
+#define NUM_BUCKETS 24          // log2 buckets, 1 µs .. 8 s
+
+typedef struct {
+    uint64_t cycles;            // unwrapped
+    double us;
+    uint16_t arg;
+    uint8_t stage;
+    char role;
+} event_t;
+
+// a latency pair is measured from the most recent 'from' event to each 'to' event.
+// with match_arg set, the 'from' event also has to carry the same arg (sequence number).
+typedef struct {
+    const char *name;
+    int from, to;
+    int match_arg;
+    int span;                   // emit as a duration event in the Chrome trace
+    double *val;
+    size_t n, cap;
+} pair_t;
+
+static pair_t pairs[] = {
+    { "isr -> notify",          TRACE_I2S_RX_ISR,  TRACE_TX_NOTIFY,   0, 0 },
+    { "notify -> pack",         TRACE_TX_NOTIFY,   TRACE_TX_PACK,     1, 1 },
+    { "pack -> sendto",         TRACE_TX_PACK,     TRACE_TX_SENDTO,   1, 1 },
+    { "isr -> sendto",          TRACE_I2S_RX_ISR,  TRACE_TX_SENDTO,   0, 0 },
+    { "i2s rx period",          TRACE_I2S_RX_ISR,  TRACE_I2S_RX_ISR,  0, 0 },
+    { "recvfrom -> put",        TRACE_RX_RECVFROM, TRACE_RX_PUT,      1, 1 },
+    { "recvfrom interval",      TRACE_RX_RECVFROM, TRACE_RX_RECVFROM, 0, 0 },
+    { "isr -> get",             TRACE_I2S_TX_ISR,  TRACE_RX_GET,      0, 1 },
+    { "i2s tx period",          TRACE_I2S_TX_ISR,  TRACE_I2S_TX_ISR,  0, 0 },
+    { "put -> get (residency)", TRACE_RX_PUT,      TRACE_RX_GET,      1, 0 },
+};
+#define NUM_PAIRS (sizeof(pairs)/sizeof(pair_t))
+
+static event_t *events;
+static size_t num_events, cap_events;
+static unsigned long trace_cpu_hz;                     // of the last block
+
+
+static void add_event(event_t *e) {
+    if (num_events == cap_events) {
+        cap_events = cap_events ? 2 * cap_events : 4096;
+        events = realloc(events, cap_events * sizeof(event_t));
+        if (events == NULL) { perror("realloc"); exit(1); }
+    }
+    events[num_events++] = *e;
+}
+
+
+static void add_value(pair_t *pp, double v) {
+    if (pp->n == pp->cap) {
+        pp->cap = pp->cap ? 2 * pp->cap : 1024;
+        pp->val = realloc(pp->val, pp->cap * sizeof(double));
+        if (pp->val == NULL) { perror("realloc"); exit(1); }
+    }
+    pp->val[pp->n++] = v;
+}
+
+
+static int hexval(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+
+// parse all WGKTRACE blocks. The cycle counter is 32 bit and wraps every few seconds,
+// so we unwrap it with the signed difference to the previous event. This is exact within
+// a block; across blocks it is correct as long as the dump interval is shorter than one wrap.
+static int parse(FILE *f) {
+    char line[4096];
+    int in_block = 0, version, blocks = 0;
+    char role = '?';
+    unsigned long cpu_hz = 0, n;
+    uint32_t last_raw = 0;
+    uint64_t now = 0;
+    int have_last = 0;
+
+    while (fgets(line, sizeof(line), f)) {
+        char *s = strstr(line, "WGKTRACE");
+        if (s) {
+            if (strncmp(s, "WGKTRACE END", 12) == 0) {
+                in_block = 0;
+            } else if (sscanf(s, "WGKTRACE %d %c %lu %lu", &version, &role, &cpu_hz, &n) == 4) {
+                if (version != 1) {
+                    fprintf(stderr, "unsupported trace version %d\n", version);
+                    return -1;
+                }
+                in_block = 1;
+                blocks++;
+                trace_cpu_hz = cpu_hz;
+            }
+            continue;
+        }
+        if (!in_block) continue;
+
+        // one line holds up to 16 events in hex
+        char *c = line;
+        uint8_t b[EVENT_SIZE];
+        int k = 0;
+        while (hexval(c[0]) >= 0 && hexval(c[1]) >= 0) {
+            b[k++] = (uint8_t)(hexval(c[0]) << 4 | hexval(c[1]));
+            c += 2;
+            if (k == EVENT_SIZE) {
+                event_t e;
+                uint32_t raw = b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24;
+                if (have_last) {
+                    now += (int64_t)(int32_t)(raw - last_raw);
+                } else {
+                    now = raw;
+                    have_last = 1;
+                }
+                last_raw = raw;
+                e.cycles = now;
+                e.us = (double)now * 1.0e6 / (double)cpu_hz;
+                e.arg = (uint16_t)(b[4] | b[5] << 8);
+                e.stage = b[6];
+                e.role = role;
+                if (e.stage < TRACE_NUM_STAGES) {
+                    add_event(&e);
+                }
+                k = 0;
+            }
+        }
+    }
+    return blocks;
+}
+
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+// the worst packet in cycles, 0 if the pair is not in the trace. Needs the values sorted.
+static uint32_t max_cycles(int from, int to) {
+    size_t p;
+
+    for (p = 0; p < NUM_PAIRS; p++) {
+        if (pairs[p].from == from && pairs[p].to == to && pairs[p].n > 0) {
+            return (uint32_t)(pairs[p].val[pairs[p].n - 1] * trace_cpu_hz / 1.0e6);
+        }
+    }
+    return 0;
+}
+
+
+// the sections CPU_GOV measures on the target, see cpu_gov_sample_task() and _isr()
+static void governor(void) {
+    uint32_t task, isr;
+    int l, level, idle;
+
+    task = max_cycles(TRACE_TX_NOTIFY, TRACE_TX_PACK);
+    if (max_cycles(TRACE_RX_RECVFROM, TRACE_RX_PUT) > task) task = max_cycles(TRACE_RX_RECVFROM, TRACE_RX_PUT);
+    isr = max_cycles(TRACE_I2S_TX_ISR, TRACE_RX_GET);
+    if (task == 0 && isr == 0) return;
+
+    printf("\ngovernor, worst packet %u cycles in the task, %u in the I2S callback, at %lu MHz\n",
+           task, isr, trace_cpu_hz / 1000000);
+    for (l = 0; l < CPU_GOV_LEVELS; l++) {
+        printf("  %3u MHz  margin %4ld permille\n", cpu_gov_mhz[l], (long)cpu_gov_margin(task, isr, cpu_gov_mhz[l]));
+    }
+    level = cpu_gov_lowest(task, isr, CPU_GOV_MARGIN);
+    idle = cpu_gov_lowest(0, isr, CPU_GOV_MARGIN + CPU_GOV_HYST);
+    if (idle > level) idle = level;
+    printf("  picks %u MHz, idle %u MHz%s\n", cpu_gov_mhz[level], cpu_gov_mhz[idle],
+           cpu_gov_margin(task, isr, cpu_gov_mhz[level]) < CPU_GOV_MARGIN ? ", short of the margin even there" : "");
+}
+
+
+static void report(FILE *json) {
+    double last_us[TRACE_NUM_STAGES];
+    int have[TRACE_NUM_STAGES] = {0};
+    struct { uint16_t arg; double us; int valid; } last_arg[TRACE_NUM_STAGES][ARG_SLOTS];
+    size_t i, p;
+    int first = 1;
+
+    memset(last_arg, 0, sizeof(last_arg));
+    for (i = 0; i < num_events; i++) {
+        event_t *e = &events[i];
+        for (p = 0; p < NUM_PAIRS; p++) {
+            pair_t *pp = &pairs[p];
+            double from_us;
+            if (pp->to != e->stage) continue;
+            if (pp->match_arg) {
+                int slot = e->arg & (ARG_SLOTS - 1);
+                if (!last_arg[pp->from][slot].valid || last_arg[pp->from][slot].arg != e->arg) continue;
+                from_us = last_arg[pp->from][slot].us;
+            } else {
+                if (!have[pp->from]) continue;
+                from_us = last_us[pp->from];
+            }
+            add_value(pp, e->us - from_us);
+            if (json && pp->span) {
+                fprintf(json, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":\"%c\",\"tid\":\"%s\",\"args\":{\"sn\":%u}}",
+                        first ? "" : ",", pp->name, from_us, e->us - from_us, e->role, stage_name[pp->to], e->arg);
+                first = 0;
+            }
+        }
+        if (json) {
+            fprintf(json, "%s\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":\"%c\",\"tid\":\"%s\",\"args\":{\"arg\":%u}}",
+                    first ? "" : ",", stage_name[e->stage], e->us, e->role, stage_name[e->stage], e->arg);
+            first = 0;
+        }
+        last_us[e->stage] = e->us;
+        have[e->stage] = 1;
+        last_arg[e->stage][e->arg & (ARG_SLOTS - 1)].arg = e->arg;
+        last_arg[e->stage][e->arg & (ARG_SLOTS - 1)].us = e->us;
+        last_arg[e->stage][e->arg & (ARG_SLOTS - 1)].valid = 1;
+    }
+
+    printf("%-24s %8s %10s %10s %10s %10s %10s %10s\n",
+           "latency [us]", "count", "min", "avg", "p50", "p99", "p99.9", "max");
+    for (p = 0; p < NUM_PAIRS; p++) {
+        pair_t *pp = &pairs[p];
+        double sum = 0.0;
+        if (pp->n == 0) continue;
+        qsort(pp->val, pp->n, sizeof(double), cmp_double);
+        for (i = 0; i < pp->n; i++) sum += pp->val[i];
+        printf("%-24s %8zu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", pp->name, pp->n,
+               pp->val[0], sum / pp->n,
+               pp->val[(size_t)(0.5 * (pp->n - 1))],
+               pp->val[(size_t)(0.99 * (pp->n - 1))],
+               pp->val[(size_t)(0.999 * (pp->n - 1))],
+               pp->val[pp->n - 1]);
+    }
+    governor();
+
+    for (p = 0; p < NUM_PAIRS; p++) {
+        pair_t *pp = &pairs[p];
+        size_t bucket[NUM_BUCKETS] = {0}, maxcount = 0;
+        int b, lo = NUM_BUCKETS, hi = 0;
+        if (pp->n == 0) continue;
+        for (i = 0; i < pp->n; i++) {
+            double v = pp->val[i];
+            for (b = 0; b < NUM_BUCKETS - 1 && v >= (double)(1u << b); b++)
+                ;
+            bucket[b]++;
+        }
+        for (b = 0; b < NUM_BUCKETS; b++) {
+            if (bucket[b] == 0) continue;
+            if (b < lo) lo = b;
+            if (b > hi) hi = b;
+            if (bucket[b] > maxcount) maxcount = bucket[b];
+        }
+        printf("\n%s\n", pp->name);
+        for (b = lo; b <= hi; b++) {
+            int w = (int)(50 * bucket[b] / maxcount);
+            printf("  < %8u us %8zu |%.*s\n", 1u << b, bucket[b], w,
+                   "##################################################");
+        }
+    }
+}
+
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-j chrome_trace.json] trace.log\n", me);
+    exit(1);
+}
+
+
+int main(int argc, char **argv) {
+    const char *json_name = NULL;
+    FILE *f, *json = NULL;
+    int opt, blocks;
+
+    while ((opt = getopt(argc, argv, "j:h")) != -1) {
+        switch (opt) {
+            case 'j': json_name = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1) usage(argv[0]);
+
+    f = fopen(argv[optind], "r");
+    if (f == NULL) { perror(argv[optind]); return 1; }
+    blocks = parse(f);
+    fclose(f);
+    if (blocks < 0) return 1;
+    printf("%d trace blocks, %zu events\n\n", blocks, num_events);
+
+    if (json_name) {
+        json = fopen(json_name, "w");
+        if (json == NULL) { perror(json_name); return 1; }
+        fprintf(json, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    }
+    report(json);
+    if (json) {
+        fprintf(json, "\n]}\n");
+        fclose(json);
+    }
+    return 0;
+}
@@ -0,0 +1,491 @@
+/*
+ * capture daemon for the audio datagrams, replaces udpserver.py (now in _attic)
+ *
+ * one receive thread per port pulls datagrams with recvmmsg() straight into a preallocated
+ * ring of fixed size records, each with the SO_TIMESTAMPNS kernel receive time. A writer
+ * thread drains the rings with large sequential write()s. Several senders on one port are
+ * told apart by their source address, several ports are several streams as well. The
+ * file format is in stream_file.h, tools/stream_analyze.c reads it (-S selects the stream).
+ * Kernel socket buffer drops are counted with SO_RXQ_OVFL and printed once a second.
+ *
+ * -B runs the built-in benchmark: generator threads send numbered udp_buf_t datagrams to
+ * the capture ports on localhost with sendmmsg(), and afterwards the file is read back and
+ * every stream is checked for missing sequence numbers.
+ *
+ * gcc -O2 -Wall -pthread -I../main -o udp_capture udp_capture.c ../main/wgk_core.c
+ * ./udp_capture [-p port]... [-s payload_size] [-m ring_mb] out.wgks
+ * ./udp_capture -B streams:pps:seconds [-p first_port] /tmp/bench.wgks
+ */
+
+#define _GNU_SOURCE                     // recvmmsg, sendmmsg
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "wgk_core.h"
+#include "stream_file.h"
+
+#define DEFAULT_PORT            45678                   // PORT in wireless_gk.h
+#define MAX_PORTS               STREAM_MAX_STREAMS
+#define BATCH                   64                      // datagrams per recvmmsg() / sendmmsg()
+#define RCVBUF_SIZE             (16 << 20)
+#define WRITE_MIN               (1 << 20)               // bytes, unless the writer is idle
+#define CMSG_SPACE_ALL          (CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t)))
+
+typedef struct {
+    int sock;
+    uint16_t port;
+    pthread_t tid;
+    uint8_t *ring;              // num_recs records of rec_size
+    uint32_t num_recs;
+    uint64_t head, tail;        // records produced by the receiver and written by the writer
+    uint64_t ring_full;         // times the receiver had to wait for the writer
+    uint32_t kernel_drops;      // last SO_RXQ_OVFL value
+} rx_port_t;
+
+static rx_port_t ports[MAX_PORTS];
+static int num_ports;
+static uint32_t payload_size = sizeof(udp_buf_t), rec_size;
+static stream_file_hdr_t file_hdr;
+static pthread_mutex_t stream_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile sig_atomic_t stop;
+static int out_fd;
+static uint64_t bytes_written;
+
+
+static void on_signal(int sig) {
+    stop = 1;
+}
+
+
+static uint64_t now_ns(clockid_t clock) {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+// new streams are rare, so a lock around the insertion and a lock free scan for the rest
+static uint8_t stream_id(const struct sockaddr_in *src, uint16_t local_port) {
+    uint32_t i, n = __atomic_load_n(&file_hdr.num_streams, __ATOMIC_ACQUIRE);
+    stream_info_t *s;
+
+    for (i = 0; i < n; i++) {
+        s = &file_hdr.stream[i];
+        if (s->addr == src->sin_addr.s_addr && s->port == ntohs(src->sin_port) && s->local_port == local_port) {
+            return i;
+        }
+    }
+    pthread_mutex_lock(&stream_lock);
+    n = file_hdr.num_streams;
+    for (i = 0; i < n; i++) {
+        s = &file_hdr.stream[i];
+        if (s->addr == src->sin_addr.s_addr && s->port == ntohs(src->sin_port) && s->local_port == local_port) break;
+    }
+    if (i == n && n < STREAM_MAX_STREAMS) {
+        s = &file_hdr.stream[n];
+        s->addr = src->sin_addr.s_addr;
+        s->port = ntohs(src->sin_port);
+        s->local_port = local_port;
+        __atomic_store_n(&file_hdr.num_streams, n + 1, __ATOMIC_RELEASE);
+        fprintf(stderr, "stream %u: %s:%u -> port %u\n", n, inet_ntoa(src->sin_addr), s->port, local_port);
+    }
+    pthread_mutex_unlock(&stream_lock);
+    return i < STREAM_MAX_STREAMS ? i : STREAM_MAX_STREAMS - 1;
+}
+
+
+static int open_port(rx_port_t *p, uint16_t port) {
+    struct sockaddr_in addr;
+    struct timeval tv = { 0, 100000 };
+    int one = 1, size = RCVBUF_SIZE;
+
+    p->port = port;
+    p->sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (p->sock < 0) {
+        perror("socket");
+        return -1;
+    }
+    // SO_RCVBUFFORCE needs CAP_NET_ADMIN, otherwise net.core.rmem_max is the limit
+    if (setsockopt(p->sock, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0) {
+        setsockopt(p->sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    setsockopt(p->sock, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+    setsockopt(p->sock, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+    setsockopt(p->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));    // to notice stop
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(p->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        return -1;
+    }
+    return 0;
+}
+
+
+static void *rx_thread(void *arg) {
+    rx_port_t *p = (rx_port_t *)arg;
+    struct mmsghdr msg[BATCH];
+    struct iovec iov[BATCH];
+    struct sockaddr_in src[BATCH];
+    static __thread uint8_t cbuf[BATCH][CMSG_SPACE_ALL];
+    uint64_t head = 0, tail;
+    uint32_t slot, i, n, want;
+    int got;
+
+    while (!stop) {
+        // free contiguous slots, the writer moves tail
+        tail = __atomic_load_n(&p->tail, __ATOMIC_ACQUIRE);
+        slot = head % p->num_recs;
+        want = p->num_recs - (uint32_t)(head - tail);
+        if (want > p->num_recs - slot) want = p->num_recs - slot;
+        if (want > BATCH) want = BATCH;
+        if (want == 0) {
+            p->ring_full++;
+            usleep(100);                        // the socket buffer holds the datagrams meanwhile
+            continue;
+        }
+        for (i = 0; i < want; i++) {
+            iov[i].iov_base = p->ring + (size_t)(slot + i) * rec_size + sizeof(stream_rec_hdr_t);
+            iov[i].iov_len = payload_size;
+            memset(&msg[i].msg_hdr, 0, sizeof(struct msghdr));
+            msg[i].msg_hdr.msg_name = &src[i];
+            msg[i].msg_hdr.msg_namelen = sizeof(src[i]);
+            msg[i].msg_hdr.msg_iov = &iov[i];
+            msg[i].msg_hdr.msg_iovlen = 1;
+            msg[i].msg_hdr.msg_control = cbuf[i];
+            msg[i].msg_hdr.msg_controllen = sizeof(cbuf[i]);
+        }
+        got = recvmmsg(p->sock, msg, want, MSG_WAITFORONE, NULL);
+        if (got <= 0) {
+            if (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("recvmmsg");
+            continue;
+        }
+        for (i = 0; i < (uint32_t)got; i++) {
+            stream_rec_hdr_t *h = (stream_rec_hdr_t *)(p->ring + (size_t)(slot + i) * rec_size);
+            struct cmsghdr *c;
+
+            memset(h, 0, sizeof(stream_rec_hdr_t));
+            n = msg[i].msg_len;
+            h->len = n > 0xffff ? 0xffff : n;
+            if (msg[i].msg_hdr.msg_flags & MSG_TRUNC) h->flags |= STREAM_FLAG_TRUNC;
+            else if (n < payload_size) memset((uint8_t *)(h + 1) + n, 0, payload_size - n);
+            h->stream = stream_id(&src[i], p->port);
+            for (c = CMSG_FIRSTHDR(&msg[i].msg_hdr); c != NULL; c = CMSG_NXTHDR(&msg[i].msg_hdr, c)) {
+                if (c->cmsg_level != SOL_SOCKET) continue;
+                if (c->cmsg_type == SCM_TIMESTAMPNS) {
+                    struct timespec ts;
+                    memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                    h->t_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+                } else if (c->cmsg_type == SO_RXQ_OVFL) {
+                    memcpy(&p->kernel_drops, CMSG_DATA(c), sizeof(uint32_t));
+                }
+            }
+            __atomic_fetch_add(&file_hdr.stream[h->stream].packets, 1, __ATOMIC_RELAXED);
+        }
+        head += got;
+        __atomic_store_n(&p->head, head, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+
+static void write_all(const uint8_t *buf, size_t len) {
+    ssize_t w;
+
+    while (len > 0) {
+        w = write(out_fd, buf, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            perror("write");
+            exit(1);
+        }
+        buf += w;
+        len -= w;
+        bytes_written += w;
+    }
+}
+
+
+// drains the rings in large contiguous pieces straight from ring memory
+static void *writer_thread(void *arg) {
+    uint64_t head, tail, n;
+    uint32_t slot;
+    bool idle, done = false;
+    int i;
+
+    while (!done) {
+        done = stop;                            // one more round after stop
+        idle = true;
+        for (i = 0; i < num_ports; i++) {
+            rx_port_t *p = &ports[i];
+            head = __atomic_load_n(&p->head, __ATOMIC_ACQUIRE);
+            tail = p->tail;
+            slot = tail % p->num_recs;
+            n = head - tail;
+            if (n > p->num_recs - slot) n = p->num_recs - slot;
+            if (n == 0 || (n * rec_size < WRITE_MIN && !done && head - tail == n && slot + n < p->num_recs)) {
+                continue;                       // wait for more, unless we are stopping
+            }
+            write_all(p->ring + (size_t)slot * rec_size, n * rec_size);
+            __atomic_store_n(&p->tail, tail + n, __ATOMIC_RELEASE);
+            idle = false;
+        }
+        if (idle && !done) usleep(1000);
+    }
+    // the last records below WRITE_MIN
+    for (i = 0; i < num_ports; i++) {
+        rx_port_t *p = &ports[i];
+        while ((n = p->head - p->tail) > 0) {
+            slot = p->tail % p->num_recs;
+            if (n > p->num_recs - slot) n = p->num_recs - slot;
+            write_all(p->ring + (size_t)slot * rec_size, n * rec_size);
+            p->tail += n;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * benchmark: packet generator
+ */
+typedef struct {
+    uint16_t port;
+    uint32_t pps;
+    double seconds;
+    uint64_t sent, errors;
+    pthread_t tid;
+} gen_t;
+
+static void *gen_thread(void *arg) {
+    gen_t *g = (gen_t *)arg;
+    static __thread udp_buf_t buf[BATCH];
+    struct mmsghdr msg[BATCH];
+    struct iovec iov[BATCH];
+    struct sockaddr_in dest;
+    struct timespec next;
+    uint64_t total = (uint64_t)(g->pps * g->seconds), seq = 1, due, start;
+    uint32_t i, n;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0), r;
+
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    dest.sin_port = htons(g->port);
+    memset(buf, 0, sizeof(buf));
+    for (i = 0; i < BATCH; i++) {
+        iov[i].iov_base = &buf[i];
+        iov[i].iov_len = sizeof(udp_buf_t);
+        memset(&msg[i], 0, sizeof(msg[i]));
+        msg[i].msg_hdr.msg_name = &dest;
+        msg[i].msg_hdr.msg_namelen = sizeof(dest);
+        msg[i].msg_hdr.msg_iov = &iov[i];
+        msg[i].msg_hdr.msg_iovlen = 1;
+    }
+    // every millisecond send what is due by then
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    start = next.tv_sec * 1000000000ULL + next.tv_nsec;
+    while (seq <= total) {
+        next.tv_nsec += 1000000;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        due = (next.tv_sec * 1000000000ULL + next.tv_nsec - start) * g->pps / 1000000000ULL;
+        if (due > total) due = total;
+        while (seq <= due) {
+            n = (due - seq + 1) < BATCH ? (uint32_t)(due - seq + 1) : BATCH;
+            for (i = 0; i < n; i++) {
+                buf[i].sequence_number = (wire_seq_t)(seq + i);
+                buf[i].checksum = calculate_checksum((uint32_t *)&buf[i], NFRAMES * sizeof(udp_frame_t) / 4);
+            }
+            r = sendmmsg(sock, msg, n, 0);
+            if (r <= 0) {
+                g->errors++;
+                r = 1;                          // count it as lost and move on
+            }
+            g->sent += r;
+            seq += r;
+        }
+    }
+    close(sock);
+    return NULL;
+}
+
+
+// reads the capture back and counts the sequence numbers missing per stream
+static int verify(const char *name, gen_t *gen, int num_gen, double secs) {
+    int fd = open(name, O_RDONLY), i, bad = 0;
+    struct stat st;
+    const uint8_t *d;
+    const stream_file_hdr_t *h;
+    uint64_t n, r, missing[STREAM_MAX_STREAMS] = {0}, count[STREAM_MAX_STREAMS] = {0};
+    uint32_t last[STREAM_MAX_STREAMS] = {0}, seq;
+    wire_seq_t w;
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(name);
+        return 1;
+    }
+    d = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (d == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    h = (const stream_file_hdr_t *)d;
+    n = (st.st_size - h->hdr_size) / h->rec_size;
+    for (r = 0; r < n; r++) {
+        const stream_rec_hdr_t *rh = (const stream_rec_hdr_t *)(d + h->hdr_size + r * h->rec_size);
+        memcpy(&w, (const uint8_t *)(rh + 1) + offsetof(udp_buf_t, sequence_number), sizeof(w));
+        seq = seq_unwrap(last[rh->stream] + 1, w);
+        if (seq_gt(seq, last[rh->stream] + 1)) missing[rh->stream] += seq - last[rh->stream] - 1;
+        last[rh->stream] = seq;
+        count[rh->stream]++;
+    }
+    printf("%llu records, %.1f MB/s to disk, %llu kernel drops\n", (unsigned long long)n,
+           bytes_written / 1e6 / secs, (unsigned long long)h->kernel_drops);
+    for (i = 0; i < (int)h->num_streams; i++) {
+        printf("stream %d port %u: %llu captured, %llu missing\n", i, h->stream[i].local_port,
+               (unsigned long long)count[i], (unsigned long long)missing[i]);
+        bad |= missing[i] != 0;
+    }
+    for (i = 0; i < num_gen; i++) {
+        printf("generator port %u: %llu sent, %llu send errors\n", gen[i].port,
+               (unsigned long long)gen[i].sent, (unsigned long long)gen[i].errors);
+    }
+    bad |= h->kernel_drops != 0;
+    printf("%s\n", bad ? "DROPS" : "PASS");
+    munmap((void *)d, st.st_size);
+    close(fd);
+    return bad;
+}
+
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-p port]... [-s payload_size] [-m ring_mb] out.wgks\n"
+                    "       %s -B streams:pps:seconds [-p first_port] out.wgks\n", name, name);
+}
+
+
+int main(int argc, char **argv) {
+    uint16_t port_list[MAX_PORTS];
+    uint32_t ring_mb = 64, i, drops;
+    int opt, num_gen = 0, pps = 0;
+    double bench_secs = 0.0, secs;
+    gen_t gen[MAX_PORTS];
+    pthread_t writer;
+    uint64_t t0, last_packets = 0, packets;
+    struct sigaction sa;
+    const char *out;
+
+    while ((opt = getopt(argc, argv, "p:s:m:B:h")) != -1) {
+        switch (opt) {
+            case 'p':
+                if (num_ports < MAX_PORTS) port_list[num_ports++] = atoi(optarg);
+                break;
+            case 's': payload_size = strtoul(optarg, NULL, 0); break;
+            case 'm': ring_mb = strtoul(optarg, NULL, 0); break;
+            case 'B':
+                if (sscanf(optarg, "%d:%d:%lf", &num_gen, &pps, &bench_secs) != 3 || num_gen < 1 || num_gen > MAX_PORTS) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind >= argc || payload_size < 4 || payload_size > 65507) {
+        usage(argv[0]);
+        return 2;
+    }
+    out = argv[optind];
+    if (num_ports == 0) port_list[num_ports++] = DEFAULT_PORT;
+    if (num_gen > 0) {
+        // one port per generated stream, counting up from the first one
+        for (i = 1; i < (uint32_t)num_gen; i++) port_list[i] = port_list[0] + i;
+        num_ports = num_gen;
+    }
+
+    rec_size = sizeof(stream_rec_hdr_t) + ((payload_size + 7) & ~7u);
+    out_fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+        perror(out);
+        return 1;
+    }
+    memset(&file_hdr, 0, sizeof(file_hdr));
+    file_hdr.magic = STREAM_MAGIC;
+    file_hdr.version = STREAM_VERSION;
+    file_hdr.hdr_size = STREAM_HDR_SIZE;
+    file_hdr.rec_size = rec_size;
+    file_hdr.payload_size = payload_size;
+    file_hdr.start_ns = now_ns(CLOCK_REALTIME);
+    write_all((const uint8_t *)&file_hdr, sizeof(file_hdr));        // rewritten at the end
+
+    for (i = 0; i < (uint32_t)num_ports; i++) {
+        rx_port_t *p = &ports[i];
+        p->num_recs = (uint32_t)(((uint64_t)ring_mb << 20) / rec_size);
+        p->ring = malloc((size_t)p->num_recs * rec_size);
+        if (p->ring == NULL || open_port(p, port_list[i]) < 0) return 1;
+        memset(p->ring, 0, (size_t)p->num_recs * rec_size);             // fault the pages in now
+        mlock(p->ring, (size_t)p->num_recs * rec_size);                  // best effort
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    for (i = 0; i < (uint32_t)num_ports; i++) pthread_create(&ports[i].tid, NULL, rx_thread, &ports[i]);
+    pthread_create(&writer, NULL, writer_thread, NULL);
+    fprintf(stderr, "capturing on %d port(s) from %u to %s, %u byte records\n", num_ports, port_list[0], out, rec_size);
+
+    for (i = 0; i < (uint32_t)num_gen; i++) {
+        gen[i].port = port_list[i];
+        gen[i].pps = pps;
+        gen[i].seconds = bench_secs;
+        gen[i].sent = gen[i].errors = 0;
+        pthread_create(&gen[i].tid, NULL, gen_thread, &gen[i]);
+    }
+
+    t0 = now_ns(CLOCK_MONOTONIC);
+    while (!stop) {
+        sleep(1);
+        for (packets = 0, i = 0; i < file_hdr.num_streams; i++) packets += file_hdr.stream[i].packets;
+        for (drops = 0, i = 0; i < (uint32_t)num_ports; i++) drops += ports[i].kernel_drops;
+        fprintf(stderr, "%llu packets/s, %u streams, %.1f MB written, %u kernel drops\n",
+                (unsigned long long)(packets - last_packets), file_hdr.num_streams, bytes_written / 1e6, drops);
+        last_packets = packets;
+        if (num_gen > 0 && (now_ns(CLOCK_MONOTONIC) - t0) / 1e9 > bench_secs + 1.0) stop = 1;
+    }
+    secs = (now_ns(CLOCK_MONOTONIC) - t0) / 1e9;
+
+    for (i = 0; i < (uint32_t)num_gen; i++) pthread_join(gen[i].tid, NULL);
+    for (i = 0; i < (uint32_t)num_ports; i++) pthread_join(ports[i].tid, NULL);
+    pthread_join(writer, NULL);
+    for (i = 0; i < (uint32_t)num_ports; i++) file_hdr.kernel_drops += ports[i].kernel_drops;
+    if (pwrite(out_fd, &file_hdr, sizeof(file_hdr), 0) != sizeof(file_hdr)) perror("pwrite");
+    close(out_fd);
+    fprintf(stderr, "%.1f MB in %.1f s\n", bytes_written / 1e6, secs);
+
+    return num_gen > 0 ? verify(out, gen, num_gen, secs) : 0;
+}